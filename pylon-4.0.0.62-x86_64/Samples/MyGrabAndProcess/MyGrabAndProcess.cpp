@@ -25,6 +25,7 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include "../include/GrabResultMat.h"
 #include <time.h>
 #include <iostream>
 #include <unistd.h>
@@ -123,21 +124,14 @@ int main(int argc, char* argv[])
                 // CImagePersistence::Save( ImageFileFormat_Png, "GrabbedImage.png", ptrGrabResult);
 
 
-                // Copy frame to OpenCV Mat image...
-                // suppose your camera is monochrome... get a pointer to pylon image 
-                //const pylon::uint8_t *pImageBuffer = (uint8_t *)ptrGrabResult->GetBuffer();
-                int frameCols = ptrGrabResult->GetWidth();
-                int frameRows = ptrGrabResult->GetHeight();
-                // Map the pylon image buffer to a cv::Mat (create a cv::Mat from external buffer)
-                
-                //theFrame = cv::Mat(cv::Size(frameCols, frameRows), CV_8UC1, (void*)pImageBuffer, cv::Mat::AUTO_STEP);
-                //Mat theFrame = cv::Mat(cv::Size(frameCols, frameRows), CV_8UC1, (void*)pImageBuffer);
-                Mat theFrame = cv::Mat(frameRows, frameCols, CV_8UC1);
-                memcpy(theFrame.ptr(),(uint8_t *)ptrGrabResult->GetBuffer(),frameCols*frameRows);
+                // Map the pylon image buffer to a cv::Mat without copying. The Mat keeps the grab
+                // result alive, so the buffer is not reused before theFrame is destroyed.
+                // Works for Mono8, Mono10/12/16 and RGB8/BGR8 and takes the row padding into account.
+                Mat theFrame = GrabResultToMat( ptrGrabResult);
 
 
                 // Save openCV Mat image
-                char str[15];
+                char str[32];
                 tCount = clock() - tStart;
                 sprintf(str, "%f seconds", ((float)tCount)/CLOCKS_PER_SEC);
                 printf("%ld: %f seconds\n", tCount, ((float)tCount)/CLOCKS_PER_SEC);
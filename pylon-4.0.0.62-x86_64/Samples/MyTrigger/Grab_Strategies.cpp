@@ -54,76 +54,16 @@ const char* MyEventNames[] =
 // WHAT PARTS OF CODE BELOW ARE REALLY NEEDED?
 //==============================================
 
-#include <sys/time.h>
-#include <iomanip>      // std::setw
+#include "../include/EventJournal.h"
+#include "../include/ExposureEndProfiler.h"
 
-// Used for logging received events without outputting the information on the screen
-// because outputting will change the timing.
-// This class is used for demonstration purposes only.
-struct LogItem
-{
-    LogItem()
-        : eventType( eMyNoEvent)
-        , frameNumber(0)
-    {
-    }
-    LogItem( MyEvents event, uint16_t frameNr)
-        : eventType(event)
-        , frameNumber(frameNr)
-    {
-        //Warning, measured values can be wrong on older PC hardware.
-#if defined(PYLON_WIN_BUILD)
-        QueryPerformanceCounter(&time);
-#elif defined(PYLON_LINUX_BUILD)
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        time = static_cast<unsigned long long>(tv.tv_sec) * 1000L + static_cast<unsigned long long>(tv.tv_usec) / 1000LL;
-#endif
-    }
-#if defined(PYLON_WIN_BUILD)
-    LARGE_INTEGER time; // Recorded time stamps.
-#elif defined(PYLON_LINUX_BUILD)
-    unsigned long long time; // Recorded time stamps.
-#endif
-    MyEvents eventType; // Type of the received event.
-    uint16_t frameNumber; // Frame number of the received event.
-};
-// Helper function for printing a log.
-// This function is used for demonstration purposes only.
-void PrintLog( const std::vector<LogItem>& aLog)
-{
-#if defined(PYLON_WIN_BUILD)
-    // Get the PC timer frequency.
-    LARGE_INTEGER timerFrequency;
-    QueryPerformanceFrequency(&timerFrequency);
-#elif defined(PYLON_LINUX_BUILD)
-#endif
-    cout << std::endl << "Warning, the printed time values can be wrong on older PC hardware." << std::endl << std::endl;
-    // Print the event information header.
-    cout << "Time [ms]    " << "Event                 " << "FrameNumber" << std::endl;
-    cout << "------------ " << "--------------------- " << "-----------" << std::endl;
-    // Print the logged information.
-    size_t logSize = aLog.size();
-    for ( size_t i = 0; i < logSize; ++i)
-    {
-        // Calculate the elapsed time between the events.
-        double time_ms = 0;
-        if ( i)
-        {
-#if defined(PYLON_WIN_BUILD)
-            __int64 oldTicks = ((__int64)aLog[i-1].time.HighPart << 32) + (__int64)aLog[i-1].time.LowPart;
-            __int64 newTicks = ((__int64)aLog[i].time.HighPart << 32) + (__int64)aLog[i].time.LowPart;
-            long double timeDifference = (long double) (newTicks - oldTicks);
-            long double ticksPerSecond = (long double) (((__int64)timerFrequency.HighPart << 32) + (__int64)timerFrequency.LowPart);
-            time_ms = (timeDifference / ticksPerSecond) * 1000;
-#elif defined(PYLON_LINUX_BUILD)
-            time_ms = aLog[i].time - aLog[i-1].time;
-#endif
-        }
-        // Print the event information.
-        cout << setw(12) << fixed << setprecision(4) << time_ms <<" "<< MyEventNames[ aLog[i].eventType ] <<" "<< aLog[i].frameNumber << std::endl;
-    }
-}
+#include <memory>
+
+// Received events are recorded in an event journal instead of being output on the screen
+// because outputting will change the timing. Recording an event takes a time stamp with
+// nanosecond resolution and does not block; the journal is written to this file in the
+// background.
+static const char c_journalFilename[] = "Grab_Strategies.journal";
 
 // Number of images to be grabbed.
 static const uint32_t c_countOfImagesToGrab = 50;
@@ -139,8 +79,12 @@ public:
         , m_nextFrameNumberForMove(0)
         , m_frameIDsInitialized(false)
     {
-        // Reserve space to log camera, image and move events.
-        m_log.reserve( c_countOfImagesToGrab * 3);
+        // Name the events for the printed output.
+        for ( uint32_t event = eMyExposureEndEvent; event < eMyNoEvent; ++event)
+        {
+            m_journal.SetEventName( event, MyEventNames[ event ]);
+        }
+        m_journal.Open( c_journalFilename);
     }
 
     // This method is called when a camera event has been received.
@@ -155,7 +99,8 @@ public:
             // An Exposure End event has been received.
             uint16_t frameNumber = (uint16_t)camera.EventExposureEndFrameID.GetValue();
             cout << "frameNumber = " << frameNumber << endl; 
-            m_log.push_back( LogItem( eMyExposureEndEvent, frameNumber));
+            m_journal.Record( eMyExposureEndEvent, frameNumber);
+            m_profiler.OnExposureEnd( frameNumber);
             // If Exposure End event is not doubled.
             if ( GetIncrementedFrameNumber( frameNumber) != m_nextExpectedFrameNumberExposureEnd)
             {
@@ -181,7 +126,7 @@ public:
         {
             cout << "\tMJR: Start OnCameraEvent:eMyFrameStartOvertrigger" << endl;
             // The camera has been overtriggered.
-            m_log.push_back( LogItem( eMyFrameStartOvertrigger, 0));
+            m_journal.Record( eMyFrameStartOvertrigger, 0);
             // Handle this error...
             cout << "\tMJR: End OnCameraEvent:eMyFrameStartOvertrigger" << endl;
         }
@@ -204,9 +149,12 @@ public:
     {   
         cout << "MJR: Start OnImageGrabbed()" << endl;
 
+        // Profile the latencies from the Exposure End event to the image and of this handler.
+        const uint64_t arrivalNs = m_profiler.OnImageGrabbed( ptrGrabResult);
+
         // An image has been received.
         uint16_t frameNumber = (uint16_t)ptrGrabResult->GetBlockID();
-        m_log.push_back( LogItem( eMyImageReceivedEvent, frameNumber));
+        m_journal.Record( eMyImageReceivedEvent, frameNumber);
         // Check whether the imaged item or the sensor head can be moved.
         // This will be the case if the Exposure End has been lost or if the Exposure End is received later than the image.
         if ( frameNumber == m_nextFrameNumberForMove)
@@ -223,6 +171,8 @@ public:
         IncrementFrameNumber( m_nextExpectedFrameNumberImage);
         cout << m_nextExpectedFrameNumberExposureEnd << endl;
         cout << "MJR: End OnImageGrabbed()" << endl;
+
+        m_profiler.OnImageHandled( arrivalNs);
     }
 
     void MoveImagedItemOrSensorHead()
@@ -231,14 +181,27 @@ public:
         // The imaged item or the sensor head can be moved now...
         // The camera may not be ready for a trigger at this point yet because the sensor is still being read out.
         // See the documentation of the CInstantCamera::WaitForFrameTriggerReady() method for more information.
-        m_log.push_back( LogItem( eMyMoveEvent, m_nextFrameNumberForMove));
+        m_journal.Record( eMyMoveEvent, m_nextFrameNumberForMove);
         IncrementFrameNumber( m_nextFrameNumberForMove);
         cout << "MJR: End MoveImagedItemOrSensorHead()" << endl;
     }
 
     void PrintLog()
     {
-        ::PrintLog( m_log);
+        // Write the remaining events to the file and print the journal sorted by time.
+        m_journal.Close();
+        cout << std::endl;
+        CEventJournalReader( c_journalFilename).Print( cout);
+
+        // Print the latency percentiles.
+        cout << std::endl;
+        m_profiler.PrintStatistics( cout);
+    }
+
+    // Sets the clock correlator used for the latency from frame start to image.
+    void SetClockCorrelator( const CCameraClockCorrelator* pCorrelator)
+    {
+        m_profiler.SetClockCorrelator( pCorrelator);
     }
 
 private:
@@ -255,7 +218,8 @@ private:
     uint16_t m_nextExpectedFrameNumberExposureEnd;
     uint16_t m_nextFrameNumberForMove;
     bool m_frameIDsInitialized;
-    std::vector<LogItem> m_log;
+    CEventJournal m_journal;
+    CExposureEndProfiler m_profiler;
 };
 
 
@@ -319,6 +283,19 @@ int main(int argc, char* argv[])
         camera.ExposureTime.SetValue( 20000.0 );
         camera.AcquisitionStart.Execute( );
 
+        // Relate the image time stamps to host time for profiling the latency from frame start
+        // to image, if the camera can latch its time stamp.
+        std::unique_ptr<CCameraClockCorrelator> pCorrelator;
+        try
+        {
+            pCorrelator.reset( new CCameraClockCorrelator( camera.GetNodeMap()));
+            pCorrelator->Start();
+            eventHandler.SetClockCorrelator( pCorrelator.get());
+        }
+        catch (GenICam::GenericException &)
+        {
+            cout << "The camera cannot latch its time stamp, the latency from frame start to image is not profiled." << endl;
+        }
 
         // Check if the device supports events.
         if ( !IsAvailable( camera.EventSelector))
@@ -594,6 +571,9 @@ int main(int argc, char* argv[])
             //Stop the grabbing
             camera.StopGrabbing();        
         }
+
+        // Print the recorded events and the latency percentiles.
+        eventHandler.PrintLog();
     }
     catch (GenICam::GenericException &e)
     {
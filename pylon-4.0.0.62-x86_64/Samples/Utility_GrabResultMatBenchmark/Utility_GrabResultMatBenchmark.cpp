@@ -0,0 +1,187 @@
+// Utility_GrabResultMatBenchmark.cpp
+/*
+    This utility compares two ways of handing a grab result to OpenCV:
+    * copy: allocate a new cv::Mat per frame and memcpy the image into it, as done in
+      MyGrabAndProcess and Grab2 before.
+    * wrap: GrabResultToMat() from GrabResultMat.h, which wraps the grab buffer without copying.
+
+    Usage: Utility_GrabResultMatBenchmark [pixel format] [frames]
+
+    The frames are grabbed from the pylon camera emulator (set PYLON_CAMEMU=1). The pixel format
+    (default Mono8) is set if the emulator supports it. For every frame, both paths create a
+    cv::Mat and compute cv::sum() on it as a stand-in for the processing; the order of the two
+    paths alternates from frame to frame. Printed are the mean time per frame for creating the
+    Mat alone and including the processing, the bytes moved by the copy (read and write), and
+    the page faults caused per frame.
+*/
+
+// Include files to use the PYLON API.
+#include <pylon/PylonIncludes.h>
+#include <opencv2/core/core.hpp>
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <iostream>
+#include <iomanip>
+#include "../include/GrabResultMat.h"
+
+// Namespace for using pylon objects.
+using namespace Pylon;
+
+// Namespace for using GenApi objects.
+using namespace GenApi;
+
+// Namespace for using cout.
+using namespace std;
+
+static double GetSeconds()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long GetPageFaults()
+{
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+// Time spent and page faults caused by one path, summed over all frames.
+struct SPathStatistics
+{
+    double createSeconds;
+    double totalSeconds;
+    long pageFaults;
+    double checksum;
+};
+
+// The copy path: a new Mat per frame, filled row by row with memcpy.
+static cv::Mat CopyToMat( const CGrabResultPtr& ptrGrabResult)
+{
+    const int type = GetMatTypeForPixelType( ptrGrabResult->GetPixelType());
+    cv::Mat mat( (int) ptrGrabResult->GetHeight(), (int) ptrGrabResult->GetWidth(), type);
+    const size_t rowSize = mat.cols * mat.elemSize();
+    const size_t step = rowSize + ptrGrabResult->GetPaddingX();
+    const uint8_t* pSource = (const uint8_t*) ptrGrabResult->GetBuffer();
+    for ( int row = 0; row < mat.rows; ++row )
+    {
+        memcpy( mat.ptr( row), pSource + row * step, rowSize);
+    }
+    return mat;
+}
+
+static void RunPath( bool copy, const CGrabResultPtr& ptrGrabResult, SPathStatistics& statistics)
+{
+    const long faults = GetPageFaults();
+    const double start = GetSeconds();
+    {
+        cv::Mat mat = copy ? CopyToMat( ptrGrabResult) : GrabResultToMat( ptrGrabResult);
+        const double created = GetSeconds();
+        cv::Scalar sum = cv::sum( mat);
+        statistics.checksum += sum[0] + sum[1] + sum[2] + sum[3];
+        statistics.createSeconds += created - start;
+    }
+    statistics.totalSeconds += GetSeconds() - start;
+    statistics.pageFaults += GetPageFaults() - faults;
+}
+
+static void PrintPath( const char* name, const SPathStatistics& statistics, size_t frames, double bytesPerFrame)
+{
+    cout << setw( 6) << name
+         << "  create " << setw( 9) << 1e6 * statistics.createSeconds / frames << " us"
+         << "  create+sum " << setw( 9) << 1e6 * statistics.totalSeconds / frames << " us"
+         << "  copied " << setw( 9) << bytesPerFrame / 1e6 << " MB"
+         << "  page faults " << setw( 7) << (double) statistics.pageFaults / frames << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    // The exit code of the sample application.
+    int exitCode = 0;
+
+    const char* pixelFormatName = argc > 1 ? argv[1] : "Mono8";
+    const size_t frameCount = argc > 2 ? strtoul( argv[2], NULL, 10) : 200;
+
+    // Automagically call PylonInitialize and PylonTerminate to ensure the pylon runtime system
+    // is initialized during the lifetime of this object.
+    Pylon::PylonAutoInitTerm autoInitTerm;
+
+    try
+    {
+        // Only look for the camera emulator.
+        CDeviceInfo info;
+        info.SetDeviceClass( BaslerCamEmuDeviceClass);
+        CInstantCamera camera( CTlFactory::GetInstance().CreateFirstDevice( info));
+        cout << "Using device " << camera.GetDeviceInfo().GetModelName() << endl;
+
+        camera.Open();
+        CEnumerationPtr pixelFormat( camera.GetNodeMap().GetNode( "PixelFormat"));
+        if ( IsWritable( pixelFormat) && IsAvailable( pixelFormat->GetEntryByName( pixelFormatName)) )
+        {
+            pixelFormat->FromString( pixelFormatName);
+        }
+        else
+        {
+            cerr << "Pixel format " << pixelFormatName << " is not available, using the current one." << endl;
+        }
+
+        SPathStatistics copyStatistics = { 0.0, 0.0, 0, 0.0 };
+        SPathStatistics wrapStatistics = { 0.0, 0.0, 0, 0.0 };
+        double bytesPerFrame = 0.0;
+        size_t frames = 0;
+
+        camera.StartGrabbing( frameCount);
+        CGrabResultPtr ptrGrabResult;
+        while ( camera.IsGrabbing() )
+        {
+            camera.RetrieveResult( 5000, ptrGrabResult, TimeoutHandling_ThrowException);
+            if ( !ptrGrabResult->GrabSucceeded() )
+            {
+                cout << "Error: " << ptrGrabResult->GetErrorCode() << " " << ptrGrabResult->GetErrorDescription() << endl;
+                continue;
+            }
+            if ( frames == 0 )
+            {
+                cout << "Frame " << ptrGrabResult->GetWidth() << " x " << ptrGrabResult->GetHeight() << " "
+                     << CPixelTypeMapper::GetNameByPixelType( ptrGrabResult->GetPixelType()) << ", " << frameCount << " frames" << endl;
+                if ( GetMatTypeForPixelType( ptrGrabResult->GetPixelType()) < 0 )
+                {
+                    throw RUNTIME_EXCEPTION( "This pixel type cannot be wrapped as cv::Mat.");
+                }
+                // The copy reads and writes every byte of the image.
+                const size_t rowSize = ptrGrabResult->GetWidth() * CV_ELEM_SIZE( GetMatTypeForPixelType( ptrGrabResult->GetPixelType()));
+                bytesPerFrame = 2.0 * rowSize * ptrGrabResult->GetHeight();
+            }
+
+            const bool copyFirst = (frames % 2) == 0;
+            RunPath( copyFirst, ptrGrabResult, copyFirst ? copyStatistics : wrapStatistics);
+            RunPath( !copyFirst, ptrGrabResult, copyFirst ? wrapStatistics : copyStatistics);
+            ++frames;
+        }
+
+        if ( frames == 0 )
+        {
+            throw RUNTIME_EXCEPTION( "No frame has been grabbed.");
+        }
+        if ( copyStatistics.checksum != wrapStatistics.checksum )
+        {
+            cerr << "The wrapped and the copied images differ." << endl;
+            exitCode = 1;
+        }
+        cout << fixed << setprecision( 2);
+        PrintPath( "copy", copyStatistics, frames, bytesPerFrame);
+        PrintPath( "wrap", wrapStatistics, frames, 0.0);
+    }
+    catch (GenICam::GenericException &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.GetDescription() << endl;
+        exitCode = 1;
+    }
+
+    return exitCode;
+}
@@ -0,0 +1,320 @@
+// Contains a correlator that maps camera time stamps to the host monotonic clock.
+//
+// Time stamps of grab results (ChunkTimestamp, GetTimeStamp()) and of camera events
+// (e.g. EventExposureEndTimestamp) are counted by the camera clock, which has its own offset
+// and drifts against the host clock by some ppm. The correlator periodically latches the camera
+// clock (TimestampLatch / TimestampLatchValue on USB cameras, GevTimestampControlLatch /
+// GevTimestampValue on GigE cameras) between two readings of CLOCK_MONOTONIC, and fits
+// host time = offset + slope * camera ticks over a sliding window of these samples by least
+// squares. Latching is done by a background thread. Converting a time stamp only evaluates the
+// last fit, so it can be done for every frame and event.
+//
+// The accuracy is reported as the residual of the fit and as the error with which each new
+// sample was predicted by the fit before it. The latch round trip, half of which is the
+// uncertainty of a single sample, is reported as well.
+
+#ifndef INCLUDED_CLOCKCORRELATION_H_6620491
+#define INCLUDED_CLOCKCORRELATION_H_6620491
+
+#include <pylon/PylonIncludes.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include "LatencyHistogram.h"
+
+namespace Pylon
+{
+    // The mapping from camera ticks to host time determined by the last fit.
+    struct SClockCorrelationFit
+    {
+        size_t samples;         // Samples in the window, 0 if there is no fit yet.
+        int64_t cameraTicks0;   // A camera time stamp and the host time it corresponds to.
+        double hostNs0;
+        double nsPerTick;       // Host ns per camera tick, including the drift.
+        double driftPpm;        // Deviation of the camera clock from its nominal rate, > 0 if fast.
+        double residualRmsNs;   // Residual of the samples in the window.
+        double residualMaxNs;
+    };
+
+
+    class CCameraClockCorrelator
+    {
+    public:
+        // The node map is the one of the camera device, e.g. CInstantCamera::GetNodeMap(), and
+        // must outlive the correlator. Throws if the camera cannot latch its time stamp.
+        explicit CCameraClockCorrelator( GenApi::INodeMap& nodeMap, size_t windowSize = 32, unsigned int intervalMs = 1000)
+            : m_nodeMap( nodeMap)
+            , m_windowSize( windowSize < 2 ? 2 : windowSize)
+            , m_interval( intervalMs)
+            , m_nominalNsPerTick( 1.0)
+            , m_stopping( false)
+            , m_latchErrors( 0)
+        {
+            m_latch = nodeMap.GetNode( "TimestampLatch");
+            m_latchValue = nodeMap.GetNode( "TimestampLatchValue");
+            if ( !IsAvailable( m_latch) || !IsAvailable( m_latchValue) )
+            {
+                // GigE cameras, SFNC 1.x names.
+                m_latch = nodeMap.GetNode( "GevTimestampControlLatch");
+                m_latchValue = nodeMap.GetNode( "GevTimestampValue");
+                GenApi::CIntegerPtr tickFrequency( nodeMap.GetNode( "GevTimestampTickFrequency"));
+                if ( IsReadable( tickFrequency) && tickFrequency->GetValue() > 0 )
+                {
+                    m_nominalNsPerTick = 1e9 / (double) tickFrequency->GetValue();
+                }
+            }
+            if ( !IsWritable( m_latch) || !IsReadable( m_latchValue) )
+            {
+                throw RUNTIME_EXCEPTION( "The camera cannot latch its time stamp.");
+            }
+            memset( &m_fit, 0, sizeof( m_fit));
+        }
+
+        ~CCameraClockCorrelator()
+        {
+            Stop();
+        }
+
+        // Takes a first sample and starts latching every intervalMs in the background.
+        void Start()
+        {
+            if ( m_thread.joinable() )
+            {
+                return;
+            }
+            Latch();
+            m_stopping = false;
+            m_thread = std::thread( &CCameraClockCorrelator::LatchLoop, this);
+        }
+
+        void Stop()
+        {
+            if ( !m_thread.joinable() )
+            {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock( m_mutex);
+                m_stopping = true;
+            }
+            m_wakeUp.notify_all();
+            m_thread.join();
+        }
+
+        // Takes one sample now and updates the fit. Called by the background thread; can also be
+        // called directly, e.g. to fill the window faster after opening the camera.
+        void Latch()
+        {
+            // Latch a few times and keep the reading with the shortest round trip, it is least
+            // disturbed by scheduling and bus traffic.
+            uint64_t bestRoundTripNs = UINT64_MAX;
+            uint64_t hostNs = 0;
+            int64_t cameraTicks = 0;
+            std::unique_lock<std::mutex> latchLock( m_latchMutex);
+            for ( int i = 0; i < c_latchAttempts; ++i )
+            {
+                const uint64_t beforeNs = GetMonotonicTimeNs();
+                m_latch->Execute();
+                const uint64_t afterNs = GetMonotonicTimeNs();
+                const int64_t ticks = m_latchValue->GetValue();
+                if ( afterNs - beforeNs < bestRoundTripNs )
+                {
+                    bestRoundTripNs = afterNs - beforeNs;
+                    hostNs = beforeNs + (afterNs - beforeNs) / 2;
+                    cameraTicks = ticks;
+                }
+            }
+            latchLock.unlock();
+
+            std::lock_guard<std::mutex> lock( m_mutex);
+            m_roundTrip.Record( bestRoundTripNs);
+            if ( m_fit.samples >= 2 )
+            {
+                const double errorNs = fabs( Evaluate( m_fit, cameraTicks) - (double) hostNs);
+                m_predictionError.Record( (uint64_t) errorNs);
+            }
+            if ( !m_samples.empty() && cameraTicks <= m_samples.back().cameraTicks )
+            {
+                // The camera clock has been reset, e.g. by TimestampReset. Start over.
+                m_samples.clear();
+            }
+            SSample sample = { cameraTicks, hostNs };
+            m_samples.push_back( sample);
+            if ( m_samples.size() > m_windowSize )
+            {
+                m_samples.pop_front();
+            }
+            Fit();
+        }
+
+        // Returns the host CLOCK_MONOTONIC time in ns for a camera time stamp, or 0 if there is
+        // no sample yet.
+        uint64_t ToHostTimeNs( int64_t cameraTicks) const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            if ( m_fit.samples == 0 )
+            {
+                return 0;
+            }
+            const double hostNs = Evaluate( m_fit, cameraTicks);
+            return hostNs > 0.0 ? (uint64_t) (hostNs + 0.5) : 0;
+        }
+
+        // Returns the host time of a grab result. The time stamp chunk is used if present,
+        // otherwise the time stamp the transport layer reports for the buffer.
+        uint64_t GetHostTimeNs( const CGrabResultPtr& ptrGrabResult) const
+        {
+            GenApi::CIntegerPtr chunkTimestamp( ptrGrabResult->GetChunkDataNodeMap().GetNode( "ChunkTimestamp"));
+            if ( IsReadable( chunkTimestamp) )
+            {
+                return ToHostTimeNs( chunkTimestamp->GetValue());
+            }
+            return ToHostTimeNs( (int64_t) ptrGrabResult->GetTimeStamp());
+        }
+
+        // Returns the host time of a camera event, given the time stamp node of the event, e.g.
+        // "EventExposureEndTimestamp". Call it from the camera event handler.
+        uint64_t GetEventHostTimeNs( const char* timestampNodeName) const
+        {
+            GenApi::CIntegerPtr timestamp( m_nodeMap.GetNode( timestampNodeName));
+            if ( !IsReadable( timestamp) )
+            {
+                throw RUNTIME_EXCEPTION( "The event time stamp %s is not readable.", timestampNodeName);
+            }
+            return ToHostTimeNs( timestamp->GetValue());
+        }
+
+        SClockCorrelationFit GetFit() const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            return m_fit;
+        }
+
+        void PrintStatistics( std::ostream& os) const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            std::ios::fmtflags flags = os.flags();
+            std::streamsize precision = os.precision();
+            os << std::fixed << std::setprecision( 3);
+            os << "Clock correlation: " << m_fit.samples << " samples in the window, drift " << m_fit.driftPpm
+               << " ppm, residual rms " << m_fit.residualRmsNs / 1000.0 << " us, max " << m_fit.residualMaxNs / 1000.0
+               << " us, " << m_latchErrors << " latch errors" << std::endl;
+            os.flags( flags);
+            os.precision( precision);
+            m_roundTrip.Print( os, "Latch round trip");
+            m_predictionError.Print( os, "Prediction error");
+        }
+
+    private:
+        struct SSample
+        {
+            int64_t cameraTicks;
+            uint64_t hostNs;
+        };
+
+        static double Evaluate( const SClockCorrelationFit& fit, int64_t cameraTicks)
+        {
+            return fit.hostNs0 + fit.nsPerTick * (double) (cameraTicks - fit.cameraTicks0);
+        }
+
+        // Least squares fit over the window. Values are taken relative to the first sample so
+        // the sums keep their precision in double.
+        void Fit()
+        {
+            const size_t n = m_samples.size();
+            const int64_t ticks0 = m_samples.front().cameraTicks;
+            const uint64_t host0 = m_samples.front().hostNs;
+            double meanX = 0.0;
+            double meanY = 0.0;
+            for ( size_t i = 0; i < n; ++i )
+            {
+                meanX += (double) (m_samples[i].cameraTicks - ticks0);
+                meanY += (double) (int64_t) (m_samples[i].hostNs - host0);
+            }
+            meanX /= n;
+            meanY /= n;
+            double sxx = 0.0;
+            double sxy = 0.0;
+            for ( size_t i = 0; i < n; ++i )
+            {
+                const double dx = (double) (m_samples[i].cameraTicks - ticks0) - meanX;
+                const double dy = (double) (int64_t) (m_samples[i].hostNs - host0) - meanY;
+                sxx += dx * dx;
+                sxy += dx * dy;
+            }
+
+            SClockCorrelationFit fit;
+            fit.samples = n;
+            fit.cameraTicks0 = ticks0;
+            fit.nsPerTick = n >= 2 && sxx > 0.0 ? sxy / sxx : m_nominalNsPerTick;
+            fit.hostNs0 = (double) host0 + meanY - fit.nsPerTick * meanX;
+            fit.driftPpm = (m_nominalNsPerTick / fit.nsPerTick - 1.0) * 1e6;
+            double sumSquares = 0.0;
+            double maxResidual = 0.0;
+            for ( size_t i = 0; i < n; ++i )
+            {
+                const double residual = Evaluate( fit, m_samples[i].cameraTicks) - (double) m_samples[i].hostNs;
+                sumSquares += residual * residual;
+                maxResidual = std::max( maxResidual, fabs( residual));
+            }
+            fit.residualRmsNs = sqrt( sumSquares / n);
+            fit.residualMaxNs = maxResidual;
+            m_fit = fit;
+        }
+
+        void LatchLoop()
+        {
+            std::unique_lock<std::mutex> lock( m_mutex);
+            for (;;)
+            {
+                m_wakeUp.wait_for( lock, m_interval, [this] { return m_stopping; });
+                if ( m_stopping )
+                {
+                    return;
+                }
+                lock.unlock();
+                try
+                {
+                    Latch();
+                }
+                catch (const GenICam::GenericException& e)
+                {
+                    std::cerr << "Latching the camera time stamp failed: " << e.GetDescription() << std::endl;
+                    std::lock_guard<std::mutex> errorLock( m_mutex);
+                    ++m_latchErrors;
+                }
+                lock.lock();
+            }
+        }
+
+        static const int c_latchAttempts = 3;
+
+        GenApi::INodeMap& m_nodeMap;
+        GenApi::CCommandPtr m_latch;
+        GenApi::CIntegerPtr m_latchValue;
+        const size_t m_windowSize;
+        const std::chrono::milliseconds m_interval;
+        double m_nominalNsPerTick;
+        std::mutex m_latchMutex; // Keeps latching and reading the value together.
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_wakeUp;
+        std::thread m_thread;
+        bool m_stopping;
+        std::deque<SSample> m_samples;
+        SClockCorrelationFit m_fit;
+        uint64_t m_latchErrors;
+        CLatencyHistogram m_roundTrip;
+        CLatencyHistogram m_predictionError;
+    };
+}
+
+#endif /* INCLUDED_CLOCKCORRELATION_H_6620491 */
@@ -0,0 +1,138 @@
+// Contains a function that wraps the image buffer of a grab result as a cv::Mat without copying.
+//
+// The cv::Mat shares the grab buffer and holds a reference to the grab result: the buffer is
+// not returned to the camera before the last cv::Mat sharing it (copies, ROIs, function
+// arguments) has been destroyed. Keep in mind that the camera cannot reuse a buffer while it is
+// held, so don't keep more Mats alive than MaxNumBuffer allows. Mat::clone() and copyTo() make
+// real copies that don't hold the grab result.
+//
+// The reference is attached through a cv::UMatData whose allocator releases the grab result when
+// OpenCV frees the data. This needs OpenCV 3.0 or newer.
+//
+// Supported pixel types and the resulting Mat types:
+//   Mono8, Bayer??8                    CV_8UC1
+//   Mono10, Mono12, Mono16, Bayer??16  CV_16UC1 (LSB aligned, e.g. 0..4095 for Mono12)
+//   BGR8packed                         CV_8UC3
+//   RGB8packed                         CV_8UC3, channels in RGB order (see cv::cvtColor)
+//   BGRA8packed                        CV_8UC4
+// Packed formats such as Mono12packed must be converted with CImageFormatConverter first.
+// The row step includes the padding of the grab result (PaddingX).
+
+#ifndef INCLUDED_GRABRESULTMAT_H_5907342
+#define INCLUDED_GRABRESULTMAT_H_5907342
+
+#include <pylon/PylonIncludes.h>
+#include <opencv2/core/core.hpp>
+
+#if CV_MAJOR_VERSION < 3
+#  error "GrabResultMat.h needs OpenCV 3.0 or newer."
+#endif
+
+namespace Pylon
+{
+    // Returns the OpenCV type of the Mat a grab result of this pixel type is wrapped in, or -1.
+    inline int GetMatTypeForPixelType( EPixelType pixelType)
+    {
+        switch ( pixelType )
+        {
+        case PixelType_Mono8:
+        case PixelType_BayerGR8:
+        case PixelType_BayerRG8:
+        case PixelType_BayerGB8:
+        case PixelType_BayerBG8:
+            return CV_8UC1;
+        case PixelType_Mono10:
+        case PixelType_Mono12:
+        case PixelType_Mono16:
+        case PixelType_BayerGR16:
+        case PixelType_BayerRG16:
+        case PixelType_BayerGB16:
+        case PixelType_BayerBG16:
+            return CV_16UC1;
+        case PixelType_RGB8packed:
+        case PixelType_BGR8packed:
+            return CV_8UC3;
+        case PixelType_BGRA8packed:
+            return CV_8UC4;
+        default:
+            return -1;
+        }
+    }
+
+
+    // Releases the grab result held by a UMatData created by GrabResultToMat() when OpenCV unmaps
+    // it. Allocation requests are passed on to the standard allocator.
+    class CGrabResultMatAllocator : public cv::MatAllocator
+    {
+#if CV_MAJOR_VERSION >= 4
+        typedef cv::AccessFlag AccessFlag_t;
+#else
+        typedef int AccessFlag_t;
+#endif
+    public:
+        static const CGrabResultMatAllocator* GetInstance()
+        {
+            static CGrabResultMatAllocator allocator;
+            return &allocator;
+        }
+
+        virtual cv::UMatData* allocate( int dims, const int* sizes, int type, void* data, size_t* step, AccessFlag_t flags, cv::UMatUsageFlags usageFlags) const
+        {
+            return cv::Mat::getStdAllocator()->allocate( dims, sizes, type, data, step, flags, usageFlags);
+        }
+
+        virtual bool allocate( cv::UMatData* pData, AccessFlag_t accessFlags, cv::UMatUsageFlags usageFlags) const
+        {
+            return cv::Mat::getStdAllocator()->allocate( pData, accessFlags, usageFlags);
+        }
+
+        virtual void deallocate( cv::UMatData* pData) const
+        {
+            unmap( pData);
+        }
+
+        virtual void unmap( cv::UMatData* pData) const
+        {
+            if ( pData->urefcount == 0 && pData->refcount == 0 )
+            {
+                delete static_cast<CGrabResultPtr*>( pData->userdata);
+                delete pData;
+            }
+        }
+    };
+
+
+    // Returns a cv::Mat header for the image data of the grab result, without copying.
+    // Throws if the grab failed or the pixel type is not supported.
+    inline cv::Mat GrabResultToMat( const CGrabResultPtr& ptrGrabResult)
+    {
+        if ( !ptrGrabResult.IsValid() || !ptrGrabResult->GrabSucceeded() )
+        {
+            throw RUNTIME_EXCEPTION( "The grab result does not contain an image.");
+        }
+        const EPixelType pixelType = ptrGrabResult->GetPixelType();
+        const int type = GetMatTypeForPixelType( pixelType);
+        if ( type < 0 )
+        {
+            throw RUNTIME_EXCEPTION( "Pixel type %s cannot be wrapped as cv::Mat, convert it first.", CPixelTypeMapper::GetNameByPixelType( pixelType));
+        }
+
+        const int rows = (int) ptrGrabResult->GetHeight();
+        const int cols = (int) ptrGrabResult->GetWidth();
+        const size_t step = (size_t) cols * CV_ELEM_SIZE( type) + ptrGrabResult->GetPaddingX();
+        uint8_t* pBuffer = (uint8_t*) ptrGrabResult->GetBuffer();
+        cv::Mat mat( rows, cols, type, pBuffer, step);
+
+        cv::UMatData* pData = new cv::UMatData( CGrabResultMatAllocator::GetInstance());
+        pData->data = pBuffer;
+        pData->origdata = pBuffer;
+        pData->size = step * rows;
+        pData->flags = cv::UMatData::USER_ALLOCATED;
+        pData->userdata = new CGrabResultPtr( ptrGrabResult);
+        pData->refcount = 1;
+        mat.u = pData;
+        return mat;
+    }
+}
+
+#endif /* INCLUDED_GRABRESULTMAT_H_5907342 */
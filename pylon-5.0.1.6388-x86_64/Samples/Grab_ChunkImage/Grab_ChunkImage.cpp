@@ -11,6 +11,9 @@
     data. When the camera is in chunk mode, it transfers data blocks that are partitioned into chunks. The first
     chunk is always the image data. When chunk features are enabled, the image data chunk is followed by chunks
     containing the information generated by the chunk features.
+
+    Accessing the chunks through the node map looks up every node by name for every image. At high frame rates,
+    CChunkDecoder (../include/ChunkDecoder.h) reads them directly from the buffer; see Utility_ChunkDecoderBenchmark.
 */
 
 // Include files to use the PYLON API
@@ -18,6 +21,7 @@
 #ifdef PYLON_WIN_BUILD
 #    include <pylon/PylonGUI.h>
 #endif
+#include "../include/PayloadCrcVerifier.h"
 
 // Namespace for using pylon objects.
 using namespace Pylon;
@@ -80,6 +84,10 @@ public:
 // Number of images to be grabbed.
 static const uint32_t c_countOfImagesToGrab = 5;
 
+// What happens to images whose payload CRC does not match: CrcFailure_Drop skips them,
+// CrcFailure_Flag processes them anyway.
+static const ECrcFailurePolicy c_crcFailurePolicy = CrcFailure_Drop;
+
 int main(int argc, char* argv[])
 {
     // The exit code of the sample application.
@@ -145,6 +153,9 @@ int main(int argc, char* argv[])
         // This smart pointer will receive the grab result data.
         GrabResultPtr_t ptrGrabResult;
 
+        // Verifies the CRC checksum chunk of every image.
+        CPayloadCrcVerifier crcVerifier( c_crcFailurePolicy);
+
         // Camera.StopGrabbing() is called automatically by the RetrieveResult() method
         // when c_countOfImagesToGrab images have been retrieved.
         while( camera.IsGrabbing())
@@ -177,9 +188,18 @@ int main(int argc, char* argv[])
             // the integrity of the buffer first.
             // Note: Enabling the CRC Checksum feature is not a prerequisite for using
             // chunks. Chunks can also be handled when the CRC Checksum feature is deactivated.
-            if (ptrGrabResult->HasCRC() && ptrGrabResult->CheckCRC() == false)
+            // The verifier computes the CRC with the fastest kernel of the CPU, which keeps up
+            // with the full data rate of the camera; damaged images are counted.
+            SChunkData chunkData;
+            const ECrcVerdict crcVerdict = crcVerifier.Verify( ptrGrabResult, chunkData);
+            if (crcVerdict == CrcVerdict_Dropped)
+            {
+                cout << "Image was damaged, dropped." << endl << endl;
+                continue;
+            }
+            if (crcVerdict == CrcVerdict_Flagged)
             {
-                throw RUNTIME_EXCEPTION( "Image was damaged!");
+                cout << "Image was damaged!" << endl;
             }
 
             // Access the chunk data attached to the result.
@@ -196,6 +216,7 @@ int main(int argc, char* argv[])
 
             cout << endl;
         }
+        crcVerifier.PrintStatistics( cout);
 
         // Disable chunk mode.
         camera.ChunkModeActive.SetValue(false);
@@ -0,0 +1,185 @@
+// Grab_ClockCorrelation.cpp
+/*
+    This sample shows how to relate the time stamps of images and camera events to the host
+    clock, e.g. to line up frames with data from other sensors.
+
+    Usage: Grab_ClockCorrelation [images]
+
+    The CCameraClockCorrelator (ClockCorrelation.h) latches the camera time stamp against the
+    host CLOCK_MONOTONIC in the background and estimates the offset and the drift of the camera
+    clock. With this, every grab result and every Exposure End event gets an estimated host time.
+    Printed are the times from the time stamp of an image to its arrival in RetrieveResult()
+    and from the end of an exposure to the arrival of its event, together with the accuracy of
+    the correlation.
+
+    The sample works with GigE and USB cameras. The time stamp chunk and the Exposure End event
+    are used if the camera supports them; otherwise the time stamp of the grab result is used.
+*/
+
+// Include files to use the PYLON API.
+#include <pylon/PylonIncludes.h>
+#include <stdlib.h>
+#include <iostream>
+#include "../include/ClockCorrelation.h"
+#include "../include/LatencyHistogram.h"
+
+// Namespace for using pylon objects.
+using namespace Pylon;
+
+// Namespace for using GenApi objects.
+using namespace GenApi;
+
+// Namespace for using cout.
+using namespace std;
+
+// Time between two latches of the camera time stamp and the number of latches the fit uses.
+static const unsigned int c_latchIntervalMs = 200;
+static const size_t c_correlationWindow = 32;
+
+// Sets an enumeration to the first of the given values that is available.
+static bool TrySetEnumeration( INodeMap& nodeMap, const char* name, const char* value1, const char* value2 = NULL)
+{
+    CEnumerationPtr enumeration( nodeMap.GetNode( name));
+    if ( !IsWritable( enumeration) )
+    {
+        return false;
+    }
+    if ( IsAvailable( enumeration->GetEntryByName( value1)) )
+    {
+        enumeration->FromString( value1);
+        return true;
+    }
+    if ( value2 != NULL && IsAvailable( enumeration->GetEntryByName( value2)) )
+    {
+        enumeration->FromString( value2);
+        return true;
+    }
+    return false;
+}
+
+// Records the time from the end of an exposure to the arrival of its Exposure End event.
+class CExposureEndHandler : public CCameraEventHandler
+{
+public:
+    CExposureEndHandler( const CCameraClockCorrelator& correlator, const char* timestampNodeName)
+        : m_correlator( correlator)
+        , m_timestampNodeName( timestampNodeName)
+    {
+    }
+
+    virtual void OnCameraEvent( CInstantCamera& /*camera*/, intptr_t /*userProvidedId*/, GenApi::INode* /*pNode*/)
+    {
+        const uint64_t arrivalNs = GetMonotonicTimeNs();
+        const uint64_t exposureEndNs = m_correlator.GetEventHostTimeNs( m_timestampNodeName);
+        m_latency.Record( arrivalNs > exposureEndNs ? arrivalNs - exposureEndNs : 0);
+    }
+
+    // Only call when no events are received anymore.
+    const CLatencyHistogram& GetLatency() const
+    {
+        return m_latency;
+    }
+
+private:
+    const CCameraClockCorrelator& m_correlator;
+    const char* m_timestampNodeName;
+    CLatencyHistogram m_latency;
+};
+
+int main(int argc, char* argv[])
+{
+    // The exit code of the sample application.
+    int exitCode = 0;
+
+    const size_t imagesToGrab = argc > 1 ? strtoul( argv[1], NULL, 10) : 100;
+
+    // Automagically call PylonInitialize and PylonTerminate to ensure the pylon runtime system
+    // is initialized during the lifetime of this object.
+    Pylon::PylonAutoInitTerm autoInitTerm;
+
+    try
+    {
+        CInstantCamera camera( CTlFactory::GetInstance().CreateFirstDevice());
+        cout << "Using device " << camera.GetDeviceInfo().GetModelName() << endl;
+        camera.Open();
+        INodeMap& nodeMap = camera.GetNodeMap();
+
+        // Start correlating the clocks. Latch a few times right away so the drift is known
+        // before the first image arrives.
+        CCameraClockCorrelator correlator( nodeMap, c_correlationWindow, c_latchIntervalMs);
+        for ( int i = 0; i < 4; ++i )
+        {
+            correlator.Latch();
+        }
+        correlator.Start();
+
+        // Let the camera send the time stamp of each image as chunk, if supported.
+        CBooleanPtr chunkModeActive( nodeMap.GetNode( "ChunkModeActive"));
+        if ( IsWritable( chunkModeActive) )
+        {
+            chunkModeActive->SetValue( true);
+            if ( TrySetEnumeration( nodeMap, "ChunkSelector", "Timestamp") )
+            {
+                CBooleanPtr( nodeMap.GetNode( "ChunkEnable"))->SetValue( true);
+            }
+        }
+
+        // Receive Exposure End events, if supported. USB cameras use the SFNC 2.0 names,
+        // GigE cameras the SFNC 1.x names.
+        const bool sfnc2 = nodeMap.GetNode( "EventExposureEndTimestamp") != NULL;
+        const char* dataNodeName = sfnc2 ? "EventExposureEndData" : "ExposureEndEventData";
+        CExposureEndHandler exposureEndHandler( correlator, sfnc2 ? "EventExposureEndTimestamp" : "ExposureEndEventTimestamp");
+        bool eventsEnabled = false;
+        if ( TrySetEnumeration( nodeMap, "EventSelector", "ExposureEnd") )
+        {
+            CBooleanPtr( camera.GetInstantCameraNodeMap().GetNode( "GrabCameraEvents"))->SetValue( true);
+            camera.RegisterCameraEventHandler( &exposureEndHandler, dataNodeName, 0, RegistrationMode_Append, Cleanup_None);
+            eventsEnabled = TrySetEnumeration( nodeMap, "EventNotification", "On", "GenICamEvent");
+        }
+        if ( !eventsEnabled )
+        {
+            cout << "The camera does not send Exposure End events." << endl;
+        }
+
+        CLatencyHistogram imageLatency;
+        camera.StartGrabbing( imagesToGrab);
+        CGrabResultPtr ptrGrabResult;
+        while ( camera.IsGrabbing() )
+        {
+            camera.RetrieveResult( 5000, ptrGrabResult, TimeoutHandling_ThrowException);
+            const uint64_t arrivalNs = GetMonotonicTimeNs();
+            if ( !ptrGrabResult->GrabSucceeded() )
+            {
+                cout << "Error: " << ptrGrabResult->GetErrorCode() << " " << ptrGrabResult->GetErrorDescription() << endl;
+                continue;
+            }
+
+            // The estimated host time of the time stamp of the image.
+            const uint64_t imageNs = correlator.GetHostTimeNs( ptrGrabResult);
+            imageLatency.Record( arrivalNs > imageNs ? arrivalNs - imageNs : 0);
+        }
+
+        if ( eventsEnabled )
+        {
+            TrySetEnumeration( nodeMap, "EventNotification", "Off");
+        }
+        camera.DeregisterCameraEventHandler( &exposureEndHandler, dataNodeName);
+        correlator.Stop();
+
+        imageLatency.Print( cout, "Image time stamp to RetrieveResult");
+        if ( eventsEnabled )
+        {
+            exposureEndHandler.GetLatency().Print( cout, "Exposure end to event");
+        }
+        correlator.PrintStatistics( cout);
+    }
+    catch (const GenericException &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.GetDescription() << endl;
+        exitCode = 1;
+    }
+
+    return exitCode;
+}
@@ -15,6 +15,9 @@
     Alternatively, the grabbing can be started using the internal grab loop threads
     of all cameras in the CInstantCameraArray. The grabbed images can then be processed by one or more
     image event handlers. Please note that this is not shown in this example.
+    Because one thread serves all cameras here, slow processing of one camera's images delays
+    all cameras. CMultiCameraGrabber (include/MultiCameraGrabber.h) runs a grab thread and a
+    processing thread per camera instead; Utility_MultiCameraBenchmark compares both.
 */
 
 // Include files to use the PYLON API.
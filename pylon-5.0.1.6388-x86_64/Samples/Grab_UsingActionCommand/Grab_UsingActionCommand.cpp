@@ -11,6 +11,12 @@
 
     To make the configuration of multiple cameras easier this sample uses the CInstantCameraArray class.
     It also uses a CActionTriggerConfiguration to set up the basic action command features.
+
+    Several action commands are issued. The grab results arrive one by one in any order; a
+    CFrameSynchronizer (FrameSynchronizer.h) groups them into one set per action command, which
+    is what stereo or multi-view processing needs. The action command of a frame is taken from
+    its block ID, which each camera counts from 1 after the start of grabbing, so a frame
+    arriving late is still assigned to its own command.
 */
 
 #include <time.h>   // for time
@@ -23,6 +29,8 @@
 #endif
 #include <pylon/gige/PylonGigEIncludes.h>
 #include <pylon/gige/ActionTriggerConfiguration.h>
+#include <vector>
+#include "../include/FrameSynchronizer.h"
 
 // Settings to use Basler GigE cameras.
 using namespace Basler_GigECameraParams;
@@ -47,6 +55,73 @@ using namespace std;
 // Application Note (AW000649xx000) provides more information about this topic.
 static const uint32_t c_maxCamerasToUse = 2;
 
+// Number of action commands to issue.
+static const uint32_t c_countOfActionCommands = 10;
+
+// Sets waiting for frames at a time. Must stay below MaxNumBuffer.
+static const size_t c_synchronizerWindow = 4;
+
+// The maximum difference of the ChunkTimestamp values within a set, in ns. All cameras are
+// triggered by the same action command, so a larger difference means a frame was assigned to the
+// wrong command. The check is only made if all cameras send the time stamp chunk and have their
+// clocks synchronized with IEEE 1588 (GevIEEE1588); otherwise the clocks are unrelated. 0
+// disables it.
+static const uint64_t c_timestampToleranceNs = 100000;
+
+
+// Hands a grab result to the synchronizer. nsPerTick is 0 for cameras without time stamp chunk.
+static void PushGrabResult(CFrameSynchronizer& synchronizer, const CBaslerGigEGrabResultPtr& ptrGrabResult, const vector<double>& nsPerTick)
+{
+    // When the cameras in the array are created the camera context value
+    // is set to the index of the camera in the array.
+    // The camera context is a user-settable value.
+    // This value is attached to each grab result and can be used
+    // to determine the camera that produced the grab result.
+    intptr_t cameraIndex = ptrGrabResult->GetCameraContext();
+
+    // Image grabbed successfully?
+    if (ptrGrabResult->GrabSucceeded())
+    {
+#ifdef PYLON_WIN_BUILD
+        // Show the image acquired by each camera in the window related to the camera.
+        // DisplayImage supports up to 32 image windows.
+        if (cameraIndex <= 31)
+            Pylon::DisplayImage(cameraIndex, ptrGrabResult);
+#endif
+        // Hand the frame to the synchronizer, which calls the printer once the
+        // frames of all cameras for this action command are there.
+        const uint64_t timestampNs = nsPerTick[cameraIndex] != 0.0 ? (uint64_t) (ptrGrabResult->ChunkTimestamp.GetValue() * nsPerTick[cameraIndex]) : 0;
+        synchronizer.Push(cameraIndex, ptrGrabResult, timestampNs, ptrGrabResult->GetBlockID() - 1);
+    }
+    else
+    {
+        // If a buffer has been incompletely grabbed, the network bandwidth is possibly insufficient for transferring
+        // multiple images simultaneously. See note above c_maxCamerasToUse.
+        cout << "Error: " << ptrGrabResult->GetErrorCode() << " " << ptrGrabResult->GetErrorDescription() << endl;
+    }
+}
+
+
+// Receives one set of frames per action command.
+class CFrameSetPrinter : public IFrameSetHandler
+{
+public:
+    virtual void OnFrameSet( const SFrameSet& frameSet)
+    {
+        cout << "Action command " << frameSet.key << ": " << frameSet.frameCount << " of " << frameSet.frames.size() << " frames";
+        for ( size_t i = 0; i < frameSet.frames.size(); ++i )
+        {
+            // The frames of all cameras of this trigger could be processed together here.
+            if ( frameSet.frames[i].IsValid() )
+            {
+                const uint8_t *pImageBuffer = (uint8_t *) frameSet.frames[i]->GetBuffer();
+                cout << ", camera " << i << " first pixel " << (uint32_t) pImageBuffer[0];
+            }
+        }
+        cout << endl;
+    }
+};
+
 
 int main(int argc, char* argv[])
 {
@@ -134,73 +209,97 @@ int main(int argc, char* argv[])
         // This will apply the CActionTriggerConfiguration specified above.
         cameras.Open();
 
+        // Send the time stamp of each frame as a chunk, where available, and convert it from
+        // camera ticks to ns for the skew check of the synchronizer.
+        vector<double> nsPerTick(cameras.GetSize(), 0.0);
+        bool checkSkew = c_timestampToleranceNs != 0;
+        for (size_t i = 0; i < cameras.GetSize(); ++i)
+        {
+            if (GenApi::IsWritable(cameras[i].ChunkModeActive) && GenApi::IsReadable(cameras[i].GevTimestampTickFrequency))
+            {
+                cameras[i].ChunkModeActive.SetValue(true);
+                cameras[i].ChunkSelector.SetValue(ChunkSelector_Timestamp);
+                cameras[i].ChunkEnable.SetValue(true);
+                nsPerTick[i] = 1e9 / (double) cameras[i].GevTimestampTickFrequency.GetValue();
+            }
+            const bool ptpActive = GenApi::IsReadable(cameras[i].GevIEEE1588) && cameras[i].GevIEEE1588.GetValue();
+            checkSkew = checkSkew && nsPerTick[i] != 0.0 && ptpActive;
+        }
+        if (c_timestampToleranceNs != 0 && !checkSkew)
+        {
+            cout << "The time stamps are not checked, as not all cameras send synchronized time stamps." << endl;
+        }
+
         //////////////////////////////////////////////////////////////////////
         //////////////////////////////////////////////////////////////////////
         // Use an Action Command to Trigger Multiple Cameras at the Same Time.
         //////////////////////////////////////////////////////////////////////
         //////////////////////////////////////////////////////////////////////
 
-        cout << endl << "Issuing an action command." << endl;
+        cout << endl << "Issuing " << c_countOfActionCommands << " action commands." << endl;
+
+        // Groups the frames of all cameras by the action command that triggered them.
+        CFrameSetPrinter frameSetPrinter;
+        CFrameSynchronizer synchronizer( cameras.GetSize(), frameSetPrinter, FrameSetMatching_Generation, checkSkew ? c_timestampToleranceNs : 0,
+            c_synchronizerWindow, 1000000000ULL, IncompleteSet_Emit);
 
         // Starts grabbing for all cameras.
         // The cameras won't transmit any image data, because they are configured to wait for an action command.
         cameras.StartGrabbing();
 
-        // Now we issue the action command to all devices in the subnet.
-        // The devices with a matching DeviceKey, GroupKey and valid GroupMask will grab an image.
-        pTL->IssueActionCommand(DeviceKey, GroupKey, AllGroupMask, subnet);
-
         // This smart pointer will receive the grab result data.
         CBaslerGigEGrabResultPtr ptrGrabResult;
 
-        // Retrieve images from all cameras.
         const int DefaultTimeout_ms = 5000;
-        for (size_t i = 0; i < usableDeviceInfos.size() && cameras.IsGrabbing(); ++i)
+        for (uint32_t command = 0; command < c_countOfActionCommands && cameras.IsGrabbing(); ++command)
         {
-            // CInstantCameraArray::RetrieveResult will return grab results in the order they arrive.
-            cameras.RetrieveResult(DefaultTimeout_ms, ptrGrabResult, TimeoutHandling_ThrowException);
-
-            // When the cameras in the array are created the camera context value
-            // is set to the index of the camera in the array.
-            // The camera context is a user-settable value.
-            // This value is attached to each grab result and can be used
-            // to determine the camera that produced the grab result.
-            intptr_t cameraIndex = ptrGrabResult->GetCameraContext();
-
+            // Hand over the frames of earlier commands that arrived after their timeout.
+            while (cameras.RetrieveResult(0, ptrGrabResult, TimeoutHandling_Return))
+            {
+                PushGrabResult(synchronizer, ptrGrabResult, nsPerTick);
+            }
 
-            // Image grabbed successfully?
-            if (ptrGrabResult->GrabSucceeded())
+            // To avoid overtriggering, wait until all cameras are ready for the next trigger
+            // (see Grab_UsingGrabLoopThread sample for details).
+            for (size_t i = 0; i < cameras.GetSize(); ++i)
             {
-#ifdef PYLON_WIN_BUILD
-                // Show the image acquired by each camera in the window related to the camera.
-                // DisplayImage supports up to 32 image windows.
-                if (cameraIndex <= 31)
-                    Pylon::DisplayImage(cameraIndex, ptrGrabResult);
-#endif
-                // Print the index and the model name of the camera.
-                cout << "Camera " <<  cameraIndex << ": " << cameras[cameraIndex].GetDeviceInfo().GetModelName() <<
-                    " (" << cameras[cameraIndex].GetDeviceInfo().GetIpAddress() << ")" << endl;
-
-                // You could process the image here by accessing the image buffer.
-                cout << "GrabSucceeded: " << ptrGrabResult->GrabSucceeded() << endl;
-                const uint8_t *pImageBuffer = (uint8_t *) ptrGrabResult->GetBuffer();
-                cout << "Gray value of first pixel: " << (uint32_t) pImageBuffer[0] << endl << endl;
+                cameras[i].WaitForFrameTriggerReady(DefaultTimeout_ms, TimeoutHandling_ThrowException);
             }
-            else
+
+            // Now we issue the action command to all devices in the subnet.
+            // The devices with a matching DeviceKey, GroupKey and valid GroupMask will grab an image.
+            pTL->IssueActionCommand(DeviceKey, GroupKey, AllGroupMask, subnet);
+
+            // Retrieve images from all cameras.
+            for (size_t i = 0; i < usableDeviceInfos.size() && cameras.IsGrabbing(); ++i)
             {
-                // If a buffer has been incompletely grabbed, the network bandwidth is possibly insufficient for transferring
-                // multiple images simultaneously. See note above c_maxCamerasToUse.
-                cout << "Error: " << ptrGrabResult->GetErrorCode() << " " << ptrGrabResult->GetErrorDescription() << endl;
+                // CInstantCameraArray::RetrieveResult will return grab results in the order they arrive.
+                // If a frame does not arrive, its set is completed without it.
+                if (!cameras.RetrieveResult(DefaultTimeout_ms, ptrGrabResult, TimeoutHandling_Return))
+                {
+                    cerr << "A frame of action command " << command << " has not arrived." << endl;
+                    break;
+                }
+                PushGrabResult(synchronizer, ptrGrabResult, nsPerTick);
             }
         }
+        ptrGrabResult.Release();
 
-        // In case you want to trigger again you should wait for the camera
-        // to become trigger-ready before issuing the next action command.
-        // To avoid overtriggering you should call cameras[0].WaitForFrameTriggerReady
-        // (see Grab_UsingGrabLoopThread sample for details).
+        // Emit the sets still waiting for frames.
+        synchronizer.Flush();
+        synchronizer.PrintStatistics(cout);
 
         cameras.StopGrabbing();
 
+        // Disable chunk mode.
+        for (size_t i = 0; i < cameras.GetSize(); ++i)
+        {
+            if (nsPerTick[i] != 0.0)
+            {
+                cameras[i].ChunkModeActive.SetValue(false);
+            }
+        }
+
         // Close all cameras.
         cameras.Close();
     }
@@ -17,12 +17,10 @@
 
 // Include files used by samples.
 #include "../include/ConfigurationEventPrinter.h"
+#include "../include/EventJournal.h"
+#include "../include/ExposureEndProfiler.h"
 
-#include <iomanip>
-
-#ifdef PYLON_LINUX_BUILD
-#    include <sys/time.h>
-#endif
+#include <memory>
 
 // Namespace for using pylon objects.
 using namespace Pylon;
@@ -69,84 +67,13 @@ const char* MyEventNames[] =
     "NoEvent              "
 };
 
-// Used for logging received events without outputting the information on the screen
-// because outputting will change the timing.
-// This class is used for demonstration purposes only.
-struct LogItem
-{
-    LogItem()
-        : eventType( eMyNoEvent)
-        , frameNumber(0)
-    {
-    }
-
-    LogItem( MyEvents event, uint32_t frameNr)
-        : eventType(event)
-        , frameNumber(frameNr)
-    {
-        //Warning, measured values can be wrong on older PC hardware.
-#if defined(PYLON_WIN_BUILD)
-        QueryPerformanceCounter(&time);
-#elif defined(PYLON_LINUX_BUILD)
-        struct timeval tv;
-
-        gettimeofday(&tv, NULL);
-        time = static_cast<unsigned long long>(tv.tv_sec) * 1000L + static_cast<unsigned long long>(tv.tv_usec) / 1000LL;
-#endif
-    }
+// Received events are recorded in an event journal instead of being output on the screen
+// because outputting will change the timing. Recording an event takes a time stamp with
+// nanosecond resolution and does not block; the journal is written to this file in the
+// background. Print it later with Utility_EventJournal.
+static const char c_journalFilename[] = "Grab_UsingExposureEndEvent.journal";
 
 
-#if defined(PYLON_WIN_BUILD)
-    LARGE_INTEGER time; // Recorded time stamps.
-#elif defined(PYLON_LINUX_BUILD)
-    unsigned long long time; // Recorded time stamps.
-#endif
-    MyEvents eventType; // Type of the received event.
-    uint16_t frameNumber; // Frame number of the received event. A frame number may not be available for some transport layers.
-                          // Frame numbers are not supported by all transport layers.
-};
-
-
-// Helper function for printing a log.
-// This function is used for demonstration purposes only.
-void PrintLog( const std::vector<LogItem>& aLog)
-{
-#if defined(PYLON_WIN_BUILD)
-    // Get the PC timer frequency.
-    LARGE_INTEGER timerFrequency;
-    QueryPerformanceFrequency(&timerFrequency);
-#elif defined(PYLON_LINUX_BUILD)
-#endif
-
-    cout << std::endl << "Warning, the printed time values can be wrong on older PC hardware." << std::endl << std::endl;
-    // Print the event information header.
-    cout << "Time [ms]    " << "Event                 " << "FrameNumber" << std::endl;
-    cout << "------------ " << "--------------------- " << "-----------" << std::endl;
-
-    // Print the logged information.
-    size_t logSize = aLog.size();
-    for ( size_t i = 0; i < logSize; ++i)
-    {
-        // Calculate the elapsed time between the events.
-        double time_ms = 0;
-        if ( i)
-        {
-#if defined(PYLON_WIN_BUILD)
-            __int64 oldTicks = ((__int64)aLog[i-1].time.HighPart << 32) + (__int64)aLog[i-1].time.LowPart;
-            __int64 newTicks = ((__int64)aLog[i].time.HighPart << 32) + (__int64)aLog[i].time.LowPart;
-            long double timeDifference = (long double) (newTicks - oldTicks);
-            long double ticksPerSecond = (long double) (((__int64)timerFrequency.HighPart << 32) + (__int64)timerFrequency.LowPart);
-            time_ms = (timeDifference / ticksPerSecond) * 1000;
-#elif defined(PYLON_LINUX_BUILD)
-            time_ms = aLog[i].time - aLog[i-1].time;
-#endif
-        }
-
-        // Print the event information.
-        cout << setw(12) << fixed << setprecision(4) << time_ms <<" "<< MyEventNames[ aLog[i].eventType ] <<" "<< aLog[i].frameNumber << std::endl;
-    }
-}
-
 // Number of images to be grabbed.
 static const uint32_t c_countOfImagesToGrab = 50;
 
@@ -162,8 +89,12 @@ public:
         , m_nextExpectedFrameNumberExposureEnd(1)
         , m_nextFrameNumberForMove(1)
     {
-        // Reserve space to log camera events and image events.
-        m_log.reserve( c_countOfImagesToGrab * 2);
+        // Name the events for the printed output.
+        for ( uint32_t event = eMyExposureEndEvent; event < eMyNoEvent; ++event)
+        {
+            m_journal.SetEventName( event, MyEventNames[ event ]);
+        }
+        m_journal.Open( c_journalFilename);
     }
 
     // This method is called when a camera event has been received.
@@ -173,7 +104,8 @@ public:
         {
             // An Exposure End event has been received.
             uint16_t frameNumber = (uint16_t)camera.ExposureEndEventFrameID.GetValue();
-            m_log.push_back( LogItem( eMyExposureEndEvent, frameNumber));
+            m_journal.Record( eMyExposureEndEvent, frameNumber);
+            m_profiler.OnExposureEnd( frameNumber);
 
             // If Exposure End event is not doubled.
             if ( GetIncrementedFrameNumber( frameNumber) != m_nextExpectedFrameNumberExposureEnd)
@@ -195,7 +127,7 @@ public:
         else if ( userProvidedId == eMyFrameStartOvertrigger)
         {
             // The camera has been overtriggered.
-            m_log.push_back( LogItem( eMyFrameStartOvertrigger, 0));
+            m_journal.Record( eMyFrameStartOvertrigger, 0);
 
             // Handle this error...
         }
@@ -203,7 +135,7 @@ public:
         {
             // The camera was unable to send all its events to the PC.
             // Events have been dropped by the camera.
-            m_log.push_back( LogItem( eMyEventOverrunEvent, 0));
+            m_journal.Record( eMyEventOverrunEvent, 0);
 
             // Handle this error...
         }
@@ -216,9 +148,12 @@ public:
     // This method is called when an image has been grabbed.
     virtual void OnImageGrabbed( CBaslerGigEInstantCamera& camera, const CBaslerGigEGrabResultPtr& ptrGrabResult)
     {
+        // Profile the latencies from the Exposure End event to the image and of this handler.
+        const uint64_t arrivalNs = m_profiler.OnImageGrabbed( ptrGrabResult);
+
         // An image has been received. Block ID is equal to frame number for GigE camera devices.
         uint16_t frameNumber = (uint16_t)ptrGrabResult->GetBlockID();
-        m_log.push_back( LogItem( eMyImageReceivedEvent, frameNumber));
+        m_journal.Record( eMyImageReceivedEvent, frameNumber);
 
         // Check whether the imaged item or the sensor head can be moved.
         // This will be the case if the Exposure End has been lost or if the Exposure End is received later than the image.
@@ -233,6 +168,8 @@ public:
             throw RUNTIME_EXCEPTION( "An image has been lost. Expected frame number is %d but got frame number %d.", m_nextExpectedFrameNumberExposureEnd, frameNumber);
         }
         IncrementFrameNumber( m_nextExpectedFrameNumberImage);
+
+        m_profiler.OnImageHandled( arrivalNs);
     }
 
     void MoveImagedItemOrSensorHead()
@@ -240,13 +177,26 @@ public:
         // The imaged item or the sensor head can be moved now...
         // The camera may not be ready for a trigger at this point yet because the sensor is still being read out.
         // See the documentation of the CInstantCamera::WaitForFrameTriggerReady() method for more information.
-        m_log.push_back( LogItem( eMyMoveEvent, m_nextFrameNumberForMove));
+        m_journal.Record( eMyMoveEvent, m_nextFrameNumberForMove);
         IncrementFrameNumber( m_nextFrameNumberForMove);
     }
 
     void PrintLog()
     {
-        ::PrintLog( m_log);
+        // Write the remaining events to the file and print the journal sorted by time.
+        m_journal.Close();
+        cout << std::endl;
+        CEventJournalReader( c_journalFilename).Print( cout);
+
+        // Print the latency percentiles.
+        cout << std::endl;
+        m_profiler.PrintStatistics( cout);
+    }
+
+    // Sets the clock correlator used for the latency from frame start to image.
+    void SetClockCorrelator( const CCameraClockCorrelator* pCorrelator)
+    {
+        m_profiler.SetClockCorrelator( pCorrelator);
     }
 
 private:
@@ -270,7 +220,8 @@ private:
     uint16_t m_nextExpectedFrameNumberExposureEnd;
     uint16_t m_nextFrameNumberForMove;
 
-    std::vector<LogItem> m_log;
+    CEventJournal m_journal;
+    CExposureEndProfiler m_profiler;
 };
 
 #else //No GigE camera
@@ -281,8 +232,12 @@ class CEventHandler : public CameraEventHandler_t , public ImageEventHandler_t
 public:
     CEventHandler()
     {
-        // Reserve space to log camera events and image events.
-        m_log.reserve( c_countOfImagesToGrab * 2);
+        // Name the events for the printed output.
+        for ( uint32_t event = eMyExposureEndEvent; event < eMyNoEvent; ++event)
+        {
+            m_journal.SetEventName( event, MyEventNames[ event ]);
+        }
+        m_journal.Open( c_journalFilename);
     }
 
     // This method is called when a camera event has been received.
@@ -291,7 +246,9 @@ public:
         if ( userProvidedId == eMyExposureEndEvent)
         {
             // An Exposure End event has been received.
-            m_log.push_back( LogItem( eMyExposureEndEvent, (uint16_t)camera.ExposureEndEventFrameID.GetValue()));
+            uint16_t frameNumber = (uint16_t)camera.ExposureEndEventFrameID.GetValue();
+            m_journal.Record( eMyExposureEndEvent, frameNumber);
+            m_profiler.OnExposureEnd( frameNumber);
 
             // Move the imaged item or the sensor head.
             MoveImagedItemOrSensorHead();
@@ -299,7 +256,7 @@ public:
         else if ( userProvidedId == eMyFrameStartOvertrigger)
         {
             // The camera has been overtriggered.
-            m_log.push_back( LogItem( eMyFrameStartOvertrigger, 0));
+            m_journal.Record( eMyFrameStartOvertrigger, 0);
 
             // Handle this error...
         }
@@ -307,7 +264,7 @@ public:
         {
             // The camera was unable to send all its events to the PC.
             // Events have been dropped by the camera.
-            m_log.push_back( LogItem( eMyEventOverrunEvent, 0));
+            m_journal.Record( eMyEventOverrunEvent, 0);
 
             // Handle this error...
         }
@@ -320,8 +277,13 @@ public:
     // This method is called when an image has been grabbed.
     virtual void OnImageGrabbed( Camera_t& camera, const GrabResultPtr_t& ptrGrabResult)
     {
+        // Profile the latencies from the Exposure End event to the image and of this handler.
+        const uint64_t arrivalNs = m_profiler.OnImageGrabbed( ptrGrabResult);
+
         // An image has been received.
-        m_log.push_back( LogItem( eMyImageReceivedEvent, (uint16_t)ptrGrabResult->GetBlockID()));
+        m_journal.Record( eMyImageReceivedEvent, (uint16_t)ptrGrabResult->GetBlockID());
+
+        m_profiler.OnImageHandled( arrivalNs);
     }
 
     void MoveImagedItemOrSensorHead()
@@ -329,16 +291,30 @@ public:
         // The imaged item or the sensor head can be moved now...
         // The camera may not be ready for trigger at this point yet because the sensor is still being read out.
         // See the documentation of the CInstantCamera::WaitForFrameTriggerReady() method for more information.
-        m_log.push_back( LogItem( eMyMoveEvent, 0));
+        m_journal.Record( eMyMoveEvent, 0);
     }
 
     void PrintLog()
     {
-        ::PrintLog( m_log);
+        // Write the remaining events to the file and print the journal sorted by time.
+        m_journal.Close();
+        cout << std::endl;
+        CEventJournalReader( c_journalFilename).Print( cout);
+
+        // Print the latency percentiles.
+        cout << std::endl;
+        m_profiler.PrintStatistics( cout);
+    }
+
+    // Sets the clock correlator used for the latency from frame start to image.
+    void SetClockCorrelator( const CCameraClockCorrelator* pCorrelator)
+    {
+        m_profiler.SetClockCorrelator( pCorrelator);
     }
 
 private:
-    std::vector<LogItem> m_log;
+    CEventJournal m_journal;
+    CExposureEndProfiler m_profiler;
 };
 #endif
 
@@ -379,6 +355,20 @@ int main(int argc, char* argv[])
         // Open the camera for setting parameters.
         camera.Open();
 
+        // Relate the image time stamps to host time for profiling the latency from frame start
+        // to image, if the camera can latch its time stamp.
+        std::unique_ptr<CCameraClockCorrelator> pCorrelator;
+        try
+        {
+            pCorrelator.reset( new CCameraClockCorrelator( camera.GetNodeMap()));
+            pCorrelator->Start();
+            eventHandler.SetClockCorrelator( pCorrelator.get());
+        }
+        catch (const GenericException &)
+        {
+            cout << "The camera cannot latch its time stamp, the latency from frame start to image is not profiled." << endl;
+        }
+
         // The network packet signaling an event of a GigE camera device can get lost on the network.
         // The following commented parameters can be used to control the handling of lost events.
         //camera.GetEventGrabberParams().Timeout;
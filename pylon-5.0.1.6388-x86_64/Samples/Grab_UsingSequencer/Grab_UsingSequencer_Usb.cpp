@@ -8,6 +8,12 @@
     This sample shows how to grab images using the sequencer feature of a camera.
     Three sequence sets are used for image acquisition. Each sequence set
     uses a different image height.
+
+    With c_useHdrBracketing, the three sequence sets use full height images with the exposure
+    times of c_hdrExposureTimesUs instead. The sequence set of each frame is read from the
+    SequencerSetActive chunk, and every complete bracket of three frames is fused into one HDR
+    frame by CHdrBracketFuser (include/HdrFusion.h). Fused frames/s and the bracket latency
+    are printed at the end.
 */
 
 // Include files to use the PYLON API
@@ -15,6 +21,9 @@
 #ifdef PYLON_WIN_BUILD
 #    include <pylon/PylonGUI.h>
 #endif
+#include <iostream>
+#include <vector>
+#include "../include/HdrFusion.h"
 
 using namespace Pylon;
 
@@ -33,6 +42,32 @@ using namespace std;
 // Number of images to be grabbed.
 static const uint32_t c_countOfImagesToGrab = 10;
 
+// Fuse the frames of the three sequence sets into HDR frames, with the exposure times in us of
+// the sets. c_countOfImagesToGrab brackets are grabbed.
+static const bool c_useHdrBracketing = true;
+static const double c_hdrExposureTimesUs[3] = { 250.0, 1000.0, 4000.0 };
+static const EHdrOutput c_hdrOutput = HdrOutput_Mono16;
+
+// Prints the fused frames.
+class CHdrFramePrinter : public IHdrFrameHandler
+{
+public:
+    virtual void OnHdrFrame( const SHdrFrame& frame)
+    {
+        const size_t center = (size_t) frame.width * (frame.height / 2) + frame.width / 2;
+        cout << "HDR frame " << frame.bracketIndex << ": " << frame.width << " x " << frame.height << ", center value ";
+        if ( frame.output == HdrOutput_Float )
+        {
+            cout << static_cast<const float*>( frame.pBuffer)[center];
+        }
+        else
+        {
+            cout << static_cast<const uint16_t*>( frame.pBuffer)[center];
+        }
+        cout << ", latency " << frame.latencyNs / 1000 << " us" << endl;
+    }
+};
+
 int main(int argc, char* argv[])
 {
     // The exit code of the sample application.
@@ -89,6 +124,18 @@ int main(int argc, char* argv[])
             PixelFormatEnums e = camera.PixelFormat.GetValue();
             cout << "PixelFormat: " << camera.PixelFormat.GetValue() << endl;
 
+            if ( c_useHdrBracketing )
+            {
+                // Send the index of the sequence set with each frame.
+                camera.ChunkModeActive.SetValue(true);
+                camera.ChunkSelector.SetValue(ChunkSelector_SequencerSetActive);
+                camera.ChunkEnable.SetValue(true);
+                if ( IsWritable(camera.ExposureAuto) )
+                {
+                    camera.ExposureAuto.SetValue(ExposureAuto_Off);
+                }
+            }
+
             // Set up sequence sets.
 
             // Configure how the sequence will advance.
@@ -102,7 +149,8 @@ int main(int argc, char* argv[])
             int64_t incSet = camera.SequencerSetSelector.GetInc();
             int64_t curSet = initialSet;
 
-            // Set the parameters for step 0; quarter height image.
+            // Set the parameters for step 0; quarter height image, or the shortest exposure time
+            // for HDR bracketing.
             camera.SequencerSetSelector.SetValue(initialSet);
             { // valid for all sets
                 // reset on software signal 1;
@@ -114,8 +162,17 @@ int main(int argc, char* argv[])
                 camera.SequencerTriggerSource.SetValue(SequencerTriggerSource_FrameStart);
             }
             camera.SequencerSetNext.SetValue(curSet + incSet);
-            // quarter height
-            camera.Height.SetValue(camera.Height.GetInc() * (increments / 4));
+            if ( c_useHdrBracketing )
+            {
+                // full height, so that the frames of a bracket can be fused
+                camera.Height.SetValue(camera.Height.GetMax());
+                camera.ExposureTime.SetValue(c_hdrExposureTimesUs[0]);
+            }
+            else
+            {
+                // quarter height
+                camera.Height.SetValue(camera.Height.GetInc() * (increments / 4));
+            }
             camera.SequencerSetSave.Execute();
 
             // Set the parameters for step 1; half height image.
@@ -123,8 +180,17 @@ int main(int argc, char* argv[])
             camera.SequencerSetSelector.SetValue(curSet);
             // advance on Frame Start to next set
             camera.SequencerSetNext.SetValue(curSet + incSet);
-            // half height
-            camera.Height.SetValue(camera.Height.GetInc() * (increments / 2));
+            if ( c_useHdrBracketing )
+            {
+                // full height
+                camera.Height.SetValue(camera.Height.GetMax());
+                camera.ExposureTime.SetValue(c_hdrExposureTimesUs[1]);
+            }
+            else
+            {
+                // half height
+                camera.Height.SetValue(camera.Height.GetInc() * (increments / 2));
+            }
             camera.SequencerSetSave.Execute();
 
             // Set the parameters for step 2; full height image.
@@ -132,8 +198,17 @@ int main(int argc, char* argv[])
             camera.SequencerSetSelector.SetValue(curSet);
             // advance on Frame End to initial set,
             camera.SequencerSetNext.SetValue(initialSet); // terminates sequence definition
-            // full height
-            camera.Height.SetValue(camera.Height.GetInc() * increments);
+            if ( c_useHdrBracketing )
+            {
+                // full height
+                camera.Height.SetValue(camera.Height.GetMax());
+                camera.ExposureTime.SetValue(c_hdrExposureTimesUs[2]);
+            }
+            else
+            {
+                // full height
+                camera.Height.SetValue(camera.Height.GetInc() * increments);
+            }
             camera.SequencerSetSave.Execute();
 
             // Enable the sequencer feature.
@@ -141,11 +216,16 @@ int main(int argc, char* argv[])
             camera.SequencerConfigurationMode.SetValue(SequencerConfigurationMode_Off);
             camera.SequencerMode.SetValue(SequencerMode_On);
 
-            // Start the grabbing of c_countOfImagesToGrab images.
-            camera.StartGrabbing(c_countOfImagesToGrab);
+            // The HDR fuser needs the exposure time of each sequence set, indexed from the first set.
+            CHdrFramePrinter hdrFramePrinter;
+            const vector<double> exposureTimesUs( c_hdrExposureTimesUs, c_hdrExposureTimesUs + 3);
+            CHdrBracketFuser hdrFuser( exposureTimesUs, hdrFramePrinter, c_hdrOutput);
+
+            // Start the grabbing of c_countOfImagesToGrab images, or brackets of three images.
+            camera.StartGrabbing(c_useHdrBracketing ? 3 * c_countOfImagesToGrab : c_countOfImagesToGrab);
 
             // This smart pointer will receive the grab result data.
-            CGrabResultPtr grabResult;
+            Camera_t::GrabResultPtr_t grabResult;
 
             // Camera.StopGrabbing() is called automatically by the RetrieveResult() method
             // when c_countOfImagesToGrab images have been retrieved.
@@ -156,6 +236,22 @@ int main(int argc, char* argv[])
                 {
                     camera.ExecuteSoftwareTrigger();
 
+                    if ( c_useHdrBracketing )
+                    {
+                        // Fuse the frames without waiting for user input. The fuser holds the
+                        // grab results of one bracket at most.
+                        camera.RetrieveResult(5000, grabResult, TimeoutHandling_ThrowException);
+                        if (grabResult->GrabSucceeded() && IsReadable(grabResult->ChunkSequencerSetActive))
+                        {
+                            hdrFuser.Push(grabResult, (size_t) ((grabResult->ChunkSequencerSetActive.GetValue() - initialSet) / incSet));
+                        }
+                        else if (!grabResult->GrabSucceeded())
+                        {
+                            cout << "Error: " << grabResult->GetErrorCode() << " " << grabResult->GetErrorDescription() << endl;
+                        }
+                        continue;
+                    }
+
                     // Wait for an image and then retrieve it. A timeout of 5000 ms is used.
                     cout << "RetrieveResult" << endl;
                     camera.RetrieveResult(5000, grabResult, TimeoutHandling_ThrowException);
@@ -188,6 +284,11 @@ int main(int argc, char* argv[])
 
             // Disable the sequencer.
             camera.SequencerMode.SetValue(SequencerMode_Off);
+
+            if ( c_useHdrBracketing )
+            {
+                hdrFuser.PrintStatistics(cout);
+            }
         }
         else
         {
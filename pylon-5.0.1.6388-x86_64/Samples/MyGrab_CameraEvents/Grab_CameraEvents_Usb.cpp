@@ -24,7 +24,7 @@ for the same event.
 */
 
 #include <ctime>    // get clock/date time for use in output file names
-#include <unistd.h> // for sleep() of x microseconds
+#include <memory>   // for std::unique_ptr
 //#include <chrono>   // for sleep() of x milliseconds
 //#include <thread>   // for sleep() of x milliseconds
 
@@ -34,6 +34,13 @@ for the same event.
 // Include files used by samples.
 #include "../include/ConfigurationEventPrinter.h"
 #include "../include/CameraEventPrinter.h"
+#include "../include/FrameWriterPool.h"
+#include "../include/CaptureContainer.h"
+#include "../include/TiffFileSink.h"
+#include "../include/BurstSession.h"
+#include "../include/HugePageBufferFactory.h"
+#include "../include/ExposureController.h"
+#include "../include/BurstAverager.h"
 
 // Namespace for using pylon objects.
 using namespace Pylon;
@@ -66,6 +73,46 @@ enum MyEvents
 // Number of images to be grabbed.
 static const uint32_t c_countOfImagesToGrab = 6;
 
+// Maximum number of bursts to record, 0 for no limit. Recording always ends at the next full hour.
+static const uint64_t c_maxBursts = 0;
+
+// Image files are written by a pool of threads so the grab loop never waits for the disk.
+// The write queue must stay smaller than the number of grab buffers, otherwise the grab
+// engine runs out of buffers before the queue starts dropping frames.
+static const size_t c_numWriterThreads = 4;
+static const size_t c_writeQueueCapacity = 48;
+static const uint32_t c_maxNumBuffer = 64;
+
+// Set to true to grab into locked huge pages (CHugePageBufferFactory, HugePageBufferFactory.h)
+// that are kept across the grab sessions of the bursts. This maps and locks at least 64 MB.
+// Set c_bufferNumaNode to the NUMA node of the CPUs the writer threads run on to bind the memory
+// to it; c_numaNodeAny leaves the placement to the system.
+static const bool c_useHugePageBuffers = false;
+static const int c_bufferNumaNode = CHugePageBufferFactory::c_numaNodeAny;
+
+// Set to true to save the TIFF files with the sinks from TiffFileSink.h instead of CImagePersistence.
+// The io_uring backend batches up to c_maxWriteBatch frames per submission and falls back to POSIX
+// I/O on older kernels. Note that these files store Mono12 LSB aligned (pixel values 0..4095),
+// while CImagePersistence stores them MSB aligned.
+static const bool c_useDirectTiffSink = false;
+static const ETiffSinkBackend c_tiffSinkBackend = TiffSinkBackend_Uring;
+static const size_t c_maxWriteBatch = 16;
+
+// Set to true to adjust ExposureTime and Gain between bursts with CExposureController
+// (ExposureController.h) instead of keeping the start values. GainAuto stays off, as the camera
+// auto functions do not settle with sparse burst triggers.
+static const bool c_useExposureControl = false;
+static const double c_maxExposureUs = 10000.0;
+static const double c_maxGainDb = 23.059349;
+
+// Set to true to save one averaged Mono16 frame per burst (CBurstAverager, BurstAverager.h)
+// instead of every frame. The frames are accumulated as they arrive; samples further than
+// c_burstClipSigma standard deviations from the other frames are rejected (0 disables this).
+// Set c_saveRawBurstFrames to keep saving every frame as well.
+static const bool c_useBurstAveraging = false;
+static const bool c_saveRawBurstFrames = false;
+static const double c_burstClipSigma = 3.0;
+
 
 // Example handler for camera events.
 class CSampleCameraEventHandler : public CameraEventHandler_t
@@ -98,29 +145,117 @@ public:
 class CSampleImageEventHandler : public CImageEventHandler
 {
 public:
+    CSampleImageEventHandler( CFrameWriterPool& writerPool, CExposureController* pExposureController, CBurstAverager* pBurstAverager)
+        : m_writerPool( writerPool)
+        , m_pExposureController( pExposureController)
+        , m_pBurstAverager( pBurstAverager)
+    {
+    }
+
+    // Runs on the grab loop thread: only build the file name and queue the frame.
+    // The frame is saved by one of the writer threads.
     virtual void OnImageGrabbed( CInstantCamera& camera, const CGrabResultPtr& ptrGrabResult)
     {   
-        cout << "CSampleImageEventHandler::OnImageGrabbed called." << std::endl;
         char frameFilename[100];
         uint16_t frameNumber = (uint16_t)ptrGrabResult->GetBlockID();
 
         time_t currentTime;
-        struct tm *localTime;
+        struct tm localTime;
         time( &currentTime );                   // Get the current time
-        localTime = localtime( &currentTime );  // Convert the current time to the local time
-        // int Day    = localTime->tm_mday;
-        // int Month  = localTime->tm_mon + 1;
-        // int Year   = localTime->tm_year + 1900;
-        int Hour   = localTime->tm_hour;
-        int Min    = localTime->tm_min;
-        int Sec    = localTime->tm_sec;
+        localtime_r( &currentTime, &localTime );  // Convert the current time to the local time
+        int Hour   = localTime.tm_hour;
+        int Min    = localTime.tm_min;
+        int Sec    = localTime.tm_sec;
 
         // sprintf(frameFilename,"./captures_mono12p/GrabbedImage_%.2d_%.2d_%.2d_%.2d.png",Hour,Min,Sec,frameNumber);                
-        // CImagePersistence::Save( ImageFileFormat_Png, frameFilename, ptrGrabResult); // Portable Network Graphics, lossless data compression
         sprintf(frameFilename,"./captures_sunny_mono12_1000us/GrabbedImage_%.2d_%.2d_%.2d_%.2d.tiff",Hour,Min,Sec,frameNumber);                
-        CImagePersistence::Save( ImageFileFormat_Tiff, frameFilename, ptrGrabResult); // Tagged Image File Format, no compression, supports mono images with more than 8 bit bit depth. 
-        cout << "Saved image to file: " << frameFilename << endl << endl;
+        if ( (m_pBurstAverager == NULL || c_saveRawBurstFrames) && !m_writerPool.Push( ptrGrabResult, frameFilename) )
+        {
+            cerr << "Write queue full, dropped frame " << frameNumber << endl;
+        }
+
+        // The histogram of every 8th line takes well below 1 ms.
+        const EPixelType pixelType = ptrGrabResult->GetPixelType();
+        if ( m_pExposureController != NULL && (pixelType == PixelType_Mono8 || pixelType == PixelType_Mono12) )
+        {
+            const uint32_t bitsPerPixel = pixelType == PixelType_Mono8 ? 8 : 12;
+            const size_t stride = (size_t) ptrGrabResult->GetWidth() * (bitsPerPixel > 8 ? 2 : 1) + ptrGrabResult->GetPaddingX();
+            m_pExposureController->AddFrame( ptrGrabResult->GetBuffer(), ptrGrabResult->GetWidth(), ptrGrabResult->GetHeight(), stride, bitsPerPixel);
+        }
+
+        // Every grab result of the burst is counted, so the average is saved after the last one.
+        if ( m_pBurstAverager != NULL )
+        {
+            if ( ptrGrabResult->GrabSucceeded() && (pixelType == PixelType_Mono8 || pixelType == PixelType_Mono12) )
+            {
+                const uint32_t bitsPerPixel = pixelType == PixelType_Mono8 ? 8 : 12;
+                const size_t stride = (size_t) ptrGrabResult->GetWidth() * (bitsPerPixel > 8 ? 2 : 1) + ptrGrabResult->GetPaddingX();
+                m_pBurstAverager->AddFrame( ptrGrabResult->GetBuffer(), ptrGrabResult->GetWidth(), ptrGrabResult->GetHeight(), stride, bitsPerPixel);
+            }
+            else
+            {
+                m_pBurstAverager->SkipFrame();
+            }
+        }
+    }
+
+private:
+    CFrameWriterPool& m_writerPool;
+    CExposureController* m_pExposureController;
+    CBurstAverager* m_pBurstAverager;
+};
+
+
+// Saves the averaged frame of each burst as Mono16 TIFF, Mono12 values MSB aligned like
+// CImagePersistence stores Mono12 frames. Runs on the averaging thread of CBurstAverager, so the
+// grab loop thread only accumulates the frames and re-arms the burst without waiting for the file.
+class CBurstAverageWriter : public IBurstAverageHandler
+{
+public:
+    virtual void OnBurstAverage( const SBurstAverage& average)
+    {
+        char averageFilename[100];
+        time_t currentTime;
+        struct tm localTime;
+        time( &currentTime );
+        localtime_r( &currentTime, &localTime );
+        sprintf(averageFilename,"./captures_sunny_mono12_1000us/AveragedImage_%.2d_%.2d_%.2d_%.4d.tiff",
+            localTime.tm_hour,localTime.tm_min,localTime.tm_sec,(int)(average.burstIndex % 10000));
+
+        CPylonImage image;
+        image.AttachUserBuffer( const_cast<void*>( average.pBuffer), (size_t) average.width * average.height * sizeof( uint16_t),
+            PixelType_Mono16, average.width, average.height, 0);
+        CImagePersistence::Save( ImageFileFormat_Tiff, averageFilename, image);
+    }
+};
+
+
+// Writes new ExposureTime and Gain values between bursts when the controller asks for them.
+class CBurstExposureControl : public IBurstEndHandler
+{
+public:
+    CBurstExposureControl( Camera_t& camera, CExposureController& controller)
+        : m_camera( camera)
+        , m_controller( controller)
+    {
+    }
+
+    virtual void OnBurstEnd( CInstantCamera& /*camera*/, uint64_t burstCount)
+    {
+        const SExposureUpdate update = m_controller.Update( m_camera.ExposureTime.GetValue(), m_camera.Gain.GetValue());
+        if ( update.write )
+        {
+            m_camera.ExposureTime.SetValue( update.exposureUs );
+            m_camera.Gain.SetValue( update.gainDb );
+            cout << "Burst " << burstCount << ": 99th percentile at " << update.highLevel * 100.0 << " %, "
+                 << update.saturatedFraction * 100.0 << " % saturated, new exposure time " << update.exposureUs
+                 << " us, gain " << update.gainDb << " dB" << endl;
+        }
     }
+
+private:
+    Camera_t& m_camera;
+    CExposureController& m_controller;
 };
 
 
@@ -147,11 +282,65 @@ int main(int argc, char* argv[])
         CDeviceInfo info;
         info.SetDeviceClass( Camera_t::DeviceClass());
 
+        // The buffer factory must outlive the camera.
+        std::unique_ptr<CHugePageBufferFactory> pBufferFactory;
+        if ( c_useHugePageBuffers )
+        {
+            pBufferFactory.reset( new CHugePageBufferFactory( c_bufferNumaNode ) );
+        }
+
+        // The controller is used by the image event handler and must outlive the camera as well.
+        // It starts from the ExposureTime and Gain values set below.
+        SExposureControlSettings exposureSettings;
+        exposureSettings.maxExposureUs = c_maxExposureUs;
+        exposureSettings.maxGainDb = c_maxGainDb;
+        CExposureController exposureController( exposureSettings );
+
+        // The averager is used by the image event handler too.
+        CBurstAverageWriter burstAverageWriter;
+        std::unique_ptr<CBurstAverager> pBurstAverager;
+        if ( c_useBurstAveraging )
+        {
+            pBurstAverager.reset( new CBurstAverager( c_countOfImagesToGrab, burstAverageWriter, BurstAverageOutput_Mono16, c_burstClipSigma ) );
+        }
+
+        // When a file name is given on the command line, all frames are appended to one capture
+        // container with Mono12 stored as Mono12p (see Utility_CaptureExport for converting it to
+        // image files). Otherwise each frame is saved as TIFF (no compression, supports mono images
+        // with more than 8 bit bit depth).
+        // Use ImageFileFormat_Png and a .png file name for lossless compressed files.
+        // The sink and the pool are declared before the camera, so that they outlive it: the camera
+        // and its grab loop thread are destroyed first, also when an exception is thrown while grabbing.
+        const bool bUseCaptureContainer = argc > 1;
+        std::unique_ptr<IFrameSink> pFrameSink;
+        if ( bUseCaptureContainer )
+        {
+            pFrameSink.reset( new CCaptureContainerWriter( argv[1], true, 16 * 1024 * 1024, CapturePacking_Mono12p ) );
+        }
+        else if ( c_useDirectTiffSink )
+        {
+            pFrameSink.reset( CreateTiffFileSink( c_tiffSinkBackend ) );
+        }
+        else
+        {
+            pFrameSink.reset( new CImagePersistenceSink( ImageFileFormat_Tiff ) );
+        }
+        // The container is written sequentially, one writer thread keeps the disk busy.
+        // The io_uring sink completes asynchronously, one thread submitting batches is enough.
+        const bool bSingleWriter = bUseCaptureContainer || (c_useDirectTiffSink && dynamic_cast<CPosixTiffSink*>( pFrameSink.get()) == NULL);
+        CFrameWriterPool writerPool( *pFrameSink, bSingleWriter ? 1 : c_numWriterThreads, c_writeQueueCapacity, QueueFull_Drop,
+            bSingleWriter ? c_maxWriteBatch : 1 );
+
         // Create an instant camera object with the first found camera device matching the specified device class.
         Camera_t camera( CTlFactory::GetInstance().CreateFirstDevice( info));
+        if ( pBufferFactory )
+        {
+            camera.SetBufferFactory( pBufferFactory.get(), Cleanup_None );
+        }
 
         camera.RegisterConfiguration( new CAcquireContinuousConfiguration, RegistrationMode_ReplaceAll, Cleanup_Delete);
-        camera.RegisterImageEventHandler( new CSampleImageEventHandler, RegistrationMode_Append, Cleanup_Delete);
+        camera.RegisterImageEventHandler( new CSampleImageEventHandler( writerPool, c_useExposureControl ? &exposureController : NULL,
+            pBurstAverager.get() ), RegistrationMode_Append, Cleanup_Delete);
         camera.GrabCameraEvents = true;
 
         // Register an event handler for the Exposure End and Frame Start events
@@ -187,6 +376,18 @@ int main(int argc, char* argv[])
         camera.Gain.SetValue(23.059349); // max gain is 23.059349 dB
 
         camera.PixelFormat.SetValue(PixelFormat_Mono12);    // _Mono8, _Mono12, _Mono12p
+
+        // The capture container stores timestamp, exposure time and gain of every frame.
+        if ( bUseCaptureContainer && GenApi::IsWritable( camera.ChunkModeActive ) )
+        {
+            camera.ChunkModeActive.SetValue( true );
+            camera.ChunkSelector.SetValue( ChunkSelector_Timestamp );
+            camera.ChunkEnable.SetValue( true );
+            camera.ChunkSelector.SetValue( ChunkSelector_ExposureTime );
+            camera.ChunkEnable.SetValue( true );
+            camera.ChunkSelector.SetValue( ChunkSelector_Gain );
+            camera.ChunkEnable.SetValue( true );
+        }
         
         // camera.AcquisitionStart.Execute( );  // MJR: Don't think this is necessary. Called by camera.StartGrabbing()?
         // while ( ! finished )
@@ -215,46 +416,62 @@ int main(int argc, char* argv[])
         camera.EventNotification.SetValue(EventNotification_On);    // Enable it.
 
 
-        // Start the grabbing of c_countOfImagesToGrab images.
+        // Provide enough buffers to cover a full write queue plus the frames in flight.
+        camera.MaxNumBuffer = c_maxNumBuffer;
+        if ( pBufferFactory )
+        {
+            pBufferFactory->Reserve( (size_t) camera.PayloadSize.GetValue(), c_maxNumBuffer );
+        }
+
+        // Grab one session of c_countOfImagesToGrab images per burst trigger. The next session is
+        // started as soon as the camera has stopped the previous one, until the next full hour.
         camera.LineSelector.SetValue(LineSelector_Line3);
-        camera.StartGrabbing( c_countOfImagesToGrab, GrabStrategy_OneByOne, GrabLoop_ProvidedByInstantCamera);
-        int cnt = 0;
         time_t currentTime;
-        struct tm *localTime;
-        time( &currentTime );                   // Get the current time
-        localTime = localtime( &currentTime );  // Convert the current time to the local time
-        int hourStart   = localTime->tm_hour;
-        // while ( camera.IsGrabbing() && cnt < 10000)
-        // while ( camera.IsGrabbing() )
-        bool bKeepGrabbing = true;
-        while ( bKeepGrabbing )
+        struct tm localTime;
+        time( &currentTime );                       // Get the current time
+        localtime_r( &currentTime, &localTime );    // Convert the current time to the local time
+        localTime.tm_min = 0;
+        localTime.tm_sec = 0;
+        localTime.tm_hour += 1;
+        localTime.tm_isdst = -1;
+
+        CBurstExposureControl burstExposureControl( camera, exposureController );
+        CBurstSession burstSession( camera, c_countOfImagesToGrab, GrabStrategy_OneByOne );
+        burstSession.SetDeadline( mktime( &localTime ) );
+        burstSession.SetMaxBursts( c_maxBursts );
+        if ( c_useExposureControl )
         {
-            // bool bLineStatus = camera.LineStatus.GetValue();
-            // // Get info about single Line
-            // cout << cnt++ << ": " << bLineStatus << endl;
-            if ( !camera.IsGrabbing())
-            {
-                // stop grabbing after a few hours
-                time( &currentTime );                   // Get the current time
-                localTime = localtime( &currentTime );  // Convert the current time to the local time
-                if (localTime->tm_hour - hourStart > 0)
-                {
-                    bKeepGrabbing = false;
-                }
-
-                // pause then start grabbing again
-                //sleep(500);
-                //std::this_thread::sleep_for(std::chrono::milliseconds(500));
-                usleep(500000);
-                camera.StartGrabbing( c_countOfImagesToGrab, GrabStrategy_OneByOne, GrabLoop_ProvidedByInstantCamera);
-            }
-
+            burstSession.SetBurstEndHandler( &burstExposureControl );
+        }
+        burstSession.Run();
+        burstSession.PrintStatistics( cout );
+        if ( c_useExposureControl )
+        {
+            exposureController.PrintStatistics( cout );
+        }
+        if ( pBurstAverager )
+        {
+            pBurstAverager->Flush();
+            pBurstAverager->PrintStatistics( cout );
+        }
+        if ( pBufferFactory )
+        {
+            pBufferFactory->PrintStatistics( cout );
         }
 
-        
         camera.StopGrabbing();              // MJR: Don't think this is necessary
         camera.AcquisitionStop.Execute( );  // MJR: Don't think this is necessary
 
+        // Write the frames still in the queue and report the writer statistics.
+        writerPool.Stop();
+        writerPool.PrintStatistics( cout );
+
+
+        // Disable chunk mode.
+        if ( bUseCaptureContainer && GenApi::IsWritable( camera.ChunkModeActive ) )
+        {
+            camera.ChunkModeActive.SetValue( false );
+        }
 
         // Disable sending Exposure End events.
         camera.EventSelector.SetValue(EventSelector_ExposureEnd);
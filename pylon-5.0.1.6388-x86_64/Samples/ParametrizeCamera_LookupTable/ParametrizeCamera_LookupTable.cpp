@@ -6,6 +6,10 @@
     strongly recommends reading the Migration topic in the pylon C++ API documentation.
 
     This sample program demonstrates the use of the Luminance Lookup Table feature.
+
+    The camera has one table, which cannot change from frame to frame. For tables applied on
+    the host and replaceable between any two frames, see CPixelLookupStage (PixelLookupTable.h)
+    and Utility_LookupTableBenchmark.
 */
 
 // Include files to use the PYLON API.
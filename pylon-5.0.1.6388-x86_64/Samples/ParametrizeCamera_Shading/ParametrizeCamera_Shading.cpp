@@ -9,6 +9,12 @@
     set to a Basler runner line scan camera.
 
     This sample only applies to Basler runner cameras.
+
+    The column intensities are averaged over several frames by CShadingAccumulator
+    (ShadingCalibration.h); see Utility_ShadingCalibrationBenchmark for its speed.
+
+    For cameras without shading correction, or for a per-pixel instead of a per-column
+    correction, see Utility_FlatFieldCorrection, which corrects the frames on the host.
 */
 
 // For use with Visual Studio >= 2005, disable deprecate warnings caused by the fopen function.
@@ -16,6 +22,8 @@
 
 // Include files to use the PYLON API.
 #include <pylon/PylonIncludes.h>
+#include <memory>
+#include "../include/ShadingCalibration.h"
 
 // Namespace for using pylon objects.
 using namespace Pylon;
@@ -64,6 +72,9 @@ void CheckShadingData(Camera_t& camera);
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Number of frames averaged for calculating and for checking the shading data.
+static const uint32_t c_countOfFramesToAverage = 16;
+
 // Name of the file where we will store the shading data on the local disk.
 static const char LocalFilename[] = "ShadingData.bin";
 
@@ -181,8 +192,8 @@ int main(int argc, char* argv[])
 
 
 //
-// Grab a frame and store the intensitiy for the pixels in each column
-// in 'Intensities'.
+// Grab c_countOfFramesToAverage frames and store the average intensity of the pixels
+// in each column in 'Intensities'.
 //
 void AverageLines(Camera_t& camera,
                    uint32_t Width,         // Width of frame (number of pixels in each line).
@@ -190,54 +201,50 @@ void AverageLines(Camera_t& camera,
                    uint32_t NumCoeffs,     // Number of coefficients.
                    double *Intensities)    // Destination array.
 {
-    for (uint32_t x = 0; x < NumCoeffs; x++)
-    {
-        Intensities[x] = 0.0;
-    }
-
-    cout << "Grab frame for averaging." << endl;
+    cout << "Grab " << c_countOfFramesToAverage << " frames for averaging." << endl;
 
+    // The frames are added row by row with SIMD integer adds on all cores,
+    // see ShadingCalibration.h.
+    std::unique_ptr<CShadingAccumulator> pAccumulator;
+    size_t BytesPerValue = 1;
     CGrabResultPtr ptrGrabResult;
-        camera.GrabOne( 5000, ptrGrabResult);
-    uint8_t *Buffer = static_cast<uint8_t*>( ptrGrabResult->GetBuffer());
-
-    if (NumCoeffs == 3 * Width)
+    camera.StartGrabbing(c_countOfFramesToAverage);
+    while (camera.IsGrabbing())
     {
-        //
-        // RGB mode.
-        //
-        for (uint32_t x = 0; x < Width; x++)
+        camera.RetrieveResult(5000, ptrGrabResult, TimeoutHandling_ThrowException);
+        if (!ptrGrabResult->GrabSucceeded())
         {
-            for (uint32_t y = 0; y < Height; y++)
-            {
-                // Add intensities.
-                uint32_t idx = 3 * (y * Width + x);
-                Intensities[x] += Buffer[idx];
-                Intensities[x + Width] += Buffer[idx + 1];
-                Intensities[x + 2 * Width] += Buffer[idx + 2];
-            }
+            cout << "Error: " << ptrGrabResult->GetErrorCode() << " " << ptrGrabResult->GetErrorDescription() << endl;
+            continue;
         }
-    }
-    else
-    {
-        //
-        // Mono mode.
-        //
-        for (uint32_t x = 0; x < Width; x++)
+
+        if (!pAccumulator)
         {
-            for (uint32_t y = 0; y < Height; y++)
+            EShadingFormat format = ShadingFormat_Mono8;
+            if (NumCoeffs == 3 * Width)
+            {
+                format = ShadingFormat_RGB8;
+            }
+            else if (ptrGrabResult->GetPixelType() == PixelType_Mono12)
             {
-                // Add intensities.
-                Intensities[x] += Buffer[y * Width + x];
+                format = ShadingFormat_Mono12;
+                BytesPerValue = 2;
             }
+            pAccumulator.reset(new CShadingAccumulator(Width, format));
         }
+
+        // Lines can be padded.
+        const size_t Stride = NumCoeffs * BytesPerValue + ptrGrabResult->GetPaddingX();
+        pAccumulator->AddFrame(ptrGrabResult->GetBuffer(), Height, Stride);
     }
-    double scale = 1.0 / double(Height);
-    for (uint32_t x = 0; x < NumCoeffs; x++)
+
+    if (!pAccumulator)
     {
-        // Calculate average intensities.
-        Intensities[x] *= scale;
+        throw RUNTIME_EXCEPTION("No frame has been grabbed for averaging.");
     }
+
+    // Calculate average intensities.
+    pAccumulator->GetAverages(Intensities);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,241 @@
+// Utility_BufferFactoryBenchmark.cpp
+/*
+    This utility compares the grab buffer allocators available to the instant camera:
+    * default: the allocator built into pylon,
+    * new[]: a buffer factory allocating every buffer with new[], as MyBufferFactory in
+      Grab_UsingBufferFactory,
+    * hugepage: CHugePageBufferFactory from HugePageBufferFactory.h.
+
+    Usage: Utility_BufferFactoryBenchmark [cycles] [frames per cycle]
+
+    The camera emulator (set PYLON_CAMEMU=1) is started and stopped again and again, as in a
+    burst loop (default 50 cycles of 10 frames). Each frame is processed by reading all of its
+    pixels. Printed for each allocator are the first-frame latency (from StartGrabbing() to the
+    first image), the page faults per cycle and the data TLB misses per frame during the
+    processing. TLB misses are counted with perf_event_open; they are shown as "n/a" if
+    performance counters are not accessible (see /proc/sys/kernel/perf_event_paranoid).
+*/
+
+// Include files to use the PYLON API.
+#include <pylon/PylonIncludes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/perf_event.h>
+#include <iostream>
+#include <iomanip>
+#include "../include/HugePageBufferFactory.h"
+#include "../include/LatencyHistogram.h"
+
+// Namespace for using pylon objects.
+using namespace Pylon;
+
+// Namespace for using cout.
+using namespace std;
+
+// Allocates every buffer with new[], like MyBufferFactory in Grab_UsingBufferFactory.
+class CNewBufferFactory : public IBufferFactory
+{
+public:
+    virtual void AllocateBuffer( size_t bufferSize, void** pCreatedBuffer, intptr_t& bufferContext)
+    {
+        *pCreatedBuffer = new uint8_t[bufferSize];
+        bufferContext = 0;
+    }
+
+    virtual void FreeBuffer( void* pCreatedBuffer, intptr_t /*bufferContext*/)
+    {
+        delete[] static_cast<uint8_t*>( pCreatedBuffer);
+    }
+
+    virtual void DestroyBufferFactory()
+    {
+    }
+};
+
+// Counts the data TLB read misses of the calling thread, in user space.
+class CTlbMissCounter
+{
+public:
+    CTlbMissCounter()
+    {
+        struct perf_event_attr attributes;
+        memset( &attributes, 0, sizeof( attributes));
+        attributes.size = sizeof( attributes);
+        attributes.type = PERF_TYPE_HW_CACHE;
+        attributes.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        m_fd = (int) syscall( __NR_perf_event_open, &attributes, 0, -1, -1, 0);
+    }
+
+    ~CTlbMissCounter()
+    {
+        if ( m_fd >= 0 )
+        {
+            close( m_fd);
+        }
+    }
+
+    bool IsAvailable() const
+    {
+        return m_fd >= 0;
+    }
+
+    void Start()
+    {
+        if ( m_fd >= 0 )
+        {
+            ioctl( m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    void Stop()
+    {
+        if ( m_fd >= 0 )
+        {
+            ioctl( m_fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    // The misses counted while started, in total.
+    uint64_t GetCount() const
+    {
+        uint64_t count = 0;
+        if ( m_fd < 0 || read( m_fd, &count, sizeof( count)) != (ssize_t) sizeof( count) )
+        {
+            return 0;
+        }
+        return count;
+    }
+
+private:
+    int m_fd;
+};
+
+static long GetPageFaults()
+{
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+// Reads every pixel, as image processing would.
+static uint64_t Process( const CGrabResultPtr& ptrGrabResult)
+{
+    const uint64_t* p = (const uint64_t*) ptrGrabResult->GetBuffer();
+    const size_t count = ptrGrabResult->GetPayloadSize() / sizeof( uint64_t);
+    uint64_t sum = 0;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        sum += p[i];
+    }
+    return sum;
+}
+
+static void RunAllocator( CInstantCamera& camera, const char* name, IBufferFactory* pFactory, size_t cycles, size_t framesPerCycle)
+{
+    if ( pFactory != NULL )
+    {
+        camera.SetBufferFactory( pFactory, Cleanup_None);
+    }
+
+    CLatencyHistogram firstFrame;
+    CTlbMissCounter tlbMisses;
+    uint64_t frames = 0;
+    uint64_t checksum = 0;
+    const long faultsStart = GetPageFaults();
+    CGrabResultPtr ptrGrabResult;
+    for ( size_t cycle = 0; cycle < cycles; ++cycle )
+    {
+        const uint64_t startNs = GetMonotonicTimeNs();
+        camera.StartGrabbing( framesPerCycle);
+        bool first = true;
+        while ( camera.IsGrabbing() )
+        {
+            camera.RetrieveResult( 5000, ptrGrabResult, TimeoutHandling_ThrowException);
+            if ( first )
+            {
+                firstFrame.Record( GetMonotonicTimeNs() - startNs);
+                first = false;
+            }
+            if ( ptrGrabResult->GrabSucceeded() )
+            {
+                tlbMisses.Start();
+                checksum += Process( ptrGrabResult);
+                tlbMisses.Stop();
+                ++frames;
+            }
+        }
+        ptrGrabResult.Release();
+    }
+    const long faults = GetPageFaults() - faultsStart;
+
+    cout << setw( 9) << name
+         << "  first frame p50 " << setw( 8) << firstFrame.GetPercentile( 50.0) / 1000.0
+         << " us  p99 " << setw( 8) << firstFrame.GetPercentile( 99.0) / 1000.0
+         << " us  page faults/cycle " << setw( 8) << (double) faults / cycles
+         << "  dTLB misses/frame ";
+    if ( tlbMisses.IsAvailable() && frames != 0 )
+    {
+        cout << setw( 8) << (double) tlbMisses.GetCount() / frames;
+    }
+    else
+    {
+        cout << setw( 8) << "n/a";
+    }
+    cout << "  (checksum " << (checksum & 0xFFFF) << ")" << endl;
+
+    // Let the camera allocate its own buffers again. The factory must not be in use.
+    if ( pFactory != NULL )
+    {
+        camera.SetBufferFactory( NULL, Cleanup_None);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // The exit code of the sample application.
+    int exitCode = 0;
+
+    const size_t cycles = argc > 1 ? strtoul( argv[1], NULL, 10) : 50;
+    const size_t framesPerCycle = argc > 2 ? strtoul( argv[2], NULL, 10) : 10;
+
+    // Automagically call PylonInitialize and PylonTerminate to ensure the pylon runtime system
+    // is initialized during the lifetime of this object.
+    Pylon::PylonAutoInitTerm autoInitTerm;
+
+    try
+    {
+        // The factories must outlive the camera.
+        CNewBufferFactory newFactory;
+        CHugePageBufferFactory hugePageFactory( CHugePageBufferFactory::GetCurrentNumaNode());
+
+        // Only look for the camera emulator.
+        CDeviceInfo info;
+        info.SetDeviceClass( BaslerCamEmuDeviceClass);
+        CInstantCamera camera( CTlFactory::GetInstance().CreateFirstDevice( info));
+        cout << "Using device " << camera.GetDeviceInfo().GetModelName() << ", " << cycles << " cycles of "
+             << framesPerCycle << " frames" << endl;
+        camera.Open();
+
+        cout << fixed << setprecision( 1);
+        RunAllocator( camera, "default", NULL, cycles, framesPerCycle);
+        RunAllocator( camera, "new[]", &newFactory, cycles, framesPerCycle);
+        RunAllocator( camera, "hugepage", &hugePageFactory, cycles, framesPerCycle);
+        hugePageFactory.PrintStatistics( cout);
+    }
+    catch (const GenericException &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.GetDescription() << endl;
+        exitCode = 1;
+    }
+
+    return exitCode;
+}
@@ -0,0 +1,221 @@
+// Utility_BurstAveraging.cpp
+/*
+    This utility measures CBurstAverager (BurstAverager.h), which reduces each burst of frames to
+    one averaged frame, and shows the noise reduction on a simulated static scene.
+
+    Usage: Utility_BurstAveraging [width] [height] [burst length]
+
+    First, the time to accumulate one frame (default 2048 x 1088 pixels) is printed for Mono8
+    and Mono12, without and with sigma clipping, for the scalar and the AVX2 kernel, together
+    with the time to average a burst (default 6 frames). Both kernels must give the same
+    averaged frame.
+
+    Then a burst of noisy Mono12 frames of a gradient is simulated, with a few samples hit by
+    outliers. The RMS error against the noise-free gradient and the number of pixels off by more
+    than 50 gray values are printed for a single frame, the plain average and the average with
+    sigma clipping at 3 sigma.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <exception>
+#include <iostream>
+#include <iomanip>
+#include "../include/BurstAverager.h"
+
+// Namespace for using the averager.
+using namespace Pylon;
+
+// Namespace for using cout.
+using namespace std;
+
+static const double c_clipSigma = 3.0;
+static const uint32_t c_timedBursts = 10;
+static const double c_maxError = 50.0;
+
+// Keeps a copy of the last averaged frame as float values.
+class CLastAverage : public IBurstAverageHandler
+{
+public:
+    virtual void OnBurstAverage( const SBurstAverage& average)
+    {
+        const size_t pixelCount = (size_t) average.width * average.height;
+        values.resize( pixelCount);
+        for ( size_t i = 0; i < pixelCount; ++i )
+        {
+            values[i] = average.output == BurstAverageOutput_Float ? static_cast<const float*>( average.pBuffer)[i]
+                : static_cast<const uint16_t*>( average.pBuffer)[i];
+        }
+        rejectedSamples = average.rejectedSamples;
+    }
+
+    vector<float> values;
+    uint64_t rejectedSamples;
+};
+
+// Averages c_timedBursts bursts and returns the accumulation time per frame in ms. The averaging
+// runs on the averaging thread of the averager and is timed there.
+template <typename T>
+static double RunKernel( const vector< vector<T> >& frames, uint32_t width, uint32_t height, uint32_t bitsPerPixel, double clipSigma,
+    BurstAverageKernels::EKernel kernel, CLastAverage& lastAverage, double& averageMs)
+{
+    CBurstAverager averager( (uint32_t) frames.size(), lastAverage, BurstAverageOutput_Float, clipSigma, kernel);
+    for ( uint32_t burst = 0; burst < c_timedBursts; ++burst )
+    {
+        for ( size_t i = 0; i < frames.size(); ++i )
+        {
+            averager.AddFrame( &frames[i][0], width, height, 0, bitsPerPixel);
+        }
+    }
+    averager.Flush();
+    averageMs = averager.GetAverageTime().GetMean() / 1e6;
+    return averager.GetAccumulateTime().GetMean() / 1e6;
+}
+
+template <typename T>
+static bool MeasureAveraging( const char* name, uint32_t bitsPerPixel, uint32_t width, uint32_t height, uint32_t burstLength)
+{
+    const uint32_t maxValue = (1u << bitsPerPixel) - 1;
+    vector< vector<T> > frames( burstLength, vector<T>( (size_t) width * height));
+    srand( 1);
+    for ( size_t f = 0; f < frames.size(); ++f )
+    {
+        for ( size_t i = 0; i < frames[f].size(); ++i )
+        {
+            frames[f][i] = (T) ((i % width) * maxValue / width + rand() % 16) % (maxValue + 1);
+        }
+    }
+
+    bool equal = true;
+    const double clipSigmas[2] = { 0.0, c_clipSigma };
+    for ( int c = 0; c < 2; ++c )
+    {
+        cout << setw( 7) << name << setw( 10) << (clipSigmas[c] > 0.0 ? "yes" : "no");
+        CLastAverage scalar;
+        CLastAverage simd;
+        double scalarAverageMs = 0.0;
+        double simdAverageMs = 0.0;
+        cout << setw( 12) << RunKernel( frames, width, height, bitsPerPixel, clipSigmas[c], BurstAverageKernels::Kernel_Scalar, scalar, scalarAverageMs);
+        if ( BurstAverageKernels::GetBestKernel() == BurstAverageKernels::Kernel_Avx2 )
+        {
+            const double simdMs = RunKernel( frames, width, height, bitsPerPixel, clipSigmas[c], BurstAverageKernels::Kernel_Avx2, simd, simdAverageMs);
+            cout << setw( 12) << simdMs << setw( 12) << frames[0].size() * sizeof( T) / simdMs / 1e6;
+            equal = equal && simd.values == scalar.values;
+        }
+        else
+        {
+            cout << setw( 12) << "-" << setw( 12) << "-";
+        }
+        cout << setw( 12) << scalarAverageMs << (equal ? "  equal" : "  DIFFERENT") << endl;
+    }
+    return equal;
+}
+
+// Prints the RMS error against the noise-free scene and the pixels off by more than
+// c_maxError gray values.
+static void PrintError( const char* name, const vector<float>& values, const vector<double>& truth, double scale)
+{
+    double sum = 0.0;
+    size_t offPixels = 0;
+    for ( size_t i = 0; i < values.size(); ++i )
+    {
+        const double error = values[i] / scale - truth[i];
+        sum += error * error;
+        offPixels += fabs( error) > c_maxError;
+    }
+    cout << setw( 20) << name << setw( 12) << sqrt( sum / values.size()) << setw( 12) << offPixels << endl;
+}
+
+// Averages one simulated burst of a gradient with noise and outliers.
+static void Simulate( uint32_t width, uint32_t height, uint32_t burstLength)
+{
+    vector<double> truth( (size_t) width * height);
+    for ( size_t i = 0; i < truth.size(); ++i )
+    {
+        truth[i] = 200.0 + 3000.0 * (i % width) / width;
+    }
+
+    vector< vector<uint16_t> > frames( burstLength, vector<uint16_t>( truth.size()));
+    uint64_t outliers = 0;
+    srand( 2);
+    for ( size_t f = 0; f < frames.size(); ++f )
+    {
+        for ( size_t i = 0; i < truth.size(); ++i )
+        {
+            // About normally distributed noise with a standard deviation of 20 gray values, and
+            // one sample in 2000 much brighter.
+            double noise = 0.0;
+            for ( int k = 0; k < 4; ++k )
+            {
+                noise += rand() % 35 - 17.0;
+            }
+            double value = truth[i] + noise;
+            if ( rand() % 2000 == 0 )
+            {
+                value += 800.0;
+                ++outliers;
+            }
+            frames[f][i] = (uint16_t) min( 4095.0, max( 0.0, value + 0.5));
+        }
+    }
+
+    CLastAverage single;
+    CBurstAverager singleAverager( 1, single, BurstAverageOutput_Float);
+    singleAverager.AddFrame( &frames[0][0], width, height, 0, 12);
+
+    CLastAverage plain;
+    CBurstAverager plainAverager( burstLength, plain, BurstAverageOutput_Float);
+    CLastAverage clipped;
+    CBurstAverager clippedAverager( burstLength, clipped, BurstAverageOutput_Mono16, c_clipSigma);
+    for ( size_t f = 0; f < frames.size(); ++f )
+    {
+        plainAverager.AddFrame( &frames[f][0], width, height, 0, 12);
+        clippedAverager.AddFrame( &frames[f][0], width, height, 0, 12);
+    }
+    singleAverager.Flush();
+    plainAverager.Flush();
+    clippedAverager.Flush();
+
+    cout << endl << "Simulated burst of " << burstLength << " Mono12 frames, " << outliers << " outlier samples" << endl;
+    cout << setw( 20) << "Frame" << setw( 12) << "RMS error" << setw( 10) << "Error > " << (int) c_maxError << endl;
+    PrintError( "single frame", single.values, truth, 1.0);
+    PrintError( "average", plain.values, truth, 1.0);
+    PrintError( "clipped (Mono16)", clipped.values, truth, 16.0);
+    clippedAverager.PrintStatistics( cout);
+}
+
+
+int main(int argc, char* argv[])
+{
+    const uint32_t width = argc > 1 ? (uint32_t) strtoul( argv[1], NULL, 10) : 2048;
+    const uint32_t height = argc > 2 ? (uint32_t) strtoul( argv[2], NULL, 10) : 1088;
+    const uint32_t burstLength = argc > 3 ? (uint32_t) strtoul( argv[3], NULL, 10) : 6;
+    if ( width == 0 || height == 0 || burstLength < 2 || burstLength > 255 )
+    {
+        cerr << "Usage: " << argv[0] << " [width] [height] [burst length 2..255]" << endl;
+        return 1;
+    }
+
+    try
+    {
+        cout << "Accumulation time per " << width << " x " << height << " frame in ms, averaging time per burst of "
+             << burstLength << " frames in ms" << endl;
+        cout << setw( 7) << "Format" << setw( 10) << "Clipping" << setw( 12) << "Scalar" << setw( 12) << "AVX2" << setw( 12) << "GB/s"
+             << setw( 12) << "Average" << endl;
+        cout << fixed << setprecision( 3);
+        bool equal = MeasureAveraging<uint8_t>( "Mono8", 8, width, height, burstLength);
+        equal = MeasureAveraging<uint16_t>( "Mono12", 12, width, height, burstLength) && equal;
+
+        Simulate( width, height, burstLength);
+        return equal ? 0 : 1;
+    }
+    catch (const std::exception &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,113 @@
+// Utility_CaptureExport.cpp
+/*
+    This utility turns a capture container written by CCaptureContainerWriter back into
+    one image file per frame using CImagePersistence.
+
+    Usage: Utility_CaptureExport <capture file> [output directory] [tiff|png] [first frame] [frame count]
+
+    The files are named GrabbedImage_HH_MM_SS_NN.<ext> like the files written directly by
+    the burst recorder, where HH_MM_SS is the local time the frame was grabbed and NN is
+    the block ID. With no output directory, only the container contents are listed.
+*/
+
+// Include files to use the PYLON API.
+#include <pylon/PylonIncludes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/CaptureContainer.h"
+
+// Namespace for using pylon objects.
+using namespace Pylon;
+
+// Namespace for using cout.
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    // The exit code of the sample application.
+    int exitCode = 0;
+
+    if ( argc < 2 )
+    {
+        cerr << "Usage: " << argv[0] << " <capture file> [output directory] [tiff|png] [first frame] [frame count]" << endl;
+        return 1;
+    }
+
+    // Automagically call PylonInitialize and PylonTerminate to ensure the pylon runtime system
+    // is initialized during the lifetime of this object.
+    Pylon::PylonAutoInitTerm autoInitTerm;
+
+    try
+    {
+        CCaptureContainerReader reader( argv[1] );
+        const SCaptureFileHeader& header = reader.GetHeader();
+
+        cout << argv[1] << ": " << reader.GetFrameCount() << " frames, "
+             << header.width << "x" << header.height << " "
+             << CPixelTypeMapper::GetNameByPixelType( (EPixelType) header.pixelType )
+             << (reader.IsPacked() ? " (stored as Mono12p)" : "") << endl;
+        if ( reader.IsRecovered() )
+        {
+            cout << "The index is missing (interrupted recording), frames were recovered from the records." << endl;
+        }
+
+        if ( argc < 3 )
+        {
+            for ( size_t i = 0; i < reader.GetFrameCount(); ++i )
+            {
+                const SCaptureRecordHeader& record = reader.GetRecord( i );
+                cout << "BlockID: " << record.blockId << " Timestamp: " << record.chunkTimestamp
+                     << " ExposureTime: " << record.exposureTime << " Gain: " << record.gain << endl;
+            }
+            return 0;
+        }
+
+        const string outputDirectory = argv[2];
+        EImageFileFormat format = ImageFileFormat_Tiff;
+        const char* extension = "tiff";
+        if ( argc > 3 && strcmp( argv[3], "png" ) == 0 )
+        {
+            format = ImageFileFormat_Png;
+            extension = "png";
+        }
+        size_t firstFrame = argc > 4 ? (size_t) strtoul( argv[4], NULL, 10 ) : 0;
+        size_t frameCount = argc > 5 ? (size_t) strtoul( argv[5], NULL, 10 ) : reader.GetFrameCount();
+        if ( firstFrame > reader.GetFrameCount() )
+        {
+            firstFrame = reader.GetFrameCount();
+        }
+        if ( frameCount > reader.GetFrameCount() - firstFrame )
+        {
+            frameCount = reader.GetFrameCount() - firstFrame;
+        }
+
+        CPylonImage image;
+        for ( size_t i = firstFrame; i < firstFrame + frameCount; ++i )
+        {
+            const SCaptureRecordHeader& record = reader.GetRecord( i );
+            time_t recordTime = (time_t) (record.hostTimeNs / 1000000000ULL);
+            struct tm localTime;
+            localtime_r( &recordTime, &localTime );
+
+            char frameFilename[512];
+            snprintf( frameFilename, sizeof( frameFilename ), "%s/GrabbedImage_%.2d_%.2d_%.2d_%.2d.%s",
+                outputDirectory.c_str(), localTime.tm_hour, localTime.tm_min, localTime.tm_sec,
+                (int) (uint16_t) record.blockId, extension );
+
+            reader.GetImage( i, image );
+            CImagePersistence::Save( format, frameFilename, image );
+        }
+        cout << "Exported " << frameCount << " frames to " << outputDirectory << endl;
+    }
+    catch (GenICam::GenericException &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.GetDescription() << endl;
+        exitCode = 1;
+    }
+
+    return exitCode;
+}
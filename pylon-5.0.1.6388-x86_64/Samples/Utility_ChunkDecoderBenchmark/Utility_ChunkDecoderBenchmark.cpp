@@ -0,0 +1,152 @@
+// Utility_ChunkDecoderBenchmark.cpp
+/*
+    This utility compares decoding the chunk data of grab results with CChunkDecoder
+    (ChunkDecoder.h) against reading it through the chunk data node map as in Grab_ChunkImage.
+
+    Usage: Utility_ChunkDecoderBenchmark [frames] [repetitions]
+
+    The first camera found is opened and the Timestamp, Framecounter (or CounterValue),
+    ExposureTime, Gain (or GainAll), LineStatusAll, SequenceSetIndex (or SequencerSetActive) and
+    PayloadCRC16 chunks are enabled as far as the camera has them. Then the given number of frames
+    (default 100) is grabbed. Each grab result is decoded repeatedly (default 1000 times) through
+    the node map and with the chunk decoder, and the time per decode is printed for both. Both
+    must give the same values for every frame. At the end, the layout the decoder has learned is
+    printed.
+*/
+
+// Include files to use the PYLON API.
+#include <pylon/PylonIncludes.h>
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include "../include/ChunkDecoder.h"
+#include "../include/LatencyHistogram.h"
+
+// Namespace for using pylon objects.
+using namespace Pylon;
+
+// Namespace for using GenApi objects.
+using namespace GenApi;
+
+// Namespace for using cout.
+using namespace std;
+
+// Enables the chunks the decoder reads, as far as the camera has them.
+static void EnableChunks( INodeMap& nodeMap)
+{
+    CBooleanPtr chunkModeActive( nodeMap.GetNode( "ChunkModeActive"));
+    if ( !IsWritable( chunkModeActive) )
+    {
+        throw RUNTIME_EXCEPTION( "The camera doesn't support chunk features");
+    }
+    chunkModeActive->SetValue( true);
+
+    CEnumerationPtr chunkSelector( nodeMap.GetNode( "ChunkSelector"));
+    CBooleanPtr chunkEnable( nodeMap.GetNode( "ChunkEnable"));
+    const char* const chunks[] =
+    {
+        "Timestamp", "Framecounter", "CounterValue", "ExposureTime", "Gain", "GainAll", "LineStatusAll", "SequenceSetIndex",
+        "SequencerSetActive", "PayloadCRC16"
+    };
+    for ( size_t i = 0; i < sizeof( chunks) / sizeof( chunks[0]); ++i )
+    {
+        if ( IsWritable( chunkSelector) && IsAvailable( chunkSelector->GetEntryByName( chunks[i])) )
+        {
+            chunkSelector->FromString( chunks[i]);
+            if ( IsWritable( chunkEnable) )
+            {
+                chunkEnable->SetValue( true);
+            }
+        }
+    }
+}
+
+static bool IsSameChunkData( const SChunkData& a, const SChunkData& b)
+{
+    return a.validFields == b.validFields && a.timestamp == b.timestamp && a.framecounter == b.framecounter
+        && a.exposureTime == b.exposureTime && a.gain == b.gain && a.lineStatusAll == b.lineStatusAll
+        && a.sequenceSetIndex == b.sequenceSetIndex && a.payloadCRC16 == b.payloadCRC16;
+}
+
+
+int main(int argc, char* argv[])
+{
+    // The exit code of the sample application.
+    int exitCode = 0;
+
+    const uint32_t frameCount = argc > 1 ? (uint32_t) strtoul( argv[1], NULL, 10) : 100;
+    const uint32_t repetitions = argc > 2 ? (uint32_t) strtoul( argv[2], NULL, 10) : 1000;
+    if ( frameCount == 0 || repetitions == 0 )
+    {
+        cerr << "Usage: " << argv[0] << " [frames] [repetitions]" << endl;
+        return 1;
+    }
+
+    // Automagically call PylonInitialize and PylonTerminate to ensure the pylon runtime system
+    // is initialized during the lifetime of this object.
+    Pylon::PylonAutoInitTerm autoInitTerm;
+
+    try
+    {
+        CInstantCamera camera( CTlFactory::GetInstance().CreateFirstDevice());
+        cout << "Using device " << camera.GetDeviceInfo().GetModelName() << endl;
+        camera.Open();
+        EnableChunks( camera.GetNodeMap());
+
+        CChunkDecoder decoder;
+        CLatencyHistogram nodeMapTime;
+        CLatencyHistogram decoderTime;
+        uint32_t differentFrames = 0;
+        camera.StartGrabbing( frameCount);
+        CGrabResultPtr ptrGrabResult;
+        while ( camera.IsGrabbing() )
+        {
+            camera.RetrieveResult( 5000, ptrGrabResult, TimeoutHandling_ThrowException);
+
+            // The first decode of a frame learns the layout, so it is not timed.
+            SChunkData expected;
+            SChunkData decoded;
+            if ( !CChunkDecoder::DecodeFromNodeMap( ptrGrabResult, expected) || !decoder.Decode( ptrGrabResult, decoded) )
+            {
+                cerr << "Frame without chunk data: " << ptrGrabResult->GetErrorDescription() << endl;
+                continue;
+            }
+            bool same = IsSameChunkData( expected, decoded);
+            for ( uint32_t i = 0; i < repetitions; ++i )
+            {
+                uint64_t startNs = GetMonotonicTimeNs();
+                CChunkDecoder::DecodeFromNodeMap( ptrGrabResult, expected);
+                nodeMapTime.Record( GetMonotonicTimeNs() - startNs);
+
+                startNs = GetMonotonicTimeNs();
+                decoder.Decode( ptrGrabResult, decoded);
+                decoderTime.Record( GetMonotonicTimeNs() - startNs);
+            }
+            same = same && IsSameChunkData( expected, decoded);
+            differentFrames += same ? 0 : 1;
+        }
+
+        // Disable chunk mode.
+        CBooleanPtr( camera.GetNodeMap().GetNode( "ChunkModeActive"))->SetValue( false);
+
+        cout << decoder.GetFrameCount() << " decodes of " << frameCount << " frames, " << differentFrames << " frames with different values"
+             << (differentFrames == 0 ? "  equal" : "  DIFFERENT") << endl;
+        nodeMapTime.Print( cout, "Node map", 1.0, "ns");
+        decoderTime.Print( cout, "Chunk decoder", 1.0, "ns");
+        if ( decoderTime.GetMean() > 0.0 )
+        {
+            cout << "Speedup: " << fixed << setprecision( 1) << nodeMapTime.GetMean() / decoderTime.GetMean() << endl;
+        }
+        decoder.PrintLayout( cout);
+        exitCode = differentFrames == 0 ? 0 : 1;
+    }
+    catch (const GenericException &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.GetDescription() << endl;
+        exitCode = 1;
+    }
+
+    return exitCode;
+}
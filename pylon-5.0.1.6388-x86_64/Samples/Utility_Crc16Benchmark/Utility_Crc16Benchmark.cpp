@@ -0,0 +1,111 @@
+// Utility_Crc16Benchmark.cpp
+/*
+    This utility checks and benchmarks the CRC-16 kernels in Crc16.h, which CPayloadCrcVerifier
+    (PayloadCrcVerifier.h) uses to verify the PayloadCRC16 chunk.
+
+    Usage: Utility_Crc16Benchmark [width] [height] [iterations]
+
+    First, every kernel is checked: the CRC of "123456789" must be 0x31C3, and the CRC must be
+    the same as the one of the scalar reference for all lengths from 0 to 1024 bytes at all 16
+    start offsets, also when continuing from a previous CRC. Then the throughput of each kernel
+    is measured on a Mono8 frame of the given size (default 2048 x 1088, acA2000-165um) and
+    compared with the data rate of the camera at 165 frames/s.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include "../include/Crc16.h"
+
+// Namespace for using cout.
+using namespace std;
+
+// The maximum frame rate of the acA2000-165um at full resolution.
+static const double c_cameraFps = 165.0;
+
+static double GetSeconds()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool CheckKernel( Crc16::EKernel kernel, const vector<uint8_t>& data)
+{
+    const char checkString[] = "123456789";
+    const uint16_t checkValue = Crc16::Compute( checkString, 9, 0, kernel);
+    if ( checkValue != 0x31C3 )
+    {
+        cerr << Crc16::GetKernelName( kernel) << ": the check value is 0x" << hex << checkValue << dec << " instead of 0x31C3." << endl;
+        return false;
+    }
+
+    for ( size_t offset = 0; offset < 16; ++offset )
+    {
+        for ( size_t length = 0; length <= 1024; ++length )
+        {
+            const uint16_t previous = (uint16_t) (length * 2654435761u >> 16);
+            const uint16_t reference = Crc16::ComputeScalar( &data[offset], length, previous);
+            if ( Crc16::Compute( &data[offset], length, previous, kernel) != reference )
+            {
+                cerr << Crc16::GetKernelName( kernel) << ": the CRC of " << length << " bytes at offset " << offset << " differs from the reference." << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t width = argc > 1 ? strtoul( argv[1], NULL, 10) : 2048;
+    const size_t height = argc > 2 ? strtoul( argv[2], NULL, 10) : 1088;
+    const int iterations = argc > 3 ? atoi( argv[3]) : 200;
+    const size_t frameSize = width * height;
+    if ( frameSize < 1040 || iterations <= 0 )
+    {
+        cerr << "Usage: " << argv[0] << " [width] [height] [iterations], at least 1040 pixels" << endl;
+        return 1;
+    }
+
+    vector<uint8_t> frame( frameSize);
+    srand( 1);
+    for ( size_t i = 0; i < frameSize; ++i )
+    {
+        frame[i] = (uint8_t) rand();
+    }
+
+    Crc16::EKernel kernels[] = { Crc16::Kernel_Scalar, Crc16::Kernel_Sliced, Crc16::Kernel_Pclmul };
+    const size_t kernelCount = Crc16::GetBestKernel() == Crc16::Kernel_Pclmul ? 3 : 2;
+    for ( size_t k = 0; k < kernelCount; ++k )
+    {
+        if ( !CheckKernel( kernels[k], frame) )
+        {
+            return 1;
+        }
+    }
+    cout << "The CRC is the same for all " << kernelCount << " kernels." << endl;
+
+    // Benchmark.
+    const double cameraRate = frameSize * c_cameraFps / 1e6;
+    cout << "Frame " << width << " x " << height << ", " << iterations << " iterations, camera data rate " << fixed << setprecision( 1)
+         << cameraRate << " MB/s" << endl;
+    cout << setw( 8) << "Kernel" << setw( 12) << "MB/s" << setw( 12) << "x camera" << setw( 10) << "CRC" << endl;
+    for ( size_t k = 0; k < kernelCount; ++k )
+    {
+        uint16_t crc = 0;
+        const double start = GetSeconds();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            crc = Crc16::Compute( &frame[0], frameSize, 0, kernels[k]);
+        }
+        const double rate = frameSize * (double) iterations / (GetSeconds() - start) / 1e6;
+        cout << setw( 8) << Crc16::GetKernelName( kernels[k]) << setw( 12) << rate << setw( 12) << rate / cameraRate
+             << "    0x" << hex << setw( 4) << setfill( '0') << crc << dec << setfill( ' ') << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+// Utility_EventJournal.cpp
+/*
+    This utility prints event journal files written by CEventJournal (EventJournal.h), e.g. by
+    the Grab_UsingExposureEndEvent sample, and benchmarks the journal.
+
+    Usage: Utility_EventJournal <journal file>
+           Utility_EventJournal -bench [threads] [events per thread]
+
+    Printing shows the events sorted by time with the time since the previous event in ms, the
+    event name and the frame number, followed by the number of dropped events.
+
+    The benchmark records events from the given number of threads (default 2) into a journal
+    written to the current directory, as the camera event and image grab threads would do. It
+    reports the cost of Record() per call, and then reads the journal back and checks that no
+    event has been lost or reordered within a thread apart from those counted as dropped. With
+    more threads than cores, the maximum cost includes the time a thread was preempted between
+    two clock readings.
+*/
+
+// Include files to use the PYLON API.
+#include <pylon/PylonIncludes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <iomanip>
+#include "../include/EventJournal.h"
+#include "../include/LatencyHistogram.h"
+
+// Namespace for using the journal.
+using namespace Pylon;
+
+// Namespace for using cout.
+using namespace std;
+
+// Calls of Record() timed together, so the clock readings of the benchmark don't dominate.
+static const uint64_t c_callsPerSample = 16;
+
+static void RecordEvents( CEventJournal& journal, uint32_t eventType, uint64_t events, atomic<bool>& go, CLatencyHistogram& histogram)
+{
+    while ( !go.load() )
+    {
+    }
+    for ( uint64_t i = 0; i < events; i += c_callsPerSample )
+    {
+        const uint64_t startNs = GetMonotonicTimeNs();
+        for ( uint64_t j = i; j < i + c_callsPerSample; ++j )
+        {
+            journal.Record( eventType, j);
+        }
+        histogram.Record( (GetMonotonicTimeNs() - startNs) / c_callsPerSample);
+    }
+}
+
+static int RunBenchmark( unsigned int threadCount, uint64_t eventsPerThread)
+{
+    const char c_filename[] = "Utility_EventJournal_bench.journal";
+    eventsPerThread = (eventsPerThread + c_callsPerSample - 1) / c_callsPerSample * c_callsPerSample;
+
+    CEventJournal journal;
+    for ( unsigned int i = 0; i < threadCount && i < c_eventJournalMaxEventTypes; ++i )
+    {
+        char name[32];
+        snprintf( name, sizeof( name), "Thread%u", i);
+        journal.SetEventName( i, name);
+    }
+    journal.Open( c_filename);
+
+    vector<CLatencyHistogram> histograms( threadCount);
+    vector<thread> threads;
+    atomic<bool> go( false);
+    for ( unsigned int i = 0; i < threadCount; ++i )
+    {
+        threads.push_back( thread( RecordEvents, ref( journal), i, eventsPerThread, ref( go), ref( histograms[i])));
+    }
+    const uint64_t startNs = GetMonotonicTimeNs();
+    go = true;
+    for ( size_t i = 0; i < threads.size(); ++i )
+    {
+        threads[i].join();
+    }
+    const uint64_t elapsedNs = GetMonotonicTimeNs() - startNs;
+    journal.Close();
+
+    CLatencyHistogram cost;
+    for ( size_t i = 0; i < histograms.size(); ++i )
+    {
+        cost.Merge( histograms[i]);
+    }
+    const uint64_t total = eventsPerThread * threadCount;
+    cout << threadCount << " threads, " << total << " events in " << fixed << setprecision( 3) << elapsedNs / 1e6 << " ms, "
+         << total * 1e3 / elapsedNs << " M events/s" << endl;
+    cost.Print( cout, "Record() per call", 1.0, "ns");
+
+    // Check the journal: every thread's values must be increasing and complete except for drops.
+    CEventJournalReader reader( c_filename);
+    unlink( c_filename);
+    const vector<SEventJournalRecord>& records = reader.GetRecords();
+    map<uint32_t, uint64_t> lastValue;
+    bool ordered = true;
+    for ( size_t i = 0; i < records.size(); ++i )
+    {
+        map<uint32_t, uint64_t>::iterator it = lastValue.find( records[i].threadId);
+        if ( it != lastValue.end() && records[i].value <= it->second )
+        {
+            ordered = false;
+        }
+        lastValue[ records[i].threadId ] = records[i].value;
+    }
+    const uint64_t dropped = reader.GetHeader().droppedCount;
+    cout << records.size() << " events written, " << dropped << " dropped" << endl;
+    if ( !ordered || records.size() + dropped != total || reader.IsRecovered() )
+    {
+        cerr << "The journal is inconsistent." << endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    // The exit code of the sample application.
+    int exitCode = 0;
+
+    if ( argc < 2 )
+    {
+        cerr << "Usage: " << argv[0] << " <journal file>" << endl
+             << "       " << argv[0] << " -bench [threads] [events per thread]" << endl;
+        return 1;
+    }
+
+    try
+    {
+        if ( strcmp( argv[1], "-bench") == 0 )
+        {
+            const unsigned int threadCount = argc > 2 ? (unsigned int) strtoul( argv[2], NULL, 10) : 2;
+            const uint64_t eventsPerThread = argc > 3 ? strtoull( argv[3], NULL, 10) : 10000;
+            exitCode = RunBenchmark( threadCount ? threadCount : 1, eventsPerThread);
+        }
+        else
+        {
+            CEventJournalReader( argv[1]).Print( cout);
+        }
+    }
+    catch (const GenericException &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.GetDescription() << endl;
+        exitCode = 1;
+    }
+
+    return exitCode;
+}
@@ -0,0 +1,198 @@
+// Utility_ExposureControlSimulation.cpp
+/*
+    This utility measures the burst histogram of CExposureController (ExposureController.h) and
+    runs the controller in a closed loop against a simulated camera.
+
+    Usage: Utility_ExposureControlSimulation [width] [height] [bursts]
+
+    First, the time to add one frame (default 2048 x 1088 pixels) to the histogram is printed
+    for Mono8 and Mono12, for every line and for every 8th line (the default), with the scalar
+    and the AVX2 kernel. Both kernels must count the same bins.
+
+    Then bursts of 6 Mono12 frames of a quarter of the size in each direction are simulated
+    (default 60 bursts), starting at 1000 us and 23.06 dB like the burst program. The scene gets
+    10 times darker after a third of the bursts and 20 times brighter after two thirds. For each
+    burst, the exposure time and gain used, the measured 99th percentile, the saturated pixels
+    and whether new values were written are printed.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <exception>
+#include <iostream>
+#include <iomanip>
+#include "../include/ExposureController.h"
+
+// Namespace for using the controller.
+using namespace Pylon;
+
+// Namespace for using cout.
+using namespace std;
+
+static const uint32_t c_framesPerBurst = 6;
+static const uint32_t c_timedFrames = 50;
+
+// Counts the bins of a whole frame with the given kernel.
+template <typename T>
+static vector<uint32_t> CountFrame( const vector<T>& frame, uint32_t width, uint32_t height, HistogramKernels::EKernel kernel, uint64_t& saturated)
+{
+    vector<uint32_t> bins( 4 * HistogramKernels::c_binCount, 0);
+    saturated = 0;
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        HistogramKernels::AddRow( &frame[ (size_t) y * width ], width, &bins[0], saturated, kernel);
+    }
+    return bins;
+}
+
+template <typename T>
+static bool MeasureHistogram( const char* name, uint32_t bitsPerPixel, uint32_t width, uint32_t height)
+{
+    const uint32_t maxValue = (1u << bitsPerPixel) - 1;
+    vector<T> frame( (size_t) width * height);
+    srand( 1);
+    for ( size_t i = 0; i < frame.size(); ++i )
+    {
+        // A ramp with a saturated stripe at the right.
+        const uint32_t x = (uint32_t) (i % width);
+        frame[i] = (T) (x > width - width / 16 ? maxValue : (x * maxValue / width + rand() % 8) % (maxValue + 1));
+    }
+
+    const HistogramKernels::EKernel kernels[2] = { HistogramKernels::Kernel_Scalar, HistogramKernels::Kernel_Avx2 };
+    const uint32_t rowSteps[2] = { 1, SExposureControlSettings().rowStep };
+    cout << setw( 7) << name;
+    for ( int step = 0; step < 2; ++step )
+    {
+        for ( int k = 0; k < 2; ++k )
+        {
+            if ( kernels[k] == HistogramKernels::Kernel_Avx2 && HistogramKernels::GetBestKernel() != HistogramKernels::Kernel_Avx2 )
+            {
+                cout << setw( 14) << "-";
+                continue;
+            }
+            SExposureControlSettings settings;
+            settings.rowStep = rowSteps[ step ];
+            CExposureController controller( settings, kernels[k]);
+            const uint64_t startNs = GetMonotonicTimeNs();
+            for ( uint32_t i = 0; i < c_timedFrames; ++i )
+            {
+                controller.AddFrame( &frame[0], width, height, 0, bitsPerPixel);
+            }
+            cout << setw( 14) << (GetMonotonicTimeNs() - startNs) / 1e6 / c_timedFrames;
+        }
+    }
+
+    bool equal = true;
+    if ( HistogramKernels::GetBestKernel() == HistogramKernels::Kernel_Avx2 )
+    {
+        uint64_t scalarSaturated = 0;
+        uint64_t simdSaturated = 0;
+        const vector<uint32_t> scalar = CountFrame( frame, width, height, HistogramKernels::Kernel_Scalar, scalarSaturated);
+        const vector<uint32_t> simd = CountFrame( frame, width, height, HistogramKernels::Kernel_Avx2, simdSaturated);
+        // The AVX2 kernel may count a bin in another of the four tables.
+        for ( size_t bin = 0; bin < HistogramKernels::c_binCount; ++bin )
+        {
+            uint64_t scalarCount = 0;
+            uint64_t simdCount = 0;
+            for ( size_t table = 0; table < 4; ++table )
+            {
+                scalarCount += scalar[ table * HistogramKernels::c_binCount + bin ];
+                simdCount += simd[ table * HistogramKernels::c_binCount + bin ];
+            }
+            equal = equal && scalarCount == simdCount;
+        }
+        equal = equal && scalarSaturated == simdSaturated;
+    }
+    cout << (equal ? "  equal" : "  DIFFERENT") << endl;
+    return equal;
+}
+
+// Simulates bursts of a scene whose brightness changes twice.
+static void Simulate( uint32_t width, uint32_t height, uint32_t burstCount)
+{
+    // The scene: a horizontal gradient with a small bright spot, in gray values per us of
+    // exposure at 0 dB.
+    vector<double> scene( (size_t) width * height);
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        for ( uint32_t x = 0; x < width; ++x )
+        {
+            const bool spot = x > width / 2 && x < width / 2 + width / 20 && y > height / 2 && y < height / 2 + height / 20;
+            scene[ (size_t) y * width + x ] = (0.02 + 0.3 * x / width) * (spot ? 3.0 : 1.0);
+        }
+    }
+
+    const SExposureControlSettings settings;
+    CExposureController controller( settings);
+    double exposureUs = 1000.0;
+    double gainDb = 23.06;
+    uint32_t writes = 0;
+    vector<uint16_t> frame( scene.size());
+    srand( 2);
+    cout << endl << "Closed loop, " << c_framesPerBurst << " frames of " << width << " x " << height << " per burst" << endl;
+    cout << setw( 6) << "Burst" << setw( 8) << "Scene" << setw( 12) << "Exposure" << setw( 10) << "Gain" << setw( 8) << "P99"
+         << setw( 12) << "Saturated" << "  Write" << endl;
+    cout << fixed;
+    for ( uint32_t burst = 0; burst < burstCount; ++burst )
+    {
+        const double sceneScale = burst < burstCount / 3 ? 1.0 : (burst < 2 * burstCount / 3 ? 0.1 : 2.0);
+        const double sensitivity = exposureUs * pow( 10.0, gainDb / 20.0) * sceneScale;
+        for ( uint32_t i = 0; i < c_framesPerBurst; ++i )
+        {
+            for ( size_t p = 0; p < frame.size(); ++p )
+            {
+                const double value = scene[p] * sensitivity + (rand() % 9) - 4;
+                frame[p] = (uint16_t) min( 4095.0, max( 0.0, value));
+            }
+            controller.AddFrame( &frame[0], width, height, 0, 12);
+        }
+
+        const SExposureUpdate update = controller.Update( exposureUs, gainDb);
+        cout << setw( 6) << burst << setw( 8) << setprecision( 1) << sceneScale << setw( 9) << setprecision( 0) << exposureUs << " us"
+             << setw( 7) << setprecision( 2) << gainDb << " dB" << setw( 8) << update.highLevel << setw( 10) << setprecision( 3)
+             << 100.0 * update.saturatedFraction << " %" << (update.write ? "  yes" : "") << endl;
+        if ( update.write )
+        {
+            exposureUs = update.exposureUs;
+            gainDb = update.gainDb;
+            ++writes;
+        }
+    }
+    cout << writes << " parameter writes in " << burstCount << " bursts" << endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const uint32_t width = argc > 1 ? (uint32_t) strtoul( argv[1], NULL, 10) : 2048;
+    const uint32_t height = argc > 2 ? (uint32_t) strtoul( argv[2], NULL, 10) : 1088;
+    const uint32_t burstCount = argc > 3 ? (uint32_t) strtoul( argv[3], NULL, 10) : 60;
+    if ( width == 0 || height == 0 || burstCount == 0 )
+    {
+        cerr << "Usage: " << argv[0] << " [width] [height] [bursts]" << endl;
+        return 1;
+    }
+
+    try
+    {
+        cout << "Histogram time per " << width << " x " << height << " frame in ms" << endl;
+        cout << setw( 7) << "Format" << setw( 14) << "Scalar" << setw( 14) << "AVX2" << setw( 14) << "Scalar 1/" << SExposureControlSettings().rowStep
+             << setw( 13) << "AVX2 1/" << SExposureControlSettings().rowStep << endl;
+        cout << fixed << setprecision( 3);
+        bool equal = MeasureHistogram<uint8_t>( "Mono8", 8, width, height);
+        equal = MeasureHistogram<uint16_t>( "Mono12", 12, width, height) && equal;
+
+        // The closed loop runs on a quarter of the size in each direction to keep it short.
+        Simulate( max( width / 4, 32u), max( height / 4, 32u), burstCount);
+        return equal ? 0 : 1;
+    }
+    catch (const std::exception &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,288 @@
+// Utility_FlatFieldCorrection.cpp
+/*
+    This utility corrects frames on the host with per-pixel dark offset and gain maps
+    (FlatFieldCorrection.h), for cameras without shading correction or when a per-column
+    correction (see ParametrizeCamera_Shading) is not sufficient.
+
+    Usage: Utility_FlatFieldCorrection -calibrate <map file> [frames]
+           Utility_FlatFieldCorrection -apply <map file> [frames]
+           Utility_FlatFieldCorrection -bench [width] [height] [frames]
+
+    -calibrate averages frames (default 16) of the first camera found with the lens covered and
+    then of a uniformly lit scene, and writes the maps to the file. The camera must grab Mono8
+    or Mono12 with the same settings later used for -apply.
+    -apply loads the maps and corrects grabbed frames (default 100) in place; the correction
+    time and throughput are printed.
+    -bench needs no camera. It corrects synthetic Mono8 and Mono12 frames (default 4096 x 3072,
+    100 frames) with each kernel, prints the throughput in GB/s (frame bytes corrected per
+    second), and checks that the SIMD kernels give the results of the scalar kernel.
+*/
+
+// Include files to use the PYLON API.
+#include <pylon/PylonIncludes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include "../include/FlatFieldCorrection.h"
+#include "../include/LatencyHistogram.h"
+
+// Namespace for using pylon objects.
+using namespace Pylon;
+
+// Namespace for using cout.
+using namespace std;
+
+static void PrintUsage( const char* program)
+{
+    cerr << "Usage: " << program << " -calibrate <map file> [frames]" << endl
+         << "       " << program << " -apply <map file> [frames]" << endl
+         << "       " << program << " -bench [width] [height] [frames]" << endl;
+}
+
+static EShadingFormat GetFormat( EPixelType pixelType)
+{
+    if ( pixelType == PixelType_Mono8 )
+    {
+        return ShadingFormat_Mono8;
+    }
+    if ( pixelType == PixelType_Mono12 )
+    {
+        return ShadingFormat_Mono12;
+    }
+    throw RUNTIME_EXCEPTION( "Only Mono8 and Mono12 frames can be corrected.");
+}
+
+// Returns the distance between the starts of two lines of the grab result in bytes.
+static size_t GetStride( const CGrabResultPtr& ptrGrabResult)
+{
+    const size_t bytesPerPixel = GetFormat( ptrGrabResult->GetPixelType()) == ShadingFormat_Mono8 ? 1 : 2;
+    return (size_t) ptrGrabResult->GetWidth() * bytesPerPixel + ptrGrabResult->GetPaddingX();
+}
+
+// Grabs the next frame and checks that it has been grabbed successfully.
+static void RetrieveFrame( CInstantCamera& camera, CGrabResultPtr& ptrGrabResult)
+{
+    camera.RetrieveResult( 5000, ptrGrabResult, TimeoutHandling_ThrowException);
+    if ( !ptrGrabResult->GrabSucceeded() )
+    {
+        throw RUNTIME_EXCEPTION( "Grabbing failed: %s", ptrGrabResult->GetErrorDescription().c_str());
+    }
+}
+
+static void WaitForEnter( const char* prompt)
+{
+    cout << prompt << " Press Enter to continue." << endl;
+    while ( cin.get() != '\n' );
+}
+
+static void Calibrate( const char* filename, size_t frameCount)
+{
+    CInstantCamera camera( CTlFactory::GetInstance().CreateFirstDevice());
+    cout << "Using device " << camera.GetDeviceInfo().GetModelName() << endl;
+    camera.Open();
+
+    CGrabResultPtr ptrGrabResult;
+    WaitForEnter( "Cover the lens for the dark frames.");
+    camera.StartGrabbing( frameCount);
+    RetrieveFrame( camera, ptrGrabResult);
+    CFlatFieldCalibrator calibrator( ptrGrabResult->GetWidth(), ptrGrabResult->GetHeight(), GetFormat( ptrGrabResult->GetPixelType()));
+    calibrator.AddDarkFrame( ptrGrabResult->GetBuffer(), GetStride( ptrGrabResult));
+    while ( camera.IsGrabbing() )
+    {
+        RetrieveFrame( camera, ptrGrabResult);
+        calibrator.AddDarkFrame( ptrGrabResult->GetBuffer(), GetStride( ptrGrabResult));
+    }
+
+    WaitForEnter( "Point the camera at a uniformly lit, unsaturated scene for the flat frames.");
+    camera.StartGrabbing( frameCount);
+    while ( camera.IsGrabbing() )
+    {
+        RetrieveFrame( camera, ptrGrabResult);
+        calibrator.AddFlatFrame( ptrGrabResult->GetBuffer(), GetStride( ptrGrabResult));
+    }
+    ptrGrabResult.Release();
+    camera.Close();
+
+    const CFlatFieldCorrector corrector = calibrator.CreateCorrector();
+    corrector.Save( filename);
+    cout << "Averaged " << calibrator.GetDarkFrameCount() << " dark and " << calibrator.GetFlatFrameCount() << " flat frames of "
+         << corrector.GetWidth() << " x " << corrector.GetHeight() << " pixels, " << corrector.GetDefectivePixelCount()
+         << " defective pixels. Maps written to " << filename << "." << endl;
+}
+
+static void Apply( const char* filename, size_t frameCount)
+{
+    const CFlatFieldCorrector corrector = CFlatFieldCorrector::Load( filename);
+    CInstantCamera camera( CTlFactory::GetInstance().CreateFirstDevice());
+    cout << "Using device " << camera.GetDeviceInfo().GetModelName() << ", "
+         << FlatFieldKernels::GetKernelName( FlatFieldKernels::Kernel_Auto) << " kernel" << endl;
+    camera.Open();
+
+    CLatencyHistogram correctionTime;
+    uint64_t correctedBytes = 0;
+    uint64_t totalCorrectionNs = 0;
+    const uint64_t grabStartNs = GetMonotonicTimeNs();
+    CGrabResultPtr ptrGrabResult;
+    camera.StartGrabbing( frameCount);
+    while ( camera.IsGrabbing() )
+    {
+        RetrieveFrame( camera, ptrGrabResult);
+        if ( ptrGrabResult->GetWidth() != corrector.GetWidth() || ptrGrabResult->GetHeight() != corrector.GetHeight()
+            || GetFormat( ptrGrabResult->GetPixelType()) != corrector.GetFormat() )
+        {
+            throw RUNTIME_EXCEPTION( "The frames do not match the maps in %s.", filename);
+        }
+
+        // The grab buffer is corrected in place.
+        const uint64_t startNs = GetMonotonicTimeNs();
+        corrector.Apply( ptrGrabResult->GetBuffer(), GetStride( ptrGrabResult));
+        const uint64_t durationNs = GetMonotonicTimeNs() - startNs;
+        correctionTime.Record( durationNs);
+        totalCorrectionNs += durationNs;
+        correctedBytes += (uint64_t) corrector.GetWidth() * corrector.GetHeight() * corrector.GetBytesPerPixel();
+    }
+    const double grabSeconds = (GetMonotonicTimeNs() - grabStartNs) / 1e9;
+    ptrGrabResult.Release();
+    camera.Close();
+
+    cout << fixed << setprecision( 2);
+    cout << correctionTime.GetCount() << " frames grabbed at " << correctionTime.GetCount() / grabSeconds << " fps, corrected at "
+         << (totalCorrectionNs != 0 ? (double) correctedBytes / totalCorrectionNs : 0.0) << " GB/s" << endl;
+    correctionTime.Print( cout, "Correction time per frame");
+}
+
+// Creates maps with a vignetting gain profile and dark offsets around 2 % of the range.
+static CFlatFieldCorrector CreateMaps( uint32_t width, uint32_t height, EShadingFormat format)
+{
+    const uint32_t maxValue = format == ShadingFormat_Mono8 ? 255 : 4095;
+    vector<uint16_t> dark( (size_t) width * height);
+    vector<uint16_t> gain( dark.size());
+    srand( 1);
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        for ( uint32_t x = 0; x < width; ++x )
+        {
+            const double dx = (2.0 * x - width) / width;
+            const double dy = (2.0 * y - height) / height;
+            const size_t i = (size_t) y * width + x;
+            dark[i] = (uint16_t) (maxValue / 50 + rand() % 5);
+            gain[i] = (uint16_t) (FlatFieldKernels::c_unityGain * (1.0 + 0.4 * (dx * dx + dy * dy)) + rand() % 64);
+        }
+    }
+    return CFlatFieldCorrector( width, height, format, dark, gain);
+}
+
+template <typename T>
+static bool Benchmark( const char* name, EShadingFormat format, uint32_t width, uint32_t height, size_t frameCount)
+{
+    const uint32_t maxValue = format == ShadingFormat_Mono8 ? 255 : 4095;
+    CFlatFieldCorrector corrector = CreateMaps( width, height, format);
+    vector<T> source( (size_t) width * height);
+    for ( size_t i = 0; i < source.size(); ++i )
+    {
+        source[i] = (T) (rand() % (maxValue + 1));
+    }
+
+    const FlatFieldKernels::EKernel kernels[3] = { FlatFieldKernels::Kernel_Scalar, FlatFieldKernels::Kernel_Ssse3, FlatFieldKernels::Kernel_Avx2 };
+    const bool supported[3] = { true, __builtin_cpu_supports( "ssse3") != 0, __builtin_cpu_supports( "avx2") != 0 };
+    vector<T> reference;
+    bool equal = true;
+    cout << setw( 7) << name;
+    for ( int k = 0; k < 3; ++k )
+    {
+        if ( !supported[k] )
+        {
+            cout << setw( 12) << "-";
+            continue;
+        }
+        corrector.SetKernel( kernels[k]);
+
+        // The first correction is checked; the frame is then corrected repeatedly in place,
+        // which takes the same time per frame as fresh data would.
+        vector<T> frame( source);
+        corrector.Apply( &frame[0]);
+        if ( reference.empty() )
+        {
+            reference = frame;
+        }
+        else if ( frame != reference )
+        {
+            equal = false;
+        }
+
+        const uint64_t startNs = GetMonotonicTimeNs();
+        for ( size_t i = 0; i < frameCount; ++i )
+        {
+            corrector.Apply( &frame[0]);
+        }
+        const uint64_t durationNs = GetMonotonicTimeNs() - startNs;
+        cout << setw( 12) << (double) frame.size() * sizeof( T) * frameCount / max( durationNs, (uint64_t) 1);
+    }
+    cout << (equal ? "  equal" : "  DIFFERENT") << endl;
+    return equal;
+}
+
+
+int main(int argc, char* argv[])
+{
+    // The exit code of the sample application.
+    int exitCode = 0;
+
+    if ( argc < 2 || ((strcmp( argv[1], "-calibrate") == 0 || strcmp( argv[1], "-apply") == 0) && argc < 3) )
+    {
+        PrintUsage( argv[0]);
+        return 1;
+    }
+
+    if ( strcmp( argv[1], "-bench") == 0 )
+    {
+        const uint32_t width = argc > 2 ? (uint32_t) strtoul( argv[2], NULL, 10) : 4096;
+        const uint32_t height = argc > 3 ? (uint32_t) strtoul( argv[3], NULL, 10) : 3072;
+        const size_t frameCount = argc > 4 ? strtoul( argv[4], NULL, 10) : 100;
+        if ( width == 0 || height == 0 || frameCount == 0 )
+        {
+            PrintUsage( argv[0]);
+            return 1;
+        }
+        cout << frameCount << " frames of " << width << " x " << height << " pixels, throughput in GB/s" << endl;
+        cout << setw( 7) << "Format" << setw( 12) << "Scalar" << setw( 12) << "SSSE3" << setw( 12) << "AVX2" << endl;
+        cout << fixed << setprecision( 2);
+        bool equal = Benchmark<uint8_t>( "Mono8", ShadingFormat_Mono8, width, height, frameCount);
+        equal = Benchmark<uint16_t>( "Mono12", ShadingFormat_Mono12, width, height, frameCount) && equal;
+        return equal ? 0 : 1;
+    }
+
+    const size_t frameCount = argc > 3 ? strtoul( argv[3], NULL, 10) : (strcmp( argv[1], "-apply") == 0 ? 100 : 16);
+
+    // Automagically call PylonInitialize and PylonTerminate to ensure the pylon runtime system
+    // is initialized during the lifetime of this object.
+    Pylon::PylonAutoInitTerm autoInitTerm;
+
+    try
+    {
+        if ( strcmp( argv[1], "-calibrate") == 0 )
+        {
+            Calibrate( argv[2], frameCount);
+        }
+        else if ( strcmp( argv[1], "-apply") == 0 )
+        {
+            Apply( argv[2], frameCount);
+        }
+        else
+        {
+            PrintUsage( argv[0]);
+            exitCode = 1;
+        }
+    }
+    catch (const GenericException &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.GetDescription() << endl;
+        exitCode = 1;
+    }
+
+    return exitCode;
+}
@@ -0,0 +1,329 @@
+// Utility_GrabStrategyBenchmark.cpp
+/*
+    This utility measures how the grab strategies shown in Grab_Strategies behave under load,
+    to choose the strategy and the buffer settings for an application.
+
+    Usage: Utility_GrabStrategyBenchmark [-duration s] [-fps rate] [-buffers list] [-queue list] [-cost list]
+
+    Lists are comma separated, e.g. -buffers 2,5,10. The camera emulator (set PYLON_CAMEMU=1)
+    acquires continuously, at the given frame rate if set. For every combination of
+    * grab strategy (OneByOne, LatestImageOnly, LatestImages, UpcomingImage),
+    * MaxNumBuffer (-buffers, default 2,5,10),
+    * OutputQueueSize (-queue, default 1,4; LatestImages only, must not exceed MaxNumBuffer),
+    * processing time per frame in ms (-cost, default 0,2,10; simulated by busy waiting),
+    frames are grabbed with RetrieveResult() for the given duration (default 2 s).
+
+    Printed is one table row per combination: the frame rate delivered to the application,
+    the images skipped by the strategy (OnImagesSkipped), the time spent waiting in
+    RetrieveResult() (p50/p99), the age of the delivered images (p50/p99, from the image time
+    stamp via CCameraClockCorrelator, if the device can latch its time stamp), and the CPU
+    load of the process in percent of one core.
+*/
+
+// Include files to use the PYLON API.
+#include <pylon/PylonIncludes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <memory>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include "../include/ClockCorrelation.h"
+#include "../include/LatencyHistogram.h"
+
+// Namespace for using pylon objects.
+using namespace Pylon;
+
+// Namespace for using GenApi objects.
+using namespace GenApi;
+
+// Namespace for using cout.
+using namespace std;
+
+// Counts the images skipped by the grab strategies.
+class CSkippedImageCounter : public CImageEventHandler
+{
+public:
+    CSkippedImageCounter()
+        : m_skipped( 0)
+    {
+    }
+
+    virtual void OnImagesSkipped( CInstantCamera& /*camera*/, size_t countOfSkippedImages)
+    {
+        m_skipped += countOfSkippedImages;
+    }
+
+    // Returns the count since the last call. RetrieveResult() calls the handler, so no locking
+    // is needed as long as the same thread calls both.
+    uint64_t TakeCount()
+    {
+        const uint64_t skipped = m_skipped;
+        m_skipped = 0;
+        return skipped;
+    }
+
+private:
+    uint64_t m_skipped;
+};
+
+// The result of one combination of settings.
+struct SCellResult
+{
+    double framesPerSecond;
+    uint64_t skipped;
+    CLatencyHistogram wait;
+    CLatencyHistogram age;
+    double cpuPercent;
+};
+
+static double GetCpuSeconds()
+{
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+static vector<double> ParseList( const char* text)
+{
+    vector<double> values;
+    stringstream stream( text);
+    string item;
+    while ( getline( stream, item, ',') )
+    {
+        values.push_back( atof( item.c_str()));
+    }
+    return values;
+}
+
+static const char* GetStrategyName( EGrabStrategy strategy)
+{
+    switch ( strategy )
+    {
+    case GrabStrategy_OneByOne:
+        return "OneByOne";
+    case GrabStrategy_LatestImageOnly:
+        return "LatestImageOnly";
+    case GrabStrategy_LatestImages:
+        return "LatestImages";
+    case GrabStrategy_UpcomingImage:
+        return "UpcomingImage";
+    default:
+        return "?";
+    }
+}
+
+static void RunCell( CInstantCamera& camera, CSkippedImageCounter& skippedCounter, const CCameraClockCorrelator* pCorrelator,
+    EGrabStrategy strategy, double costMs, double durationSeconds, SCellResult& result)
+{
+    const uint64_t costNs = (uint64_t) (costMs * 1e6);
+    const uint64_t durationNs = (uint64_t) (durationSeconds * 1e9);
+    uint64_t frames = 0;
+
+    camera.StartGrabbing( strategy);
+    skippedCounter.TakeCount();
+    const double cpuStart = GetCpuSeconds();
+    const uint64_t startNs = GetMonotonicTimeNs();
+    uint64_t nowNs = startNs;
+    CGrabResultPtr ptrGrabResult;
+    while ( nowNs - startNs < durationNs )
+    {
+        const uint64_t waitStartNs = GetMonotonicTimeNs();
+        camera.RetrieveResult( 5000, ptrGrabResult, TimeoutHandling_ThrowException);
+        nowNs = GetMonotonicTimeNs();
+        result.wait.Record( nowNs - waitStartNs);
+        if ( !ptrGrabResult->GrabSucceeded() )
+        {
+            continue;
+        }
+        ++frames;
+        if ( pCorrelator != NULL )
+        {
+            const uint64_t imageNs = pCorrelator->GetHostTimeNs( ptrGrabResult);
+            result.age.Record( nowNs > imageNs ? nowNs - imageNs : 0);
+        }
+
+        // Simulated processing.
+        while ( GetMonotonicTimeNs() - nowNs < costNs )
+        {
+        }
+        nowNs = GetMonotonicTimeNs();
+    }
+    const double elapsedSeconds = (nowNs - startNs) * 1e-9;
+    result.cpuPercent = 100.0 * (GetCpuSeconds() - cpuStart) / elapsedSeconds;
+    ptrGrabResult.Release();
+    camera.StopGrabbing();
+
+    result.framesPerSecond = frames / elapsedSeconds;
+    result.skipped = skippedCounter.TakeCount();
+}
+
+static void PrintRow( EGrabStrategy strategy, int64_t buffers, int64_t queue, double costMs, const SCellResult& result)
+{
+    cout << setw( 16) << GetStrategyName( strategy)
+         << setw( 8) << buffers
+         << setw( 6) << queue
+         << setw( 9) << costMs
+         << setw( 9) << result.framesPerSecond
+         << setw( 9) << result.skipped
+         << setw( 10) << result.wait.GetPercentile( 50.0) / 1000.0
+         << setw( 10) << result.wait.GetPercentile( 99.0) / 1000.0;
+    if ( result.age.GetCount() != 0 )
+    {
+        cout << setw( 10) << result.age.GetPercentile( 50.0) / 1e6
+             << setw( 10) << result.age.GetPercentile( 99.0) / 1e6;
+    }
+    else
+    {
+        cout << setw( 10) << "-" << setw( 10) << "-";
+    }
+    cout << setw( 7) << result.cpuPercent << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    // The exit code of the sample application.
+    int exitCode = 0;
+
+    double durationSeconds = 2.0;
+    double frameRate = 0.0;
+    vector<double> bufferCounts = ParseList( "2,5,10");
+    vector<double> queueSizes = ParseList( "1,4");
+    vector<double> costsMs = ParseList( "0,2,10");
+    for ( int i = 1; i + 1 < argc; i += 2 )
+    {
+        if ( strcmp( argv[i], "-duration") == 0 )
+        {
+            durationSeconds = atof( argv[i + 1]);
+        }
+        else if ( strcmp( argv[i], "-fps") == 0 )
+        {
+            frameRate = atof( argv[i + 1]);
+        }
+        else if ( strcmp( argv[i], "-buffers") == 0 )
+        {
+            bufferCounts = ParseList( argv[i + 1]);
+        }
+        else if ( strcmp( argv[i], "-queue") == 0 )
+        {
+            queueSizes = ParseList( argv[i + 1]);
+        }
+        else if ( strcmp( argv[i], "-cost") == 0 )
+        {
+            costsMs = ParseList( argv[i + 1]);
+        }
+    }
+
+    // Automagically call PylonInitialize and PylonTerminate to ensure the pylon runtime system
+    // is initialized during the lifetime of this object.
+    Pylon::PylonAutoInitTerm autoInitTerm;
+
+    try
+    {
+        // The counter must outlive the camera, which calls it.
+        CSkippedImageCounter skippedCounter;
+
+        // Only look for the camera emulator.
+        CDeviceInfo info;
+        info.SetDeviceClass( BaslerCamEmuDeviceClass);
+        CInstantCamera camera( CTlFactory::GetInstance().CreateFirstDevice( info));
+        cout << "Using device " << camera.GetDeviceInfo().GetModelName() << endl;
+        camera.RegisterImageEventHandler( &skippedCounter, RegistrationMode_Append, Cleanup_None);
+        camera.Open();
+
+        if ( frameRate > 0.0 )
+        {
+            CBooleanPtr frameRateEnable( camera.GetNodeMap().GetNode( "AcquisitionFrameRateEnable"));
+            CFloatPtr acquisitionFrameRate( camera.GetNodeMap().GetNode( "AcquisitionFrameRateAbs"));
+            if ( IsWritable( frameRateEnable) )
+            {
+                frameRateEnable->SetValue( true);
+            }
+            if ( IsWritable( acquisitionFrameRate) )
+            {
+                acquisitionFrameRate->SetValue( frameRate);
+            }
+            else
+            {
+                cerr << "The frame rate cannot be set." << endl;
+            }
+        }
+
+        // The age of the images needs the camera clock related to the host clock.
+        std::unique_ptr<CCameraClockCorrelator> pCorrelator;
+        try
+        {
+            pCorrelator.reset( new CCameraClockCorrelator( camera.GetNodeMap(), 32, 200));
+            pCorrelator->Start();
+        }
+        catch (const GenericException &)
+        {
+            cout << "The device cannot latch its time stamp, the image age is not measured." << endl;
+        }
+
+        vector<EGrabStrategy> strategies;
+        strategies.push_back( GrabStrategy_OneByOne);
+        strategies.push_back( GrabStrategy_LatestImageOnly);
+        strategies.push_back( GrabStrategy_LatestImages);
+        if ( !camera.IsUsb() )
+        {
+            // See Grab_Strategies.
+            strategies.push_back( GrabStrategy_UpcomingImage);
+        }
+
+        cout << setw( 16) << "Strategy" << setw( 8) << "Buffers" << setw( 6) << "Queue" << setw( 9) << "Cost ms"
+             << setw( 9) << "Frames/s" << setw( 9) << "Skipped" << setw( 10) << "Wait p50" << setw( 10) << "Wait p99"
+             << setw( 10) << "Age p50" << setw( 10) << "Age p99" << setw( 7) << "CPU %" << endl;
+        cout << setw( 16) << "" << setw( 8) << "" << setw( 6) << "" << setw( 9) << ""
+             << setw( 9) << "" << setw( 9) << "" << setw( 10) << "us" << setw( 10) << "us"
+             << setw( 10) << "ms" << setw( 10) << "ms" << setw( 7) << "" << endl;
+        cout << fixed << setprecision( 1);
+
+        for ( size_t s = 0; s < strategies.size(); ++s )
+        {
+            for ( size_t b = 0; b < bufferCounts.size(); ++b )
+            {
+                const int64_t buffers = (int64_t) bufferCounts[b];
+                // OutputQueueSize cannot exceed MaxNumBuffer.
+                camera.OutputQueueSize = 1;
+                camera.MaxNumBuffer = buffers;
+                // The output queue size only matters for LatestImages.
+                const size_t queueSizeCount = strategies[s] == GrabStrategy_LatestImages ? queueSizes.size() : 1;
+                for ( size_t q = 0; q < queueSizeCount; ++q )
+                {
+                    const int64_t queue = strategies[s] == GrabStrategy_LatestImages ? (int64_t) queueSizes[q] : 0;
+                    if ( queue > buffers )
+                    {
+                        continue;
+                    }
+                    if ( queue > 0 )
+                    {
+                        camera.OutputQueueSize = queue;
+                    }
+                    for ( size_t c = 0; c < costsMs.size(); ++c )
+                    {
+                        SCellResult result;
+                        RunCell( camera, skippedCounter, pCorrelator.get(), strategies[s], costsMs[c], durationSeconds, result);
+                        PrintRow( strategies[s], buffers, queue, costsMs[c], result);
+                    }
+                }
+            }
+        }
+        if ( pCorrelator )
+        {
+            pCorrelator->Stop();
+            pCorrelator->PrintStatistics( cout);
+        }
+    }
+    catch (const GenericException &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.GetDescription() << endl;
+        exitCode = 1;
+    }
+
+    return exitCode;
+}
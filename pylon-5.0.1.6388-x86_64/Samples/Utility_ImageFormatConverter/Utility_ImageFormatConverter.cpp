@@ -13,6 +13,9 @@
     convert these to a number of output formats.
     The conversion can be controlled by several parameters.
     See the converter class documentation for more details.
+
+    For large frames, CParallelFormatConverter (ParallelFormatConverter.h) converts bands of
+    rows on several threads with the same parameters, see Utility_ParallelConverterBenchmark.
 */
 
 // Include files to use the PYLON API.
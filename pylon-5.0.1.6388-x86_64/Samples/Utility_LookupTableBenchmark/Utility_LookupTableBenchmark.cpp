@@ -0,0 +1,236 @@
+// Utility_LookupTableBenchmark.cpp
+/*
+    This utility measures CPixelLookupStage (PixelLookupTable.h), which maps Mono12 frames to
+    Mono8 or Mono16 through a host lookup table, and compares it with the gamma conversion of
+    CImageFormatConverter for the same mapping.
+
+    Usage: Utility_LookupTableBenchmark [width] [height] [frames]
+
+    A synthetic Mono12 frame (default 4096 x 3072 pixels) is mapped repeatedly (default 50
+    times) with the gamma, log and window presets. For each mapping, the time per frame is
+    printed for CImageFormatConverter where it offers the mapping, for the scalar kernel and
+    for the AVX2 gather kernel. The kernels must give the same results, also for a 16 bit table
+    mapped to Mono8, whose values are saturated to 255, and the gamma table must match the
+    converter within one gray value.
+
+    At the end, a second thread swaps the table continuously while frames are mapped; every
+    frame must have been mapped completely with one of the two tables.
+*/
+
+// Include files to use the PYLON API.
+#include <pylon/PylonIncludes.h>
+#include <stdlib.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include "../include/PixelLookupTable.h"
+#include "../include/LatencyHistogram.h"
+
+// Namespace for using pylon objects.
+using namespace Pylon;
+
+// Namespace for using GenApi objects.
+using namespace GenApi;
+
+// Namespace for using cout.
+using namespace std;
+
+// The gamma used for the comparison with CImageFormatConverter.
+static const double c_gamma = 0.45;
+
+static double GetMillisecondsPerFrame( uint64_t startNs, size_t frameCount)
+{
+    return (GetMonotonicTimeNs() - startNs) / 1e6 / frameCount;
+}
+
+// Maps the frame repeatedly with the given kernel and returns the time per frame in ms.
+template <typename TOut>
+static double RunKernel( const SPixelLookupTable& table, PixelLookupKernels::EKernel kernel, const vector<uint16_t>& source,
+    vector<TOut>& destination, uint32_t width, uint32_t height, size_t frameCount)
+{
+    const CPixelLookupStage stage( table, kernel);
+    destination.assign( source.size(), 0);
+    const uint64_t startNs = GetMonotonicTimeNs();
+    for ( size_t i = 0; i < frameCount; ++i )
+    {
+        stage.Apply( &source[0], 0, &destination[0], 0, width, height);
+    }
+    return GetMillisecondsPerFrame( startNs, frameCount);
+}
+
+// Prints one row. converterMs is negative if the converter does not offer the mapping.
+template <typename TOut>
+static bool RunMapping( const char* name, const SPixelLookupTable& table, const vector<uint16_t>& source,
+    uint32_t width, uint32_t height, size_t frameCount, double converterMs)
+{
+    vector<TOut> scalar;
+    vector<TOut> simd;
+    const double scalarMs = RunKernel( table, PixelLookupKernels::Kernel_Scalar, source, scalar, width, height, frameCount);
+    cout << setw( 16) << name;
+    if ( converterMs >= 0.0 )
+    {
+        cout << setw( 12) << converterMs;
+    }
+    else
+    {
+        cout << setw( 12) << "-";
+    }
+    cout << setw( 12) << scalarMs;
+    bool equal = true;
+    if ( PixelLookupKernels::GetBestKernel() == PixelLookupKernels::Kernel_Avx2 )
+    {
+        const double simdMs = RunKernel( table, PixelLookupKernels::Kernel_Avx2, source, simd, width, height, frameCount);
+        equal = simd == scalar;
+        cout << setw( 12) << simdMs << setw( 12) << source.size() / simdMs / 1e3;
+    }
+    else
+    {
+        cout << setw( 12) << "-" << setw( 12) << source.size() / scalarMs / 1e3;
+    }
+    cout << (equal ? "  equal" : "  DIFFERENT") << endl;
+    return equal;
+}
+
+// Maps the frame with CImageFormatConverter and returns the time per frame in ms.
+static double RunConverter( const vector<uint16_t>& source, uint32_t width, uint32_t height, size_t frameCount, CPylonImage& target)
+{
+    CImageFormatConverter converter;
+    converter.OutputPixelFormat = PixelType_Mono8;
+    converter.MonoConversionMethod = MonoConversionMethod_Gamma;
+    converter.Gamma = c_gamma;
+
+    // The first conversion allocates the target image and the converter's table.
+    const size_t sourceSize = source.size() * sizeof( uint16_t);
+    converter.Convert( target, &source[0], sourceSize, PixelType_Mono12, width, height, 0, ImageOrientation_TopDown);
+    const uint64_t startNs = GetMonotonicTimeNs();
+    for ( size_t i = 0; i < frameCount; ++i )
+    {
+        converter.Convert( target, &source[0], sourceSize, PixelType_Mono12, width, height, 0, ImageOrientation_TopDown);
+    }
+    return GetMillisecondsPerFrame( startNs, frameCount);
+}
+
+// Maps frames while another thread alternates between two tables, and checks that each frame
+// has been mapped with one table only.
+static bool RunHotSwap( const vector<uint16_t>& source, uint32_t width, uint32_t height, size_t frameCount)
+{
+    SPixelLookupTable tables[2];
+    PixelLookupTables::CreateWindow( tables[0], 0, 4095, 255);
+    PixelLookupTables::CreateWindow( tables[1], 1024, 3071, 255);
+    vector<uint8_t> expected[2];
+    for ( int i = 0; i < 2; ++i )
+    {
+        expected[i].resize( source.size());
+        PixelLookupKernels::Map( tables[i].values, &source[0], &expected[i][0], source.size());
+    }
+
+    CPixelLookupStage stage( tables[0]);
+    atomic<bool> stop( false);
+    thread swapper( [&]()
+    {
+        for ( size_t i = 1; !stop; ++i )
+        {
+            stage.SetTable( tables[ i % 2 ]);
+        }
+    });
+
+    vector<uint8_t> destination( source.size());
+    size_t mixedFrames = 0;
+    for ( size_t i = 0; i < frameCount; ++i )
+    {
+        stage.Apply( &source[0], 0, &destination[0], 0, width, height);
+        if ( destination != expected[0] && destination != expected[1] )
+        {
+            ++mixedFrames;
+        }
+    }
+    stop = true;
+    swapper.join();
+
+    cout << "Hot swap: " << frameCount << " frames mapped during " << stage.GetSwapCount() << " table swaps, "
+         << mixedFrames << " frames mapped with more than one table" << endl;
+    return mixedFrames == 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+    // The exit code of the sample application.
+    int exitCode = 0;
+
+    const uint32_t width = argc > 1 ? (uint32_t) strtoul( argv[1], NULL, 10) : 4096;
+    const uint32_t height = argc > 2 ? (uint32_t) strtoul( argv[2], NULL, 10) : 3072;
+    const size_t frameCount = argc > 3 ? strtoul( argv[3], NULL, 10) : 50;
+    if ( width == 0 || height == 0 || frameCount == 0 )
+    {
+        cerr << "Usage: " << argv[0] << " [width] [height] [frames]" << endl;
+        return 1;
+    }
+
+    // Automagically call PylonInitialize and PylonTerminate to ensure the pylon runtime system
+    // is initialized during the lifetime of this object.
+    Pylon::PylonAutoInitTerm autoInitTerm;
+
+    try
+    {
+        // A horizontal ramp over the full 12 bit range with noise.
+        vector<uint16_t> source( (size_t) width * height);
+        srand( 1);
+        for ( size_t i = 0; i < source.size(); ++i )
+        {
+            const int value = (int) ((i % width) * 4095 / width) + rand() % 33 - 16;
+            source[i] = (uint16_t) max( 0, min( 4095, value));
+        }
+
+        cout << frameCount << " frames of " << width << " x " << height << " pixels, times in ms per frame" << endl;
+        cout << setw( 16) << "Mapping" << setw( 12) << "Converter" << setw( 12) << "Scalar" << setw( 12) << "AVX2"
+             << setw( 12) << "Mpixel/s" << endl;
+        cout << fixed << setprecision( 3);
+
+        CPylonImage converted;
+        const double converterMs = RunConverter( source, width, height, frameCount, converted);
+
+        SPixelLookupTable table;
+        PixelLookupTables::CreateGamma( table, c_gamma, 255);
+        bool passed = RunMapping<uint8_t>( "gamma -> Mono8", table, source, width, height, frameCount, converterMs);
+
+        // Compare with the converter's output.
+        vector<uint8_t> mapped( source.size());
+        PixelLookupKernels::Map( table.values, &source[0], &mapped[0], source.size());
+        const uint8_t* pConverted = static_cast<const uint8_t*>( converted.GetBuffer());
+        size_t deviations = 0;
+        for ( size_t i = 0; i < mapped.size(); ++i )
+        {
+            if ( abs( (int) mapped[i] - (int) pConverted[i]) > 1 )
+            {
+                ++deviations;
+            }
+        }
+
+        PixelLookupTables::CreateLog( table, 255);
+        passed = RunMapping<uint8_t>( "log -> Mono8", table, source, width, height, frameCount, -1.0) && passed;
+        PixelLookupTables::CreateWindow( table, 1024, 3071, 255);
+        passed = RunMapping<uint8_t>( "window -> Mono8", table, source, width, height, frameCount, -1.0) && passed;
+        PixelLookupTables::CreateLinear( table, 65535);
+        passed = RunMapping<uint8_t>( "16 bit -> Mono8", table, source, width, height, frameCount, -1.0) && passed;
+        PixelLookupTables::CreateGamma( table, c_gamma, 65535);
+        passed = RunMapping<uint16_t>( "gamma -> Mono16", table, source, width, height, frameCount, -1.0) && passed;
+        PixelLookupTables::CreateWindow( table, 1024, 3071, 65535);
+        passed = RunMapping<uint16_t>( "window -> Mono16", table, source, width, height, frameCount, -1.0) && passed;
+
+        cout << "Gamma " << c_gamma << ": " << deviations << " pixels differ from CImageFormatConverter by more than 1" << endl;
+        passed = RunHotSwap( source, width, height, frameCount) && deviations == 0 && passed;
+        exitCode = passed ? 0 : 1;
+    }
+    catch (const GenericException &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.GetDescription() << endl;
+        exitCode = 1;
+    }
+
+    return exitCode;
+}
@@ -0,0 +1,197 @@
+// Utility_Mono12pDecoderBenchmark.cpp
+/*
+    This utility checks CMono12pDecoder (Mono12pDecoder.h) against CImageFormatConverter and
+    measures whether it keeps up with the camera on one core.
+
+    Usage: Utility_Mono12pDecoderBenchmark [width] [height] [frames]
+
+    A Mono12p frame (default 2048 x 1088 pixels, acA2000-165um) is decoded repeatedly (default
+    200 times) to Mono12, Mono16 and Mono8 with CImageFormatConverter and with the scalar, SSSE3
+    and AVX2 kernels of the decoder. For each, the time per frame and the frames per second are
+    printed. Every kernel must give the same output as CImageFormatConverter (Mono16 LSB aligned
+    for Mono12), for the frame, for the frame with 3 padding bytes per line and for all lengths
+    from 0 to 256 pixels. At the end, the frame rate of the best kernel is compared with the
+    165 frames/s of the camera.
+*/
+
+// Include files to use the PYLON API.
+#include <pylon/PylonIncludes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include "../include/Mono12pDecoder.h"
+#include "../include/LatencyHistogram.h"
+
+// Namespace for using pylon objects.
+using namespace Pylon;
+
+// Namespace for using GenApi objects.
+using namespace GenApi;
+
+// Namespace for using cout.
+using namespace std;
+
+// The maximum frame rate of the acA2000-165um at full resolution.
+static const double c_cameraFps = 165.0;
+
+// The padding of the lines of the padded frame in bytes.
+static const size_t c_paddingX = 3;
+
+// A Mono12p frame, unpadded and with every line packed on its own followed by c_paddingX bytes.
+struct SPackedFrame
+{
+    uint32_t width;
+    uint32_t height;
+    vector<uint8_t> packed;
+    vector<uint8_t> padded;
+};
+
+// Decodes a frame with CImageFormatConverter and returns the time per frame in ms.
+// The converter has no Mono12 output; Mono12 is Mono16 with LSB alignment.
+static double RunConverter( const SPackedFrame& frame, size_t frameCount, EPixelType outputPixelType, CPylonImage& target)
+{
+    CImageFormatConverter converter;
+    converter.OutputPixelFormat = outputPixelType == PixelType_Mono8 ? PixelType_Mono8 : PixelType_Mono16;
+    converter.OutputBitAlignment = outputPixelType == PixelType_Mono12 ? OutputBitAlignment_LsbAligned : OutputBitAlignment_MsbAligned;
+
+    // The first conversion allocates the target image.
+    converter.Convert( target, &frame.packed[0], frame.packed.size(), PixelType_Mono12p, frame.width, frame.height, 0, ImageOrientation_TopDown);
+    const uint64_t startNs = GetMonotonicTimeNs();
+    for ( size_t i = 0; i < frameCount; ++i )
+    {
+        converter.Convert( target, &frame.packed[0], frame.packed.size(), PixelType_Mono12p, frame.width, frame.height, 0, ImageOrientation_TopDown);
+    }
+    return (GetMonotonicTimeNs() - startNs) / 1e6 / frameCount;
+}
+
+// Decodes all lengths from 0 to 256 pixels and compares them with the converter.
+static bool CheckLengths( EPixelType outputPixelType, Mono12Packing::EKernel kernel, const vector<uint8_t>& packed, const uint8_t* pExpected)
+{
+    const size_t bytesPerPixel = outputPixelType == PixelType_Mono8 ? 1 : 2;
+    CMono12pDecoder decoder( outputPixelType, kernel);
+    for ( uint32_t length = 0; length <= 256; ++length )
+    {
+        // A guard byte detects writes past the end.
+        vector<uint8_t> decoded( length * bytesPerPixel + 1, 0xA5);
+        decoder.Decode( &decoded[0], decoded.size(), &packed[0], packed.size(), length, 1, 0);
+        if ( memcmp( &decoded[0], pExpected, length * bytesPerPixel) != 0 || decoded.back() != 0xA5 )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Prints one row per kernel and returns false if a kernel differs from the converter.
+static bool RunDecoder( const char* name, EPixelType outputPixelType, const SPackedFrame& frame, size_t frameCount, double& bestFps)
+{
+    const uint32_t width = frame.width;
+    const uint32_t height = frame.height;
+    const vector<uint8_t>& packed = frame.packed;
+    CPylonImage expected;
+    const double converterMs = RunConverter( frame, frameCount, outputPixelType, expected);
+    cout << setw( 8) << name << setw( 12) << "converter" << setw( 12) << converterMs << setw( 12) << 1000.0 / converterMs << endl;
+
+    bool equal = true;
+    const Mono12Packing::EKernel kernels[] = { Mono12Packing::Kernel_Scalar, Mono12Packing::Kernel_Ssse3, Mono12Packing::Kernel_Avx2 };
+    for ( size_t k = 0; k < sizeof( kernels) / sizeof( kernels[0]); ++k )
+    {
+        if ( kernels[k] > Mono12Packing::GetBestKernel() )
+        {
+            continue;
+        }
+        // The first frame is decoded as an image, which allocates the destination.
+        CMono12pDecoder decoder( outputPixelType, kernels[k]);
+        CPylonImage source;
+        source.AttachUserBuffer( const_cast<uint8_t*>( &packed[0]), packed.size(), PixelType_Mono12p, width, height, 0);
+        CPylonImage decoded;
+        decoder.Decode( decoded, source);
+        const uint64_t startNs = GetMonotonicTimeNs();
+        for ( size_t i = 0; i < frameCount; ++i )
+        {
+            decoder.Decode( decoded.GetBuffer(), decoded.GetAllocatedBufferSize(), &packed[0], packed.size(), width, height, 0);
+        }
+        const double decoderMs = (GetMonotonicTimeNs() - startNs) / 1e6 / frameCount;
+        bestFps = max( bestFps, 1000.0 / decoderMs);
+
+        CPylonImage decodedPadded;
+        decodedPadded.Reset( outputPixelType, width, height);
+        decoder.Decode( decodedPadded.GetBuffer(), decodedPadded.GetAllocatedBufferSize(), &frame.padded[0], frame.padded.size(), width, height, c_paddingX);
+
+        const bool sameOutput = decoded.GetImageSize() == expected.GetImageSize()
+            && memcmp( decoded.GetBuffer(), expected.GetBuffer(), expected.GetImageSize()) == 0
+            && memcmp( decodedPadded.GetBuffer(), expected.GetBuffer(), expected.GetImageSize()) == 0
+            && CheckLengths( outputPixelType, kernels[k], packed, static_cast<const uint8_t*>( expected.GetBuffer()));
+        equal = equal && sameOutput;
+        cout << setw( 8) << "" << setw( 12) << Mono12Packing::GetKernelName( kernels[k]) << setw( 12) << decoderMs << setw( 12) << 1000.0 / decoderMs
+             << (sameOutput ? "  equal" : "  DIFFERENT") << endl;
+    }
+    return equal;
+}
+
+
+int main(int argc, char* argv[])
+{
+    // The exit code of the sample application.
+    int exitCode = 0;
+
+    const uint32_t width = argc > 1 ? (uint32_t) strtoul( argv[1], NULL, 10) : 2048;
+    const uint32_t height = argc > 2 ? (uint32_t) strtoul( argv[2], NULL, 10) : 1088;
+    const size_t frameCount = argc > 3 ? strtoul( argv[3], NULL, 10) : 200;
+    if ( width == 0 || height == 0 || frameCount == 0 || (size_t) width * height < 256 )
+    {
+        cerr << "Usage: " << argv[0] << " [width] [height] [frames], at least 256 pixels" << endl;
+        return 1;
+    }
+
+    // Automagically call PylonInitialize and PylonTerminate to ensure the pylon runtime system
+    // is initialized during the lifetime of this object.
+    Pylon::PylonAutoInitTerm autoInitTerm;
+
+    try
+    {
+        // Random pixels over the full 12 bit range, packed with the scalar reference.
+        vector<uint16_t> pixels( (size_t) width * height);
+        srand( 1);
+        for ( size_t i = 0; i < pixels.size(); ++i )
+        {
+            pixels[i] = (uint16_t) (rand() & 0xFFF);
+        }
+        SPackedFrame frame;
+        frame.width = width;
+        frame.height = height;
+        frame.packed.resize( Mono12Packing::GetPackedSize( pixels.size()));
+        Mono12Packing::PackScalar( &pixels[0], &frame.packed[0], pixels.size());
+        const size_t paddedStride = Mono12Packing::GetPackedSize( width) + c_paddingX;
+        frame.padded.resize( paddedStride * height);
+        for ( uint32_t y = 0; y < height; ++y )
+        {
+            Mono12Packing::PackScalar( &pixels[(size_t) y * width], &frame.padded[y * paddedStride], width);
+        }
+
+        cout << frameCount << " Mono12p frames of " << width << " x " << height << " pixels" << endl;
+        cout << setw( 8) << "Output" << setw( 12) << "Decoder" << setw( 12) << "ms/frame" << setw( 12) << "frames/s" << endl;
+        cout << fixed << setprecision( 3);
+        double bestFps = 0.0;
+        bool passed = RunDecoder( "Mono12", PixelType_Mono12, frame, frameCount, bestFps);
+        passed = RunDecoder( "Mono16", PixelType_Mono16, frame, frameCount, bestFps) && passed;
+        passed = RunDecoder( "Mono8", PixelType_Mono8, frame, frameCount, bestFps) && passed;
+
+        // The frame rate scales with the number of pixels of the 2048 x 1088 sensor.
+        const double requiredFps = c_cameraFps * 2048.0 * 1088.0 / ((double) width * height);
+        cout << "Best decoder: " << bestFps << " frames/s on one core, the camera needs " << requiredFps << " frames/s"
+             << (bestFps >= requiredFps ? "" : " - TOO SLOW") << endl;
+        exitCode = passed ? 0 : 1;
+    }
+    catch (const GenericException &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.GetDescription() << endl;
+        exitCode = 1;
+    }
+
+    return exitCode;
+}
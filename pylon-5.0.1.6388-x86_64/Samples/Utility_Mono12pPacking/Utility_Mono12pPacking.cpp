@@ -0,0 +1,170 @@
+// Utility_Mono12pPacking.cpp
+/*
+    This utility checks and benchmarks the Mono12 <-> Mono12p kernels in Mono12Packing.h.
+
+    Usage: Utility_Mono12pPacking [width] [height] [iterations]
+
+    First, every kernel is checked against the scalar reference: packing must produce identical
+    bytes and unpacking must restore the original pixels bit for bit, for all lengths from 0 to
+    256 pixels and for a full frame. Then the throughput of each kernel is measured on a frame
+    of the given size (default 2048 x 1088, acA2000-165um) and compared with a naive per-pixel
+    loop. Throughput is given in GB/s of Mono12 (16 bit) data.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include "../include/Mono12Packing.h"
+
+// Namespace for using cout.
+using namespace std;
+
+static double GetSeconds()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// The straightforward implementation the kernels are compared with: one pixel at a time,
+// bit position computed for every pixel.
+static void PackNaive( const uint16_t* pSource, uint8_t* pDestination, size_t pixelCount)
+{
+    memset( pDestination, 0, Mono12Packing::GetPackedSize( pixelCount));
+    for ( size_t i = 0; i < pixelCount; ++i )
+    {
+        size_t bit = i * 12;
+        uint32_t value = (uint32_t) (pSource[i] & 0xFFF) << (bit % 8);
+        pDestination[bit / 8] |= (uint8_t) value;
+        pDestination[bit / 8 + 1] |= (uint8_t) (value >> 8);
+    }
+}
+
+static void UnpackNaive( const uint8_t* pSource, uint16_t* pDestination, size_t pixelCount)
+{
+    for ( size_t i = 0; i < pixelCount; ++i )
+    {
+        size_t bit = i * 12;
+        uint32_t value = pSource[bit / 8] | (pSource[bit / 8 + 1] << 8);
+        pDestination[i] = (uint16_t) ((value >> (bit % 8)) & 0xFFF);
+    }
+}
+
+static bool CheckKernel( Mono12Packing::EKernel kernel, const vector<uint16_t>& pixels)
+{
+    // Guard bytes detect writes past the end.
+    const uint8_t c_guard = 0xA5;
+    vector<uint8_t> reference( Mono12Packing::GetPackedSize( pixels.size()));
+    vector<uint8_t> packed( reference.size() + 16);
+    vector<uint16_t> unpacked( pixels.size() + 16);
+
+    // All lengths up to 256 pixels, then the whole frame.
+    for ( size_t length = 0; length <= pixels.size(); length = (length < 256 ? length + 1 : (length < pixels.size() ? pixels.size() : pixels.size() + 1)) )
+    {
+        size_t packedSize = Mono12Packing::GetPackedSize( length);
+        PackNaive( &pixels[0], &reference[0], length);
+        fill( packed.begin(), packed.end(), c_guard);
+        fill( unpacked.begin(), unpacked.end(), 0xA5A5);
+
+        Mono12Packing::Pack( &pixels[0], &packed[0], length, kernel);
+        Mono12Packing::Unpack( &packed[0], &unpacked[0], length, kernel);
+
+        if ( !equal( reference.begin(), reference.begin() + packedSize, packed.begin())
+            || packed[packedSize] != c_guard )
+        {
+            cerr << Mono12Packing::GetKernelName( kernel) << ": packing " << length << " pixels differs from the reference." << endl;
+            return false;
+        }
+        for ( size_t i = 0; i < length; ++i )
+        {
+            if ( unpacked[i] != (pixels[i] & 0xFFF) )
+            {
+                cerr << Mono12Packing::GetKernelName( kernel) << ": round trip of " << length << " pixels differs at pixel " << i << "." << endl;
+                return false;
+            }
+        }
+        if ( unpacked[length] != 0xA5A5 )
+        {
+            cerr << Mono12Packing::GetKernelName( kernel) << ": unpacking " << length << " pixels wrote past the end." << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t width = argc > 1 ? strtoul( argv[1], NULL, 10) : 2048;
+    const size_t height = argc > 2 ? strtoul( argv[2], NULL, 10) : 1088;
+    const int iterations = argc > 3 ? atoi( argv[3]) : 200;
+    const size_t pixelCount = width * height;
+
+    // Random 12 bit data; the upper bits are set in some pixels to check that they are masked.
+    vector<uint16_t> pixels( pixelCount);
+    srand( 1);
+    for ( size_t i = 0; i < pixelCount; ++i )
+    {
+        pixels[i] = (uint16_t) (rand() & (i % 7 == 0 ? 0xFFFF : 0xFFF));
+    }
+
+    Mono12Packing::EKernel kernels[] = { Mono12Packing::Kernel_Scalar, Mono12Packing::Kernel_Ssse3, Mono12Packing::Kernel_Avx2 };
+    size_t kernelCount = sizeof( kernels) / sizeof( kernels[0]);
+    if ( Mono12Packing::GetBestKernel() != Mono12Packing::Kernel_Avx2 )
+    {
+        kernelCount = Mono12Packing::GetBestKernel() == Mono12Packing::Kernel_Ssse3 ? 2 : 1;
+    }
+
+    for ( size_t k = 0; k < kernelCount; ++k )
+    {
+        if ( !CheckKernel( kernels[k], pixels) )
+        {
+            return 1;
+        }
+    }
+    cout << "Round trip is bit exact for all " << kernelCount << " kernels." << endl;
+
+    // Benchmark.
+    vector<uint8_t> packed( Mono12Packing::GetPackedSize( pixelCount));
+    vector<uint16_t> unpacked( pixelCount);
+    const double gigabytes = pixelCount * sizeof( uint16_t) * (double) iterations / 1e9;
+    cout << "Frame " << width << " x " << height << ", " << iterations << " iterations, GB/s of Mono12 data:" << endl;
+    cout << fixed << setprecision( 2);
+
+    double start = GetSeconds();
+    for ( int i = 0; i < iterations; ++i )
+    {
+        PackNaive( &pixels[0], &packed[0], pixelCount);
+    }
+    double packSeconds = GetSeconds() - start;
+    start = GetSeconds();
+    for ( int i = 0; i < iterations; ++i )
+    {
+        UnpackNaive( &packed[0], &unpacked[0], pixelCount);
+    }
+    double unpackSeconds = GetSeconds() - start;
+    cout << setw( 8) << "naive" << "  pack " << setw( 7) << gigabytes / packSeconds << "  unpack " << setw( 7) << gigabytes / unpackSeconds << endl;
+
+    for ( size_t k = 0; k < kernelCount; ++k )
+    {
+        start = GetSeconds();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            Mono12Packing::Pack( &pixels[0], &packed[0], pixelCount, kernels[k]);
+        }
+        packSeconds = GetSeconds() - start;
+        start = GetSeconds();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            Mono12Packing::Unpack( &packed[0], &unpacked[0], pixelCount, kernels[k]);
+        }
+        unpackSeconds = GetSeconds() - start;
+        cout << setw( 8) << Mono12Packing::GetKernelName( kernels[k]) << "  pack " << setw( 7) << gigabytes / packSeconds
+             << "  unpack " << setw( 7) << gigabytes / unpackSeconds << endl;
+    }
+
+    return 0;
+}
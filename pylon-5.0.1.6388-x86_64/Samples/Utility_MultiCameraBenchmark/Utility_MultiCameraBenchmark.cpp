@@ -0,0 +1,285 @@
+// Utility_MultiCameraBenchmark.cpp
+/*
+    This utility compares grabbing from several cameras with one thread, as shown in
+    Grab_MultipleCameras, against CMultiCameraGrabber (MultiCameraGrabber.h), which runs a grab
+    thread and a processing worker per camera, and shows how both scale with the camera count.
+
+    Usage: Utility_MultiCameraBenchmark [-cameras N] [-duration s] [-fps rate] [-cost ms] [-slow ms]
+                                        [-queue N] [-grabcores list] [-workercores list]
+
+    Emulated cameras are used. If PYLON_CAMEMU is not set, it is set to the camera count (default
+    4). For 1 to N cameras, each free running or at the given frame rate, frames are grabbed for
+    the given duration (default 2 s) and processed by busy waiting for -cost ms (default 2).
+    The frames of the last camera take -slow ms instead (default: the same as -cost), to show
+    that one slow camera holds up all others when one thread serves them all.
+
+    * array: one thread calls CInstantCameraArray::RetrieveResult() and processes every frame,
+    * threaded: CMultiCameraGrabber with a queue of -queue frames (default 4) per camera. Core
+      lists are comma separated, e.g. -grabcores 0,1 -workercores 2,3,4,5.
+
+    Printed is one row per camera count and mode with the total and the lowest per-camera frame
+    rate, followed by the per-camera statistics of the threaded run with all cameras.
+*/
+
+// Include files to use the PYLON API.
+#include <pylon/PylonIncludes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include "../include/MultiCameraGrabber.h"
+
+// Namespace for using pylon objects.
+using namespace Pylon;
+
+// Namespace for using GenApi objects.
+using namespace GenApi;
+
+// Namespace for using cout.
+using namespace std;
+
+// Simulates processing by busy waiting, for a longer time on the last camera.
+class CBusyProcessor : public ICameraFrameProcessor
+{
+public:
+    CBusyProcessor( size_t cameraCount, double costMs, double slowCostMs)
+        : m_slowCamera( cameraCount - 1)
+        , m_costNs( (uint64_t) (costMs * 1e6))
+        , m_slowCostNs( (uint64_t) (slowCostMs * 1e6))
+        , m_frames( cameraCount, 0)
+    {
+    }
+
+    virtual void ProcessFrame( size_t cameraIndex, const CGrabResultPtr& /*ptrGrabResult*/)
+    {
+        const uint64_t startNs = GetMonotonicTimeNs();
+        const uint64_t costNs = cameraIndex == m_slowCamera ? m_slowCostNs : m_costNs;
+        while ( GetMonotonicTimeNs() - startNs < costNs )
+        {
+        }
+        // Each camera's frames are processed by one thread at a time.
+        ++m_frames[ cameraIndex ];
+    }
+
+    uint64_t GetTotal() const
+    {
+        uint64_t total = 0;
+        for ( size_t i = 0; i < m_frames.size(); ++i )
+        {
+            total += m_frames[i];
+        }
+        return total;
+    }
+
+    uint64_t GetMinimum() const
+    {
+        return *min_element( m_frames.begin(), m_frames.end());
+    }
+
+private:
+    const size_t m_slowCamera;
+    const uint64_t m_costNs;
+    const uint64_t m_slowCostNs;
+    vector<uint64_t> m_frames;
+};
+
+static vector<int> ParseCores( const char* text)
+{
+    vector<int> cores;
+    stringstream stream( text);
+    string item;
+    while ( getline( stream, item, ',') )
+    {
+        cores.push_back( atoi( item.c_str()));
+    }
+    return cores;
+}
+
+static void SetFrameRate( CInstantCamera& camera, double frameRate)
+{
+    CBooleanPtr frameRateEnable( camera.GetNodeMap().GetNode( "AcquisitionFrameRateEnable"));
+    CFloatPtr acquisitionFrameRate( camera.GetNodeMap().GetNode( "AcquisitionFrameRateAbs"));
+    if ( IsWritable( frameRateEnable) )
+    {
+        frameRateEnable->SetValue( true);
+    }
+    if ( IsWritable( acquisitionFrameRate) )
+    {
+        acquisitionFrameRate->SetValue( frameRate);
+    }
+    else
+    {
+        cerr << "The frame rate cannot be set." << endl;
+    }
+}
+
+static void PrintRow( size_t cameraCount, const char* mode, const CBusyProcessor& processor, double seconds)
+{
+    cout << setw( 8) << cameraCount << setw( 10) << mode
+         << setw( 12) << processor.GetTotal() / seconds
+         << setw( 12) << processor.GetMinimum() / seconds << endl;
+}
+
+// Grabs and processes all frames in this thread, as Grab_MultipleCameras does.
+static void RunArray( CInstantCameraArray& cameras, double costMs, double slowCostMs, double durationSeconds)
+{
+    CBusyProcessor processor( cameras.GetSize(), costMs, slowCostMs);
+    const uint64_t durationNs = (uint64_t) (durationSeconds * 1e9);
+    CGrabResultPtr ptrGrabResult;
+    cameras.StartGrabbing();
+    const uint64_t startNs = GetMonotonicTimeNs();
+    while ( GetMonotonicTimeNs() - startNs < durationNs )
+    {
+        cameras.RetrieveResult( 5000, ptrGrabResult, TimeoutHandling_ThrowException);
+        if ( ptrGrabResult->GrabSucceeded() )
+        {
+            processor.ProcessFrame( (size_t) ptrGrabResult->GetCameraContext(), ptrGrabResult);
+        }
+    }
+    const double seconds = (GetMonotonicTimeNs() - startNs) * 1e-9;
+    ptrGrabResult.Release();
+    cameras.StopGrabbing();
+    PrintRow( cameras.GetSize(), "array", processor, seconds);
+}
+
+static void RunThreaded( CInstantCameraArray& cameras, double costMs, double slowCostMs, double durationSeconds, size_t queueCapacity,
+    const vector<int>& grabCores, const vector<int>& workerCores, bool printCameras)
+{
+    CBusyProcessor processor( cameras.GetSize(), costMs, slowCostMs);
+    CMultiCameraGrabber grabber( cameras, processor, queueCapacity, grabCores, workerCores);
+    const uint64_t startNs = GetMonotonicTimeNs();
+    grabber.Start();
+    usleep( (useconds_t) (durationSeconds * 1e6));
+    grabber.Stop();
+    const double seconds = (GetMonotonicTimeNs() - startNs) * 1e-9;
+    PrintRow( cameras.GetSize(), "threaded", processor, seconds);
+    if ( printCameras || grabber.HasErrors() )
+    {
+        cout << endl;
+        grabber.PrintStatistics( cout);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // The exit code of the sample application.
+    int exitCode = 0;
+
+    size_t maxCameras = 4;
+    double durationSeconds = 2.0;
+    double frameRate = 0.0;
+    double costMs = 2.0;
+    double slowCostMs = -1.0;
+    size_t queueCapacity = 4;
+    vector<int> grabCores;
+    vector<int> workerCores;
+    for ( int i = 1; i + 1 < argc; i += 2 )
+    {
+        if ( strcmp( argv[i], "-cameras") == 0 )
+        {
+            maxCameras = strtoul( argv[i + 1], NULL, 10);
+        }
+        else if ( strcmp( argv[i], "-duration") == 0 )
+        {
+            durationSeconds = atof( argv[i + 1]);
+        }
+        else if ( strcmp( argv[i], "-fps") == 0 )
+        {
+            frameRate = atof( argv[i + 1]);
+        }
+        else if ( strcmp( argv[i], "-cost") == 0 )
+        {
+            costMs = atof( argv[i + 1]);
+        }
+        else if ( strcmp( argv[i], "-slow") == 0 )
+        {
+            slowCostMs = atof( argv[i + 1]);
+        }
+        else if ( strcmp( argv[i], "-queue") == 0 )
+        {
+            queueCapacity = strtoul( argv[i + 1], NULL, 10);
+        }
+        else if ( strcmp( argv[i], "-grabcores") == 0 )
+        {
+            grabCores = ParseCores( argv[i + 1]);
+        }
+        else if ( strcmp( argv[i], "-workercores") == 0 )
+        {
+            workerCores = ParseCores( argv[i + 1]);
+        }
+    }
+    if ( maxCameras == 0 || queueCapacity == 0 )
+    {
+        cerr << "Usage: " << argv[0] << " [-cameras N] [-duration s] [-fps rate] [-cost ms] [-slow ms] [-queue N]"
+             << " [-grabcores list] [-workercores list]" << endl;
+        return 1;
+    }
+    if ( slowCostMs < 0.0 )
+    {
+        slowCostMs = costMs;
+    }
+
+    // The number of emulated cameras is read when pylon is initialized.
+    if ( getenv( "PYLON_CAMEMU") == NULL )
+    {
+        setenv( "PYLON_CAMEMU", to_string( (unsigned long long) maxCameras).c_str(), 1);
+    }
+
+    // Automagically call PylonInitialize and PylonTerminate to ensure the pylon runtime system
+    // is initialized during the lifetime of this object.
+    Pylon::PylonAutoInitTerm autoInitTerm;
+
+    try
+    {
+        // Only look for the camera emulator.
+        CTlFactory& tlFactory = CTlFactory::GetInstance();
+        CDeviceInfo info;
+        info.SetDeviceClass( BaslerCamEmuDeviceClass);
+        DeviceInfoList_t filter;
+        filter.push_back( info);
+        DeviceInfoList_t devices;
+        if ( tlFactory.EnumerateDevices( devices, filter) == 0 )
+        {
+            throw RUNTIME_EXCEPTION( "No emulated camera present.");
+        }
+        maxCameras = min( maxCameras, (size_t) devices.size());
+        cout << maxCameras << " emulated cameras, processing " << costMs << " ms per frame ("
+             << slowCostMs << " ms on the last camera)" << endl;
+
+        cout << setw( 8) << "Cameras" << setw( 10) << "Mode" << setw( 12) << "Frames/s" << setw( 12) << "Min/camera" << endl;
+        cout << fixed << setprecision( 1);
+        for ( size_t cameraCount = 1; cameraCount <= maxCameras; ++cameraCount )
+        {
+            CInstantCameraArray cameras( cameraCount);
+            for ( size_t i = 0; i < cameras.GetSize(); ++i )
+            {
+                cameras[ i ].Attach( tlFactory.CreateDevice( devices[ i ]));
+                cameras[ i ].Open();
+                // The queue must leave buffers to the grab engine. Its capacity is rounded up to
+                // a power of two.
+                cameras[ i ].MaxNumBuffer = (int64_t) (2 * queueCapacity + 4);
+                if ( frameRate > 0.0 )
+                {
+                    SetFrameRate( cameras[ i ], frameRate);
+                }
+            }
+
+            RunArray( cameras, costMs, slowCostMs, durationSeconds);
+            RunThreaded( cameras, costMs, slowCostMs, durationSeconds, queueCapacity, grabCores, workerCores, cameraCount == maxCameras);
+            cameras.Close();
+        }
+    }
+    catch (const GenericException &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.GetDescription() << endl;
+        exitCode = 1;
+    }
+
+    return exitCode;
+}
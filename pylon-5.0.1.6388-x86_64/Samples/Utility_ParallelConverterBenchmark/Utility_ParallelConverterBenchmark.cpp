@@ -0,0 +1,141 @@
+// Utility_ParallelConverterBenchmark.cpp
+/*
+    This utility measures how CParallelFormatConverter (ParallelFormatConverter.h) scales with
+    the number of threads, compared with one CImageFormatConverter on the whole frame.
+
+    Usage: Utility_ParallelConverterBenchmark [width] [height] [frames] [max threads]
+
+    A synthetic frame (default 4096 x 3072 pixels) is converted repeatedly (default 20 times)
+    from Mono12 to Mono8, from BayerBG8 to BGR8packed and from BayerBG12 to BGR8packed. For each
+    conversion, the time per frame is printed for CImageFormatConverter and for the parallel
+    converter with 1, 2, 4, ... threads up to max threads (default: the number of cores),
+    together with the speedup. The parallel converter must give the same output as
+    CImageFormatConverter.
+*/
+
+// Include files to use the PYLON API.
+#include <pylon/PylonIncludes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <thread>
+#include <iostream>
+#include <iomanip>
+#include "../include/ParallelFormatConverter.h"
+#include "../include/LatencyHistogram.h"
+
+// Namespace for using pylon objects.
+using namespace Pylon;
+
+// Namespace for using GenApi objects.
+using namespace GenApi;
+
+// Namespace for using cout.
+using namespace std;
+
+static double GetMillisecondsPerFrame( uint64_t startNs, size_t frameCount)
+{
+    return (GetMonotonicTimeNs() - startNs) / 1e6 / frameCount;
+}
+
+// Converts the frame with all thread counts and returns false if an output differs from the
+// output of CImageFormatConverter.
+static bool RunConversion( const char* name, EPixelType sourcePixelType, EPixelType outputPixelType, uint32_t width, uint32_t height,
+    size_t frameCount, unsigned int maxThreads)
+{
+    // A noisy ramp; the Bayer frames get the same values in every channel.
+    const uint32_t maxValue = (1u << BitPerPixel( sourcePixelType)) - 1;
+    CPylonImage source;
+    source.Reset( sourcePixelType, width, height);
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        for ( uint32_t x = 0; x < width; ++x )
+        {
+            const uint32_t value = ((x + y) * maxValue / (width + height) + rand() % 16) & maxValue;
+            if ( maxValue > 255 )
+            {
+                static_cast<uint16_t*>( source.GetBuffer())[ (size_t) y * width + x ] = (uint16_t) value;
+            }
+            else
+            {
+                static_cast<uint8_t*>( source.GetBuffer())[ (size_t) y * width + x ] = (uint8_t) value;
+            }
+        }
+    }
+
+    // The first conversion allocates the target image.
+    CImageFormatConverter converter;
+    converter.OutputPixelFormat = outputPixelType;
+    CPylonImage expected;
+    converter.Convert( expected, source);
+    uint64_t startNs = GetMonotonicTimeNs();
+    for ( size_t i = 0; i < frameCount; ++i )
+    {
+        converter.Convert( expected, source);
+    }
+    const double converterMs = GetMillisecondsPerFrame( startNs, frameCount);
+    cout << setw( 24) << name << setw( 10) << "-" << setw( 12) << converterMs << setw( 10) << 1.0 << endl;
+
+    bool equal = true;
+    for ( unsigned int threads = 1; threads <= maxThreads; threads = threads < maxThreads ? min( 2 * threads, maxThreads) : threads + 1 )
+    {
+        CParallelFormatConverter parallelConverter( threads);
+        parallelConverter.GetConverter().OutputPixelFormat = outputPixelType;
+        CPylonImage target;
+        parallelConverter.Convert( target, source);
+        startNs = GetMonotonicTimeNs();
+        for ( size_t i = 0; i < frameCount; ++i )
+        {
+            parallelConverter.Convert( target, source);
+        }
+        const double parallelMs = GetMillisecondsPerFrame( startNs, frameCount);
+        const bool sameOutput = target.GetImageSize() == expected.GetImageSize()
+            && memcmp( target.GetBuffer(), expected.GetBuffer(), expected.GetImageSize()) == 0;
+        equal = equal && sameOutput;
+        cout << setw( 24) << "" << setw( 10) << threads << setw( 12) << parallelMs << setw( 10) << converterMs / parallelMs
+             << (sameOutput ? "  equal" : "  DIFFERENT") << endl;
+    }
+    return equal;
+}
+
+
+int main(int argc, char* argv[])
+{
+    // The exit code of the sample application.
+    int exitCode = 0;
+
+    const uint32_t width = argc > 1 ? (uint32_t) strtoul( argv[1], NULL, 10) : 4096;
+    const uint32_t height = argc > 2 ? (uint32_t) strtoul( argv[2], NULL, 10) : 3072;
+    const size_t frameCount = argc > 3 ? strtoul( argv[3], NULL, 10) : 20;
+    const unsigned int maxThreads = argc > 4 ? (unsigned int) strtoul( argv[4], NULL, 10) : max( 1u, thread::hardware_concurrency());
+    if ( width == 0 || height == 0 || frameCount == 0 || maxThreads == 0 )
+    {
+        cerr << "Usage: " << argv[0] << " [width] [height] [frames] [max threads]" << endl;
+        return 1;
+    }
+
+    // Automagically call PylonInitialize and PylonTerminate to ensure the pylon runtime system
+    // is initialized during the lifetime of this object.
+    Pylon::PylonAutoInitTerm autoInitTerm;
+
+    try
+    {
+        cout << frameCount << " frames of " << width << " x " << height << " pixels, times in ms per frame" << endl;
+        cout << setw( 24) << "Conversion" << setw( 10) << "Threads" << setw( 12) << "Time" << setw( 10) << "Speedup" << endl;
+        cout << fixed << setprecision( 3);
+        srand( 1);
+        bool passed = RunConversion( "Mono12 -> Mono8", PixelType_Mono12, PixelType_Mono8, width, height, frameCount, maxThreads);
+        passed = RunConversion( "BayerBG8 -> BGR8packed", PixelType_BayerBG8, PixelType_BGR8packed, width, height, frameCount, maxThreads) && passed;
+        passed = RunConversion( "BayerBG12 -> BGR8packed", PixelType_BayerBG12, PixelType_BGR8packed, width, height, frameCount, maxThreads) && passed;
+        exitCode = passed ? 0 : 1;
+    }
+    catch (const GenericException &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.GetDescription() << endl;
+        exitCode = 1;
+    }
+
+    return exitCode;
+}
@@ -0,0 +1,117 @@
+// Utility_ReplayCapture.cpp
+/*
+    This utility replays a recording through CReplayCamera so processing code can be
+    benchmarked on a machine without a camera.
+
+    Usage: Utility_ReplayCapture <capture directory or container> [recorded|fast] [loops] [preload|ondemand]
+
+    The recording is either a directory of GrabbedImage_HH_MM_SS_NN.tiff/.png files written by
+    the burst recorder or a capture container. The sample handler computes the mean gray value
+    of every frame; replace it with the processing to be measured. At the end, the achieved
+    frame rate, the decode time and the handler time per frame are printed.
+*/
+
+// Include files to use the PYLON API.
+#include <pylon/PylonIncludes.h>
+#include <string.h>
+#include <stdlib.h>
+#include "../include/ReplayCamera.h"
+
+// Namespace for using pylon objects.
+using namespace Pylon;
+
+// Namespace for using cout.
+using namespace std;
+
+// Example of a replay image event handler standing in for the processing under test.
+class CMeanGrayValueHandler : public CReplayImageEventHandler
+{
+public:
+    CMeanGrayValueHandler()
+        : m_sum( 0.0)
+        , m_count( 0)
+    {
+    }
+
+    virtual void OnImageGrabbed( CReplayCamera& /* camera */, const CPylonImage& image, const SReplayFrameInfo& /* info */)
+    {
+        const size_t pixelCount = (size_t) image.GetWidth() * image.GetHeight();
+        uint64_t total = 0;
+        if ( BitPerPixel( image.GetPixelType()) > 8 )
+        {
+            const uint16_t* pPixels = (const uint16_t*) image.GetBuffer();
+            for ( size_t i = 0; i < pixelCount; ++i )
+            {
+                total += pPixels[i];
+            }
+        }
+        else
+        {
+            const uint8_t* pPixels = (const uint8_t*) image.GetBuffer();
+            for ( size_t i = 0; i < pixelCount; ++i )
+            {
+                total += pPixels[i];
+            }
+        }
+        m_sum += pixelCount ? (double) total / pixelCount : 0.0;
+        ++m_count;
+    }
+
+    double GetAverageMean() const
+    {
+        return m_count ? m_sum / m_count : 0.0;
+    }
+
+private:
+    double m_sum;
+    uint64_t m_count;
+};
+
+
+int main(int argc, char* argv[])
+{
+    // The exit code of the sample application.
+    int exitCode = 0;
+
+    if ( argc < 2 )
+    {
+        cerr << "Usage: " << argv[0] << " <capture directory or container> [recorded|fast] [loops] [preload|ondemand]" << endl;
+        return 1;
+    }
+
+    // Automagically call PylonInitialize and PylonTerminate to ensure the pylon runtime system
+    // is initialized during the lifetime of this object.
+    Pylon::PylonAutoInitTerm autoInitTerm;
+
+    try
+    {
+        EReplayPacing pacing = (argc > 2 && strcmp( argv[2], "fast") == 0) ? ReplayPacing_AsFastAsPossible : ReplayPacing_Recorded;
+        uint32_t loopCount = argc > 3 ? (uint32_t) strtoul( argv[3], NULL, 10) : 1;
+        EReplayLoading loading = (argc > 4 && strcmp( argv[4], "ondemand") == 0) ? ReplayLoading_OnDemand : ReplayLoading_Preload;
+
+        CReplayCamera camera;
+        CMeanGrayValueHandler handler;
+        camera.Open( argv[1], loading);
+        camera.RegisterImageEventHandler( &handler);
+        cout << "Replaying " << camera.GetFrameCount() << " frames from " << argv[1] << endl;
+
+        camera.StartGrabbing( pacing, loopCount);
+        while ( !camera.WaitForGrabStop( 1000) )
+        {
+            // Wait for the replay thread to finish.
+        }
+        camera.StopGrabbing();
+
+        camera.PrintStatistics( cout);
+        cout << "Average mean gray value: " << handler.GetAverageMean() << endl;
+    }
+    catch (GenICam::GenericException &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.GetDescription() << endl;
+        exitCode = 1;
+    }
+
+    return exitCode;
+}
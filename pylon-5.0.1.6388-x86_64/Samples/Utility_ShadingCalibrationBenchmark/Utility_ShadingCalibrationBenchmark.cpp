@@ -0,0 +1,182 @@
+// Utility_ShadingCalibrationBenchmark.cpp
+/*
+    This utility compares the column averaging of shading calibration as written in the
+    original AverageLines() of ParametrizeCamera_Shading (column by column, one double addition
+    per pixel) against CShadingAccumulator (ShadingCalibration.h).
+
+    Usage: Utility_ShadingCalibrationBenchmark [width] [height] [frames] [threads]
+
+    Synthetic frames with a vignetting profile and noise are generated for Mono8, Mono12 and
+    RGB8 (default 4096 x 1024 pixels, 16 frames, one thread per core). For each format, the
+    time to average all frames is printed for the original loop, the engine with the scalar
+    kernel on one thread, with the best SIMD kernel on one thread, and with the best kernel on
+    all threads. The averages of the engine are checked against those of the original loop.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <exception>
+#include <iostream>
+#include <iomanip>
+#include "../include/ShadingCalibration.h"
+#include "../include/LatencyHistogram.h"
+
+// Namespace for using the engine.
+using namespace Pylon;
+
+// Namespace for using cout.
+using namespace std;
+
+// The distinct frames generated; they are averaged repeatedly up to the requested count.
+static const size_t c_distinctFrames = 4;
+
+// The averaging of the original AverageLines() for one frame, for T = uint16_t extended to
+// Mono12. The results are added to Intensities, which the caller scales by the frame count.
+template <typename T>
+static void AverageLinesOriginal( const T* Buffer, uint32_t Width, uint32_t Height, uint32_t NumCoeffs, double* Intensities)
+{
+    vector<double> frameIntensities( NumCoeffs, 0.0);
+    if (NumCoeffs == 3 * Width)
+    {
+        for (uint32_t x = 0; x < Width; x++)
+        {
+            for (uint32_t y = 0; y < Height; y++)
+            {
+                uint32_t idx = 3 * (y * Width + x);
+                frameIntensities[x] += Buffer[idx];
+                frameIntensities[x + Width] += Buffer[idx + 1];
+                frameIntensities[x + 2 * Width] += Buffer[idx + 2];
+            }
+        }
+    }
+    else
+    {
+        for (uint32_t x = 0; x < Width; x++)
+        {
+            for (uint32_t y = 0; y < Height; y++)
+            {
+                frameIntensities[x] += Buffer[y * Width + x];
+            }
+        }
+    }
+    double scale = 1.0 / double(Height);
+    for (uint32_t x = 0; x < NumCoeffs; x++)
+    {
+        Intensities[x] += frameIntensities[x] * scale;
+    }
+}
+
+// Creates a frame that is darker towards the edges, with noise.
+template <typename T>
+static void CreateFrame( vector<T>& frame, uint32_t width, uint32_t height, uint32_t channels, uint32_t maxValue, unsigned int seed)
+{
+    srand( seed);
+    frame.resize( (size_t) width * height * channels);
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        for ( uint32_t x = 0; x < width; ++x )
+        {
+            const double position = (2.0 * x - width) / width;
+            for ( uint32_t channel = 0; channel < channels; ++channel )
+            {
+                const double value = maxValue * (0.7 - 0.05 * channel) * (1.0 - 0.3 * position * position) + (rand() % 17) - 8;
+                frame[ ((size_t) y * width + x) * channels + channel ] = (T) max( 0.0, min( (double) maxValue, value));
+            }
+        }
+    }
+}
+
+static double GetMilliseconds( uint64_t startNs)
+{
+    return (GetMonotonicTimeNs() - startNs) / 1e6;
+}
+
+template <typename T>
+static bool RunFormat( const char* name, EShadingFormat format, uint32_t width, uint32_t height, size_t frameCount, unsigned int threadCount)
+{
+    const uint32_t channels = format == ShadingFormat_RGB8 ? 3 : 1;
+    const uint32_t maxValue = format == ShadingFormat_Mono12 ? 4095 : 255;
+    const uint32_t numCoeffs = width * channels;
+    vector< vector<T> > frames( c_distinctFrames);
+    for ( size_t i = 0; i < frames.size(); ++i )
+    {
+        CreateFrame( frames[i], width, height, channels, maxValue, (unsigned int) i + 1);
+    }
+
+    vector<double> reference( numCoeffs, 0.0);
+    uint64_t startNs = GetMonotonicTimeNs();
+    for ( size_t frame = 0; frame < frameCount; ++frame )
+    {
+        AverageLinesOriginal( &frames[ frame % frames.size() ][0], width, height, numCoeffs, &reference[0]);
+    }
+    for ( uint32_t x = 0; x < numCoeffs; ++x )
+    {
+        reference[x] /= (double) frameCount;
+    }
+    const double originalMs = GetMilliseconds( startNs);
+    cout << setw( 7) << name << setw( 12) << originalMs;
+
+    bool equal = true;
+    const ShadingKernels::EKernel kernels[3] = { ShadingKernels::Kernel_Scalar, ShadingKernels::Kernel_Auto, ShadingKernels::Kernel_Auto };
+    const unsigned int threads[3] = { 1, 1, threadCount };
+    for ( int run = 0; run < 3; ++run )
+    {
+        CShadingAccumulator accumulator( width, format, threads[run], kernels[run]);
+        startNs = GetMonotonicTimeNs();
+        for ( size_t frame = 0; frame < frameCount; ++frame )
+        {
+            accumulator.AddFrame( &frames[ frame % frames.size() ][0], height);
+        }
+        vector<double> averages( accumulator.GetNumCoeffs());
+        accumulator.GetAverages( &averages[0]);
+        const double engineMs = GetMilliseconds( startNs);
+        cout << setw( 12) << engineMs << " (" << setw( 5) << originalMs / engineMs << "x)";
+
+        for ( uint32_t x = 0; x < numCoeffs; ++x )
+        {
+            if ( fabs( averages[x] - reference[x]) > 1e-9 * maxValue )
+            {
+                cerr << endl << name << ": average " << x << " is " << averages[x] << ", expected " << reference[x] << endl;
+                equal = false;
+                break;
+            }
+        }
+    }
+    cout << (equal ? "  equal" : "  DIFFERENT") << endl;
+    return equal;
+}
+
+int main(int argc, char* argv[])
+{
+    const uint32_t width = argc > 1 ? (uint32_t) strtoul( argv[1], NULL, 10) : 4096;
+    const uint32_t height = argc > 2 ? (uint32_t) strtoul( argv[2], NULL, 10) : 1024;
+    const size_t frameCount = argc > 3 ? strtoul( argv[3], NULL, 10) : 16;
+    const unsigned int threadCount = argc > 4 ? (unsigned int) strtoul( argv[4], NULL, 10) : 0;
+    if ( width == 0 || height == 0 || frameCount == 0 )
+    {
+        cerr << "Usage: " << argv[0] << " [width] [height] [frames] [threads]" << endl;
+        return 1;
+    }
+
+    try
+    {
+        cout << frameCount << " frames of " << width << " x " << height << " pixels, best kernel "
+             << ShadingKernels::GetKernelName( ShadingKernels::Kernel_Auto) << ", times in ms" << endl;
+        cout << setw( 7) << "Format" << setw( 12) << "Original" << setw( 21) << "Scalar 1 thread" << setw( 21) << "SIMD 1 thread"
+             << setw( 21) << "SIMD all threads" << endl;
+        cout << fixed << setprecision( 1);
+        bool equal = RunFormat<uint8_t>( "Mono8", ShadingFormat_Mono8, width, height, frameCount, threadCount);
+        equal = RunFormat<uint16_t>( "Mono12", ShadingFormat_Mono12, width, height, frameCount, threadCount) && equal;
+        equal = RunFormat<uint8_t>( "RGB8", ShadingFormat_RGB8, width, height, frameCount, threadCount) && equal;
+        return equal ? 0 : 1;
+    }
+    catch (const std::exception &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.what() << endl;
+        return 1;
+    }
+}
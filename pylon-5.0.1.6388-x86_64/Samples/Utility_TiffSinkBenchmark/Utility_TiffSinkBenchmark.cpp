@@ -0,0 +1,206 @@
+// Utility_TiffSinkBenchmark.cpp
+/*
+    This utility compares the POSIX and the io_uring backend of the TIFF file sinks in
+    TiffFileSink.h.
+
+    Usage: Utility_TiffSinkBenchmark [-fsync] [-frames N] [directory ...]
+
+    A set of frames is grabbed from the pylon camera emulator (set PYLON_CAMEMU=1) and kept,
+    so the measurement only covers the save path and not the image generation of the emulator.
+    The frames are then written again and again through a CFrameWriterPool, once with each
+    backend, into every given directory (default: /dev/shm and the current directory, i.e.
+    tmpfs and a real disk). For each run, the achieved frame rate and the CPU time used by the
+    process (user and system, from getrusage) are printed. With -fsync, every file is synced
+    before it is closed.
+
+    The written files are removed after each run.
+*/
+
+// Include files to use the PYLON API.
+#include <pylon/PylonIncludes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <vector>
+#include <iomanip>
+#include "../include/TiffFileSink.h"
+
+// Namespace for using pylon objects.
+using namespace Pylon;
+
+// Namespace for using GenApi objects.
+using namespace GenApi;
+
+// Namespace for using cout.
+using namespace std;
+
+// Number of different frames kept from the emulator; they are written round robin.
+static const size_t c_countOfFramesToKeep = 16;
+
+// Writer pool settings. The POSIX backend needs several threads to keep the disk busy,
+// the io_uring backend submits batches from a single thread.
+static const size_t c_numPosixWriterThreads = 4;
+static const size_t c_numUringWriterThreads = 1;
+static const size_t c_writeQueueCapacity = 64;
+static const size_t c_maxBatch = 16;
+
+
+static double GetCpuSeconds()
+{
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6
+        + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+
+// Writes frameCount files into directory and prints frames/s and CPU usage.
+static void RunBackend( ETiffSinkBackend backend, const vector<CGrabResultPtr>& frames, const string& directory, size_t frameCount, bool useFsync)
+{
+    IFrameSink* pSink = CreateTiffFileSink( backend, useFsync, true);
+    const bool isUring = dynamic_cast<CPosixTiffSink*>( pSink) == NULL;
+    vector<string> names( frameCount);
+    for ( size_t i = 0; i < frameCount; ++i )
+    {
+        char name[64];
+        sprintf( name, "/TiffSinkBenchmark_%.5u.tiff", (unsigned int) i);
+        names[i] = directory + name;
+    }
+
+    const double cpuStart = GetCpuSeconds();
+    const uint64_t start = GetMonotonicTimeNs();
+    {
+        CFrameWriterPool writerPool( *pSink, isUring ? c_numUringWriterThreads : c_numPosixWriterThreads, c_writeQueueCapacity, QueueFull_Block, c_maxBatch);
+        for ( size_t i = 0; i < frameCount; ++i )
+        {
+            writerPool.Push( frames[ i % frames.size() ], names[i]);
+        }
+        writerPool.Stop();
+        if ( writerPool.GetDroppedCount() != 0 )
+        {
+            cerr << writerPool.GetDroppedCount() << " frames have not been written." << endl;
+        }
+    }
+    const double seconds = (GetMonotonicTimeNs() - start) * 1e-9;
+    const double cpuSeconds = GetCpuSeconds() - cpuStart;
+
+    cout << setw( 6) << (isUring ? "uring" : "posix") << "  " << setw( 9) << frameCount / seconds << " frames/s  "
+         << setw( 7) << 100.0 * cpuSeconds / seconds << " % CPU  "
+         << setw( 7) << 1e6 * cpuSeconds / frameCount << " us CPU/frame" << endl;
+#if defined( PYLON_SAMPLES_HAVE_IO_URING )
+    if ( isUring )
+    {
+        static_cast<CUringTiffSink*>( pSink)->PrintStatistics( cout);
+    }
+#endif
+    delete pSink;
+
+    for ( size_t i = 0; i < frameCount; ++i )
+    {
+        unlink( names[i].c_str());
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    // The exit code of the sample application.
+    int exitCode = 0;
+
+    bool useFsync = false;
+    size_t frameCount = 1000;
+    vector<string> directories;
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( strcmp( argv[i], "-fsync") == 0 )
+        {
+            useFsync = true;
+        }
+        else if ( strcmp( argv[i], "-frames") == 0 && i + 1 < argc )
+        {
+            frameCount = strtoul( argv[++i], NULL, 10);
+        }
+        else
+        {
+            directories.push_back( argv[i]);
+        }
+    }
+    if ( directories.empty() )
+    {
+        directories.push_back( "/dev/shm");
+        directories.push_back( ".");
+    }
+
+    // Before using any pylon methods, the pylon runtime must be initialized.
+    PylonInitialize();
+
+    try
+    {
+        // Only look for the camera emulator.
+        CDeviceInfo info;
+        info.SetDeviceClass( BaslerCamEmuDeviceClass);
+        CInstantCamera camera( CTlFactory::GetInstance().CreateFirstDevice( info));
+        cout << "Using device " << camera.GetDeviceInfo().GetModelName() << endl;
+
+        // Prefer a 16 bit format, as written by the burst recorder for Mono12 cameras.
+        camera.Open();
+        INodeMap& nodemap = camera.GetNodeMap();
+        CEnumerationPtr pixelFormat( nodemap.GetNode( "PixelFormat"));
+        if ( IsWritable( pixelFormat) )
+        {
+            if ( IsAvailable( pixelFormat->GetEntryByName( "Mono12")) )
+            {
+                pixelFormat->FromString( "Mono12");
+            }
+            else if ( IsAvailable( pixelFormat->GetEntryByName( "Mono16")) )
+            {
+                pixelFormat->FromString( "Mono16");
+            }
+        }
+
+        // Keep all grabbed frames; the camera needs one more buffer than frames are held.
+        camera.MaxNumBuffer = c_countOfFramesToKeep + 1;
+        camera.StartGrabbing( c_countOfFramesToKeep);
+        vector<CGrabResultPtr> frames;
+        while ( camera.IsGrabbing() )
+        {
+            CGrabResultPtr ptrGrabResult;
+            camera.RetrieveResult( 5000, ptrGrabResult, TimeoutHandling_ThrowException);
+            if ( ptrGrabResult->GrabSucceeded() )
+            {
+                frames.push_back( ptrGrabResult);
+            }
+        }
+        if ( frames.empty() )
+        {
+            throw RUNTIME_EXCEPTION( "No frame has been grabbed.");
+        }
+        cout << "Frame " << frames[0]->GetWidth() << " x " << frames[0]->GetHeight() << " "
+             << CPixelTypeMapper::GetNameByPixelType( frames[0]->GetPixelType()) << ", "
+             << frameCount << " frames per run" << (useFsync ? ", fsync" : "") << endl;
+        cout << fixed << setprecision( 1);
+
+        for ( size_t d = 0; d < directories.size(); ++d )
+        {
+            cout << endl << "Directory " << directories[d] << ":" << endl;
+            RunBackend( TiffSinkBackend_Posix, frames, directories[d], frameCount, useFsync);
+            RunBackend( TiffSinkBackend_Uring, frames, directories[d], frameCount, useFsync);
+        }
+
+        // Release the frames before the camera is destroyed.
+        frames.clear();
+    }
+    catch (GenICam::GenericException &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.GetDescription() << endl;
+        exitCode = 1;
+    }
+
+    // Releases all pylon resources.
+    PylonTerminate();
+
+    return exitCode;
+}
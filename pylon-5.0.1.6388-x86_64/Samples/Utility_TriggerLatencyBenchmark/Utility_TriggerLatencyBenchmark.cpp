@@ -0,0 +1,323 @@
+// Utility_TriggerLatencyBenchmark.cpp
+/*
+    This utility measures the latency from a software trigger to the delivery of the image to
+    an image event handler, i.e. the path shown in Grab_UsingGrabLoopThread.
+
+    Usage: Utility_TriggerLatencyBenchmark [-rate Hz] [-triggers N] [-exposure us] [-json file]
+
+    The pylon camera emulator is used, so no camera hardware is needed; if PYLON_CAMEMU is not
+    set, it is set to 1. Set -exposure to take the exposure time out of the measurement as far
+    as the device allows.
+    The camera is configured with CSoftwareTriggerConfiguration and grabs with the grab loop
+    thread of the instant camera. Triggers are fired at the given rate (default 100 Hz) on a
+    fixed schedule. Before each trigger, WaitForFrameTriggerReady() is called if the device
+    supports it; otherwise the image of the previous trigger is waited for.
+
+    Printed are the trigger to OnImageGrabbed latency with its percentiles and jitter (standard
+    deviation), the time ExecuteSoftwareTrigger() takes, and how late the triggers were fired
+    compared to the schedule. With -json, the same figures are also written to the given file
+    as a JSON object, for tracking regressions.
+*/
+
+// Include files to use the PYLON API.
+#include <pylon/PylonIncludes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include "../include/LatencyHistogram.h"
+
+// Namespace for using pylon objects.
+using namespace Pylon;
+
+// Namespace for using GenApi objects.
+using namespace GenApi;
+
+// Namespace for using cout.
+using namespace std;
+
+// Triggers that can be in flight; the n-th image belongs to the n-th trigger.
+static const size_t c_triggerSlots = 1024;
+
+// Records the latency from the trigger to the image event handler.
+class CTriggerLatencyHandler : public CImageEventHandler
+{
+public:
+    CTriggerLatencyHandler()
+        : m_triggerTimes()
+        , m_images( 0)
+        , m_failed( 0)
+    {
+    }
+
+    // Called by the trigger thread just before the trigger is executed.
+    void SetTriggerTime( uint64_t trigger, uint64_t timeNs)
+    {
+        m_triggerTimes[ trigger % c_triggerSlots ].store( timeNs, std::memory_order_release);
+    }
+
+    virtual void OnImageGrabbed( CInstantCamera& /*camera*/, const CGrabResultPtr& ptrGrabResult)
+    {
+        const uint64_t nowNs = GetMonotonicTimeNs();
+        const uint64_t image = m_images.load( std::memory_order_relaxed);
+        if ( ptrGrabResult->GrabSucceeded() )
+        {
+            m_latency.Record( nowNs - m_triggerTimes[ image % c_triggerSlots ].load( std::memory_order_acquire));
+        }
+        else
+        {
+            ++m_failed;
+        }
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            m_images.store( image + 1, std::memory_order_release);
+        }
+        m_imageArrived.notify_all();
+    }
+
+    // Waits until the given number of images has arrived. Returns false on timeout.
+    bool WaitForImages( uint64_t count, unsigned int timeoutMs)
+    {
+        std::unique_lock<std::mutex> lock( m_mutex);
+        return m_imageArrived.wait_for( lock, std::chrono::milliseconds( timeoutMs), [&] { return m_images.load() >= count; });
+    }
+
+    // Only call after grabbing has been stopped.
+    const CLatencyHistogram& GetLatency() const
+    {
+        return m_latency;
+    }
+
+    uint64_t GetImageCount() const
+    {
+        return m_images.load();
+    }
+
+    uint64_t GetFailedCount() const
+    {
+        return m_failed;
+    }
+
+private:
+    std::atomic<uint64_t> m_triggerTimes[ c_triggerSlots ];
+    std::atomic<uint64_t> m_images;
+    uint64_t m_failed;
+    CLatencyHistogram m_latency;
+    std::mutex m_mutex;
+    std::condition_variable m_imageArrived;
+};
+
+static void SleepUntil( uint64_t timeNs)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t) (timeNs / 1000000000ULL);
+    ts.tv_nsec = (long) (timeNs % 1000000000ULL);
+    int error;
+    while ( (error = clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) != 0 )
+    {
+        if ( error != EINTR )
+        {
+            throw RUNTIME_EXCEPTION( "Sleeping until the next trigger failed: %s", strerror( error));
+        }
+    }
+}
+
+// Writes a string as a quoted JSON string.
+static void WriteJsonString( ostream& os, const char* text)
+{
+    os << '"';
+    for ( const char* p = text; *p != 0; ++p )
+    {
+        const unsigned char c = (unsigned char) *p;
+        if ( c == '"' || c == '\\' )
+        {
+            os << '\\' << *p;
+        }
+        else if ( c < 0x20 )
+        {
+            char escaped[8];
+            snprintf( escaped, sizeof( escaped), "\\u%04x", c);
+            os << escaped;
+        }
+        else
+        {
+            os << *p;
+        }
+    }
+    os << '"';
+}
+
+static void WriteJson( const char* filename, const String_t& device, double rate, uint64_t triggers, uint64_t images,
+    const CLatencyHistogram& latency, const CLatencyHistogram& execute, const CLatencyHistogram& lateness)
+{
+    ofstream json( filename);
+    json << "{" << endl << "  \"device\": ";
+    WriteJsonString( json, device.c_str());
+    json << "," << endl
+         << "  \"rate_hz\": " << rate << "," << endl
+         << "  \"triggers\": " << triggers << "," << endl
+         << "  \"images\": " << images << "," << endl
+         << "  \"unit\": \"us\"," << endl
+         << "  \"trigger_to_image\": ";
+    latency.PrintJson( json);
+    json << "," << endl << "  \"execute_software_trigger\": ";
+    execute.PrintJson( json);
+    json << "," << endl << "  \"trigger_lateness\": ";
+    lateness.PrintJson( json);
+    json << endl << "}" << endl;
+    if ( !json )
+    {
+        throw RUNTIME_EXCEPTION( "Could not write %s.", filename);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // The exit code of the sample application.
+    int exitCode = 0;
+
+    double rate = 100.0;
+    uint64_t triggerCount = 1000;
+    double exposureUs = 0.0;
+    const char* jsonFilename = NULL;
+    for ( int i = 1; i + 1 < argc; i += 2 )
+    {
+        if ( strcmp( argv[i], "-rate") == 0 )
+        {
+            rate = atof( argv[i + 1]);
+        }
+        else if ( strcmp( argv[i], "-triggers") == 0 )
+        {
+            triggerCount = strtoull( argv[i + 1], NULL, 10);
+        }
+        else if ( strcmp( argv[i], "-exposure") == 0 )
+        {
+            exposureUs = atof( argv[i + 1]);
+        }
+        else if ( strcmp( argv[i], "-json") == 0 )
+        {
+            jsonFilename = argv[i + 1];
+        }
+    }
+    if ( rate <= 0.0 || triggerCount == 0 )
+    {
+        cerr << "Usage: " << argv[0] << " [-rate Hz] [-triggers N] [-exposure us] [-json file]" << endl;
+        return 1;
+    }
+
+    // The number of emulated cameras is read when pylon is initialized.
+    if ( getenv( "PYLON_CAMEMU") == NULL )
+    {
+        setenv( "PYLON_CAMEMU", "1", 1);
+    }
+
+    // Automagically call PylonInitialize and PylonTerminate to ensure the pylon runtime system
+    // is initialized during the lifetime of this object.
+    Pylon::PylonAutoInitTerm autoInitTerm;
+
+    try
+    {
+        // The handler must outlive the camera, which calls it from the grab loop thread.
+        CTriggerLatencyHandler handler;
+
+        // Only look for the camera emulator.
+        CDeviceInfo info;
+        info.SetDeviceClass( BaslerCamEmuDeviceClass);
+        CInstantCamera camera( CTlFactory::GetInstance().CreateFirstDevice( info));
+        const String_t device = camera.GetDeviceInfo().GetModelName();
+        cout << "Using device " << device << endl;
+
+        camera.RegisterConfiguration( new CSoftwareTriggerConfiguration, RegistrationMode_ReplaceAll, Cleanup_Delete);
+        camera.RegisterImageEventHandler( &handler, RegistrationMode_Append, Cleanup_None);
+        camera.Open();
+
+        if ( exposureUs > 0.0 )
+        {
+            CFloatPtr exposureTime( camera.GetNodeMap().GetNode( "ExposureTimeAbs"));
+            if ( !IsWritable( exposureTime) )
+            {
+                exposureTime = camera.GetNodeMap().GetNode( "ExposureTime");
+            }
+            if ( IsWritable( exposureTime) )
+            {
+                exposureTime->SetValue( std::max( exposureTime->GetMin(), std::min( exposureTime->GetMax(), exposureUs)));
+                cout << "Exposure time " << exposureTime->GetValue() << " us" << endl;
+            }
+            else
+            {
+                cerr << "The exposure time cannot be set." << endl;
+            }
+        }
+
+        const bool canWaitForTriggerReady = camera.CanWaitForFrameTriggerReady();
+        camera.StartGrabbing( GrabStrategy_OneByOne, GrabLoop_ProvidedByInstantCamera);
+
+        CLatencyHistogram execute;
+        CLatencyHistogram lateness;
+        const uint64_t periodNs = (uint64_t) (1e9 / rate);
+        const uint64_t startNs = GetMonotonicTimeNs() + periodNs;
+        uint64_t triggers = 0;
+        for ( ; triggers < triggerCount; ++triggers )
+        {
+            const uint64_t scheduledNs = startNs + triggers * periodNs;
+            SleepUntil( scheduledNs);
+            if ( canWaitForTriggerReady )
+            {
+                camera.WaitForFrameTriggerReady( 1000, TimeoutHandling_ThrowException);
+            }
+            else if ( !handler.WaitForImages( triggers, 1000) )
+            {
+                cerr << "The image of trigger " << triggers - 1 << " has not arrived." << endl;
+                break;
+            }
+
+            const uint64_t triggerNs = GetMonotonicTimeNs();
+            handler.SetTriggerTime( triggers, triggerNs);
+            camera.ExecuteSoftwareTrigger();
+            execute.Record( GetMonotonicTimeNs() - triggerNs);
+            lateness.Record( triggerNs - scheduledNs);
+        }
+        const uint64_t elapsedNs = GetMonotonicTimeNs() - startNs;
+
+        if ( !handler.WaitForImages( triggers, 1000) )
+        {
+            cerr << triggers - handler.GetImageCount() << " images have not arrived." << endl;
+            exitCode = 1;
+        }
+        camera.StopGrabbing();
+        camera.DeregisterImageEventHandler( &handler);
+
+        // The first trigger is fired at startNs, so triggers - 1 periods have passed since.
+        const double achievedRate = triggers > 1 ? (triggers - 1) * 1e9 / elapsedNs : 0.0;
+        cout << triggers << " triggers at " << rate << " Hz (achieved " << fixed << setprecision( 1) << achievedRate
+             << " Hz), " << handler.GetImageCount() << " images, " << handler.GetFailedCount() << " failed" << endl;
+        handler.GetLatency().Print( cout, "Trigger to OnImageGrabbed");
+        cout << "Jitter (standard deviation): " << handler.GetLatency().GetStandardDeviation() / 1000.0 << " us" << endl;
+        execute.Print( cout, "ExecuteSoftwareTrigger()");
+        lateness.Print( cout, "Trigger lateness");
+
+        if ( jsonFilename != NULL )
+        {
+            WriteJson( jsonFilename, device, rate, triggers, handler.GetImageCount(), handler.GetLatency(), execute, lateness);
+            cout << "Report written to " << jsonFilename << endl;
+        }
+    }
+    catch (const GenericException &e)
+    {
+        // Error handling.
+        cerr << "An exception occurred." << endl
+        << e.GetDescription() << endl;
+        exitCode = 1;
+    }
+
+    return exitCode;
+}
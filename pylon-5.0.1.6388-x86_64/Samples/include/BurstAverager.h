@@ -0,0 +1,567 @@
+// Contains a stage that reduces each burst of frames of a static scene to one averaged frame.
+//
+// The frames are accumulated as they arrive: each pixel is added to a 32 bit sum, widened from
+// 8 or 16 bits. With sigma clipping, the sum of squares and the minimum and maximum of each pixel
+// are kept as well. When the last frame of a burst has been added, its sums are queued to the
+// averaging thread of the averager, and the next burst is accumulated into another set of sums
+// from a small pool. The averaging thread computes the average and hands it to the
+// IBurstAverageHandler as Mono16 or float frame; no frame of the burst is kept. Only when all
+// sums of the pool are still queued does the adding thread wait for the averaging thread.
+//
+// Sigma clipping works in one pass, so it can reject the brightest and the darkest sample of a
+// pixel only, e.g. a hot pixel flicker or a cosmic ray hit. A sample is rejected if it deviates
+// from the mean of the other samples by more than clipSigma times their standard deviation. With
+// a few frames, that standard deviation is often far too small by chance, so it is at least the
+// noise of the burst: the median of the pixel variances, sampled on every 16th pixel, which
+// outliers hardly affect. This needs at least three frames. Burst lengths up to 255 frames are
+// supported, so the sums of squares of Mono12 pixels fit into 32 bits.
+//
+// The AVX2 kernel accumulates 16 pixels per iteration; both kernels give the same sums.
+// The class only uses the C++ standard library. AddFrame() and SkipFrame() must be called from
+// one thread, e.g. the grab loop thread in an image event handler. Flush() waits until the
+// handler has got all complete bursts; the destructor flushes as well.
+
+#ifndef INCLUDED_BURSTAVERAGER_H_7380164
+#define INCLUDED_BURSTAVERAGER_H_7380164
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <immintrin.h>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <ostream>
+#include "LatencyHistogram.h"
+
+namespace Pylon
+{
+    namespace BurstAverageKernels
+    {
+        enum EKernel
+        {
+            Kernel_Auto,
+            Kernel_Scalar,
+            Kernel_Avx2
+        };
+
+        // Adds count pixels to the sums. pSquares, pMin and pMax are NULL without sigma clipping.
+        template <typename T>
+        inline void AccumulateRowScalar( const T* pPixels, size_t count, uint32_t* pSums, uint32_t* pSquares, uint16_t* pMin, uint16_t* pMax)
+        {
+            for ( size_t i = 0; i < count; ++i )
+            {
+                const uint32_t value = pPixels[i];
+                pSums[i] += value;
+                if ( pSquares != NULL )
+                {
+                    pSquares[i] += value * value;
+                    pMin[i] = (uint16_t) std::min<uint32_t>( pMin[i], value);
+                    pMax[i] = (uint16_t) std::max<uint32_t>( pMax[i], value);
+                }
+            }
+        }
+
+        template <typename T>
+        inline T* Offset( T* p, size_t i)
+        {
+            return p != NULL ? p + i : NULL;
+        }
+
+        __attribute__(( target( "avx2")))
+        inline void AddSums( uint32_t* pSums, __m256i first, __m256i second)
+        {
+            _mm256_storeu_si256( (__m256i*) pSums, _mm256_add_epi32( _mm256_loadu_si256( (const __m256i*) pSums), first));
+            _mm256_storeu_si256( (__m256i*) (pSums + 8), _mm256_add_epi32( _mm256_loadu_si256( (const __m256i*) (pSums + 8)), second));
+        }
+
+        // Adds 16 pixels in 16 bit lanes.
+        __attribute__(( target( "avx2")))
+        inline void Accumulate16( __m256i pixels, uint32_t* pSums, uint32_t* pSquares, uint16_t* pMin, uint16_t* pMax)
+        {
+            AddSums( pSums, _mm256_cvtepu16_epi32( _mm256_castsi256_si128( pixels)), _mm256_cvtepu16_epi32( _mm256_extracti128_si256( pixels, 1)));
+            if ( pSquares != NULL )
+            {
+                // The 32 bit squares from the low and high product halves, unpacked per lane and
+                // put back into pixel order.
+                const __m256i low = _mm256_mullo_epi16( pixels, pixels);
+                const __m256i high = _mm256_mulhi_epu16( pixels, pixels);
+                const __m256i squares0 = _mm256_unpacklo_epi16( low, high);
+                const __m256i squares1 = _mm256_unpackhi_epi16( low, high);
+                AddSums( pSquares, _mm256_permute2x128_si256( squares0, squares1, 0x20), _mm256_permute2x128_si256( squares0, squares1, 0x31));
+                _mm256_storeu_si256( (__m256i*) pMin, _mm256_min_epu16( _mm256_loadu_si256( (const __m256i*) pMin), pixels));
+                _mm256_storeu_si256( (__m256i*) pMax, _mm256_max_epu16( _mm256_loadu_si256( (const __m256i*) pMax), pixels));
+            }
+        }
+
+        __attribute__(( target( "avx2")))
+        inline void AccumulateRowAvx2( const uint8_t* pPixels, size_t count, uint32_t* pSums, uint32_t* pSquares, uint16_t* pMin, uint16_t* pMax)
+        {
+            size_t i = 0;
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                const __m256i pixels = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*) (pPixels + i)));
+                Accumulate16( pixels, pSums + i, Offset( pSquares, i), Offset( pMin, i), Offset( pMax, i));
+            }
+            AccumulateRowScalar( pPixels + i, count - i, pSums + i, Offset( pSquares, i), Offset( pMin, i), Offset( pMax, i));
+        }
+
+        __attribute__(( target( "avx2")))
+        inline void AccumulateRowAvx2( const uint16_t* pPixels, size_t count, uint32_t* pSums, uint32_t* pSquares, uint16_t* pMin, uint16_t* pMax)
+        {
+            size_t i = 0;
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                const __m256i pixels = _mm256_loadu_si256( (const __m256i*) (pPixels + i));
+                Accumulate16( pixels, pSums + i, Offset( pSquares, i), Offset( pMin, i), Offset( pMax, i));
+            }
+            AccumulateRowScalar( pPixels + i, count - i, pSums + i, Offset( pSquares, i), Offset( pMin, i), Offset( pMax, i));
+        }
+
+        inline EKernel GetBestKernel()
+        {
+            static const EKernel best = __builtin_cpu_supports( "avx2") ? Kernel_Avx2 : Kernel_Scalar;
+            return best;
+        }
+
+        inline const char* GetKernelName( EKernel kernel)
+        {
+            return (kernel == Kernel_Auto ? GetBestKernel() : kernel) == Kernel_Avx2 ? "AVX2" : "scalar";
+        }
+
+        template <typename T>
+        inline void AccumulateRow( const T* pPixels, size_t count, uint32_t* pSums, uint32_t* pSquares, uint16_t* pMin, uint16_t* pMax,
+            EKernel kernel = Kernel_Auto)
+        {
+            if ( (kernel == Kernel_Auto ? GetBestKernel() : kernel) == Kernel_Avx2 )
+            {
+                AccumulateRowAvx2( pPixels, count, pSums, pSquares, pMin, pMax);
+            }
+            else
+            {
+                AccumulateRowScalar( pPixels, count, pSums, pSquares, pMin, pMax);
+            }
+        }
+    }
+
+
+    enum EBurstAverageOutput
+    {
+        BurstAverageOutput_Mono16,  // uint16_t, scaled to the full 16 bit range (Mono12 values times 16).
+        BurstAverageOutput_Float    // float, in gray values of the input.
+    };
+
+
+    // An averaged burst. The buffer belongs to the averager and is valid during OnBurstAverage() only,
+    // which is called on the averaging thread.
+    struct SBurstAverage
+    {
+        uint64_t burstIndex;
+        uint32_t width;
+        uint32_t height;
+        uint32_t bitsPerPixel;          // Of the input frames.
+        EBurstAverageOutput output;
+        const void* pBuffer;            // width * height pixels, row by row.
+        uint32_t frameCount;            // Frames averaged, less than the burst length if frames were skipped.
+        uint64_t rejectedSamples;       // Pixel samples removed by sigma clipping.
+    };
+
+
+    class IBurstAverageHandler
+    {
+    public:
+        virtual ~IBurstAverageHandler() {}
+        virtual void OnBurstAverage( const SBurstAverage& average) = 0;
+    };
+
+
+    class CBurstAverager
+    {
+    public:
+        // clipSigma 0 disables sigma clipping.
+        CBurstAverager( uint32_t burstLength, IBurstAverageHandler& handler, EBurstAverageOutput output = BurstAverageOutput_Mono16,
+            double clipSigma = 0.0, BurstAverageKernels::EKernel kernel = BurstAverageKernels::Kernel_Auto)
+            : m_burstLength( burstLength)
+            , m_handler( handler)
+            , m_output( output)
+            , m_clipSigma( clipSigma)
+            , m_kernel( kernel)
+            , m_framesInBurst( 0)
+            , m_addedInBurst( 0)
+            , m_nextBurstIndex( 0)
+            , m_frames( 0)
+            , m_skippedFrames( 0)
+            , m_failedFrames( 0)
+            , m_blockedBursts( 0)
+            , m_burstBufferCount( 0)
+            , m_averaging( false)
+            , m_stopping( false)
+            , m_bursts( 0)
+            , m_failedBursts( 0)
+            , m_rejectedSamples( 0)
+        {
+            if ( burstLength == 0 || burstLength > 255 || clipSigma < 0.0 )
+            {
+                throw std::invalid_argument( "CBurstAverager: the burst length must be 1 to 255 and clipSigma must not be negative.");
+            }
+            m_averagingThread = std::thread( &CBurstAverager::AveragingLoop, this);
+        }
+
+        // Averages the bursts still queued; an incomplete burst is discarded.
+        ~CBurstAverager()
+        {
+            {
+                std::lock_guard<std::mutex> lock( m_mutex);
+                m_stopping = true;
+            }
+            m_burstQueued.notify_one();
+            m_averagingThread.join();
+        }
+
+        // Adds a Mono8 (bitsPerPixel 8) or Mono12 (bitsPerPixel 12, 16 bit containers) frame.
+        // stride is the distance between the starts of two lines in bytes; 0 means the lines are
+        // not padded. Returns false if the frame does not match the size and format of the
+        // frames before it in the burst; it then counts as skipped.
+        bool AddFrame( const void* pBuffer, uint32_t width, uint32_t height, size_t stride, uint32_t bitsPerPixel)
+        {
+            const uint64_t startNs = GetMonotonicTimeNs();
+            if ( (bitsPerPixel != 8 && bitsPerPixel != 12)
+                || (m_addedInBurst != 0 && (width != m_pBurst->width || height != m_pBurst->height || bitsPerPixel != m_pBurst->bitsPerPixel)) )
+            {
+                ++m_failedFrames;
+                SkipFrame();
+                return false;
+            }
+            if ( m_addedInBurst == 0 )
+            {
+                StartBurst( width, height, bitsPerPixel);
+            }
+
+            const size_t bytesPerPixel = bitsPerPixel > 8 ? 2 : 1;
+            stride = stride != 0 ? stride : width * bytesPerPixel;
+            const bool clip = m_clipSigma > 0.0;
+            SBurst& burst = *m_pBurst;
+            for ( uint32_t y = 0; y < height; ++y )
+            {
+                const uint8_t* pLine = static_cast<const uint8_t*>( pBuffer) + y * stride;
+                const size_t first = (size_t) y * width;
+                uint32_t* pSquares = clip ? &burst.squares[ first ] : NULL;
+                uint16_t* pMin = clip ? &burst.min[ first ] : NULL;
+                uint16_t* pMax = clip ? &burst.max[ first ] : NULL;
+                if ( bytesPerPixel == 1 )
+                {
+                    BurstAverageKernels::AccumulateRow( pLine, width, &burst.sums[ first ], pSquares, pMin, pMax, m_kernel);
+                }
+                else
+                {
+                    BurstAverageKernels::AccumulateRow( reinterpret_cast<const uint16_t*>( pLine), width, &burst.sums[ first ], pSquares, pMin, pMax, m_kernel);
+                }
+            }
+            ++m_addedInBurst;
+            ++m_frames;
+            m_accumulateTime.Record( GetMonotonicTimeNs() - startNs);
+            CountFrame();
+            return true;
+        }
+
+        // Counts a frame of the burst that could not be grabbed, so the burst still ends after
+        // burstLength frames.
+        void SkipFrame()
+        {
+            ++m_skippedFrames;
+            CountFrame();
+        }
+
+        // Waits until the handler has got all complete bursts added so far.
+        void Flush()
+        {
+            std::unique_lock<std::mutex> lock( m_mutex);
+            m_burstAveraged.wait( lock, [this] { return m_queuedBursts.empty() && !m_averaging; });
+        }
+
+        // The accumulation times are recorded by the adding thread, call these from it.
+        CLatencyHistogram GetAccumulateTime() const
+        {
+            return m_accumulateTime;
+        }
+
+        CLatencyHistogram GetAverageTime() const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            return m_averageTime;
+        }
+
+        void PrintStatistics( std::ostream& os) const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            os << "Burst averaging (" << BurstAverageKernels::GetKernelName( m_kernel) << "): " << m_bursts << " bursts of " << m_burstLength
+               << " frames, " << m_frames << " frames added, " << m_skippedFrames << " skipped (" << m_failedFrames << " of another format)";
+            if ( m_clipSigma > 0.0 )
+            {
+                os << ", " << m_rejectedSamples << " samples rejected at " << m_clipSigma << " sigma";
+            }
+            os << ", " << m_failedBursts << " handler errors, " << m_blockedBursts << " waits for the averaging thread" << std::endl;
+            m_accumulateTime.Print( os, "Accumulation time per frame");
+            m_averageTime.Print( os, "Averaging time per burst");
+        }
+
+    private:
+        // The sums of one burst, accumulating or queued for averaging, and reused afterwards.
+        struct SBurst
+        {
+            uint64_t index;
+            uint32_t width;
+            uint32_t height;
+            uint32_t bitsPerPixel;
+            uint32_t frameCount;
+            std::vector<uint32_t> sums;
+            std::vector<uint32_t> squares;
+            std::vector<uint16_t> min;
+            std::vector<uint16_t> max;
+        };
+
+        // One burst accumulating and up to two queued; more only wait for the averaging thread.
+        static const size_t c_burstBuffers = 3;
+
+        void StartBurst( uint32_t width, uint32_t height, uint32_t bitsPerPixel)
+        {
+            {
+                std::unique_lock<std::mutex> lock( m_mutex);
+                if ( m_freeBursts.empty() && m_burstBufferCount == c_burstBuffers )
+                {
+                    ++m_blockedBursts;
+                    m_burstAveraged.wait( lock, [this] { return !m_freeBursts.empty(); });
+                }
+                if ( !m_freeBursts.empty() )
+                {
+                    m_pBurst = std::move( m_freeBursts.back());
+                    m_freeBursts.pop_back();
+                }
+            }
+            if ( !m_pBurst )
+            {
+                m_pBurst.reset( new SBurst);
+                ++m_burstBufferCount;
+            }
+
+            const size_t pixelCount = (size_t) width * height;
+            SBurst& burst = *m_pBurst;
+            burst.width = width;
+            burst.height = height;
+            burst.bitsPerPixel = bitsPerPixel;
+            burst.sums.assign( pixelCount, 0);
+            if ( m_clipSigma > 0.0 )
+            {
+                burst.squares.assign( pixelCount, 0);
+                burst.min.assign( pixelCount, 0xFFFF);
+                burst.max.assign( pixelCount, 0);
+            }
+        }
+
+        void CountFrame()
+        {
+            if ( ++m_framesInBurst < m_burstLength )
+            {
+                return;
+            }
+            if ( m_addedInBurst != 0 )
+            {
+                m_pBurst->index = m_nextBurstIndex++;
+                m_pBurst->frameCount = m_addedInBurst;
+                {
+                    std::lock_guard<std::mutex> lock( m_mutex);
+                    m_queuedBursts.push_back( std::move( m_pBurst));
+                }
+                m_burstQueued.notify_one();
+            }
+            m_framesInBurst = 0;
+            m_addedInBurst = 0;
+        }
+
+        void AveragingLoop()
+        {
+            for (;;)
+            {
+                std::unique_ptr<SBurst> pBurst;
+                {
+                    std::unique_lock<std::mutex> lock( m_mutex);
+                    m_burstQueued.wait( lock, [this] { return !m_queuedBursts.empty() || m_stopping; });
+                    if ( m_queuedBursts.empty() )
+                    {
+                        return;
+                    }
+                    pBurst = std::move( m_queuedBursts.front());
+                    m_queuedBursts.pop_front();
+                    m_averaging = true;
+                }
+
+                bool failed = false;
+                try
+                {
+                    Average( *pBurst);
+                }
+                catch (...)
+                {
+                    // The handler failed, e.g. writing the file; the next bursts are averaged anyway.
+                    failed = true;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock( m_mutex);
+                    if ( failed )
+                    {
+                        ++m_failedBursts;
+                    }
+                    m_freeBursts.push_back( std::move( pBurst));
+                    m_averaging = false;
+                }
+                m_burstAveraged.notify_all();
+            }
+        }
+
+        void Average( const SBurst& burst)
+        {
+            const uint64_t startNs = GetMonotonicTimeNs();
+            const size_t pixelCount = (size_t) burst.width * burst.height;
+            const double scale = m_output == BurstAverageOutput_Mono16 ? 65536.0 / (1u << burst.bitsPerPixel) : 1.0;
+            const bool clip = m_clipSigma > 0.0 && burst.frameCount >= 3;
+            const double others = burst.frameCount - 1.0;
+            const double threshold = m_clipSigma * m_clipSigma * (1.0 + 1.0 / others);
+            const double noiseVariance = clip ? EstimateNoiseVariance( burst) : 0.0;
+            uint64_t rejected = 0;
+            if ( m_output == BurstAverageOutput_Mono16 )
+            {
+                m_mono16Buffer.resize( pixelCount);
+            }
+            else
+            {
+                m_floatBuffer.resize( pixelCount);
+            }
+
+            const double frameScale = scale / burst.frameCount;
+            for ( size_t i = 0; i < pixelCount; ++i )
+            {
+                double value;
+                if ( clip )
+                {
+                    double sum = burst.sums[i];
+                    uint32_t count = burst.frameCount;
+                    if ( IsOutlier( burst.max[i], burst.sums[i], burst.squares[i], others, threshold, noiseVariance) )
+                    {
+                        sum -= burst.max[i];
+                        --count;
+                    }
+                    if ( IsOutlier( burst.min[i], burst.sums[i], burst.squares[i], others, threshold, noiseVariance) )
+                    {
+                        sum -= burst.min[i];
+                        --count;
+                    }
+                    rejected += burst.frameCount - count;
+                    value = sum * scale / count;
+                }
+                else
+                {
+                    value = burst.sums[i] * frameScale;
+                }
+
+                if ( m_output == BurstAverageOutput_Mono16 )
+                {
+                    m_mono16Buffer[i] = (uint16_t) std::min( value + 0.5, 65535.0);
+                }
+                else
+                {
+                    m_floatBuffer[i] = (float) value;
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock( m_mutex);
+                ++m_bursts;
+                m_rejectedSamples += rejected;
+                m_averageTime.Record( GetMonotonicTimeNs() - startNs);
+            }
+
+            SBurstAverage average;
+            average.burstIndex = burst.index;
+            average.width = burst.width;
+            average.height = burst.height;
+            average.bitsPerPixel = burst.bitsPerPixel;
+            average.output = m_output;
+            average.pBuffer = m_output == BurstAverageOutput_Mono16 ? (const void*) &m_mono16Buffer[0] : (const void*) &m_floatBuffer[0];
+            average.frameCount = burst.frameCount;
+            average.rejectedSamples = rejected;
+            m_handler.OnBurstAverage( average);
+        }
+
+        // Returns the median of the sample variances of every 16th pixel, at least one gray value
+        // squared.
+        double EstimateNoiseVariance( const SBurst& burst)
+        {
+            const size_t pixelCount = (size_t) burst.width * burst.height;
+            const double count = burst.frameCount;
+            m_varianceSamples.clear();
+            for ( size_t i = 0; i < pixelCount; i += 16 )
+            {
+                m_varianceSamples.push_back( (float) (((double) burst.squares[i] - (double) burst.sums[i] * burst.sums[i] / count) / (count - 1.0)));
+            }
+            const std::vector<float>::iterator median = m_varianceSamples.begin() + m_varianceSamples.size() / 2;
+            std::nth_element( m_varianceSamples.begin(), median, m_varianceSamples.end());
+            return std::max( (double) *median, 1.0);
+        }
+
+        // Tests the sample against the mean and the sample variance of the other samples of the
+        // pixel, which is at least noiseVariance. The deviation of a new sample from that mean
+        // has the variance times (1 + 1 / others), which is included in the threshold.
+        static bool IsOutlier( uint32_t sample, uint32_t sum, uint32_t squares, double others, double threshold, double noiseVariance)
+        {
+            const double mean = (sum - sample) / others;
+            const double variance = std::max( ((double) squares - (double) sample * sample - others * mean * mean) / (others - 1.0), noiseVariance);
+            const double deviation = sample - mean;
+            return deviation * deviation > threshold * variance;
+        }
+
+        const uint32_t m_burstLength;
+        IBurstAverageHandler& m_handler;
+        const EBurstAverageOutput m_output;
+        const double m_clipSigma;
+        const BurstAverageKernels::EKernel m_kernel;
+
+        // Used by the adding thread only.
+        uint32_t m_framesInBurst;       // Added and skipped.
+        uint32_t m_addedInBurst;
+        std::unique_ptr<SBurst> m_pBurst;
+        uint64_t m_nextBurstIndex;
+        uint64_t m_frames;
+        uint64_t m_skippedFrames;
+        uint64_t m_failedFrames;
+        uint64_t m_blockedBursts;
+        size_t m_burstBufferCount;
+        CLatencyHistogram m_accumulateTime;
+
+        // Used by the averaging thread only.
+        std::vector<uint16_t> m_mono16Buffer;
+        std::vector<float> m_floatBuffer;
+        std::vector<float> m_varianceSamples;
+
+        // Guarded by m_mutex.
+        mutable std::mutex m_mutex;
+        std::condition_variable m_burstQueued;
+        std::condition_variable m_burstAveraged;
+        std::deque< std::unique_ptr<SBurst> > m_queuedBursts;
+        std::vector< std::unique_ptr<SBurst> > m_freeBursts;
+        bool m_averaging;
+        bool m_stopping;
+        uint64_t m_bursts;
+        uint64_t m_failedBursts;
+        uint64_t m_rejectedSamples;
+        CLatencyHistogram m_averageTime;
+
+        std::thread m_averagingThread;
+    };
+}
+
+#endif /* INCLUDED_BURSTAVERAGER_H_7380164 */
@@ -0,0 +1,337 @@
+// Contains a burst session engine for cameras triggered in bursts.
+//
+// Every burst is grabbed as a grab session of framesPerBurst images, with the grab loop thread
+// of the instant camera. When the camera stops a session after its last image, the engine is
+// notified through the OnGrabStopped configuration event and Run() starts the next session right
+// away. Run() sleeps in between, so no core is spent polling IsGrabbing(). A run ends at a
+// wall-clock deadline, after a maximum number of bursts, or when Stop() is called.
+//
+// The camera ignores triggers while no session is running. This missed-trigger window lasts from
+// the OnGrabStop event (before acquisition is stopped) to the OnGrabStarted event of the next
+// session. Its duration is recorded, as well as the re-arm latency from OnGrabStopped to
+// OnGrabStarted.
+//
+// An IBurstEndHandler is called between two bursts, before the next one is armed, e.g. for
+// changing parameters that should stay constant within a burst. Its time adds to the window.
+//
+// The camera stops a session while retrieving its last image, before the image event handlers
+// get it. The session therefore also counts the images as an image event handler registered
+// after the others and ends a burst only when all of them have been handled, or after
+// c_lastImageTimeoutMs if an image does not arrive.
+
+#ifndef INCLUDED_BURSTSESSION_H_3318570
+#define INCLUDED_BURSTSESSION_H_3318570
+
+#include <pylon/PylonIncludes.h>
+#include <time.h>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
+#include <iomanip>
+#include "LatencyHistogram.h"
+
+namespace Pylon
+{
+    // How long CBurstSession::Run() waits for the last images of a burst after the session has stopped.
+    static const int c_lastImageTimeoutMs = 1000;
+
+
+    // Called by CBurstSession::Run() on its thread after a burst, before the next one is armed.
+    // The image event handlers registered before the session have handled all frames of the burst.
+    class IBurstEndHandler
+    {
+    public:
+        virtual ~IBurstEndHandler() {}
+        virtual void OnBurstEnd( CInstantCamera& camera, uint64_t burstCount) = 0;
+    };
+
+
+    class CBurstSession
+    {
+    public:
+        // The session registers itself as configuration and image event handler of the camera,
+        // after the image event handlers already registered. The camera must outlive the session.
+        CBurstSession( CInstantCamera& camera, size_t framesPerBurst, EGrabStrategy strategy = GrabStrategy_OneByOne)
+            : m_camera( camera)
+            , m_framesPerBurst( framesPerBurst)
+            , m_strategy( strategy)
+            , m_notifier( *this)
+            , m_maxBursts( 0)
+            , m_deadline( 0)
+            , m_pBurstEndHandler( NULL)
+            , m_sessionStopped( false)
+            , m_stopRequested( false)
+            , m_rearmPending( false)
+            , m_imagesHandled( 0)
+            , m_grabStopNs( 0)
+            , m_grabStoppedNs( 0)
+            , m_bursts( 0)
+            , m_rearms( 0)
+            , m_grabErrors( 0)
+            , m_runTimeNs( 0)
+            , m_windowTotalNs( 0)
+            , m_longestWindowNs( 0)
+            , m_longestWindowStart( 0)
+        {
+            m_camera.RegisterConfiguration( &m_notifier, RegistrationMode_Append, Cleanup_None);
+            m_camera.RegisterImageEventHandler( &m_notifier, RegistrationMode_Append, Cleanup_None);
+        }
+
+        ~CBurstSession()
+        {
+            m_camera.DeregisterImageEventHandler( &m_notifier);
+            m_camera.DeregisterConfiguration( &m_notifier);
+        }
+
+        // Ends the run after this many bursts, 0 for no limit.
+        void SetMaxBursts( uint64_t maxBursts)
+        {
+            m_maxBursts = maxBursts;
+        }
+
+        // Ends the run at the given wall-clock time, 0 for no deadline. A burst that is armed
+        // at the deadline is abandoned.
+        void SetDeadline( time_t deadline)
+        {
+            m_deadline = deadline;
+        }
+
+        // Sets the handler called between bursts, NULL for none. The handler must outlive the run.
+        void SetBurstEndHandler( IBurstEndHandler* pHandler)
+        {
+            m_pBurstEndHandler = pHandler;
+        }
+
+        // Grabs bursts until the deadline, the maximum number of bursts, or Stop().
+        // Returns the number of bursts completed.
+        uint64_t Run()
+        {
+            {
+                std::lock_guard<std::mutex> lock( m_mutex);
+                m_sessionStopped = false;
+                m_stopRequested = false;
+                m_rearmPending = false;
+                m_imagesHandled = 0;
+            }
+            const uint64_t runStartNs = GetMonotonicTimeNs();
+            const std::chrono::system_clock::time_point deadline = std::chrono::system_clock::from_time_t( m_deadline);
+            uint64_t bursts = 0;
+
+            m_camera.StartGrabbing( m_framesPerBurst, m_strategy, GrabLoop_ProvidedByInstantCamera);
+
+            std::unique_lock<std::mutex> lock( m_mutex);
+            for (;;)
+            {
+                if ( m_deadline != 0 )
+                {
+                    m_stateChanged.wait_until( lock, deadline, [this] { return m_sessionStopped || m_stopRequested; });
+                }
+                else
+                {
+                    m_stateChanged.wait( lock, [this] { return m_sessionStopped || m_stopRequested; });
+                }
+                if ( !m_sessionStopped )
+                {
+                    break; // Deadline or Stop() while a burst is armed.
+                }
+                m_stateChanged.wait_for( lock, std::chrono::milliseconds( c_lastImageTimeoutMs),
+                    [this] { return m_imagesHandled >= m_framesPerBurst || m_stopRequested; });
+                m_sessionStopped = false;
+                m_imagesHandled = 0;
+                ++bursts;
+                ++m_bursts;
+                if ( m_stopRequested
+                    || (m_maxBursts != 0 && bursts >= m_maxBursts)
+                    || (m_deadline != 0 && std::chrono::system_clock::now() >= deadline) )
+                {
+                    break;
+                }
+
+                // Re-arm. The lock must not be held while the camera calls the event handlers.
+                m_rearmPending = true;
+                lock.unlock();
+                if ( m_pBurstEndHandler != NULL )
+                {
+                    m_pBurstEndHandler->OnBurstEnd( m_camera, bursts);
+                }
+                m_camera.StartGrabbing( m_framesPerBurst, m_strategy, GrabLoop_ProvidedByInstantCamera);
+                lock.lock();
+            }
+            m_rearmPending = false;
+            lock.unlock();
+
+            m_camera.StopGrabbing();
+
+            lock.lock();
+            m_runTimeNs += GetMonotonicTimeNs() - runStartNs;
+            return bursts;
+        }
+
+        // Ends Run() without waiting for the burst currently armed. Can be called from any thread.
+        void Stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock( m_mutex);
+                m_stopRequested = true;
+            }
+            m_stateChanged.notify_all();
+        }
+
+        uint64_t GetBurstCount() const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            return m_bursts;
+        }
+
+        void PrintStatistics( std::ostream& os) const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            std::ios::fmtflags flags = os.flags();
+            std::streamsize precision = os.precision();
+            os << std::fixed << std::setprecision( 3);
+            os << "Burst session: " << m_bursts << " bursts of " << m_framesPerBurst << " frames in "
+               << m_runTimeNs / 1e9 << " s, " << m_rearms << " re-arms, " << m_grabErrors << " grab errors" << std::endl;
+            os << "Triggers ignored for " << m_windowTotalNs / 1e6 << " ms in total ("
+               << (m_runTimeNs ? 100.0 * m_windowTotalNs / m_runTimeNs : 0.0) << " % of the run)";
+            if ( m_longestWindowNs != 0 )
+            {
+                struct tm localTime;
+                localtime_r( &m_longestWindowStart, &localTime);
+                os << ", longest window " << m_longestWindowNs / 1e6 << " ms at "
+                   << std::setfill( '0') << std::setw( 2) << localTime.tm_hour << ":" << std::setw( 2) << localTime.tm_min
+                   << ":" << std::setw( 2) << localTime.tm_sec << std::setfill( ' ');
+            }
+            os << std::endl;
+            os.flags( flags);
+            os.precision( precision);
+            m_rearmLatency.Print( os, "Re-arm latency");
+            m_missedTriggerWindow.Print( os, "Missed-trigger window");
+        }
+
+    private:
+        // Forwards the grab session events and the images of the camera to the session.
+        class CNotifier : public CConfigurationEventHandler, public CImageEventHandler
+        {
+        public:
+            explicit CNotifier( CBurstSession& session)
+                : m_session( session)
+            {
+            }
+
+            virtual void OnGrabStarted( CInstantCamera& /*camera*/)
+            {
+                m_session.OnGrabStarted();
+            }
+
+            virtual void OnGrabStop( CInstantCamera& /*camera*/)
+            {
+                m_session.OnGrabStop();
+            }
+
+            virtual void OnGrabStopped( CInstantCamera& /*camera*/)
+            {
+                m_session.OnGrabStopped();
+            }
+
+            virtual void OnGrabError( CInstantCamera& /*camera*/, const char* errorMessage)
+            {
+                m_session.OnGrabError( errorMessage);
+            }
+
+            virtual void OnImageGrabbed( CInstantCamera& /*camera*/, const CGrabResultPtr& /*ptrGrabResult*/)
+            {
+                m_session.OnImageHandled();
+            }
+
+        private:
+            CBurstSession& m_session;
+        };
+
+        void OnGrabStarted()
+        {
+            const uint64_t nowNs = GetMonotonicTimeNs();
+            std::lock_guard<std::mutex> lock( m_mutex);
+            if ( !m_rearmPending )
+            {
+                return;
+            }
+            m_rearmPending = false;
+            ++m_rearms;
+            const uint64_t windowNs = nowNs - m_grabStopNs;
+            m_rearmLatency.Record( nowNs - m_grabStoppedNs);
+            m_missedTriggerWindow.Record( windowNs);
+            m_windowTotalNs += windowNs;
+            if ( windowNs > m_longestWindowNs )
+            {
+                m_longestWindowNs = windowNs;
+                m_longestWindowStart = time( NULL) - (time_t) (windowNs / 1000000000);
+            }
+        }
+
+        void OnGrabStop()
+        {
+            const uint64_t nowNs = GetMonotonicTimeNs();
+            std::lock_guard<std::mutex> lock( m_mutex);
+            m_grabStopNs = nowNs;
+        }
+
+        void OnGrabStopped()
+        {
+            const uint64_t nowNs = GetMonotonicTimeNs();
+            {
+                std::lock_guard<std::mutex> lock( m_mutex);
+                m_grabStoppedNs = nowNs;
+                m_sessionStopped = true;
+            }
+            m_stateChanged.notify_all();
+        }
+
+        // Called after the other image event handlers, also for failed grabs.
+        void OnImageHandled()
+        {
+            {
+                std::lock_guard<std::mutex> lock( m_mutex);
+                ++m_imagesHandled;
+            }
+            m_stateChanged.notify_all();
+        }
+
+        void OnGrabError( const char* errorMessage)
+        {
+            std::cerr << "Grab error: " << errorMessage << std::endl;
+            std::lock_guard<std::mutex> lock( m_mutex);
+            ++m_grabErrors;
+        }
+
+        CInstantCamera& m_camera;
+        const size_t m_framesPerBurst;
+        const EGrabStrategy m_strategy;
+        CNotifier m_notifier;
+        uint64_t m_maxBursts;
+        time_t m_deadline;
+        IBurstEndHandler* m_pBurstEndHandler;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_stateChanged;
+        bool m_sessionStopped;
+        bool m_stopRequested;
+        bool m_rearmPending;
+        size_t m_imagesHandled;
+        uint64_t m_grabStopNs;
+        uint64_t m_grabStoppedNs;
+
+        // Statistics, protected by m_mutex.
+        uint64_t m_bursts;
+        uint64_t m_rearms;
+        uint64_t m_grabErrors;
+        uint64_t m_runTimeNs;
+        uint64_t m_windowTotalNs;
+        uint64_t m_longestWindowNs;
+        time_t m_longestWindowStart;
+        CLatencyHistogram m_rearmLatency;
+        CLatencyHistogram m_missedTriggerWindow;
+    };
+}
+
+#endif /* INCLUDED_BURSTSESSION_H_3318570 */
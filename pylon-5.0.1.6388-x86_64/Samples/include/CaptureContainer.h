@@ -0,0 +1,635 @@
+// Contains a writer and a reader for an append-only raw capture container.
+//
+// A capture container stores a whole recording in one file instead of one image file per frame:
+//
+//   [file header, c_captureBlockSize bytes]
+//   [frame record 0][frame record 1] ... [frame record N-1]
+//   [index: N SCaptureIndexEntry][padding][SCaptureFileFooter]
+//
+// Every frame record has the same size: a SCaptureRecordHeader followed by the raw image data,
+// padded to a multiple of c_captureBlockSize. The file is written sequentially in large blocks
+// from an aligned staging buffer, so it can optionally be opened with O_DIRECT. The footer is
+// stored in the last bytes of the file. If a recording is interrupted before the index has been
+// written, the reader recovers the frames by walking the fixed-size records.
+//
+// Mono12 frames can optionally be stored packed as Mono12p, which saves 25% of disk bandwidth.
+// The header then still holds Mono12 as pixel type; the reader unpacks the frames.
+
+#ifndef INCLUDED_CAPTURECONTAINER_H_8126405
+#define INCLUDED_CAPTURECONTAINER_H_8126405
+
+#include <pylon/PylonIncludes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include "FrameWriterPool.h"
+#include "Mono12Packing.h"
+
+namespace Pylon
+{
+    // Size of the I/O blocks. Also the alignment of records, staging buffer and file size.
+    static const size_t c_captureBlockSize = 4096;
+
+    static const char c_captureFileMagic[8] = { 'P', 'Y', 'L', 'N', 'C', 'A', 'P', '1' };
+    static const char c_captureIndexMagic[8] = { 'P', 'Y', 'L', 'N', 'I', 'D', 'X', '1' };
+    static const uint32_t c_captureRecordMagic = 0x304D5246; // "FRM0"
+    // Version 2 added SCaptureFileHeader::packing. Version 1 files are read as unpacked.
+    static const uint32_t c_captureFormatVersion = 2;
+
+    struct SCaptureFileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;        // Offset of the first record.
+        uint32_t pixelType;         // Pylon::EPixelType of all frames.
+        uint32_t width;
+        uint32_t height;
+        uint32_t paddingX;
+        uint64_t imageSize;         // Bytes of stored image data per frame.
+        uint64_t recordSize;        // Bytes per frame record including header and padding.
+        uint64_t creationTimeNs;    // Host wall-clock time (CLOCK_REALTIME) of the first frame.
+        uint32_t packing;           // See ECapturePacking.
+    };
+
+    enum ECapturePacking
+    {
+        CapturePacking_None = 0,    // Image data is stored as delivered by the camera.
+        CapturePacking_Mono12p = 1  // Mono12 image data is stored as Mono12p.
+    };
+
+    struct SCaptureRecordHeader
+    {
+        uint32_t magic;
+        uint32_t flags;             // See ECaptureRecordFlags.
+        uint64_t blockId;
+        uint64_t chunkTimestamp;    // Camera ticks, 0 if the chunk is not enabled.
+        uint64_t hostTimeNs;        // Host wall-clock time (CLOCK_REALTIME) when the frame was grabbed.
+        double exposureTime;        // Microseconds, from ChunkExposureTime.
+        double gain;                // dB, from ChunkGain.
+        uint64_t imageSize;         // Bytes of stored image data.
+        uint64_t reserved;
+    };
+
+    enum ECaptureRecordFlags
+    {
+        CaptureRecord_HasChunkTimestamp = 0x1,
+        CaptureRecord_HasExposureTime = 0x2,
+        CaptureRecord_HasGain = 0x4
+    };
+
+    struct SCaptureIndexEntry
+    {
+        uint64_t blockId;
+        uint64_t chunkTimestamp;
+        uint64_t offset;            // File offset of the frame record.
+    };
+
+    struct SCaptureFileFooter
+    {
+        char magic[8];
+        uint64_t indexOffset;
+        uint64_t frameCount;
+        uint64_t reserved;
+    };
+
+
+    inline uint64_t RoundUpToCaptureBlock( uint64_t size)
+    {
+        return (size + c_captureBlockSize - 1) / c_captureBlockSize * c_captureBlockSize;
+    }
+
+
+    // Reads the timestamp, exposure time and gain chunks of a grab result into a record header.
+    // Chunks that are not enabled on the camera are left at zero.
+    inline void ReadCaptureRecordChunks( const CGrabResultPtr& ptrGrabResult, SCaptureRecordHeader& record)
+    {
+        if ( !ptrGrabResult->IsChunkDataAvailable() )
+        {
+            return;
+        }
+        GenApi::INodeMap& chunkNodeMap = ptrGrabResult->GetChunkDataNodeMap();
+        GenApi::CIntegerPtr chunkTimestamp( chunkNodeMap.GetNode( "ChunkTimestamp"));
+        if ( GenApi::IsReadable( chunkTimestamp) )
+        {
+            record.chunkTimestamp = (uint64_t) chunkTimestamp->GetValue();
+            record.flags |= CaptureRecord_HasChunkTimestamp;
+        }
+        GenApi::CFloatPtr chunkExposureTime( chunkNodeMap.GetNode( "ChunkExposureTime"));
+        if ( GenApi::IsReadable( chunkExposureTime) )
+        {
+            record.exposureTime = chunkExposureTime->GetValue();
+            record.flags |= CaptureRecord_HasExposureTime;
+        }
+        GenApi::CFloatPtr chunkGain( chunkNodeMap.GetNode( "ChunkGain"));
+        if ( GenApi::IsReadable( chunkGain) )
+        {
+            record.gain = chunkGain->GetValue();
+            record.flags |= CaptureRecord_HasGain;
+        }
+    }
+
+
+    // Appends frames to a capture container. Can be used as the sink of a CFrameWriterPool;
+    // frames are serialized internally, so one writer thread is usually enough.
+    // The file layout (pixel format, size) is taken from the first frame; frames with a
+    // different image size are rejected. Packing is only applied if the first frame is Mono12
+    // without padding.
+    class CCaptureContainerWriter : public IFrameSink
+    {
+    public:
+        // stagingSize is rounded up to a multiple of c_captureBlockSize.
+        CCaptureContainerWriter( const std::string& filename, bool useDirectIo = false, size_t stagingSize = 16 * 1024 * 1024,
+            ECapturePacking packing = CapturePacking_None)
+            : m_fd( -1)
+            , m_directIo( useDirectIo)
+            , m_packing( packing)
+            , m_sourceImageSize( 0)
+            , m_pStaging( NULL)
+            , m_stagingSize( RoundUpToCaptureBlock( stagingSize))
+            , m_stagingUsed( 0)
+            , m_fileOffset( 0)
+            , m_closed( false)
+        {
+            memset( &m_header, 0, sizeof( m_header));
+            int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+            if ( m_directIo )
+            {
+                m_fd = open( filename.c_str(), flags | O_DIRECT, 0644);
+                if ( m_fd < 0 && errno == EINVAL )
+                {
+                    // The file system does not support direct I/O (e.g. tmpfs).
+                    m_directIo = false;
+                }
+            }
+#else
+            m_directIo = false;
+#endif
+            if ( m_fd < 0 )
+            {
+                m_fd = open( filename.c_str(), flags, 0644);
+            }
+            if ( m_fd < 0 )
+            {
+                throw RUNTIME_EXCEPTION( "Could not create capture file %s: %s", filename.c_str(), strerror( errno));
+            }
+            if ( posix_memalign( (void**) &m_pStaging, c_captureBlockSize, m_stagingSize) != 0 )
+            {
+                close( m_fd);
+                throw RUNTIME_EXCEPTION( "Could not allocate %u bytes of staging memory.", (unsigned int) m_stagingSize);
+            }
+        }
+
+        ~CCaptureContainerWriter()
+        {
+            try
+            {
+                Close();
+            }
+            catch (GenICam::GenericException &)
+            {
+            }
+            free( m_pStaging);
+        }
+
+        virtual void WriteFrame( const CGrabResultPtr& ptrGrabResult, const std::string& /* name */)
+        {
+            WriteRecord( ptrGrabResult, GetRealtimeNs());
+        }
+
+        virtual void Flush()
+        {
+            Close();
+        }
+
+        // Writes the index and the footer and closes the file. Called automatically on destruction.
+        // The file is closed even if writing the index fails.
+        void Close()
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            if ( m_closed )
+            {
+                return;
+            }
+            m_closed = true;
+
+            try
+            {
+                if ( m_header.recordSize != 0 )
+                {
+                    SCaptureFileFooter footer;
+                    memset( &footer, 0, sizeof( footer));
+                    memcpy( footer.magic, c_captureIndexMagic, sizeof( footer.magic));
+                    footer.indexOffset = m_fileOffset + m_stagingUsed;
+                    footer.frameCount = m_index.size();
+
+                    if ( !m_index.empty() )
+                    {
+                        Append( &m_index[0], m_index.size() * sizeof( SCaptureIndexEntry));
+                    }
+                    // Pad so that the footer ends on a block boundary.
+                    size_t used = m_stagingUsed + sizeof( footer);
+                    AppendZeros( (size_t) (RoundUpToCaptureBlock( used) - used));
+                    Append( &footer, sizeof( footer));
+                    WriteStaging();
+                }
+            }
+            catch (...)
+            {
+                close( m_fd);
+                m_fd = -1;
+                throw;
+            }
+            const int result = close( m_fd);
+            m_fd = -1;
+            if ( result != 0 )
+            {
+                throw RUNTIME_EXCEPTION( "Could not close capture file: %s", strerror( errno));
+            }
+        }
+
+        size_t GetFrameCount() const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            return m_index.size();
+        }
+
+        bool IsDirectIo() const
+        {
+            return m_directIo;
+        }
+
+    protected:
+        // Frames from a CFrameWriterPool are stored with the time they were queued at.
+        virtual void WriteJob( const SFrameWriteJob& job)
+        {
+            WriteRecord( job.ptrGrabResult, job.grabTimeNs);
+        }
+
+    private:
+        void WriteRecord( const CGrabResultPtr& ptrGrabResult, uint64_t grabTimeNs)
+        {
+            SCaptureRecordHeader record;
+            memset( &record, 0, sizeof( record));
+            record.magic = c_captureRecordMagic;
+            record.blockId = ptrGrabResult->GetBlockID();
+            record.hostTimeNs = grabTimeNs;
+            ReadCaptureRecordChunks( ptrGrabResult, record);
+
+            std::lock_guard<std::mutex> lock( m_mutex);
+            if ( m_closed )
+            {
+                throw RUNTIME_EXCEPTION( "The capture container has already been closed.");
+            }
+            if ( m_header.recordSize == 0 )
+            {
+                StartFile( ptrGrabResult, record.hostTimeNs);
+            }
+            else if ( ptrGrabResult->GetImageSize() != m_sourceImageSize
+                || ptrGrabResult->GetPixelType() != (EPixelType) m_header.pixelType
+                || ptrGrabResult->GetWidth() != m_header.width
+                || ptrGrabResult->GetHeight() != m_header.height
+                || ptrGrabResult->GetPaddingX() != m_header.paddingX )
+            {
+                throw RUNTIME_EXCEPTION( "Frame %u does not match the format of the capture container.", (unsigned int) record.blockId);
+            }
+
+            SCaptureIndexEntry entry;
+            entry.blockId = record.blockId;
+            entry.chunkTimestamp = record.chunkTimestamp;
+            entry.offset = m_fileOffset + m_stagingUsed;
+            m_index.push_back( entry);
+
+            record.imageSize = m_header.imageSize;
+            Append( &record, sizeof( record));
+            if ( m_header.packing == CapturePacking_Mono12p )
+            {
+                AppendPackedMono12p( (const uint16_t*) ptrGrabResult->GetBuffer(), (size_t) m_header.width * m_header.height);
+            }
+            else
+            {
+                Append( ptrGrabResult->GetBuffer(), (size_t) record.imageSize);
+            }
+            AppendZeros( (size_t) (m_header.recordSize - sizeof( record) - record.imageSize));
+        }
+
+        // Creates the file header from the first frame. It fills the first block of the staging buffer.
+        void StartFile( const CGrabResultPtr& ptrGrabResult, uint64_t hostTimeNs)
+        {
+            memcpy( m_header.magic, c_captureFileMagic, sizeof( m_header.magic));
+            m_header.version = c_captureFormatVersion;
+            m_header.headerSize = (uint32_t) c_captureBlockSize;
+            m_header.pixelType = (uint32_t) ptrGrabResult->GetPixelType();
+            m_header.width = ptrGrabResult->GetWidth();
+            m_header.height = ptrGrabResult->GetHeight();
+            m_header.paddingX = ptrGrabResult->GetPaddingX();
+            m_sourceImageSize = ptrGrabResult->GetImageSize();
+            m_header.imageSize = m_sourceImageSize;
+            if ( m_packing == CapturePacking_Mono12p && ptrGrabResult->GetPixelType() == PixelType_Mono12 && m_header.paddingX == 0 )
+            {
+                m_header.packing = CapturePacking_Mono12p;
+                m_header.imageSize = Mono12Packing::GetPackedSize( (size_t) m_header.width * m_header.height);
+            }
+            m_header.recordSize = RoundUpToCaptureBlock( sizeof( SCaptureRecordHeader) + m_header.imageSize);
+            m_header.creationTimeNs = hostTimeNs;
+
+            Append( &m_header, sizeof( m_header));
+            AppendZeros( c_captureBlockSize - sizeof( m_header));
+        }
+
+        void Append( const void* pData, size_t size)
+        {
+            const uint8_t* pSource = (const uint8_t*) pData;
+            while ( size > 0 )
+            {
+                size_t chunk = m_stagingSize - m_stagingUsed;
+                if ( chunk > size )
+                {
+                    chunk = size;
+                }
+                memcpy( m_pStaging + m_stagingUsed, pSource, chunk);
+                m_stagingUsed += chunk;
+                pSource += chunk;
+                size -= chunk;
+                if ( m_stagingUsed == m_stagingSize )
+                {
+                    WriteStaging();
+                }
+            }
+        }
+
+        // Packs Mono12 pixels straight into the staging buffer.
+        void AppendPackedMono12p( const uint16_t* pPixels, size_t pixelCount)
+        {
+            while ( pixelCount > 0 )
+            {
+                size_t space = m_stagingSize - m_stagingUsed;
+                if ( space < 3 )
+                {
+                    // Not even one pixel pair fits: pack it separately and let Append() split it.
+                    uint8_t pair[3];
+                    size_t count = pixelCount >= 2 ? 2 : 1;
+                    Mono12Packing::Pack( pPixels, pair, count);
+                    Append( pair, Mono12Packing::GetPackedSize( count));
+                    pPixels += count;
+                    pixelCount -= count;
+                    continue;
+                }
+                // An even number of pixels, unless these are the last ones.
+                size_t count = space / 3 * 2;
+                if ( count > pixelCount )
+                {
+                    count = pixelCount;
+                }
+                Mono12Packing::Pack( pPixels, m_pStaging + m_stagingUsed, count);
+                m_stagingUsed += Mono12Packing::GetPackedSize( count);
+                pPixels += count;
+                pixelCount -= count;
+                if ( m_stagingUsed == m_stagingSize )
+                {
+                    WriteStaging();
+                }
+            }
+        }
+
+        void AppendZeros( size_t size)
+        {
+            while ( size > 0 )
+            {
+                size_t chunk = m_stagingSize - m_stagingUsed;
+                if ( chunk > size )
+                {
+                    chunk = size;
+                }
+                memset( m_pStaging + m_stagingUsed, 0, chunk);
+                m_stagingUsed += chunk;
+                size -= chunk;
+                if ( m_stagingUsed == m_stagingSize )
+                {
+                    WriteStaging();
+                }
+            }
+        }
+
+        // Writes the used part of the staging buffer. The used part is always a multiple of
+        // c_captureBlockSize because records, header and footer are block aligned.
+        void WriteStaging()
+        {
+            size_t written = 0;
+            while ( written < m_stagingUsed )
+            {
+                ssize_t result = write( m_fd, m_pStaging + written, m_stagingUsed - written);
+                if ( result < 0 )
+                {
+                    if ( errno == EINTR )
+                    {
+                        continue;
+                    }
+                    throw RUNTIME_EXCEPTION( "Writing the capture file failed: %s", strerror( errno));
+                }
+                written += (size_t) result;
+            }
+            m_fileOffset += m_stagingUsed;
+            m_stagingUsed = 0;
+        }
+
+        int m_fd;
+        bool m_directIo;
+        const ECapturePacking m_packing;
+        uint64_t m_sourceImageSize;
+        uint8_t* m_pStaging;
+        const size_t m_stagingSize;
+        size_t m_stagingUsed;
+        uint64_t m_fileOffset;
+        bool m_closed;
+        SCaptureFileHeader m_header;
+        std::vector<SCaptureIndexEntry> m_index;
+        mutable std::mutex m_mutex;
+    };
+
+
+    // Maps a capture container into memory and gives access to its frames.
+    class CCaptureContainerReader
+    {
+    public:
+        CCaptureContainerReader()
+            : m_pData( NULL)
+            , m_size( 0)
+            , m_pHeader( NULL)
+            , m_recovered( false)
+        {
+        }
+
+        explicit CCaptureContainerReader( const std::string& filename)
+            : m_pData( NULL)
+            , m_size( 0)
+            , m_pHeader( NULL)
+            , m_recovered( false)
+        {
+            Open( filename);
+        }
+
+        ~CCaptureContainerReader()
+        {
+            Close();
+        }
+
+        void Open( const std::string& filename)
+        {
+            Close();
+            int fd = open( filename.c_str(), O_RDONLY);
+            if ( fd < 0 )
+            {
+                throw RUNTIME_EXCEPTION( "Could not open capture file %s: %s", filename.c_str(), strerror( errno));
+            }
+            struct stat fileStat;
+            if ( fstat( fd, &fileStat) != 0 || (size_t) fileStat.st_size < c_captureBlockSize )
+            {
+                close( fd);
+                throw RUNTIME_EXCEPTION( "%s is not a capture file.", filename.c_str());
+            }
+            m_size = (size_t) fileStat.st_size;
+            void* pData = mmap( NULL, m_size, PROT_READ, MAP_SHARED, fd, 0);
+            close( fd);
+            if ( pData == MAP_FAILED )
+            {
+                m_size = 0;
+                throw RUNTIME_EXCEPTION( "Could not map capture file %s: %s", filename.c_str(), strerror( errno));
+            }
+            m_pData = (const uint8_t*) pData;
+            m_pHeader = (const SCaptureFileHeader*) m_pData;
+            if ( memcmp( m_pHeader->magic, c_captureFileMagic, sizeof( c_captureFileMagic)) != 0
+                || m_pHeader->version < 1 || m_pHeader->version > c_captureFormatVersion
+                || m_pHeader->headerSize < sizeof( SCaptureFileHeader)
+                || m_pHeader->imageSize > m_pHeader->recordSize
+                || m_pHeader->recordSize < sizeof( SCaptureRecordHeader) + m_pHeader->imageSize
+                || m_pHeader->recordSize % c_captureBlockSize != 0 )
+            {
+                Close();
+                throw RUNTIME_EXCEPTION( "%s is not a valid capture file.", filename.c_str());
+            }
+            // GetImage() unpacks width * height Mono12 pixels from the stored image data. A
+            // Mono12p frame is smaller than its pixel count in bytes, which also keeps
+            // GetPackedSize() from overflowing.
+            const uint64_t pixelCount = (uint64_t) m_pHeader->width * m_pHeader->height;
+            if ( IsPacked() && (m_pHeader->pixelType != (uint32_t) PixelType_Mono12 || m_pHeader->paddingX != 0
+                || pixelCount > m_pHeader->imageSize || Mono12Packing::GetPackedSize( (size_t) pixelCount) > m_pHeader->imageSize) )
+            {
+                Close();
+                throw RUNTIME_EXCEPTION( "%s has an invalid packed frame format.", filename.c_str());
+            }
+            LoadIndex();
+        }
+
+        void Close()
+        {
+            if ( m_pData != NULL )
+            {
+                munmap( (void*) m_pData, m_size);
+            }
+            m_pData = NULL;
+            m_size = 0;
+            m_pHeader = NULL;
+            m_index.clear();
+            m_recovered = false;
+        }
+
+        const SCaptureFileHeader& GetHeader() const { return *m_pHeader; }
+        size_t GetFrameCount() const { return m_index.size(); }
+        const SCaptureIndexEntry& GetIndexEntry( size_t frame) const { return m_index[ frame ]; }
+        // True if the index was missing and the frames were found by walking the records.
+        bool IsRecovered() const { return m_recovered; }
+
+        const SCaptureRecordHeader& GetRecord( size_t frame) const
+        {
+            return *(const SCaptureRecordHeader*) (m_pData + m_index[ frame ].offset);
+        }
+
+        const uint8_t* GetImageData( size_t frame) const
+        {
+            return m_pData + m_index[ frame ].offset + sizeof( SCaptureRecordHeader);
+        }
+
+        bool IsPacked() const
+        {
+            return m_pHeader->version >= 2 && m_pHeader->packing == CapturePacking_Mono12p;
+        }
+
+        // Attaches a pylon image to the frame data without copying it.
+        // Packed frames are unpacked into the image instead.
+        void GetImage( size_t frame, CPylonImage& image) const
+        {
+            if ( IsPacked() )
+            {
+                image.Reset( (EPixelType) m_pHeader->pixelType, m_pHeader->width, m_pHeader->height);
+                Mono12Packing::Unpack( GetImageData( frame), (uint16_t*) image.GetBuffer(), (size_t) m_pHeader->width * m_pHeader->height);
+                return;
+            }
+            image.AttachUserBuffer( (void*) GetImageData( frame), (size_t) m_pHeader->imageSize,
+                (EPixelType) m_pHeader->pixelType, m_pHeader->width, m_pHeader->height, m_pHeader->paddingX);
+        }
+
+    private:
+        void LoadIndex()
+        {
+            const SCaptureFileFooter* pFooter = (const SCaptureFileFooter*) (m_pData + m_size - sizeof( SCaptureFileFooter));
+            const uint64_t indexEnd = m_size - sizeof( SCaptureFileFooter);
+            if ( memcmp( pFooter->magic, c_captureIndexMagic, sizeof( c_captureIndexMagic)) == 0
+                && pFooter->indexOffset <= indexEnd
+                && pFooter->frameCount <= (indexEnd - pFooter->indexOffset) / sizeof( SCaptureIndexEntry) )
+            {
+                const SCaptureIndexEntry* pEntries = (const SCaptureIndexEntry*) (m_pData + pFooter->indexOffset);
+                m_index.assign( pEntries, pEntries + pFooter->frameCount);
+                bool valid = true;
+                for ( size_t i = 0; i < m_index.size() && valid; ++i )
+                {
+                    valid = IsValidRecordOffset( m_index[i].offset);
+                }
+                if ( valid )
+                {
+                    return;
+                }
+                m_index.clear();
+            }
+
+            // No valid footer or index: the recording has been interrupted. Walk the fixed-size records.
+            m_recovered = true;
+            for ( uint64_t offset = m_pHeader->headerSize; IsValidRecordOffset( offset); offset += m_pHeader->recordSize )
+            {
+                const SCaptureRecordHeader* pRecord = (const SCaptureRecordHeader*) (m_pData + offset);
+                if ( pRecord->magic != c_captureRecordMagic )
+                {
+                    break;
+                }
+                SCaptureIndexEntry entry;
+                entry.blockId = pRecord->blockId;
+                entry.chunkTimestamp = pRecord->chunkTimestamp;
+                entry.offset = offset;
+                m_index.push_back( entry);
+            }
+        }
+
+        // True if a whole record starts at offset, behind the file header.
+        bool IsValidRecordOffset( uint64_t offset) const
+        {
+            return offset >= m_pHeader->headerSize && offset <= m_size && m_pHeader->recordSize <= m_size - offset;
+        }
+
+        const uint8_t* m_pData;
+        size_t m_size;
+        const SCaptureFileHeader* m_pHeader;
+        std::vector<SCaptureIndexEntry> m_index;
+        bool m_recovered;
+    };
+}
+
+#endif /* INCLUDED_CAPTURECONTAINER_H_8126405 */
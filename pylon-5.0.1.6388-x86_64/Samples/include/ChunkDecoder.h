@@ -0,0 +1,589 @@
+// Contains a chunk decoder that reads the chunk values of a grab result directly from the payload.
+//
+// Reading chunks through GetChunkDataNodeMap(), as in Grab_ChunkImage, looks up every node by
+// name and goes through the GenApi register cache for every frame. CChunkDecoder learns the
+// chunk layout once per stream instead: on the first frame it walks the chunk trailer at the end
+// of the payload (data, chunk ID, chunk length, from the end backwards; little endian for USB3
+// Vision, big endian for GigE Vision) and asks the chunk node map for the port, address, length,
+// endianness and bit field of each register. Every following frame is decoded by reading the
+// registers at their offsets in the payload into an SChunkData, after checking that the chunk
+// IDs and lengths are still at the learned places. If the layout has changed, e.g. because a
+// chunk was enabled, it is learned again.
+//
+// A field is only read from the payload if the value decoded on the learning frame is the same
+// as the one from the node map. Features that are not plain registers, e.g. converters, are read
+// through the node map for every frame.
+
+#ifndef INCLUDED_CHUNKDECODER_H_7730152
+#define INCLUDED_CHUNKDECODER_H_7730152
+
+#include <pylon/PylonIncludes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <ostream>
+#include "LatencyHistogram.h"
+
+namespace Pylon
+{
+    enum EChunkField
+    {
+        ChunkField_Timestamp,
+        ChunkField_Framecounter,
+        ChunkField_ExposureTime,
+        ChunkField_Gain,
+        ChunkField_LineStatusAll,
+        ChunkField_SequenceSetIndex,
+        ChunkField_PayloadCRC16,
+        ChunkField_Count
+    };
+
+
+    // The chunk values of one frame. A value is only set if the bit (1 << field) is set in
+    // validFields.
+    struct SChunkData
+    {
+        uint32_t validFields;
+        int64_t timestamp;
+        int64_t framecounter;       // ChunkFramecounter, or ChunkCounterValue on USB cameras.
+        double exposureTime;
+        double gain;                // ChunkGain, or the raw ChunkGainAll on GigE cameras.
+        int64_t lineStatusAll;
+        int64_t sequenceSetIndex;   // ChunkSequenceSetIndex, or ChunkSequencerSetActive on USB cameras.
+        int64_t payloadCRC16;
+
+        bool IsValid( EChunkField field) const
+        {
+            return (validFields & (1u << field)) != 0;
+        }
+    };
+
+
+    class CChunkDecoder
+    {
+    public:
+        CChunkDecoder()
+            : m_learned( false)
+            , m_bigEndianTags( false)
+            , m_payloadSize( 0)
+            , m_frames( 0)
+            , m_failedFrames( 0)
+            , m_learnings( 0)
+        {
+            ClearLayout();
+        }
+
+        // Makes the next frame learn the layout again, e.g. after StartGrabbing().
+        void Reset()
+        {
+            m_learned = false;
+        }
+
+        // Decodes the chunks of a grab result. Returns false if the grab failed or the result
+        // has no chunk data.
+        bool Decode( const CGrabResultPtr& ptrGrabResult, SChunkData& data)
+        {
+            const uint64_t startNs = GetMonotonicTimeNs();
+            memset( &data, 0, sizeof( data));
+            if ( !ptrGrabResult->GrabSucceeded() || !ptrGrabResult->IsChunkDataAvailable() )
+            {
+                ++m_failedFrames;
+                return false;
+            }
+
+            const uint8_t* pPayload = static_cast<const uint8_t*>( ptrGrabResult->GetBuffer());
+            const size_t payloadSize = ptrGrabResult->GetPayloadSize();
+            if ( !m_learned || !MatchesLayout( pPayload, payloadSize) )
+            {
+                Learn( ptrGrabResult);
+            }
+
+            for ( int field = 0; field < ChunkField_Count; ++field )
+            {
+                const SFieldLayout& layout = m_fields[field];
+                if ( layout.source == FieldSource_Payload )
+                {
+                    StoreValue( data, (EChunkField) field, ReadPayloadField( pPayload, layout));
+                }
+                else if ( layout.source == FieldSource_NodeMap )
+                {
+                    SValue value;
+                    if ( ReadNodeMapField( ptrGrabResult->GetChunkDataNodeMap(), layout.pFeatureName, value) )
+                    {
+                        StoreValue( data, (EChunkField) field, value);
+                    }
+                }
+            }
+            ++m_frames;
+            m_decodeTime.Record( GetMonotonicTimeNs() - startNs);
+            return true;
+        }
+
+        // Decodes the chunks of a grab result through the chunk node map only, by looking up every
+        // feature by name. This is what Decode() avoids; it is used for learning and as reference.
+        static bool DecodeFromNodeMap( const CGrabResultPtr& ptrGrabResult, SChunkData& data)
+        {
+            memset( &data, 0, sizeof( data));
+            if ( !ptrGrabResult->GrabSucceeded() || !ptrGrabResult->IsChunkDataAvailable() )
+            {
+                return false;
+            }
+            GenApi::INodeMap& chunkNodeMap = ptrGrabResult->GetChunkDataNodeMap();
+            for ( int field = 0; field < ChunkField_Count; ++field )
+            {
+                SValue value;
+                if ( ReadNodeMapField( chunkNodeMap, FindFeature( chunkNodeMap, (EChunkField) field), value) )
+                {
+                    StoreValue( data, (EChunkField) field, value);
+                }
+            }
+            return true;
+        }
+
+        static const char* GetFieldName( EChunkField field)
+        {
+            static const char* const names[ChunkField_Count] =
+            {
+                "Timestamp", "Framecounter", "ExposureTime", "Gain", "LineStatusAll", "SequenceSetIndex", "PayloadCRC16"
+            };
+            return field < ChunkField_Count ? names[field] : "unknown";
+        }
+
+        // Returns true if all available fields are read from the payload.
+        bool IsFullyPrecompiled() const
+        {
+            for ( int field = 0; field < ChunkField_Count; ++field )
+            {
+                if ( m_fields[field].source == FieldSource_NodeMap )
+                {
+                    return false;
+                }
+            }
+            return m_learned;
+        }
+
+        uint64_t GetFrameCount() const
+        {
+            return m_frames;
+        }
+
+        // Returns the number of payload bytes the PayloadCRC16 chunk covers, i.e. the offset of the
+        // data of the last chunk, which holds the CRC. Returns 0 if the CRC is not read from the
+        // payload.
+        size_t GetPayloadCrcCoverage() const
+        {
+            const SFieldLayout& crc = m_fields[ChunkField_PayloadCRC16];
+            if ( crc.source != FieldSource_Payload || m_chunks.empty() || crc.offset < m_chunks.front().dataOffset )
+            {
+                return 0;
+            }
+            return m_chunks.front().dataOffset;
+        }
+
+        void PrintLayout( std::ostream& os) const
+        {
+            os << "Chunk layout: " << m_chunks.size() << " chunks, " << (m_bigEndianTags ? "big" : "little") << " endian trailer, payload of "
+               << m_payloadSize << " bytes" << std::endl;
+            for ( int field = 0; field < ChunkField_Count; ++field )
+            {
+                const SFieldLayout& layout = m_fields[field];
+                os << "  " << GetFieldName( (EChunkField) field) << ": ";
+                if ( layout.source == FieldSource_Payload )
+                {
+                    os << layout.pFeatureName << " at payload offset " << layout.offset << ", " << layout.length << " bytes "
+                       << (layout.bigEndian ? "big" : "little") << " endian";
+                    if ( layout.bits != 0 )
+                    {
+                        os << ", bits " << layout.shift << ".." << layout.shift + layout.bits - 1;
+                    }
+                    os << (layout.isFloat ? ", float" : (layout.isSigned ? ", signed" : ""));
+                }
+                else if ( layout.source == FieldSource_NodeMap )
+                {
+                    os << layout.pFeatureName << " through the node map";
+                }
+                else
+                {
+                    os << "not available";
+                }
+                os << std::endl;
+            }
+        }
+
+        void PrintStatistics( std::ostream& os) const
+        {
+            os << "Chunk decoder: " << m_frames << " frames, " << m_failedFrames << " without chunk data, layout learned "
+               << m_learnings << " times" << std::endl;
+            PrintLayout( os);
+            m_decodeTime.Print( os, "Chunk decode time per frame");
+        }
+
+    private:
+        enum EFieldSource
+        {
+            FieldSource_None,       // The feature is not available.
+            FieldSource_Payload,    // The register is read from the payload.
+            FieldSource_NodeMap     // The feature is read through the node map.
+        };
+
+        struct SFieldLayout
+        {
+            EFieldSource source;
+            const char* pFeatureName;
+            size_t offset;          // Of the register from the start of the payload.
+            uint32_t length;        // Of the register in bytes, 1 to 8.
+            bool bigEndian;
+            bool isFloat;
+            bool isSigned;
+            uint32_t shift;         // Of the bit field, for masked registers.
+            uint32_t bits;          // Of the bit field, 0 for the whole register.
+        };
+
+        struct SChunk
+        {
+            uint64_t id;
+            size_t dataOffset;
+            size_t length;
+            size_t tagOffset;
+        };
+
+        struct SValue
+        {
+            bool isFloat;
+            int64_t integer;
+            double floatingPoint;
+        };
+
+        // A layout is never learned from more chunks than this.
+        static const size_t c_maxChunks = 64;
+
+        static uint64_t ReadUnsigned( const uint8_t* p, uint32_t length, bool bigEndian)
+        {
+            uint64_t value = 0;
+            for ( uint32_t i = 0; i < length; ++i )
+            {
+                value |= (uint64_t) p[ bigEndian ? length - 1 - i : i ] << (8 * i);
+            }
+            return value;
+        }
+
+        static SValue ReadPayloadField( const uint8_t* pPayload, const SFieldLayout& layout)
+        {
+            uint64_t raw = ReadUnsigned( pPayload + layout.offset, layout.length, layout.bigEndian);
+            SValue value = { layout.isFloat, 0, 0.0 };
+            if ( layout.isFloat )
+            {
+                if ( layout.length == 4 )
+                {
+                    const uint32_t raw32 = (uint32_t) raw;
+                    float f;
+                    memcpy( &f, &raw32, sizeof( f));
+                    value.floatingPoint = f;
+                }
+                else
+                {
+                    memcpy( &value.floatingPoint, &raw, sizeof( value.floatingPoint));
+                }
+                return value;
+            }
+
+            uint32_t bits = layout.length * 8;
+            if ( layout.bits != 0 )
+            {
+                raw >>= layout.shift;
+                bits = layout.bits;
+            }
+            if ( bits < 64 )
+            {
+                raw &= (1ull << bits) - 1;
+                if ( layout.isSigned && (raw >> (bits - 1)) != 0 )
+                {
+                    raw |= ~0ull << bits;
+                }
+            }
+            value.integer = (int64_t) raw;
+            return value;
+        }
+
+        static void StoreValue( SChunkData& data, EChunkField field, const SValue& value)
+        {
+            const double floatingPoint = value.isFloat ? value.floatingPoint : (double) value.integer;
+            const int64_t integer = value.isFloat ? (int64_t) value.floatingPoint : value.integer;
+            switch ( field )
+            {
+            case ChunkField_Timestamp: data.timestamp = integer; break;
+            case ChunkField_Framecounter: data.framecounter = integer; break;
+            case ChunkField_ExposureTime: data.exposureTime = floatingPoint; break;
+            case ChunkField_Gain: data.gain = floatingPoint; break;
+            case ChunkField_LineStatusAll: data.lineStatusAll = integer; break;
+            case ChunkField_SequenceSetIndex: data.sequenceSetIndex = integer; break;
+            case ChunkField_PayloadCRC16: data.payloadCRC16 = integer; break;
+            default: return;
+            }
+            data.validFields |= 1u << field;
+        }
+
+        // Returns the name of the first readable feature of the field, or NULL.
+        static const char* FindFeature( GenApi::INodeMap& chunkNodeMap, EChunkField field)
+        {
+            static const char* const featureNames[ChunkField_Count][2] =
+            {
+                { "ChunkTimestamp", NULL },
+                { "ChunkFramecounter", "ChunkCounterValue" },
+                { "ChunkExposureTime", NULL },
+                { "ChunkGain", "ChunkGainAll" },
+                { "ChunkLineStatusAll", NULL },
+                { "ChunkSequenceSetIndex", "ChunkSequencerSetActive" },
+                { "ChunkPayloadCRC16", NULL }
+            };
+            for ( int i = 0; i < 2 && featureNames[field][i] != NULL; ++i )
+            {
+                if ( GenApi::IsReadable( chunkNodeMap.GetNode( featureNames[field][i])) )
+                {
+                    return featureNames[field][i];
+                }
+            }
+            return NULL;
+        }
+
+        static bool ReadNodeMapField( GenApi::INodeMap& chunkNodeMap, const char* pFeatureName, SValue& value)
+        {
+            if ( pFeatureName == NULL )
+            {
+                return false;
+            }
+            GenApi::INode* pNode = chunkNodeMap.GetNode( pFeatureName);
+            GenApi::CFloatPtr ptrFloat( pNode);
+            GenApi::CIntegerPtr ptrInteger( pNode);
+            value.isFloat = ptrFloat.IsValid();
+            value.integer = 0;
+            value.floatingPoint = 0.0;
+            if ( value.isFloat && GenApi::IsReadable( ptrFloat) )
+            {
+                value.floatingPoint = ptrFloat->GetValue();
+                return true;
+            }
+            if ( !value.isFloat && GenApi::IsReadable( ptrInteger) )
+            {
+                value.integer = ptrInteger->GetValue();
+                return true;
+            }
+            return false;
+        }
+
+        // Walks the chunk trailers from the end of the payload to its start.
+        static bool ParseChunks( const uint8_t* pPayload, size_t payloadSize, bool bigEndian, std::vector<SChunk>& chunks)
+        {
+            chunks.clear();
+            size_t end = payloadSize;
+            while ( end > 0 )
+            {
+                if ( end < 8 || chunks.size() == c_maxChunks )
+                {
+                    return false;
+                }
+                SChunk chunk;
+                chunk.tagOffset = end - 8;
+                chunk.id = ReadUnsigned( pPayload + chunk.tagOffset, 4, bigEndian);
+                chunk.length = (size_t) ReadUnsigned( pPayload + chunk.tagOffset + 4, 4, bigEndian);
+                if ( chunk.length > chunk.tagOffset )
+                {
+                    return false;
+                }
+                chunk.dataOffset = chunk.tagOffset - chunk.length;
+                chunks.push_back( chunk);
+                end = chunk.dataOffset;
+            }
+            return !chunks.empty();
+        }
+
+        bool MatchesLayout( const uint8_t* pPayload, size_t payloadSize) const
+        {
+            if ( payloadSize != m_payloadSize )
+            {
+                return false;
+            }
+            for ( size_t i = 0; i < m_chunks.size(); ++i )
+            {
+                if ( ReadUnsigned( pPayload + m_chunks[i].tagOffset, 4, m_bigEndianTags) != m_chunks[i].id
+                    || ReadUnsigned( pPayload + m_chunks[i].tagOffset + 4, 4, m_bigEndianTags) != m_chunks[i].length )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static bool GetNodeProperty( GenApi::INode* pNode, const char* pName, String_t& value)
+        {
+            String_t attribute;
+            return pNode->GetProperty( pName, value, attribute) && !value.empty();
+        }
+
+        // The chunk ID may be given in hex with or without prefix, or in decimal.
+        static bool FindChunk( const std::vector<SChunk>& chunks, const String_t& chunkId, size_t& index)
+        {
+            const char* pId = chunkId.c_str();
+            const bool hasPrefix = pId[0] == '0' && (pId[1] == 'x' || pId[1] == 'X');
+            const uint64_t candidates[2] = { strtoull( pId, NULL, 16), hasPrefix ? strtoull( pId, NULL, 16) : strtoull( pId, NULL, 10) };
+            for ( int c = 0; c < 2; ++c )
+            {
+                for ( index = 0; index < chunks.size(); ++index )
+                {
+                    if ( chunks[index].id == candidates[c] )
+                    {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        // Finds the register of a chunk feature in the payload.
+        static bool LearnRegister( GenApi::INodeMap& chunkNodeMap, const char* pFeatureName, const std::vector<SChunk>& chunks,
+            SFieldLayout& layout)
+        {
+            GenApi::INode* pNode = chunkNodeMap.GetNode( pFeatureName);
+            GenApi::CRegisterPtr ptrRegister( pNode);
+            String_t portName;
+            String_t chunkId;
+            size_t chunkIndex = 0;
+            if ( !ptrRegister.IsValid() || !GetNodeProperty( pNode, "pPort", portName) || chunkNodeMap.GetNode( portName) == NULL
+                || !GetNodeProperty( chunkNodeMap.GetNode( portName), "ChunkID", chunkId) || !FindChunk( chunks, chunkId, chunkIndex) )
+            {
+                return false;
+            }
+            const int64_t address = ptrRegister->GetAddress();
+            const int64_t length = ptrRegister->GetLength();
+            if ( address < 0 || length < 1 || length > 8 || (uint64_t) (address + length) > chunks[chunkIndex].length )
+            {
+                return false;
+            }
+            layout.offset = chunks[chunkIndex].dataOffset + (size_t) address;
+            layout.length = (uint32_t) length;
+
+            String_t value;
+            layout.bigEndian = GetNodeProperty( pNode, "Endianess", value) && value == "BigEndian";
+            layout.isSigned = GetNodeProperty( pNode, "Sign", value) && value == "Signed";
+            layout.isFloat = pNode->GetPrincipalInterfaceType() == GenApi::intfIFloat;
+            if ( layout.isFloat && length != 4 && length != 8 )
+            {
+                return false;
+            }
+
+            // Masked registers count their bits from the least significant bit if little endian and
+            // from the most significant bit if big endian.
+            String_t lsb;
+            String_t msb;
+            if ( GetNodeProperty( pNode, "Bit", lsb) )
+            {
+                msb = lsb;
+            }
+            else if ( !GetNodeProperty( pNode, "LSB", lsb) || !GetNodeProperty( pNode, "MSB", msb) )
+            {
+                return true;
+            }
+            const uint32_t lsbIndex = (uint32_t) strtoul( lsb.c_str(), NULL, 10);
+            const uint32_t msbIndex = (uint32_t) strtoul( msb.c_str(), NULL, 10);
+            const uint32_t lastBit = layout.length * 8 - 1;
+            layout.shift = layout.bigEndian ? lastBit - lsbIndex : lsbIndex;
+            layout.bits = (layout.bigEndian ? lsbIndex - msbIndex : msbIndex - lsbIndex) + 1;
+            return lsbIndex <= lastBit && msbIndex <= lastBit && layout.shift + layout.bits <= lastBit + 1;
+        }
+
+        void ClearLayout()
+        {
+            m_chunks.clear();
+            m_payloadSize = 0;
+            for ( int field = 0; field < ChunkField_Count; ++field )
+            {
+                SFieldLayout& layout = m_fields[field];
+                layout.source = FieldSource_None;
+                layout.pFeatureName = NULL;
+                layout.offset = 0;
+                layout.length = 0;
+                layout.bigEndian = false;
+                layout.isFloat = false;
+                layout.isSigned = false;
+                layout.shift = 0;
+                layout.bits = 0;
+            }
+        }
+
+        // Learns the layout with both trailer byte orders and keeps the one that reads more
+        // fields from the payload. Fields are only read from the payload if they decode to the
+        // node map value on this frame.
+        void Learn( const CGrabResultPtr& ptrGrabResult)
+        {
+            const uint8_t* pPayload = static_cast<const uint8_t*>( ptrGrabResult->GetBuffer());
+            const size_t payloadSize = ptrGrabResult->GetPayloadSize();
+            GenApi::INodeMap& chunkNodeMap = ptrGrabResult->GetChunkDataNodeMap();
+
+            ClearLayout();
+            m_payloadSize = payloadSize;
+            int bestPayloadFields = -1;
+            const bool byteOrders[2] = { false, true };
+            for ( int order = 0; order < 2; ++order )
+            {
+                std::vector<SChunk> chunks;
+                const bool parsed = ParseChunks( pPayload, payloadSize, byteOrders[order], chunks);
+                SFieldLayout fields[ChunkField_Count];
+                int payloadFields = 0;
+                for ( int field = 0; field < ChunkField_Count; ++field )
+                {
+                    fields[field] = m_fields[field];
+                    fields[field].pFeatureName = FindFeature( chunkNodeMap, (EChunkField) field);
+                    if ( fields[field].pFeatureName == NULL )
+                    {
+                        continue;
+                    }
+                    fields[field].source = FieldSource_NodeMap;
+                    SValue expected;
+                    try
+                    {
+                        if ( parsed && LearnRegister( chunkNodeMap, fields[field].pFeatureName, chunks, fields[field])
+                            && ReadNodeMapField( chunkNodeMap, fields[field].pFeatureName, expected) )
+                        {
+                            const SValue decoded = ReadPayloadField( pPayload, fields[field]);
+                            if ( decoded.isFloat == expected.isFloat && decoded.integer == expected.integer
+                                && decoded.floatingPoint == expected.floatingPoint )
+                            {
+                                fields[field].source = FieldSource_Payload;
+                                ++payloadFields;
+                            }
+                        }
+                    }
+                    catch (const GenericException&)
+                    {
+                        // The field is read through the node map.
+                    }
+                }
+                if ( payloadFields > bestPayloadFields )
+                {
+                    bestPayloadFields = payloadFields;
+                    m_bigEndianTags = byteOrders[order];
+                    m_chunks = parsed ? chunks : std::vector<SChunk>();
+                    for ( int field = 0; field < ChunkField_Count; ++field )
+                    {
+                        m_fields[field] = fields[field];
+                    }
+                }
+            }
+            m_learned = true;
+            ++m_learnings;
+        }
+
+        bool m_learned;
+        bool m_bigEndianTags;
+        size_t m_payloadSize;
+        std::vector<SChunk> m_chunks;
+        SFieldLayout m_fields[ChunkField_Count];
+        uint64_t m_frames;
+        uint64_t m_failedFrames;
+        uint64_t m_learnings;
+        CLatencyHistogram m_decodeTime;
+    };
+}
+
+#endif /* INCLUDED_CHUNKDECODER_H_7730152 */
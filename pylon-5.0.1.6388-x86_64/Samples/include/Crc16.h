@@ -0,0 +1,229 @@
+// Contains kernels for the CRC-16 of the PayloadCRC16 chunk.
+//
+// The camera computes the checksum with the X-modem method: polynomial x^16 + x^12 + x^5 + 1
+// (0x1021), initial value 0, most significant bit first, no final XOR. The check value of the
+// ASCII string "123456789" is 0x31C3.
+//
+// Three kernels compute the same CRC:
+// * scalar: one table lookup per byte, the reference,
+// * sliced: slicing-by-8, eight table lookups for every 8 bytes, no dependency between them,
+// * PCLMUL: folds four 16 byte lanes per 64 bytes with carry-less multiplications and reduces
+//   the result with the byte table.
+// A CRC can be continued over several buffers by passing the CRC of the previous ones.
+
+#ifndef INCLUDED_CRC16_H_2618094
+#define INCLUDED_CRC16_H_2618094
+
+#include <stdint.h>
+#include <stddef.h>
+#include <immintrin.h>
+
+namespace Crc16
+{
+    enum EKernel
+    {
+        Kernel_Auto,
+        Kernel_Scalar,
+        Kernel_Sliced,
+        Kernel_Pclmul
+    };
+
+    static const uint16_t c_polynomial = 0x1021;
+
+
+    // The slicing tables: table[k][b] is the CRC of byte b followed by k zero bytes.
+    struct SCrcTables
+    {
+        uint16_t table[8][256];
+
+        SCrcTables()
+        {
+            for ( uint32_t b = 0; b < 256; ++b )
+            {
+                uint32_t crc = b << 8;
+                for ( int bit = 0; bit < 8; ++bit )
+                {
+                    crc = (crc & 0x8000) ? (crc << 1) ^ c_polynomial : crc << 1;
+                }
+                table[0][b] = (uint16_t) crc;
+            }
+            for ( int k = 1; k < 8; ++k )
+            {
+                for ( uint32_t b = 0; b < 256; ++b )
+                {
+                    const uint16_t previous = table[k - 1][b];
+                    table[k][b] = (uint16_t) ((previous << 8) ^ table[0][previous >> 8]);
+                }
+            }
+        }
+    };
+
+
+    inline const SCrcTables& GetTables()
+    {
+        static const SCrcTables tables;
+        return tables;
+    }
+
+
+    inline uint16_t ComputeScalar( const uint8_t* pData, size_t size, uint16_t crc = 0)
+    {
+        const uint16_t* pTable = GetTables().table[0];
+        for ( size_t i = 0; i < size; ++i )
+        {
+            crc = (uint16_t) ((crc << 8) ^ pTable[ (crc >> 8) ^ pData[i] ]);
+        }
+        return crc;
+    }
+
+
+    inline uint16_t ComputeSliced( const uint8_t* pData, size_t size, uint16_t crc = 0)
+    {
+        const SCrcTables& t = GetTables();
+        size_t i = 0;
+        for ( ; i + 8 <= size; i += 8 )
+        {
+            const uint32_t head = crc ^ ((uint32_t) pData[i] << 8 | pData[i + 1]);
+            crc = (uint16_t) (t.table[7][head >> 8] ^ t.table[6][head & 0xFF] ^ t.table[5][pData[i + 2]] ^ t.table[4][pData[i + 3]]
+                ^ t.table[3][pData[i + 4]] ^ t.table[2][pData[i + 5]] ^ t.table[1][pData[i + 6]] ^ t.table[0][pData[i + 7]]);
+        }
+        return ComputeScalar( pData + i, size - i, crc);
+    }
+
+
+    // Returns x^exponent mod P, the factor that moves data exponent bits further.
+    inline uint64_t GetFoldConstant( uint32_t exponent)
+    {
+        uint32_t remainder = 1;
+        for ( uint32_t i = 0; i < exponent; ++i )
+        {
+            remainder = (remainder & 0x8000) ? ((remainder << 1) ^ c_polynomial) & 0xFFFF : remainder << 1;
+        }
+        return remainder;
+    }
+
+
+    // The constants for folding 128 bit blocks over 128 * n bits, n = 1 to 4: the low half of a
+    // block is multiplied by x^(128 n) mod P, the high half by x^(128 n + 64) mod P.
+    struct SFoldConstants
+    {
+        uint64_t low[5];
+        uint64_t high[5];
+
+        SFoldConstants()
+        {
+            for ( uint32_t n = 1; n <= 4; ++n )
+            {
+                low[n] = GetFoldConstant( 128 * n);
+                high[n] = GetFoldConstant( 128 * n + 64);
+            }
+            low[0] = high[0] = 0;
+        }
+    };
+
+
+    inline const SFoldConstants& GetFoldConstants()
+    {
+        static const SFoldConstants constants;
+        return constants;
+    }
+
+
+    // Loads 16 bytes as a polynomial, the first bit as the highest coefficient.
+    __attribute__(( target( "pclmul,ssse3")))
+    inline __m128i LoadBlock( const uint8_t* pData)
+    {
+        const __m128i reverse = _mm_setr_epi8( 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        return _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*) pData), reverse);
+    }
+
+
+    __attribute__(( target( "pclmul,ssse3")))
+    inline __m128i Fold( __m128i block, __m128i constant)
+    {
+        return _mm_xor_si128( _mm_clmulepi64_si128( block, constant, 0x00), _mm_clmulepi64_si128( block, constant, 0x11));
+    }
+
+
+    __attribute__(( target( "pclmul,ssse3")))
+    inline uint16_t ComputePclmul( const uint8_t* pData, size_t size, uint16_t crc = 0)
+    {
+        if ( size < 16 )
+        {
+            return ComputeSliced( pData, size, crc);
+        }
+        const SFoldConstants& k = GetFoldConstants();
+
+        // The CRC so far is added to the first two bytes.
+        __m128i x0 = _mm_xor_si128( LoadBlock( pData), _mm_set_epi64x( (int64_t) ((uint64_t) crc << 48), 0));
+        size_t i = 16;
+        if ( size >= 64 )
+        {
+            const __m128i fold4 = _mm_set_epi64x( (int64_t) k.high[4], (int64_t) k.low[4]);
+            __m128i x1 = LoadBlock( pData + 16);
+            __m128i x2 = LoadBlock( pData + 32);
+            __m128i x3 = LoadBlock( pData + 48);
+            for ( i = 64; i + 64 <= size; i += 64 )
+            {
+                x0 = _mm_xor_si128( Fold( x0, fold4), LoadBlock( pData + i));
+                x1 = _mm_xor_si128( Fold( x1, fold4), LoadBlock( pData + i + 16));
+                x2 = _mm_xor_si128( Fold( x2, fold4), LoadBlock( pData + i + 32));
+                x3 = _mm_xor_si128( Fold( x3, fold4), LoadBlock( pData + i + 48));
+            }
+            x0 = _mm_xor_si128( _mm_xor_si128( Fold( x0, _mm_set_epi64x( (int64_t) k.high[3], (int64_t) k.low[3])),
+                Fold( x1, _mm_set_epi64x( (int64_t) k.high[2], (int64_t) k.low[2]))),
+                _mm_xor_si128( Fold( x2, _mm_set_epi64x( (int64_t) k.high[1], (int64_t) k.low[1])), x3));
+        }
+        const __m128i fold1 = _mm_set_epi64x( (int64_t) k.high[1], (int64_t) k.low[1]);
+        for ( ; i + 16 <= size; i += 16 )
+        {
+            x0 = _mm_xor_si128( Fold( x0, fold1), LoadBlock( pData + i));
+        }
+
+        // The CRC of the folded block is the CRC of the data so far.
+        uint8_t folded[16];
+        const __m128i reverse = _mm_setr_epi8( 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        _mm_storeu_si128( (__m128i*) folded, _mm_shuffle_epi8( x0, reverse));
+        return ComputeSliced( pData + i, size - i, ComputeSliced( folded, sizeof( folded)));
+    }
+
+
+    // Returns the best kernel supported by the CPU.
+    inline EKernel GetBestKernel()
+    {
+        static const EKernel best = __builtin_cpu_supports( "pclmul") && __builtin_cpu_supports( "ssse3") ? Kernel_Pclmul : Kernel_Sliced;
+        return best;
+    }
+
+
+    inline const char* GetKernelName( EKernel kernel)
+    {
+        switch ( kernel == Kernel_Auto ? GetBestKernel() : kernel )
+        {
+        case Kernel_Pclmul:
+            return "PCLMUL";
+        case Kernel_Sliced:
+            return "sliced";
+        default:
+            return "scalar";
+        }
+    }
+
+
+    // Computes the CRC of size bytes, continuing from the CRC of the data before them.
+    inline uint16_t Compute( const void* pData, size_t size, uint16_t crc = 0, EKernel kernel = Kernel_Auto)
+    {
+        const uint8_t* pBytes = static_cast<const uint8_t*>( pData);
+        switch ( kernel == Kernel_Auto ? GetBestKernel() : kernel )
+        {
+        case Kernel_Pclmul:
+            return ComputePclmul( pBytes, size, crc);
+        case Kernel_Sliced:
+            return ComputeSliced( pBytes, size, crc);
+        default:
+            return ComputeScalar( pBytes, size, crc);
+        }
+    }
+}
+
+#endif /* INCLUDED_CRC16_H_2618094 */
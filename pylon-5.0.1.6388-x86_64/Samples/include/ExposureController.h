@@ -0,0 +1,346 @@
+// Contains a host-side exposure and gain controller for triggered bursts, for cameras whose auto
+// functions do not settle with sparse trigger bursts.
+//
+// The frames of a burst are added to a 256-bin histogram of the 8 most significant bits of
+// every rowStep-th line, together with the number of saturated pixels. Between bursts, Update()
+// compares percentiles of the histogram with their targets and computes new exposure time and
+// gain values:
+// * Each target percentile p with target level t asks for a brightness change of t / level(p).
+//   The smallest change is used, so a bright highlight target wins over a dark median target.
+//   When more pixels than maxSaturatedFraction are saturated, the brightness is halved instead,
+//   as the histogram cannot tell how far the scene is clipped.
+// * The change is damped, change ^ damping, and limited to maxStepRatio per update.
+// * The total brightness (exposure time times linear gain) is split preferring exposure time up
+//   to maxExposureUs, then gain.
+// * If the total changes by less than the deadband, nothing is written.
+//
+// The AVX2 kernel converts the pixels to bin numbers and counts the saturated pixels 32 at a
+// time; the bins are counted in four interleaved tables to avoid stalls on repeated bins.
+// The class only uses the C++ standard library. AddFrame() and Update() can be called from
+// different threads.
+
+#ifndef INCLUDED_EXPOSURECONTROLLER_H_6095213
+#define INCLUDED_EXPOSURECONTROLLER_H_6095213
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <immintrin.h>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+#include <ostream>
+#include "LatencyHistogram.h"
+
+namespace Pylon
+{
+    namespace HistogramKernels
+    {
+        enum EKernel
+        {
+            Kernel_Auto,
+            Kernel_Scalar,
+            Kernel_Avx2
+        };
+
+        static const size_t c_binCount = 256;
+
+        // Bins are counted in four tables, bins[ (i & 3) * c_binCount + bin ].
+        inline void AddRowScalar( const uint8_t* pPixels, size_t count, uint32_t* pBins, uint64_t& saturated)
+        {
+            for ( size_t i = 0; i < count; ++i )
+            {
+                ++pBins[ (i & 3) * c_binCount + pPixels[i] ];
+                saturated += pPixels[i] == 255;
+            }
+        }
+
+        inline void AddRowScalar( const uint16_t* pPixels, size_t count, uint32_t* pBins, uint64_t& saturated)
+        {
+            for ( size_t i = 0; i < count; ++i )
+            {
+                ++pBins[ (i & 3) * c_binCount + std::min( pPixels[i] >> 4, 255) ];
+                saturated += pPixels[i] >= 4095;
+            }
+        }
+
+        inline void CountBins32( const uint8_t* pBinNumbers, uint32_t* pBins)
+        {
+            for ( size_t i = 0; i < 32; i += 4 )
+            {
+                ++pBins[ pBinNumbers[i] ];
+                ++pBins[ c_binCount + pBinNumbers[i + 1] ];
+                ++pBins[ 2 * c_binCount + pBinNumbers[i + 2] ];
+                ++pBins[ 3 * c_binCount + pBinNumbers[i + 3] ];
+            }
+        }
+
+        __attribute__(( target( "avx2,popcnt")))
+        inline void AddRowAvx2( const uint8_t* pPixels, size_t count, uint32_t* pBins, uint64_t& saturated)
+        {
+            const __m256i maxValue = _mm256_set1_epi8( (char) 255);
+            size_t i = 0;
+            for ( ; i + 32 <= count; i += 32 )
+            {
+                const __m256i pixels = _mm256_loadu_si256( (const __m256i*) (pPixels + i));
+                saturated += _mm_popcnt_u32( (uint32_t) _mm256_movemask_epi8( _mm256_cmpeq_epi8( pixels, maxValue)));
+                CountBins32( pPixels + i, pBins);
+            }
+            AddRowScalar( pPixels + i, count - i, pBins, saturated);
+        }
+
+        __attribute__(( target( "avx2,popcnt")))
+        inline void AddRowAvx2( const uint16_t* pPixels, size_t count, uint32_t* pBins, uint64_t& saturated)
+        {
+            const __m256i maxValue = _mm256_set1_epi16( 4095);
+            uint8_t binNumbers[32];
+            size_t i = 0;
+            for ( ; i + 32 <= count; i += 32 )
+            {
+                const __m256i low = _mm256_loadu_si256( (const __m256i*) (pPixels + i));
+                const __m256i high = _mm256_loadu_si256( (const __m256i*) (pPixels + i + 16));
+                const __m256i saturatedLow = _mm256_cmpeq_epi16( _mm256_min_epu16( low, maxValue), maxValue);
+                const __m256i saturatedHigh = _mm256_cmpeq_epi16( _mm256_min_epu16( high, maxValue), maxValue);
+                // The signed pack keeps one mask byte per pixel.
+                saturated += _mm_popcnt_u32( (uint32_t) _mm256_movemask_epi8( _mm256_packs_epi16( saturatedLow, saturatedHigh)));
+                // The pack saturates values above 4095 to bin 255. It interleaves the lanes,
+                // which does not matter for counting.
+                _mm256_storeu_si256( (__m256i*) binNumbers, _mm256_packus_epi16( _mm256_srli_epi16( low, 4), _mm256_srli_epi16( high, 4)));
+                CountBins32( binNumbers, pBins);
+            }
+            AddRowScalar( pPixels + i, count - i, pBins, saturated);
+        }
+
+        inline EKernel GetBestKernel()
+        {
+            static const EKernel best = __builtin_cpu_supports( "avx2") && __builtin_cpu_supports( "popcnt") ? Kernel_Avx2 : Kernel_Scalar;
+            return best;
+        }
+
+        inline const char* GetKernelName( EKernel kernel)
+        {
+            return (kernel == Kernel_Auto ? GetBestKernel() : kernel) == Kernel_Avx2 ? "AVX2" : "scalar";
+        }
+
+        template <typename T>
+        inline void AddRow( const T* pPixels, size_t count, uint32_t* pBins, uint64_t& saturated, EKernel kernel = Kernel_Auto)
+        {
+            if ( (kernel == Kernel_Auto ? GetBestKernel() : kernel) == Kernel_Avx2 )
+            {
+                AddRowAvx2( pPixels, count, pBins, saturated);
+            }
+            else
+            {
+                AddRowScalar( pPixels, count, pBins, saturated);
+            }
+        }
+    }
+
+
+    struct SExposureControlSettings
+    {
+        SExposureControlSettings()
+            : highPercentile( 0.99)
+            , highTarget( 0.85)
+            , midPercentile( 0.5)
+            , midTarget( 0.35)
+            , maxSaturatedFraction( 0.002)
+            , damping( 0.5)
+            , maxStepRatio( 4.0)
+            , deadband( 0.05)
+            , minExposureUs( 20.0)
+            , maxExposureUs( 10000.0)
+            , minGainDb( 0.0)
+            , maxGainDb( 23.0)
+            , rowStep( 8)
+        {
+        }
+
+        double highPercentile;          // E.g. 0.99: 99 % of the pixels are at most this bright.
+        double highTarget;              // The level of highPercentile, as a fraction of full scale.
+        double midPercentile;           // 0 disables the second target.
+        double midTarget;
+        double maxSaturatedFraction;    // More saturated pixels halve the brightness.
+        double damping;                 // 1 corrects the full error in one update.
+        double maxStepRatio;            // The largest change of the brightness per update.
+        double deadband;                // Smaller relative changes are not written, e.g. 0.05 for 5 %.
+        double minExposureUs;
+        double maxExposureUs;           // The exposure time limit, e.g. for motion blur.
+        double minGainDb;
+        double maxGainDb;
+        uint32_t rowStep;               // Only every rowStep-th line is added to the histogram.
+    };
+
+
+    // The result of Update().
+    struct SExposureUpdate
+    {
+        bool write;                     // False if the change is within the deadband.
+        double exposureUs;
+        double gainDb;
+        double brightnessRatio;         // The damped and limited change of the total brightness.
+        double highLevel;               // The measured level of the high percentile.
+        double saturatedFraction;
+        uint64_t pixelCount;            // The pixels in the histogram; 0 if no frame was added.
+    };
+
+
+    class CExposureController
+    {
+    public:
+        explicit CExposureController( const SExposureControlSettings& settings, HistogramKernels::EKernel kernel = HistogramKernels::Kernel_Auto)
+            : m_settings( settings)
+            , m_kernel( kernel)
+            , m_bins( 4 * HistogramKernels::c_binCount, 0)
+            , m_saturated( 0)
+            , m_pixelCount( 0)
+            , m_frames( 0)
+            , m_updates( 0)
+            , m_writes( 0)
+        {
+            if ( settings.rowStep == 0 || settings.damping <= 0.0 || settings.maxStepRatio < 1.0
+                || settings.minExposureUs <= 0.0 || settings.minExposureUs > settings.maxExposureUs || settings.minGainDb > settings.maxGainDb )
+            {
+                throw std::invalid_argument( "CExposureController: invalid settings.");
+            }
+        }
+
+        // Adds a Mono8 (bitsPerPixel 8) or Mono12 (bitsPerPixel 12, 16 bit containers) frame.
+        // stride is the distance between the starts of two lines in bytes; 0 means the lines are
+        // not padded.
+        void AddFrame( const void* pBuffer, uint32_t width, uint32_t height, size_t stride, uint32_t bitsPerPixel)
+        {
+            const uint64_t startNs = GetMonotonicTimeNs();
+            const size_t bytesPerPixel = bitsPerPixel > 8 ? 2 : 1;
+            stride = stride != 0 ? stride : width * bytesPerPixel;
+            std::lock_guard<std::mutex> lock( m_mutex);
+            for ( uint32_t y = 0; y < height; y += m_settings.rowStep )
+            {
+                const uint8_t* pLine = static_cast<const uint8_t*>( pBuffer) + y * stride;
+                if ( bytesPerPixel == 1 )
+                {
+                    HistogramKernels::AddRow( pLine, width, &m_bins[0], m_saturated, m_kernel);
+                }
+                else
+                {
+                    HistogramKernels::AddRow( reinterpret_cast<const uint16_t*>( pLine), width, &m_bins[0], m_saturated, m_kernel);
+                }
+                m_pixelCount += width;
+            }
+            ++m_frames;
+            m_histogramTime.Record( GetMonotonicTimeNs() - startNs);
+        }
+
+        // Computes the new values from the frames added since the last update and clears the
+        // histogram. exposureUs and gainDb are the values the frames were taken with.
+        SExposureUpdate Update( double exposureUs, double gainDb)
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            SExposureUpdate update;
+            update.write = false;
+            update.exposureUs = exposureUs;
+            update.gainDb = gainDb;
+            update.brightnessRatio = 1.0;
+            update.pixelCount = m_pixelCount;
+            update.saturatedFraction = m_pixelCount != 0 ? (double) m_saturated / m_pixelCount : 0.0;
+            update.highLevel = 0.0;
+            ++m_updates;
+            if ( m_pixelCount == 0 )
+            {
+                return update;
+            }
+
+            std::vector<uint64_t> counts( HistogramKernels::c_binCount, 0);
+            for ( size_t i = 0; i < m_bins.size(); ++i )
+            {
+                counts[ i % HistogramKernels::c_binCount ] += m_bins[i];
+            }
+            update.highLevel = GetLevel( counts, m_settings.highPercentile);
+            double ratio = m_settings.highTarget / update.highLevel;
+            if ( m_settings.midPercentile > 0.0 )
+            {
+                ratio = std::min( ratio, m_settings.midTarget / GetLevel( counts, m_settings.midPercentile));
+            }
+            if ( update.saturatedFraction > m_settings.maxSaturatedFraction )
+            {
+                ratio = std::min( ratio, 0.5);
+            }
+            ratio = pow( ratio, m_settings.damping);
+            ratio = std::min( std::max( ratio, 1.0 / m_settings.maxStepRatio), m_settings.maxStepRatio);
+
+            // Split the new total into exposure time first, then gain.
+            const double total = exposureUs * DbToLinear( gainDb) * ratio;
+            update.exposureUs = std::min( std::max( total / DbToLinear( m_settings.minGainDb), m_settings.minExposureUs), m_settings.maxExposureUs);
+            update.gainDb = std::min( std::max( 20.0 * log10( total / update.exposureUs), m_settings.minGainDb), m_settings.maxGainDb);
+            update.brightnessRatio = update.exposureUs * DbToLinear( update.gainDb) / (exposureUs * DbToLinear( gainDb));
+            update.write = fabs( log( update.brightnessRatio)) > log( 1.0 + m_settings.deadband);
+            if ( update.write )
+            {
+                ++m_writes;
+            }
+            else
+            {
+                update.exposureUs = exposureUs;
+                update.gainDb = gainDb;
+            }
+
+            std::fill( m_bins.begin(), m_bins.end(), 0);
+            m_saturated = 0;
+            m_pixelCount = 0;
+            return update;
+        }
+
+        void PrintStatistics( std::ostream& os) const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            os << "Exposure control: " << m_frames << " frames, " << m_updates << " updates, " << m_writes << " parameter writes ("
+               << HistogramKernels::GetKernelName( m_kernel) << " histogram, every " << m_settings.rowStep << ". line)" << std::endl;
+            m_histogramTime.Print( os, "Histogram time per frame");
+        }
+
+    private:
+        static double DbToLinear( double db)
+        {
+            return pow( 10.0, db / 20.0);
+        }
+
+        // Returns the level below which the given fraction of the pixels lies, as a fraction of
+        // full scale, at the upper edge of the bin. Never returns 0.
+        static double GetLevel( const std::vector<uint64_t>& counts, double fraction)
+        {
+            uint64_t total = 0;
+            for ( size_t i = 0; i < counts.size(); ++i )
+            {
+                total += counts[i];
+            }
+            const double threshold = fraction * total;
+            uint64_t sum = 0;
+            size_t bin = 0;
+            for ( ; bin + 1 < counts.size(); ++bin )
+            {
+                sum += counts[ bin ];
+                if ( sum >= threshold )
+                {
+                    break;
+                }
+            }
+            return (bin + 1.0) / counts.size();
+        }
+
+        const SExposureControlSettings m_settings;
+        const HistogramKernels::EKernel m_kernel;
+
+        mutable std::mutex m_mutex;
+        std::vector<uint32_t> m_bins;
+        uint64_t m_saturated;
+        uint64_t m_pixelCount;
+        uint64_t m_frames;
+        uint64_t m_updates;
+        uint64_t m_writes;
+        CLatencyHistogram m_histogramTime;
+    };
+}
+
+#endif /* INCLUDED_EXPOSURECONTROLLER_H_6095213 */
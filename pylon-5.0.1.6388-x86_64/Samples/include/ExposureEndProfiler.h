@@ -0,0 +1,187 @@
+// Contains a profiler for the latencies between the Exposure End event, the image and its
+// processing, per camera.
+//
+// The Exposure End event of a frame is matched with its grab result by comparing the event
+// frame ID (EventExposureEndFrameID, ExposureEndEventFrameID) with the block ID of the grab
+// result. Event frame IDs are 16 bit, so only the lower 16 bits are compared; this works across
+// the wrap-around as long as fewer than c_matchSlots frames are in flight. Recorded are:
+// * Exposure end to image: from the arrival of the event to the arrival of the image. This is
+//   what is gained by moving the imaged item or the sensor head on the event.
+// * Frame start to image: from the time stamp of the image (the frame start on Basler cameras)
+//   to the arrival of the image. Needs a CCameraClockCorrelator to convert the time stamp.
+// * Image to handler return: the processing time of the image handler.
+// Events arriving after their image are counted but not recorded in the histogram.
+//
+// Call OnExposureEnd() from the camera event handler, OnImageGrabbed() at the start and
+// OnImageHandled() at the end of the image event handler. All methods are thread-safe.
+
+#ifndef INCLUDED_EXPOSUREENDPROFILER_H_4185307
+#define INCLUDED_EXPOSUREENDPROFILER_H_4185307
+
+#include <pylon/PylonIncludes.h>
+#include <string>
+#include <mutex>
+#include <ostream>
+#include "ClockCorrelation.h"
+#include "LatencyHistogram.h"
+
+namespace Pylon
+{
+    class CExposureEndProfiler
+    {
+    public:
+        explicit CExposureEndProfiler( const std::string& cameraName = std::string(), const CCameraClockCorrelator* pCorrelator = NULL)
+            : m_cameraName( cameraName)
+            , m_pCorrelator( pCorrelator)
+        {
+            Reset();
+        }
+
+        // The correlator used for the frame start latency, NULL to not record it.
+        void SetClockCorrelator( const CCameraClockCorrelator* pCorrelator)
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            m_pCorrelator = pCorrelator;
+        }
+
+        // Clears the histograms and the pending events.
+        void Reset()
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            for ( size_t i = 0; i < c_matchSlots; ++i )
+            {
+                m_slots[i].frameId = 0;
+                m_slots[i].state = SlotState_Empty;
+            }
+            m_exposureEndToImage.Reset();
+            m_frameStartToImage.Reset();
+            m_imageToHandlerReturn.Reset();
+            m_events = 0;
+            m_duplicateEvents = 0;
+            m_lateEvents = 0;
+            m_images = 0;
+            m_unmatchedImages = 0;
+        }
+
+        // Records the arrival of an Exposure End event.
+        void OnExposureEnd( uint64_t frameId)
+        {
+            const uint64_t nowNs = GetMonotonicTimeNs();
+            const uint16_t id = (uint16_t) frameId;
+            std::lock_guard<std::mutex> lock( m_mutex);
+            ++m_events;
+            SSlot& slot = m_slots[ id % c_matchSlots ];
+            if ( slot.frameId == id && slot.state == SlotState_Event )
+            {
+                // GigE events can be sent twice, keep the first one.
+                ++m_duplicateEvents;
+                return;
+            }
+            if ( slot.frameId == id && slot.state == SlotState_Image )
+            {
+                ++m_lateEvents;
+                slot.state = SlotState_Empty;
+                return;
+            }
+            slot.frameId = id;
+            slot.state = SlotState_Event;
+            slot.timeNs = nowNs;
+        }
+
+        // Records the arrival of an image. Returns the arrival time to be passed to OnImageHandled().
+        uint64_t OnImageGrabbed( const CGrabResultPtr& ptrGrabResult)
+        {
+            const uint64_t nowNs = GetMonotonicTimeNs();
+            const uint16_t id = (uint16_t) ptrGrabResult->GetBlockID();
+            // Converting the time stamp reads the chunk node map, do it outside the lock.
+            const CCameraClockCorrelator* pCorrelator = GetClockCorrelator();
+            const uint64_t frameStartNs = pCorrelator != NULL && ptrGrabResult->GrabSucceeded() ? pCorrelator->GetHostTimeNs( ptrGrabResult) : 0;
+
+            std::lock_guard<std::mutex> lock( m_mutex);
+            ++m_images;
+            if ( frameStartNs != 0 && frameStartNs < nowNs )
+            {
+                m_frameStartToImage.Record( nowNs - frameStartNs);
+            }
+            SSlot& slot = m_slots[ id % c_matchSlots ];
+            if ( slot.frameId == id && slot.state == SlotState_Event )
+            {
+                m_exposureEndToImage.Record( nowNs - slot.timeNs);
+                slot.state = SlotState_Empty;
+            }
+            else
+            {
+                // The event is late or lost. Remember the image to tell the two apart.
+                ++m_unmatchedImages;
+                slot.frameId = id;
+                slot.state = SlotState_Image;
+                slot.timeNs = nowNs;
+            }
+            return nowNs;
+        }
+
+        // Records the end of the processing of an image.
+        void OnImageHandled( uint64_t arrivalNs)
+        {
+            const uint64_t nowNs = GetMonotonicTimeNs();
+            std::lock_guard<std::mutex> lock( m_mutex);
+            m_imageToHandlerReturn.Record( nowNs - arrivalNs);
+        }
+
+        // Prints the percentiles recorded so far. Can be called at any time.
+        void PrintStatistics( std::ostream& os) const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            const std::string prefix = m_cameraName.empty() ? std::string() : m_cameraName + ": ";
+            os << prefix << m_images << " images, " << m_events << " Exposure End events, "
+               << m_unmatchedImages << " images without preceding event, " << m_lateEvents << " late events, "
+               << m_duplicateEvents << " duplicate events" << std::endl;
+            m_exposureEndToImage.Print( os, (prefix + "Exposure end to image").c_str());
+            if ( m_frameStartToImage.GetCount() != 0 )
+            {
+                m_frameStartToImage.Print( os, (prefix + "Frame start to image").c_str());
+            }
+            m_imageToHandlerReturn.Print( os, (prefix + "Image to handler return").c_str());
+        }
+
+    private:
+        // The number of frames that can be in flight between an event and its image.
+        static const size_t c_matchSlots = 256;
+
+        enum ESlotState
+        {
+            SlotState_Empty,
+            SlotState_Event,    // The event has arrived, the image not yet.
+            SlotState_Image     // The image has arrived without event.
+        };
+
+        struct SSlot
+        {
+            uint16_t frameId;
+            ESlotState state;
+            uint64_t timeNs;
+        };
+
+        const CCameraClockCorrelator* GetClockCorrelator() const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            return m_pCorrelator;
+        }
+
+        const std::string m_cameraName;
+        const CCameraClockCorrelator* m_pCorrelator;
+
+        mutable std::mutex m_mutex;
+        SSlot m_slots[ c_matchSlots ];
+        CLatencyHistogram m_exposureEndToImage;
+        CLatencyHistogram m_frameStartToImage;
+        CLatencyHistogram m_imageToHandlerReturn;
+        uint64_t m_events;
+        uint64_t m_duplicateEvents;
+        uint64_t m_lateEvents;
+        uint64_t m_images;
+        uint64_t m_unmatchedImages;
+    };
+}
+
+#endif /* INCLUDED_EXPOSUREENDPROFILER_H_4185307 */
@@ -0,0 +1,539 @@
+// Contains a per-pixel dark-frame and flat-field correction for Mono8 and Mono12 frames.
+//
+// Each pixel value v is corrected with its own dark offset d and gain g:
+//   v' = min( ((min( v, max) - d, at least 0) * 8 * g + 16384) >> 15, max)
+// i.e. v' = (v - d) * g / 4096, rounded, where g is a 3.12 fixed-point gain (4096 = 1.0, below
+// 8.0) and max is 255 or 4095. The SIMD kernels compute this with 16 bit saturating subtracts
+// and one rounding 16 x 16 bit high multiply (pmulhrsw) per pixel, so they give exactly the
+// results of the scalar kernel. CFlatFieldCorrector::Apply() corrects a frame in place, e.g.
+// the grab buffer.
+//
+// CFlatFieldCalibrator builds the maps from averaged dark frames (lens covered) and flat frames
+// (uniformly lit scene, not saturated). The gains scale every pixel to the mean flat-field
+// response, so the mean brightness of a frame is kept. Pixels that would need more than the
+// maximum gain, e.g. dead pixels, keep unity gain, so their noise is not amplified, and are
+// counted as defective.
+//
+// The maps are stored in a binary file: SFlatFieldFileHeader, followed by the dark offsets and
+// then the gains, one uint16_t per pixel each, row by row. All fields are little-endian on any
+// host. Mono12 is 12 bit data in 16 bit containers (PixelType_Mono12).
+
+#ifndef INCLUDED_FLATFIELDCORRECTION_H_8832460
+#define INCLUDED_FLATFIELDCORRECTION_H_8832460
+
+#include <pylon/PylonIncludes.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <immintrin.h>
+#include <vector>
+#include <algorithm>
+#include "ShadingCalibration.h"
+
+namespace Pylon
+{
+    namespace FlatFieldKernels
+    {
+        enum EKernel
+        {
+            Kernel_Auto,
+            Kernel_Scalar,
+            Kernel_Ssse3,
+            Kernel_Avx2
+        };
+
+        static const uint32_t c_gainFractionBits = 12;
+        static const uint16_t c_unityGain = 1 << c_gainFractionBits;
+        static const uint16_t c_maxGain = 32767;
+
+        template <typename T>
+        inline void CorrectScalar( T* pPixels, const uint16_t* pDark, const uint16_t* pGain, size_t count, uint16_t maxValue)
+        {
+            for ( size_t i = 0; i < count; ++i )
+            {
+                const uint32_t value = std::min( (uint32_t) pPixels[i], (uint32_t) maxValue);
+                const uint32_t offset = value > pDark[i] ? value - pDark[i] : 0;
+                const uint32_t corrected = ((offset << 3) * std::min( pGain[i], c_maxGain) + 16384) >> 15;
+                pPixels[i] = (T) std::min( corrected, (uint32_t) maxValue);
+            }
+        }
+
+        // The SIMD kernels need gains up to c_maxGain, which CFlatFieldCorrector ensures.
+        __attribute__(( target( "ssse3")))
+        inline __m128i CorrectVectorSsse3( __m128i values, const uint16_t* pDark, const uint16_t* pGain, __m128i maxValue)
+        {
+            // min( values, maxValue) without SSE4.1, as the values can exceed the signed range.
+            const __m128i clamped = _mm_sub_epi16( values, _mm_subs_epu16( values, maxValue));
+            const __m128i offset = _mm_subs_epu16( clamped, _mm_loadu_si128( (const __m128i*) pDark));
+            const __m128i corrected = _mm_mulhrs_epi16( _mm_slli_epi16( offset, 3), _mm_loadu_si128( (const __m128i*) pGain));
+            return _mm_min_epi16( corrected, maxValue);
+        }
+
+        __attribute__(( target( "ssse3")))
+        inline void CorrectMono8Ssse3( uint8_t* pPixels, const uint16_t* pDark, const uint16_t* pGain, size_t count)
+        {
+            const __m128i maxValue = _mm_set1_epi16( 255);
+            const __m128i zero = _mm_setzero_si128();
+            size_t i = 0;
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                const __m128i pixels = _mm_loadu_si128( (const __m128i*) (pPixels + i));
+                const __m128i low = CorrectVectorSsse3( _mm_unpacklo_epi8( pixels, zero), pDark + i, pGain + i, maxValue);
+                const __m128i high = CorrectVectorSsse3( _mm_unpackhi_epi8( pixels, zero), pDark + i + 8, pGain + i + 8, maxValue);
+                _mm_storeu_si128( (__m128i*) (pPixels + i), _mm_packus_epi16( low, high));
+            }
+            CorrectScalar( pPixels + i, pDark + i, pGain + i, count - i, 255);
+        }
+
+        __attribute__(( target( "ssse3")))
+        inline void CorrectMono12Ssse3( uint16_t* pPixels, const uint16_t* pDark, const uint16_t* pGain, size_t count)
+        {
+            const __m128i maxValue = _mm_set1_epi16( 4095);
+            size_t i = 0;
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                __m128i* pVector = (__m128i*) (pPixels + i);
+                _mm_storeu_si128( pVector, CorrectVectorSsse3( _mm_loadu_si128( pVector), pDark + i, pGain + i, maxValue));
+            }
+            CorrectScalar( pPixels + i, pDark + i, pGain + i, count - i, 4095);
+        }
+
+        __attribute__(( target( "avx2")))
+        inline __m256i CorrectVectorAvx2( __m256i values, const uint16_t* pDark, const uint16_t* pGain, __m256i maxValue)
+        {
+            const __m256i offset = _mm256_subs_epu16( _mm256_min_epu16( values, maxValue), _mm256_loadu_si256( (const __m256i*) pDark));
+            const __m256i corrected = _mm256_mulhrs_epi16( _mm256_slli_epi16( offset, 3), _mm256_loadu_si256( (const __m256i*) pGain));
+            return _mm256_min_epi16( corrected, maxValue);
+        }
+
+        __attribute__(( target( "avx2")))
+        inline void CorrectMono8Avx2( uint8_t* pPixels, const uint16_t* pDark, const uint16_t* pGain, size_t count)
+        {
+            const __m256i maxValue = _mm256_set1_epi16( 255);
+            size_t i = 0;
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                const __m256i pixels = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*) (pPixels + i)));
+                const __m256i corrected = CorrectVectorAvx2( pixels, pDark + i, pGain + i, maxValue);
+                _mm_storeu_si128( (__m128i*) (pPixels + i),
+                    _mm_packus_epi16( _mm256_castsi256_si128( corrected), _mm256_extracti128_si256( corrected, 1)));
+            }
+            CorrectScalar( pPixels + i, pDark + i, pGain + i, count - i, 255);
+        }
+
+        __attribute__(( target( "avx2")))
+        inline void CorrectMono12Avx2( uint16_t* pPixels, const uint16_t* pDark, const uint16_t* pGain, size_t count)
+        {
+            const __m256i maxValue = _mm256_set1_epi16( 4095);
+            size_t i = 0;
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                __m256i* pVector = (__m256i*) (pPixels + i);
+                _mm256_storeu_si256( pVector, CorrectVectorAvx2( _mm256_loadu_si256( pVector), pDark + i, pGain + i, maxValue));
+            }
+            CorrectScalar( pPixels + i, pDark + i, pGain + i, count - i, 4095);
+        }
+
+        inline EKernel GetBestKernel()
+        {
+            static const EKernel best = __builtin_cpu_supports( "avx2") ? Kernel_Avx2
+                : (__builtin_cpu_supports( "ssse3") ? Kernel_Ssse3 : Kernel_Scalar);
+            return best;
+        }
+
+        inline const char* GetKernelName( EKernel kernel)
+        {
+            switch ( kernel == Kernel_Auto ? GetBestKernel() : kernel )
+            {
+            case Kernel_Avx2:
+                return "AVX2";
+            case Kernel_Ssse3:
+                return "SSSE3";
+            default:
+                return "scalar";
+            }
+        }
+
+        inline void CorrectMono8( uint8_t* pPixels, const uint16_t* pDark, const uint16_t* pGain, size_t count, EKernel kernel = Kernel_Auto)
+        {
+            switch ( kernel == Kernel_Auto ? GetBestKernel() : kernel )
+            {
+            case Kernel_Avx2:
+                CorrectMono8Avx2( pPixels, pDark, pGain, count);
+                break;
+            case Kernel_Ssse3:
+                CorrectMono8Ssse3( pPixels, pDark, pGain, count);
+                break;
+            default:
+                CorrectScalar( pPixels, pDark, pGain, count, 255);
+                break;
+            }
+        }
+
+        inline void CorrectMono12( uint16_t* pPixels, const uint16_t* pDark, const uint16_t* pGain, size_t count, EKernel kernel = Kernel_Auto)
+        {
+            switch ( kernel == Kernel_Auto ? GetBestKernel() : kernel )
+            {
+            case Kernel_Avx2:
+                CorrectMono12Avx2( pPixels, pDark, pGain, count);
+                break;
+            case Kernel_Ssse3:
+                CorrectMono12Ssse3( pPixels, pDark, pGain, count);
+                break;
+            default:
+                CorrectScalar( pPixels, pDark, pGain, count, 4095);
+                break;
+            }
+        }
+    }
+
+
+    static const char c_flatFieldMagic[8] = { 'P', 'Y', 'L', 'N', 'F', 'F', 'C', '1' };
+
+    struct SFlatFieldFileHeader
+    {
+        char magic[8];
+        uint32_t headerSize;
+        uint32_t width;
+        uint32_t height;
+        uint32_t bitsPerPixel;          // 8 or 12.
+        uint32_t gainFractionBits;      // 12.
+        uint32_t defectivePixels;
+    };
+
+
+    class CFlatFieldCorrector
+    {
+    public:
+        // The maps hold width * height values each, row by row.
+        CFlatFieldCorrector( uint32_t width, uint32_t height, EShadingFormat format, const std::vector<uint16_t>& dark,
+            const std::vector<uint16_t>& gain, uint32_t defectivePixels = 0)
+            : m_width( width)
+            , m_height( height)
+            , m_format( format)
+            , m_dark( dark)
+            , m_gain( gain)
+            , m_defectivePixels( defectivePixels)
+            , m_kernel( FlatFieldKernels::Kernel_Auto)
+        {
+            if ( format == ShadingFormat_RGB8 )
+            {
+                throw INVALID_ARGUMENT_EXCEPTION( "CFlatFieldCorrector supports Mono8 and Mono12 only.");
+            }
+            if ( dark.size() != (size_t) width * height || gain.size() != dark.size() )
+            {
+                throw INVALID_ARGUMENT_EXCEPTION( "CFlatFieldCorrector: the maps do not match the frame size.");
+            }
+            for ( size_t i = 0; i < m_gain.size(); ++i )
+            {
+                m_gain[i] = std::min( m_gain[i], FlatFieldKernels::c_maxGain);
+            }
+        }
+
+        static CFlatFieldCorrector Load( const char* filename)
+        {
+            FILE* pFile = fopen( filename, "rb");
+            if ( pFile == NULL )
+            {
+                throw RUNTIME_EXCEPTION( "Could not open %s: %s", filename, strerror( errno));
+            }
+            const long fileSize = fseek( pFile, 0, SEEK_END) == 0 ? ftell( pFile) : -1;
+            uint8_t headerBytes[ sizeof( SFlatFieldFileHeader) ];
+            const bool headerRead = fileSize >= 0 && fseek( pFile, 0, SEEK_SET) == 0 && fread( headerBytes, sizeof( headerBytes), 1, pFile) == 1;
+            SFlatFieldFileHeader header;
+            DecodeHeader( headerBytes, header);
+            if ( !headerRead || memcmp( header.magic, c_flatFieldMagic, sizeof( header.magic)) != 0 || header.headerSize != sizeof( header)
+                || (header.bitsPerPixel != 8 && header.bitsPerPixel != 12) || header.gainFractionBits != FlatFieldKernels::c_gainFractionBits )
+            {
+                fclose( pFile);
+                throw RUNTIME_EXCEPTION( "%s is not a flat-field correction file.", filename);
+            }
+
+            // Check the size before allocating, so that a corrupt header cannot request huge maps.
+            // Two maps of two bytes per pixel follow the header.
+            const uint64_t pixelCount = (uint64_t) header.width * header.height;
+            const uint64_t mapsSize = (uint64_t) fileSize - sizeof( header);
+            if ( mapsSize % 4 != 0 || mapsSize / 4 != pixelCount )
+            {
+                fclose( pFile);
+                throw RUNTIME_EXCEPTION( "%s has %ld bytes, which does not match %u x %u pixels.", filename, fileSize, header.width, header.height);
+            }
+            std::vector<uint8_t> mapBytes( (size_t) mapsSize);
+            const bool mapsRead = mapBytes.empty() || fread( &mapBytes[0], 1, mapBytes.size(), pFile) == mapBytes.size();
+            fclose( pFile);
+            if ( !mapsRead )
+            {
+                throw RUNTIME_EXCEPTION( "Could not read %s.", filename);
+            }
+            std::vector<uint16_t> dark( (size_t) pixelCount);
+            std::vector<uint16_t> gain( dark.size());
+            for ( size_t i = 0; i < dark.size(); ++i )
+            {
+                dark[i] = LoadLittleEndian16( &mapBytes[ 2 * i ]);
+                gain[i] = LoadLittleEndian16( &mapBytes[ 2 * (dark.size() + i) ]);
+            }
+            return CFlatFieldCorrector( header.width, header.height, header.bitsPerPixel == 8 ? ShadingFormat_Mono8 : ShadingFormat_Mono12,
+                dark, gain, header.defectivePixels);
+        }
+
+        void Save( const char* filename) const
+        {
+            SFlatFieldFileHeader header;
+            memset( &header, 0, sizeof( header));
+            memcpy( header.magic, c_flatFieldMagic, sizeof( header.magic));
+            header.headerSize = sizeof( header);
+            header.width = m_width;
+            header.height = m_height;
+            header.bitsPerPixel = m_format == ShadingFormat_Mono8 ? 8 : 12;
+            header.gainFractionBits = FlatFieldKernels::c_gainFractionBits;
+            header.defectivePixels = m_defectivePixels;
+
+            std::vector<uint8_t> bytes( sizeof( header) + 4 * m_dark.size());
+            EncodeHeader( header, &bytes[0]);
+            uint8_t* pMaps = &bytes[ sizeof( header) ];
+            for ( size_t i = 0; i < m_dark.size(); ++i )
+            {
+                StoreLittleEndian16( pMaps + 2 * i, m_dark[i]);
+                StoreLittleEndian16( pMaps + 2 * (m_dark.size() + i), m_gain[i]);
+            }
+
+            FILE* pFile = fopen( filename, "wb");
+            if ( pFile == NULL )
+            {
+                throw RUNTIME_EXCEPTION( "Could not create %s: %s", filename, strerror( errno));
+            }
+            bool written = fwrite( &bytes[0], 1, bytes.size(), pFile) == bytes.size();
+            written = fclose( pFile) == 0 && written;
+            if ( !written )
+            {
+                throw RUNTIME_EXCEPTION( "Could not write %s.", filename);
+            }
+        }
+
+        // Selects the kernel, e.g. for comparing them. By default the best one is used.
+        void SetKernel( FlatFieldKernels::EKernel kernel)
+        {
+            m_kernel = kernel;
+        }
+
+        // Corrects a frame in place. stride is the distance between the starts of two lines in
+        // bytes; 0 means the lines are not padded.
+        void Apply( void* pBuffer, size_t stride = 0) const
+        {
+            ApplyRows( pBuffer, stride, 0, m_height);
+        }
+
+        // Corrects the lines firstRow to firstRow + rowCount - 1 of a frame in place, so that a
+        // frame can be split among threads. pBuffer points to the start of the frame.
+        void ApplyRows( void* pBuffer, size_t stride, uint32_t firstRow, uint32_t rowCount) const
+        {
+            const size_t lineSize = (size_t) m_width * GetBytesPerPixel();
+            if ( stride == 0 )
+            {
+                stride = lineSize;
+            }
+            if ( stride < lineSize || firstRow + rowCount > m_height )
+            {
+                throw INVALID_ARGUMENT_EXCEPTION( "CFlatFieldCorrector::ApplyRows: the lines are outside the frame.");
+            }
+            uint8_t* pLine = static_cast<uint8_t*>( pBuffer) + firstRow * stride;
+            for ( uint32_t y = firstRow; y < firstRow + rowCount; ++y, pLine += stride )
+            {
+                const size_t mapOffset = (size_t) y * m_width;
+                if ( m_format == ShadingFormat_Mono8 )
+                {
+                    FlatFieldKernels::CorrectMono8( pLine, &m_dark[ mapOffset ], &m_gain[ mapOffset ], m_width, m_kernel);
+                }
+                else
+                {
+                    FlatFieldKernels::CorrectMono12( reinterpret_cast<uint16_t*>( pLine), &m_dark[ mapOffset ], &m_gain[ mapOffset ], m_width, m_kernel);
+                }
+            }
+        }
+
+        uint32_t GetWidth() const { return m_width; }
+        uint32_t GetHeight() const { return m_height; }
+        EShadingFormat GetFormat() const { return m_format; }
+        size_t GetBytesPerPixel() const { return m_format == ShadingFormat_Mono8 ? 1 : 2; }
+        uint32_t GetDefectivePixelCount() const { return m_defectivePixels; }
+        const std::vector<uint16_t>& GetDarkMap() const { return m_dark; }
+        const std::vector<uint16_t>& GetGainMap() const { return m_gain; }
+
+    private:
+        static void StoreLittleEndian16( uint8_t* pBytes, uint16_t value)
+        {
+            pBytes[0] = (uint8_t) value;
+            pBytes[1] = (uint8_t) (value >> 8);
+        }
+
+        static void StoreLittleEndian32( uint8_t* pBytes, uint32_t value)
+        {
+            StoreLittleEndian16( pBytes, (uint16_t) value);
+            StoreLittleEndian16( pBytes + 2, (uint16_t) (value >> 16));
+        }
+
+        static uint16_t LoadLittleEndian16( const uint8_t* pBytes)
+        {
+            return (uint16_t) (pBytes[0] | pBytes[1] << 8);
+        }
+
+        static uint32_t LoadLittleEndian32( const uint8_t* pBytes)
+        {
+            return LoadLittleEndian16( pBytes) | (uint32_t) LoadLittleEndian16( pBytes + 2) << 16;
+        }
+
+        // The fields in the order of SFlatFieldFileHeader, after the magic.
+        static void EncodeHeader( const SFlatFieldFileHeader& header, uint8_t* pBytes)
+        {
+            const uint32_t fields[] = { header.headerSize, header.width, header.height, header.bitsPerPixel, header.gainFractionBits, header.defectivePixels };
+            memcpy( pBytes, header.magic, sizeof( header.magic));
+            for ( size_t i = 0; i < sizeof( fields) / sizeof( fields[0]); ++i )
+            {
+                StoreLittleEndian32( pBytes + sizeof( header.magic) + 4 * i, fields[i]);
+            }
+        }
+
+        static void DecodeHeader( const uint8_t* pBytes, SFlatFieldFileHeader& header)
+        {
+            uint32_t* const fields[] = { &header.headerSize, &header.width, &header.height, &header.bitsPerPixel, &header.gainFractionBits, &header.defectivePixels };
+            memcpy( header.magic, pBytes, sizeof( header.magic));
+            for ( size_t i = 0; i < sizeof( fields) / sizeof( fields[0]); ++i )
+            {
+                *fields[i] = LoadLittleEndian32( pBytes + sizeof( header.magic) + 4 * i);
+            }
+        }
+
+        uint32_t m_width;
+        uint32_t m_height;
+        EShadingFormat m_format;
+        std::vector<uint16_t> m_dark;
+        std::vector<uint16_t> m_gain;
+        uint32_t m_defectivePixels;
+        FlatFieldKernels::EKernel m_kernel;
+    };
+
+
+    class CFlatFieldCalibrator
+    {
+    public:
+        CFlatFieldCalibrator( uint32_t width, uint32_t height, EShadingFormat format)
+            : m_width( width)
+            , m_height( height)
+            , m_format( format)
+            , m_darkSums( (size_t) width * height, 0)
+            , m_flatSums( (size_t) width * height, 0)
+            , m_darkFrames( 0)
+            , m_flatFrames( 0)
+        {
+            if ( format == ShadingFormat_RGB8 )
+            {
+                throw INVALID_ARGUMENT_EXCEPTION( "CFlatFieldCalibrator supports Mono8 and Mono12 only.");
+            }
+        }
+
+        // Adds a frame taken with the lens covered.
+        void AddDarkFrame( const void* pBuffer, size_t stride = 0)
+        {
+            AddFrame( m_darkSums, pBuffer, stride);
+            ++m_darkFrames;
+        }
+
+        // Adds a frame of a uniformly lit scene.
+        void AddFlatFrame( const void* pBuffer, size_t stride = 0)
+        {
+            AddFrame( m_flatSums, pBuffer, stride);
+            ++m_flatFrames;
+        }
+
+        uint32_t GetDarkFrameCount() const { return m_darkFrames; }
+        uint32_t GetFlatFrameCount() const { return m_flatFrames; }
+
+        // Builds the maps from the frames added. Without dark frames, the offsets are zero.
+        CFlatFieldCorrector CreateCorrector() const
+        {
+            if ( m_flatFrames == 0 )
+            {
+                throw LOGICAL_ERROR_EXCEPTION( "CFlatFieldCalibrator: no flat frames have been added.");
+            }
+            const size_t pixelCount = m_darkSums.size();
+            std::vector<uint16_t> dark( pixelCount, 0);
+            std::vector<double> response( pixelCount);
+            double responseSum = 0.0;
+            size_t respondingPixels = 0;
+            for ( size_t i = 0; i < pixelCount; ++i )
+            {
+                if ( m_darkFrames != 0 )
+                {
+                    dark[i] = (uint16_t) ((m_darkSums[i] + m_darkFrames / 2) / m_darkFrames);
+                }
+                response[i] = (double) m_flatSums[i] / m_flatFrames - dark[i];
+                if ( response[i] > 0.0 )
+                {
+                    responseSum += response[i];
+                    ++respondingPixels;
+                }
+            }
+
+            const double target = respondingPixels != 0 ? responseSum / respondingPixels : 0.0;
+            const double maxGain = (double) FlatFieldKernels::c_maxGain / FlatFieldKernels::c_unityGain;
+            std::vector<uint16_t> gain( pixelCount);
+            uint32_t defectivePixels = 0;
+            for ( size_t i = 0; i < pixelCount; ++i )
+            {
+                if ( response[i] <= 0.0 || target / response[i] > maxGain )
+                {
+                    gain[i] = FlatFieldKernels::c_unityGain;
+                    ++defectivePixels;
+                }
+                else
+                {
+                    gain[i] = (uint16_t) floor( target / response[i] * FlatFieldKernels::c_unityGain + 0.5);
+                }
+            }
+            return CFlatFieldCorrector( m_width, m_height, m_format, dark, gain, defectivePixels);
+        }
+
+    private:
+        void AddFrame( std::vector<uint32_t>& sums, const void* pBuffer, size_t stride)
+        {
+            const size_t bytesPerPixel = m_format == ShadingFormat_Mono8 ? 1 : 2;
+            if ( stride == 0 )
+            {
+                stride = m_width * bytesPerPixel;
+            }
+            const uint8_t* pLine = static_cast<const uint8_t*>( pBuffer);
+            for ( uint32_t y = 0; y < m_height; ++y, pLine += stride )
+            {
+                uint32_t* pSums = &sums[ (size_t) y * m_width ];
+                if ( bytesPerPixel == 1 )
+                {
+                    for ( uint32_t x = 0; x < m_width; ++x )
+                    {
+                        pSums[x] += pLine[x];
+                    }
+                }
+                else
+                {
+                    const uint16_t* pLine16 = reinterpret_cast<const uint16_t*>( pLine);
+                    for ( uint32_t x = 0; x < m_width; ++x )
+                    {
+                        pSums[x] += pLine16[x];
+                    }
+                }
+            }
+        }
+
+        const uint32_t m_width;
+        const uint32_t m_height;
+        const EShadingFormat m_format;
+        std::vector<uint32_t> m_darkSums;
+        std::vector<uint32_t> m_flatSums;
+        uint32_t m_darkFrames;
+        uint32_t m_flatFrames;
+    };
+}
+
+#endif /* INCLUDED_FLATFIELDCORRECTION_H_8832460 */
@@ -0,0 +1,325 @@
+// Contains a synchronizer that groups the frames of several cameras into one set per trigger.
+//
+// Frames are pushed one by one, in any order and from any thread, e.g. from the
+// CInstantCameraArray::RetrieveResult() loop of Grab_UsingActionCommand. A frame is matched to
+// an open set either by
+// * its trigger generation, i.e. the number of the action command (or other trigger) that
+//   exposed it, which the application counts per camera, or by
+// * its time stamp: frames whose time stamps differ by at most the tolerance belong together.
+//   This needs time stamps on a common time base, e.g. GigE cameras synchronized with IEEE 1588
+//   (GevIEEE1588), or host times from CCameraClockCorrelator.
+// In generation mode, a non-zero tolerance checks the time stamps of each set as well; sets
+// exceeding it are counted as skew violations, which points to a miscounted generation.
+//
+// At most windowSize sets are open at a time. A set is handed to IFrameSetHandler as soon as it
+// has a frame from every camera. When the window is full, or a set has waited longer than
+// maxWaitNs, the set with the oldest trigger is removed; if it is incomplete, it is emitted
+// with the missing frames left empty or dropped, depending on the policy. Frames that belong to
+// a trigger whose set has already been removed are dropped and counted as late.
+//
+// The open sets hold the grab results, so windowSize must stay below MaxNumBuffer of each
+// camera, with some buffers to spare.
+
+#ifndef INCLUDED_FRAMESYNCHRONIZER_H_4470219
+#define INCLUDED_FRAMESYNCHRONIZER_H_4470219
+
+#include <pylon/PylonIncludes.h>
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+#include <ostream>
+#include "LatencyHistogram.h"
+
+namespace Pylon
+{
+    // How frames are matched to sets.
+    enum EFrameSetMatching
+    {
+        FrameSetMatching_Generation,    // By the trigger generation passed to Push().
+        FrameSetMatching_Timestamp      // By time stamps within the tolerance.
+    };
+
+    // What happens to a set that is removed before it is complete.
+    enum EIncompleteSetPolicy
+    {
+        IncompleteSet_Emit,     // Hand it to the handler with the missing frames left empty.
+        IncompleteSet_Drop      // Release its frames and count it as dropped.
+    };
+
+
+    // The frames of all cameras belonging to one trigger.
+    struct SFrameSet
+    {
+        explicit SFrameSet( size_t cameraCount = 0)
+            : key( 0)
+            , frames( cameraCount)
+            , timestampsNs( cameraCount, 0)
+            , frameCount( 0)
+            , firstArrivalNs( 0)
+        {
+        }
+
+        bool IsComplete() const
+        {
+            return frameCount == frames.size();
+        }
+
+        // Returns the difference between the latest and the earliest time stamp of the set.
+        uint64_t GetSkewNs() const
+        {
+            uint64_t minimum = ~0ULL;
+            uint64_t maximum = 0;
+            for ( size_t i = 0; i < frames.size(); ++i )
+            {
+                if ( frames[i].IsValid() )
+                {
+                    minimum = std::min( minimum, timestampsNs[i]);
+                    maximum = std::max( maximum, timestampsNs[i]);
+                }
+            }
+            return maximum >= minimum ? maximum - minimum : 0;
+        }
+
+        uint64_t key;                           // The generation, or the time stamp of the first frame.
+        std::vector<CGrabResultPtr> frames;     // Indexed by camera; invalid if the frame is missing.
+        std::vector<uint64_t> timestampsNs;
+        size_t frameCount;
+        uint64_t firstArrivalNs;                // Host time the first frame of the set was pushed.
+    };
+
+
+    // Receives the sets of a CFrameSynchronizer. OnFrameSet is called with the synchronizer
+    // locked, by the thread whose Push(), ExpireSets() or Flush() call completed or removed the
+    // set, so it should only queue heavy processing. The grab results can be kept by copying
+    // the pointers.
+    class IFrameSetHandler
+    {
+    public:
+        virtual ~IFrameSetHandler() {}
+        virtual void OnFrameSet( const SFrameSet& frameSet) = 0;
+    };
+
+
+    class CFrameSynchronizer
+    {
+    public:
+        CFrameSynchronizer( size_t cameraCount, IFrameSetHandler& handler, EFrameSetMatching matching, uint64_t toleranceNs,
+            size_t windowSize = 4, uint64_t maxWaitNs = 1000000000ULL, EIncompleteSetPolicy policy = IncompleteSet_Emit)
+            : m_cameraCount( cameraCount)
+            , m_handler( handler)
+            , m_matching( matching)
+            , m_toleranceNs( toleranceNs)
+            , m_windowSize( windowSize)
+            , m_maxWaitNs( maxWaitNs)
+            , m_policy( policy)
+            , m_hasHorizon( false)
+            , m_horizon( 0)
+            , m_frames( 0)
+            , m_lateFrames( 0)
+            , m_duplicateFrames( 0)
+            , m_completeSets( 0)
+            , m_incompleteSetsEmitted( 0)
+            , m_incompleteSetsDropped( 0)
+            , m_skewViolations( 0)
+        {
+            if ( cameraCount == 0 || windowSize == 0 )
+            {
+                throw std::invalid_argument( "CFrameSynchronizer needs at least one camera and a window of at least one set.");
+            }
+        }
+
+        // Adds a frame. timestampNs is used for matching in time stamp mode and for the skew
+        // statistics; generation is used in generation mode only.
+        void Push( size_t cameraIndex, const CGrabResultPtr& ptrGrabResult, uint64_t timestampNs, uint64_t generation = 0)
+        {
+            if ( cameraIndex >= m_cameraCount )
+            {
+                throw std::out_of_range( "CFrameSynchronizer::Push: camera index out of range.");
+            }
+            std::lock_guard<std::mutex> lock( m_mutex);
+            const uint64_t nowNs = GetMonotonicTimeNs();
+            const uint64_t key = m_matching == FrameSetMatching_Generation ? generation : timestampNs;
+            const uint64_t tolerance = m_matching == FrameSetMatching_Timestamp ? m_toleranceNs : 0;
+            ++m_frames;
+
+            SetMap::iterator it = FindOpenSet( cameraIndex, key, tolerance);
+            if ( it == m_openSets.end() )
+            {
+                if ( m_hasHorizon && key <= m_horizon + tolerance )
+                {
+                    ++m_lateFrames;
+                    return;
+                }
+                if ( m_openSets.find( key) != m_openSets.end() )
+                {
+                    // The camera has already delivered a frame for this trigger.
+                    ++m_duplicateFrames;
+                    return;
+                }
+                it = m_openSets.insert( std::make_pair( key, SFrameSet( m_cameraCount))).first;
+                it->second.key = key;
+                it->second.firstArrivalNs = nowNs;
+            }
+
+            SFrameSet& frameSet = it->second;
+            frameSet.frames[ cameraIndex ] = ptrGrabResult;
+            frameSet.timestampsNs[ cameraIndex ] = timestampNs;
+            ++frameSet.frameCount;
+            if ( frameSet.IsComplete() )
+            {
+                RemoveSet( it, nowNs);
+            }
+
+            while ( m_openSets.size() > m_windowSize )
+            {
+                RemoveSet( m_openSets.begin(), nowNs);
+            }
+            ExpireSetsLocked( nowNs);
+        }
+
+        // Removes the sets that have waited longer than maxWaitNs. Push() does this too; call it
+        // periodically if frames can stop arriving, e.g. when triggering stops.
+        void ExpireSets()
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            ExpireSetsLocked( GetMonotonicTimeNs());
+        }
+
+        // Removes all open sets, e.g. after grabbing has been stopped.
+        void Flush()
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            const uint64_t nowNs = GetMonotonicTimeNs();
+            while ( !m_openSets.empty() )
+            {
+                RemoveSet( m_openSets.begin(), nowNs);
+            }
+        }
+
+        // The share of removed sets that were complete, in percent.
+        double GetCompletionRate() const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            const uint64_t sets = m_completeSets + m_incompleteSetsEmitted + m_incompleteSetsDropped;
+            return sets != 0 ? 100.0 * m_completeSets / sets : 0.0;
+        }
+
+        void PrintStatistics( std::ostream& os) const
+        {
+            const double completionRate = GetCompletionRate();
+            std::lock_guard<std::mutex> lock( m_mutex);
+            os << "Frame sets: " << m_completeSets << " complete, " << m_incompleteSetsEmitted << " incomplete emitted, "
+               << m_incompleteSetsDropped << " incomplete dropped, " << m_openSets.size() << " open (completion rate "
+               << completionRate << " %)" << std::endl;
+            os << "Frames: " << m_frames << " pushed, " << m_lateFrames << " late, " << m_duplicateFrames << " duplicate";
+            if ( m_matching == FrameSetMatching_Generation && m_toleranceNs != 0 )
+            {
+                os << ", " << m_skewViolations << " sets beyond the time stamp tolerance";
+            }
+            os << std::endl;
+            m_assemblyLatency.Print( os, "Set assembly (first frame to emission)");
+            m_skew.Print( os, "Time stamp skew within sets");
+        }
+
+    private:
+        typedef std::map<uint64_t, SFrameSet> SetMap;
+
+        // Returns the open set that the frame belongs to and that has no frame of the camera yet.
+        SetMap::iterator FindOpenSet( size_t cameraIndex, uint64_t key, uint64_t tolerance)
+        {
+            SetMap::iterator it = m_openSets.lower_bound( key >= tolerance ? key - tolerance : 0);
+            for ( ; it != m_openSets.end() && it->first <= key + tolerance; ++it )
+            {
+                if ( !it->second.frames[ cameraIndex ].IsValid() )
+                {
+                    return it;
+                }
+            }
+            return m_openSets.end();
+        }
+
+        void ExpireSetsLocked( uint64_t nowNs)
+        {
+            SetMap::iterator it = m_openSets.begin();
+            while ( it != m_openSets.end() )
+            {
+                SetMap::iterator next = it;
+                ++next;
+                if ( nowNs - it->second.firstArrivalNs > m_maxWaitNs )
+                {
+                    RemoveSet( it, nowNs);
+                }
+                it = next;
+            }
+        }
+
+        // Emits or drops the set and erases it from the window.
+        void RemoveSet( SetMap::iterator it, uint64_t nowNs)
+        {
+            const SFrameSet& frameSet = it->second;
+            const bool complete = frameSet.IsComplete();
+            if ( complete || m_policy == IncompleteSet_Emit )
+            {
+                if ( complete )
+                {
+                    ++m_completeSets;
+                }
+                else
+                {
+                    ++m_incompleteSetsEmitted;
+                }
+                m_assemblyLatency.Record( nowNs - frameSet.firstArrivalNs);
+                if ( frameSet.frameCount > 1 )
+                {
+                    const uint64_t skewNs = frameSet.GetSkewNs();
+                    m_skew.Record( skewNs);
+                    if ( m_matching == FrameSetMatching_Generation && m_toleranceNs != 0 && skewNs > m_toleranceNs )
+                    {
+                        ++m_skewViolations;
+                    }
+                }
+                m_handler.OnFrameSet( frameSet);
+            }
+            else
+            {
+                ++m_incompleteSetsDropped;
+            }
+
+            // Frames for triggers up to the oldest removed set can no longer be matched. A set
+            // completed ahead of older open sets does not move the horizon.
+            if ( it == m_openSets.begin() )
+            {
+                m_horizon = m_hasHorizon ? std::max( m_horizon, it->first) : it->first;
+                m_hasHorizon = true;
+            }
+            m_openSets.erase( it);
+        }
+
+        const size_t m_cameraCount;
+        IFrameSetHandler& m_handler;
+        const EFrameSetMatching m_matching;
+        const uint64_t m_toleranceNs;
+        const size_t m_windowSize;
+        const uint64_t m_maxWaitNs;
+        const EIncompleteSetPolicy m_policy;
+
+        mutable std::mutex m_mutex;
+        SetMap m_openSets;                  // Ordered by key, i.e. by trigger.
+        bool m_hasHorizon;
+        uint64_t m_horizon;
+        uint64_t m_frames;
+        uint64_t m_lateFrames;
+        uint64_t m_duplicateFrames;
+        uint64_t m_completeSets;
+        uint64_t m_incompleteSetsEmitted;
+        uint64_t m_incompleteSetsDropped;
+        uint64_t m_skewViolations;
+        CLatencyHistogram m_assemblyLatency;
+        CLatencyHistogram m_skew;
+    };
+}
+
+#endif /* INCLUDED_FRAMESYNCHRONIZER_H_4470219 */
@@ -0,0 +1,365 @@
+// Contains a bounded frame queue that is drained by a pool of writer threads.
+//
+// The image event handler only enqueues the grab result and returns, so the pylon grab loop
+// thread is never blocked by file I/O. The queue holds CGrabResultPtr references; a buffer is
+// returned to the instant camera when its frame has been written. Keep the queue capacity below
+// the camera's MaxNumBuffer so the grab engine always has free buffers left.
+
+#ifndef INCLUDED_FRAMEWRITERPOOL_H_6051937
+#define INCLUDED_FRAMEWRITERPOOL_H_6051937
+
+#include <pylon/PylonIncludes.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
+#include <stdexcept>
+#include "LatencyHistogram.h"
+
+namespace Pylon
+{
+    // A frame waiting in the queue of a CFrameWriterPool.
+    struct SFrameWriteJob
+    {
+        CGrabResultPtr ptrGrabResult;
+        std::string name;
+        uint64_t enqueueTimeNs;
+        uint64_t grabTimeNs;        // Host wall-clock time (CLOCK_REALTIME) of Push().
+        uint64_t writeStartNs;      // When a writer took the frame off the queue.
+    };
+
+
+    // Is told the outcome of every frame passed to IFrameSink::WriteFrames.
+    class IFrameWriteHandler
+    {
+    public:
+        virtual ~IFrameWriteHandler() {}
+        // Called once per frame when it has been written or writing it has failed. Sinks that
+        // complete asynchronously call it from their completion thread.
+        virtual void OnFrameWritten( const SFrameWriteJob& job, bool succeeded) = 0;
+    };
+
+
+    // Destination for frames taken off the queue. WriteFrame and WriteFrames are called
+    // concurrently by all writer threads of a pool and must be thread-safe. WriteFrames reports
+    // every frame to the write handler exactly once, also the ones that could not be written,
+    // and does not throw.
+    class IFrameSink
+    {
+    public:
+        IFrameSink()
+            : m_pWriteHandler( NULL)
+        {
+        }
+
+        virtual ~IFrameSink() {}
+        virtual void WriteFrame( const CGrabResultPtr& ptrGrabResult, const std::string& name) = 0;
+        // Writes several frames at once; the pool always calls this. Sinks that can batch their
+        // I/O override this; by default the frames are written one by one with WriteJob().
+        virtual void WriteFrames( const SFrameWriteJob* pJobs, size_t count)
+        {
+            for ( size_t i = 0; i < count; ++i )
+            {
+                bool succeeded = false;
+                try
+                {
+                    WriteJob( pJobs[i]);
+                    succeeded = true;
+                }
+                catch (GenICam::GenericException &e)
+                {
+                    std::cerr << "Writing " << pJobs[i].name << " failed: " << e.GetDescription() << std::endl;
+                }
+                catch (std::exception &e)
+                {
+                    std::cerr << "Writing " << pJobs[i].name << " failed: " << e.what() << std::endl;
+                }
+                ReportFrameWritten( pJobs[i], succeeded);
+            }
+        }
+        // Called once after the last frame has been written.
+        virtual void Flush() {}
+
+        // CFrameWriterPool sets itself as handler for its statistics.
+        void SetWriteHandler( IFrameWriteHandler* pHandler)
+        {
+            m_pWriteHandler = pHandler;
+        }
+
+    protected:
+        // Writes one frame for the default WriteFrames(). Override to use more of the job than
+        // the grab result and the name.
+        virtual void WriteJob( const SFrameWriteJob& job)
+        {
+            WriteFrame( job.ptrGrabResult, job.name);
+        }
+
+        void ReportFrameWritten( const SFrameWriteJob& job, bool succeeded)
+        {
+            if ( m_pWriteHandler != NULL )
+            {
+                m_pWriteHandler->OnFrameWritten( job, succeeded);
+            }
+        }
+
+    private:
+        IFrameWriteHandler* m_pWriteHandler;
+    };
+
+
+    // Writes every frame to its own image file using CImagePersistence.
+    class CImagePersistenceSink : public IFrameSink
+    {
+    public:
+        explicit CImagePersistenceSink( EImageFileFormat format = ImageFileFormat_Tiff)
+            : m_format( format)
+        {
+        }
+
+        virtual void WriteFrame( const CGrabResultPtr& ptrGrabResult, const std::string& name)
+        {
+            CImagePersistence::Save( m_format, name.c_str(), ptrGrabResult);
+        }
+
+    private:
+        EImageFileFormat m_format;
+    };
+
+
+    // What Push() does when the queue is full.
+    enum EQueueFullPolicy
+    {
+        QueueFull_Drop,     // Release the frame immediately and count it as dropped.
+        QueueFull_Block     // Wait until a writer has taken a frame (backpressure on the grab loop).
+    };
+
+
+    // With maxBatch > 1, a writer takes up to maxBatch queued frames at once and passes them
+    // to IFrameSink::WriteFrames. Written and failed frames are counted as the sink reports them,
+    // so the write time of a sink that completes asynchronously lasts until the completion.
+    class CFrameWriterPool : private IFrameWriteHandler
+    {
+    public:
+        CFrameWriterPool( IFrameSink& sink, size_t numWriters, size_t queueCapacity, EQueueFullPolicy policy = QueueFull_Drop, size_t maxBatch = 1)
+            : m_sink( sink)
+            , m_jobs( queueCapacity > 0 ? queueCapacity : 1)
+            , m_policy( policy)
+            , m_maxBatch( maxBatch > 0 ? maxBatch : 1)
+            , m_head( 0)
+            , m_depth( 0)
+            , m_stopping( false)
+            , m_pushed( 0)
+            , m_written( 0)
+            , m_dropped( 0)
+            , m_blocked( 0)
+            , m_failed( 0)
+            , m_maxDepth( 0)
+        {
+            if ( numWriters == 0 )
+            {
+                throw std::invalid_argument( "CFrameWriterPool needs at least one writer thread.");
+            }
+            m_sink.SetWriteHandler( this);
+            try
+            {
+                for ( size_t i = 0; i < numWriters; ++i )
+                {
+                    m_writers.push_back( std::thread( &CFrameWriterPool::WriterLoop, this));
+                }
+            }
+            catch (...)
+            {
+                // The destructor is not called, so the threads already started must be joined here.
+                {
+                    std::lock_guard<std::mutex> lock( m_mutex);
+                    m_stopping = true;
+                }
+                m_notEmpty.notify_all();
+                for ( size_t i = 0; i < m_writers.size(); ++i )
+                {
+                    m_writers[i].join();
+                }
+                m_sink.SetWriteHandler( NULL);
+                throw;
+            }
+        }
+
+        ~CFrameWriterPool()
+        {
+            Stop();
+            m_sink.SetWriteHandler( NULL);
+        }
+
+        // Called from the grab thread. Returns false if the frame has been dropped.
+        bool Push( const CGrabResultPtr& ptrGrabResult, const std::string& name)
+        {
+            std::unique_lock<std::mutex> lock( m_mutex);
+            if ( m_stopping )
+            {
+                // The writers may already have drained the queue and returned.
+                ++m_dropped;
+                return false;
+            }
+            if ( m_depth == m_jobs.size() )
+            {
+                if ( m_policy == QueueFull_Drop )
+                {
+                    ++m_dropped;
+                    return false;
+                }
+                ++m_blocked;
+                m_notFull.wait( lock, [this] { return m_depth < m_jobs.size() || m_stopping; });
+                if ( m_stopping )
+                {
+                    ++m_dropped;
+                    return false;
+                }
+            }
+
+            SFrameWriteJob& job = m_jobs[ (m_head + m_depth) % m_jobs.size() ];
+            job.ptrGrabResult = ptrGrabResult;
+            job.name = name;
+            job.enqueueTimeNs = GetMonotonicTimeNs();
+            job.grabTimeNs = GetRealtimeNs();
+            ++m_depth;
+            ++m_pushed;
+            if ( m_depth > m_maxDepth )
+            {
+                m_maxDepth = m_depth;
+            }
+            lock.unlock();
+            m_notEmpty.notify_one();
+            return true;
+        }
+
+        // Writes all queued frames, then joins the writer threads and flushes the sink.
+        void Stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock( m_mutex);
+                if ( m_stopping )
+                {
+                    return;
+                }
+                m_stopping = true;
+            }
+            m_notEmpty.notify_all();
+            m_notFull.notify_all();
+            for ( size_t i = 0; i < m_writers.size(); ++i )
+            {
+                m_writers[i].join();
+            }
+            m_sink.Flush();
+        }
+
+        size_t GetQueueDepth() const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            return m_depth;
+        }
+
+        uint64_t GetDroppedCount() const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            return m_dropped;
+        }
+
+        void PrintStatistics( std::ostream& os) const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            os << "Writer pool: " << m_writers.size() << " threads, queue " << m_depth << "/" << m_jobs.size()
+               << " (max " << m_maxDepth << ")" << std::endl;
+            os << "Frames queued: " << m_pushed << " written: " << m_written << " failed: " << m_failed
+               << " dropped: " << m_dropped << " blocked pushes: " << m_blocked << std::endl;
+            m_queueLatency.Print( os, "Queue wait");
+            m_writeLatency.Print( os, "Write time");
+        }
+
+    private:
+        void WriterLoop()
+        {
+            std::vector<SFrameWriteJob> batch( m_maxBatch);
+            for (;;)
+            {
+                size_t count = 0;
+                {
+                    std::unique_lock<std::mutex> lock( m_mutex);
+                    m_notEmpty.wait( lock, [this] { return m_depth > 0 || m_stopping; });
+                    if ( m_depth == 0 )
+                    {
+                        return; // Stopping and the queue has been drained.
+                    }
+                    while ( m_depth > 0 && count < m_maxBatch )
+                    {
+                        SFrameWriteJob& front = m_jobs[ m_head ];
+                        SFrameWriteJob& job = batch[ count++ ];
+                        job.ptrGrabResult = front.ptrGrabResult;
+                        job.name.swap( front.name);
+                        job.enqueueTimeNs = front.enqueueTimeNs;
+                        job.grabTimeNs = front.grabTimeNs;
+                        front.ptrGrabResult.Release();
+                        m_head = (m_head + 1) % m_jobs.size();
+                        --m_depth;
+                    }
+                }
+                m_notFull.notify_all();
+
+                const uint64_t startNs = GetMonotonicTimeNs();
+                for ( size_t i = 0; i < count; ++i )
+                {
+                    batch[i].writeStartNs = startNs;
+                }
+                // The sink reports every frame through OnFrameWritten().
+                m_sink.WriteFrames( &batch[0], count);
+
+                // Hand the buffers back to the camera. Sinks completing later hold their own reference.
+                for ( size_t i = 0; i < count; ++i )
+                {
+                    batch[i].ptrGrabResult.Release();
+                }
+            }
+        }
+
+        virtual void OnFrameWritten( const SFrameWriteJob& job, bool succeeded)
+        {
+            const uint64_t endNs = GetMonotonicTimeNs();
+            std::lock_guard<std::mutex> lock( m_mutex);
+            m_queueLatency.Record( job.writeStartNs - job.enqueueTimeNs);
+            m_writeLatency.Record( endNs - job.writeStartNs);
+            if ( succeeded )
+            {
+                ++m_written;
+            }
+            else
+            {
+                ++m_failed;
+            }
+        }
+
+        IFrameSink& m_sink;
+        std::vector<SFrameWriteJob> m_jobs;
+        const EQueueFullPolicy m_policy;
+        const size_t m_maxBatch;
+        size_t m_head;
+        size_t m_depth;
+        bool m_stopping;
+        std::vector<std::thread> m_writers;
+        mutable std::mutex m_mutex;
+        std::condition_variable m_notEmpty;
+        std::condition_variable m_notFull;
+
+        // Statistics, protected by m_mutex.
+        uint64_t m_pushed;
+        uint64_t m_written;
+        uint64_t m_dropped;
+        uint64_t m_blocked;
+        uint64_t m_failed;
+        size_t m_maxDepth;
+        CLatencyHistogram m_queueLatency;
+        CLatencyHistogram m_writeLatency;
+    };
+}
+
+#endif /* INCLUDED_FRAMEWRITERPOOL_H_6051937 */
@@ -0,0 +1,376 @@
+// Contains a stage that fuses exposure brackets grabbed with the sequencer into HDR frames.
+//
+// Each sequence set of the bracket has its own exposure time. The frames are pushed with the
+// index of their sequence set, e.g. from ChunkSequencerSetActive. A bracket is complete when a
+// frame of every set has arrived; it is then fused into one frame and handed to the
+// IHdrFrameHandler. A frame whose set is already filled, or a set index lower than the previous
+// one, starts a new bracket and drops the incomplete one. The stage holds at most one bracket
+// of grab results.
+//
+// Fusion, per pixel, over the frames i of the bracket with pixel value v_i and exposure t_i:
+//   radiance = sum( w_i * v_i * tMax / t_i) / sum( w_i),  w_i = min( v_i, max - v_i)
+// so well-exposed values count most and dark or saturated values hardly at all. The frame with
+// the shortest exposure has a minimum weight of 1, so saturated pixels get its value. The result
+// is in gray values at the longest exposure time, as float, or scaled to the full 16 bit range
+// (the largest radiance, max * tMax / tMin, becomes 65535).
+//
+// The AVX2 kernel fuses 8 pixels per iteration in single precision with the same operations in
+// the same order as the scalar kernel, so both give the same results.
+
+#ifndef INCLUDED_HDRFUSION_H_5529017
+#define INCLUDED_HDRFUSION_H_5529017
+
+#include <pylon/PylonIncludes.h>
+#include <stdint.h>
+#include <immintrin.h>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <ostream>
+#include "LatencyHistogram.h"
+
+namespace Pylon
+{
+    enum EHdrOutput
+    {
+        HdrOutput_Float,    // One float per pixel.
+        HdrOutput_Mono16    // One uint16_t per pixel, scaled to the full range.
+    };
+
+
+    namespace HdrKernels
+    {
+        enum EKernel
+        {
+            Kernel_Auto,
+            Kernel_Scalar,
+            Kernel_Avx2
+        };
+
+        // The inputs of one frame of the bracket.
+        struct SHdrInput
+        {
+            const uint8_t* pPixels;     // Mono8, or Mono12 in 16 bit containers.
+            float ratio;                // tMax / t of the frame.
+            float minWeight;            // 1 for the shortest exposure, 0 otherwise.
+        };
+
+        template <typename T>
+        inline float LoadPixel( const uint8_t* pPixels, size_t i)
+        {
+            return (float) reinterpret_cast<const T*>( pPixels)[i];
+        }
+
+        // Fuses count pixels starting at pixel index first.
+        template <typename T>
+        inline void FuseScalar( const SHdrInput* pInputs, size_t inputCount, float maxValue, size_t first, size_t count, float* pOutput)
+        {
+            for ( size_t i = first; i < first + count; ++i )
+            {
+                float sum = 0.0f;
+                float weights = 0.0f;
+                for ( size_t k = 0; k < inputCount; ++k )
+                {
+                    const float value = LoadPixel<T>( pInputs[k].pPixels, i);
+                    const float weight = std::max( std::min( value, maxValue - value), pInputs[k].minWeight);
+                    sum += weight * (value * pInputs[k].ratio);
+                    weights += weight;
+                }
+                pOutput[ i - first ] = weights > 0.0f ? sum / weights : 0.0f;
+            }
+        }
+
+        __attribute__(( target( "avx2")))
+        inline __m256 LoadPixels8( const uint8_t* pPixels, size_t i)
+        {
+            return _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*) (pPixels + i))));
+        }
+
+        __attribute__(( target( "avx2")))
+        inline __m256 LoadPixels12( const uint8_t* pPixels, size_t i)
+        {
+            return _mm256_cvtepi32_ps( _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*) (pPixels + 2 * i))));
+        }
+
+        __attribute__(( target( "avx2")))
+        inline void FuseAvx2( const SHdrInput* pInputs, size_t inputCount, bool is8Bit, float maxValue, size_t first, size_t count, float* pOutput)
+        {
+            const __m256 maxValues = _mm256_set1_ps( maxValue);
+            const __m256 zero = _mm256_setzero_ps();
+            size_t i = first;
+            for ( ; i + 8 <= first + count; i += 8 )
+            {
+                __m256 sum = zero;
+                __m256 weights = zero;
+                for ( size_t k = 0; k < inputCount; ++k )
+                {
+                    const __m256 value = is8Bit ? LoadPixels8( pInputs[k].pPixels, i) : LoadPixels12( pInputs[k].pPixels, i);
+                    const __m256 weight = _mm256_max_ps( _mm256_min_ps( value, _mm256_sub_ps( maxValues, value)), _mm256_set1_ps( pInputs[k].minWeight));
+                    sum = _mm256_add_ps( sum, _mm256_mul_ps( weight, _mm256_mul_ps( value, _mm256_set1_ps( pInputs[k].ratio))));
+                    weights = _mm256_add_ps( weights, weight);
+                }
+                // Zero weights give 0 / 0; those pixels are set to 0 like in the scalar kernel.
+                const __m256 fused = _mm256_div_ps( sum, weights);
+                _mm256_storeu_ps( pOutput + (i - first), _mm256_and_ps( fused, _mm256_cmp_ps( weights, zero, _CMP_GT_OQ)));
+            }
+            if ( is8Bit )
+            {
+                FuseScalar<uint8_t>( pInputs, inputCount, maxValue, i, first + count - i, pOutput + (i - first));
+            }
+            else
+            {
+                FuseScalar<uint16_t>( pInputs, inputCount, maxValue, i, first + count - i, pOutput + (i - first));
+            }
+        }
+
+        inline EKernel GetBestKernel()
+        {
+            static const EKernel best = __builtin_cpu_supports( "avx2") ? Kernel_Avx2 : Kernel_Scalar;
+            return best;
+        }
+
+        inline const char* GetKernelName( EKernel kernel)
+        {
+            return (kernel == Kernel_Auto ? GetBestKernel() : kernel) == Kernel_Avx2 ? "AVX2" : "scalar";
+        }
+
+        inline void Fuse( const SHdrInput* pInputs, size_t inputCount, bool is8Bit, float maxValue, size_t first, size_t count, float* pOutput,
+            EKernel kernel = Kernel_Auto)
+        {
+            if ( (kernel == Kernel_Auto ? GetBestKernel() : kernel) == Kernel_Avx2 )
+            {
+                FuseAvx2( pInputs, inputCount, is8Bit, maxValue, first, count, pOutput);
+            }
+            else if ( is8Bit )
+            {
+                FuseScalar<uint8_t>( pInputs, inputCount, maxValue, first, count, pOutput);
+            }
+            else
+            {
+                FuseScalar<uint16_t>( pInputs, inputCount, maxValue, first, count, pOutput);
+            }
+        }
+    }
+
+
+    // A fused frame. The buffer belongs to the fuser and is valid during OnHdrFrame() only.
+    struct SHdrFrame
+    {
+        uint64_t bracketIndex;
+        uint32_t width;
+        uint32_t height;
+        EHdrOutput output;
+        const void* pBuffer;            // width * height floats or uint16_t, row by row.
+        uint64_t latencyNs;             // From the arrival of the first frame of the bracket.
+    };
+
+
+    // Receives the fused frames, called by the thread whose Push() completed the bracket.
+    class IHdrFrameHandler
+    {
+    public:
+        virtual ~IHdrFrameHandler() {}
+        virtual void OnHdrFrame( const SHdrFrame& frame) = 0;
+    };
+
+
+    class CHdrBracketFuser
+    {
+    public:
+        // exposureTimesUs holds the exposure time of each sequence set, indexed by set.
+        CHdrBracketFuser( const std::vector<double>& exposureTimesUs, IHdrFrameHandler& handler, EHdrOutput output = HdrOutput_Float,
+            HdrKernels::EKernel kernel = HdrKernels::Kernel_Auto)
+            : m_exposureTimesUs( exposureTimesUs)
+            , m_handler( handler)
+            , m_output( output)
+            , m_kernel( kernel)
+            , m_bracket( exposureTimesUs.size())
+            , m_frameCount( 0)
+            , m_lastSetIndex( 0)
+            , m_firstArrivalNs( 0)
+            , m_brackets( 0)
+            , m_droppedBrackets( 0)
+            , m_failedFrames( 0)
+            , m_firstFusedNs( 0)
+            , m_lastFusedNs( 0)
+        {
+            if ( exposureTimesUs.size() < 2 )
+            {
+                throw std::invalid_argument( "CHdrBracketFuser needs at least two exposure times.");
+            }
+            for ( size_t i = 0; i < exposureTimesUs.size(); ++i )
+            {
+                if ( exposureTimesUs[i] <= 0.0 )
+                {
+                    throw std::invalid_argument( "CHdrBracketFuser: the exposure times must be positive.");
+                }
+            }
+        }
+
+        // Adds a frame of the given sequence set. Frames of other pixel types than Mono8 and
+        // Mono12 and frames with a different size than the rest of the bracket are counted as
+        // failed.
+        void Push( const CGrabResultPtr& ptrGrabResult, size_t setIndex)
+        {
+            const EPixelType pixelType = ptrGrabResult->GetPixelType();
+            if ( setIndex >= m_bracket.size() || !ptrGrabResult->GrabSucceeded() || ptrGrabResult->GetPaddingX() != 0
+                || (pixelType != PixelType_Mono8 && pixelType != PixelType_Mono12) )
+            {
+                ++m_failedFrames;
+                return;
+            }
+            if ( m_frameCount != 0 && (m_bracket[ setIndex ].IsValid() || setIndex < m_lastSetIndex) )
+            {
+                ReleaseBracket();
+                ++m_droppedBrackets;
+            }
+            if ( m_frameCount == 0 )
+            {
+                m_firstArrivalNs = GetMonotonicTimeNs();
+            }
+            else
+            {
+                const CGrabResultPtr& first = FindFirstFrame();
+                if ( first->GetWidth() != ptrGrabResult->GetWidth() || first->GetHeight() != ptrGrabResult->GetHeight()
+                    || first->GetPixelType() != pixelType )
+                {
+                    ++m_failedFrames;
+                    return;
+                }
+            }
+
+            m_bracket[ setIndex ] = ptrGrabResult;
+            m_lastSetIndex = setIndex;
+            if ( ++m_frameCount == m_bracket.size() )
+            {
+                FuseBracket();
+                ReleaseBracket();
+            }
+        }
+
+        uint64_t GetFusedCount() const
+        {
+            return m_brackets;
+        }
+
+        void PrintStatistics( std::ostream& os) const
+        {
+            const double seconds = (m_lastFusedNs - m_firstFusedNs) / 1e9;
+            os << "HDR fusion (" << HdrKernels::GetKernelName( m_kernel) << "): " << m_brackets << " brackets of " << m_bracket.size()
+               << " frames fused, " << m_droppedBrackets << " incomplete brackets dropped, " << m_failedFrames << " frames failed";
+            if ( m_brackets > 1 && seconds > 0.0 )
+            {
+                os << ", " << (m_brackets - 1) / seconds << " fused frames/s";
+            }
+            os << std::endl;
+            m_fuseTime.Print( os, "Fusion time per bracket");
+            m_latency.Print( os, "Bracket latency (first frame to fused frame)");
+        }
+
+    private:
+        const CGrabResultPtr& FindFirstFrame() const
+        {
+            for ( size_t i = 0; i < m_bracket.size(); ++i )
+            {
+                if ( m_bracket[i].IsValid() )
+                {
+                    return m_bracket[i];
+                }
+            }
+            return m_bracket[0];
+        }
+
+        void ReleaseBracket()
+        {
+            for ( size_t i = 0; i < m_bracket.size(); ++i )
+            {
+                m_bracket[i].Release();
+            }
+            m_frameCount = 0;
+            m_lastSetIndex = 0;
+        }
+
+        void FuseBracket()
+        {
+            const uint64_t startNs = GetMonotonicTimeNs();
+            const CGrabResultPtr& first = m_bracket[0];
+            const uint32_t width = first->GetWidth();
+            const uint32_t height = first->GetHeight();
+            const bool is8Bit = first->GetPixelType() == PixelType_Mono8;
+            const float maxValue = is8Bit ? 255.0f : 4095.0f;
+
+            const double maxExposure = *std::max_element( m_exposureTimesUs.begin(), m_exposureTimesUs.end());
+            const double minExposure = *std::min_element( m_exposureTimesUs.begin(), m_exposureTimesUs.end());
+            const size_t shortest = std::min_element( m_exposureTimesUs.begin(), m_exposureTimesUs.end()) - m_exposureTimesUs.begin();
+            std::vector<HdrKernels::SHdrInput> inputs( m_bracket.size());
+            for ( size_t i = 0; i < inputs.size(); ++i )
+            {
+                inputs[i].pPixels = static_cast<const uint8_t*>( m_bracket[i]->GetBuffer());
+                inputs[i].ratio = (float) (maxExposure / m_exposureTimesUs[i]);
+                inputs[i].minWeight = i == shortest ? 1.0f : 0.0f;
+            }
+
+            // Float output is fused in place; 16 bit output goes through a line of floats.
+            const size_t pixelCount = (size_t) width * height;
+            m_floatBuffer.resize( m_output == HdrOutput_Float ? pixelCount : width);
+            m_mono16Buffer.resize( m_output == HdrOutput_Mono16 ? pixelCount : 0);
+            const float scale = (float) (65535.0 / (maxValue * maxExposure / minExposure));
+            for ( uint32_t y = 0; y < height; ++y )
+            {
+                const size_t first = (size_t) y * width;
+                if ( m_output == HdrOutput_Float )
+                {
+                    HdrKernels::Fuse( &inputs[0], inputs.size(), is8Bit, maxValue, first, width, &m_floatBuffer[ first ], m_kernel);
+                }
+                else
+                {
+                    HdrKernels::Fuse( &inputs[0], inputs.size(), is8Bit, maxValue, first, width, &m_floatBuffer[0], m_kernel);
+                    for ( uint32_t x = 0; x < width; ++x )
+                    {
+                        m_mono16Buffer[ first + x ] = (uint16_t) std::min( m_floatBuffer[x] * scale + 0.5f, 65535.0f);
+                    }
+                }
+            }
+
+            const uint64_t endNs = GetMonotonicTimeNs();
+            m_fuseTime.Record( endNs - startNs);
+            m_latency.Record( endNs - m_firstArrivalNs);
+            if ( m_brackets == 0 )
+            {
+                m_firstFusedNs = endNs;
+            }
+            m_lastFusedNs = endNs;
+
+            SHdrFrame frame;
+            frame.bracketIndex = m_brackets++;
+            frame.width = width;
+            frame.height = height;
+            frame.output = m_output;
+            frame.pBuffer = m_output == HdrOutput_Float ? (const void*) &m_floatBuffer[0] : (const void*) &m_mono16Buffer[0];
+            frame.latencyNs = endNs - m_firstArrivalNs;
+            m_handler.OnHdrFrame( frame);
+        }
+
+        const std::vector<double> m_exposureTimesUs;
+        IHdrFrameHandler& m_handler;
+        const EHdrOutput m_output;
+        const HdrKernels::EKernel m_kernel;
+
+        std::vector<CGrabResultPtr> m_bracket;      // Indexed by sequence set.
+        size_t m_frameCount;
+        size_t m_lastSetIndex;
+        uint64_t m_firstArrivalNs;
+        std::vector<float> m_floatBuffer;
+        std::vector<uint16_t> m_mono16Buffer;
+
+        uint64_t m_brackets;
+        uint64_t m_droppedBrackets;
+        uint64_t m_failedFrames;
+        uint64_t m_firstFusedNs;
+        uint64_t m_lastFusedNs;
+        CLatencyHistogram m_fuseTime;
+        CLatencyHistogram m_latency;
+    };
+}
+
+#endif /* INCLUDED_HDRFUSION_H_5529017 */
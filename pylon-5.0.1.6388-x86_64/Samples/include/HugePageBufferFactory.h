@@ -0,0 +1,277 @@
+// Contains a buffer factory that provides grab buffers from locked 2 MB huge pages.
+//
+// Grab buffers are carved out of large memory regions (arenas) that are
+// * backed by 2 MB huge pages: explicit huge pages (MAP_HUGETLB) if the system has some
+//   reserved (vm.nr_hugepages), otherwise transparent huge pages are requested with madvise,
+// * optionally bound to a NUMA node, normally the one of the threads processing the images,
+// * locked with mlock, so they are never paged out, and faulted in when the arena is created,
+//   not when the first frame is written into them.
+// Every buffer starts at a 4 KB boundary, which suits SIMD code and DMA.
+//
+// FreeBuffer() does not return memory to the system but keeps the buffer in a free list, and
+// AllocateBuffer() takes the smallest free buffer that is large enough. So stopping and
+// restarting the grab (e.g. CBurstSession) reuses the same memory without system calls or page
+// faults, and the addresses of the grab buffers stay the same. The memory is unmapped when
+// the factory is destroyed, so the factory must outlive the cameras using it.
+//
+// If the memory lock limit (ulimit -l, RLIMIT_MEMLOCK) is too low, locking fails; the memory
+// is then faulted in but not locked, and the failure is counted in the statistics.
+
+#ifndef INCLUDED_HUGEPAGEBUFFERFACTORY_H_7093156
+#define INCLUDED_HUGEPAGEBUFFERFACTORY_H_7093156
+
+#include <pylon/PylonIncludes.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <ostream>
+
+#ifndef MAP_HUGE_SHIFT
+#  define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#  define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+
+namespace Pylon
+{
+    class CHugePageBufferFactory : public IBufferFactory
+    {
+    public:
+        // Use for numaNode to not bind the memory to a node.
+        static const int c_numaNodeAny = -1;
+
+        // New arenas are at least minArenaSize bytes large, rounded up to 2 MB.
+        explicit CHugePageBufferFactory( int numaNode = c_numaNodeAny, bool lockMemory = true, size_t minArenaSize = 64 << 20)
+            : m_numaNode( numaNode)
+            , m_lockMemory( lockMemory)
+            , m_minArenaSize( RoundUp( minArenaSize, c_hugePageSize))
+            , m_pArenaFree( NULL)
+            , m_arenaRemaining( 0)
+            , m_mappedBytes( 0)
+            , m_hugeTlbBytes( 0)
+            , m_lockedBytes( 0)
+            , m_lockFailures( 0)
+            , m_bindFailures( 0)
+            , m_newBuffers( 0)
+            , m_reusedBuffers( 0)
+        {
+        }
+
+        virtual ~CHugePageBufferFactory()
+        {
+            for ( size_t i = 0; i < m_arenas.size(); ++i )
+            {
+                munmap( m_arenas[i].pBase, m_arenas[i].size);
+            }
+        }
+
+        // Returns the NUMA node of the CPU the calling thread runs on. To bind the memory to the
+        // node of the processing threads, call it from one of them after setting its affinity.
+        static int GetCurrentNumaNode()
+        {
+            unsigned int cpu = 0;
+            unsigned int node = 0;
+            if ( syscall( SYS_getcpu, &cpu, &node, NULL) != 0 )
+            {
+                return 0;
+            }
+            return (int) node;
+        }
+
+        // Reserves memory for count buffers of the given size, so that even the first
+        // StartGrabbing() does not map memory, e.g. count = MaxNumBuffer and size = PayloadSize.
+        void Reserve( size_t bufferSize, size_t count)
+        {
+            std::vector<void*> buffers( count);
+            std::vector<intptr_t> contexts( count);
+            for ( size_t i = 0; i < count; ++i )
+            {
+                AllocateBuffer( bufferSize, &buffers[i], contexts[i]);
+            }
+            for ( size_t i = 0; i < count; ++i )
+            {
+                FreeBuffer( buffers[i], contexts[i]);
+            }
+        }
+
+        // Called by the instant camera, possibly from different threads.
+        virtual void AllocateBuffer( size_t bufferSize, void** pCreatedBuffer, intptr_t& bufferContext)
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            std::multimap<size_t, intptr_t>::iterator it = m_freeBuffers.lower_bound( bufferSize);
+            if ( it != m_freeBuffers.end() )
+            {
+                bufferContext = it->second;
+                m_freeBuffers.erase( it);
+                ++m_reusedBuffers;
+            }
+            else
+            {
+                const size_t capacity = RoundUp( bufferSize == 0 ? 1 : bufferSize, c_bufferAlignment);
+                if ( capacity > m_arenaRemaining )
+                {
+                    // The rest of the current arena stays unused, it is small compared to the arena.
+                    MapArena( capacity);
+                }
+                SBuffer buffer = { m_pArenaFree, capacity };
+                m_pArenaFree += capacity;
+                m_arenaRemaining -= capacity;
+                bufferContext = (intptr_t) m_buffers.size();
+                m_buffers.push_back( buffer);
+                ++m_newBuffers;
+            }
+            *pCreatedBuffer = m_buffers[ bufferContext ].pData;
+        }
+
+        virtual void FreeBuffer( void* /*pCreatedBuffer*/, intptr_t bufferContext)
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            m_freeBuffers.insert( std::make_pair( m_buffers[ bufferContext ].capacity, bufferContext));
+        }
+
+        // The factory is owned by the application; use Cleanup_None when setting it.
+        virtual void DestroyBufferFactory()
+        {
+        }
+
+        void PrintStatistics( std::ostream& os) const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            os << "Buffer factory: " << m_arenas.size() << " arenas, " << (m_mappedBytes >> 20) << " MB mapped ("
+               << (m_hugeTlbBytes >> 20) << " MB explicit huge pages, " << (m_lockedBytes >> 20) << " MB locked), "
+               << m_buffers.size() << " buffers, " << m_newBuffers << " allocations carved, " << m_reusedBuffers << " reused";
+            if ( m_lockFailures != 0 || m_bindFailures != 0 )
+            {
+                os << ", " << m_lockFailures << " mlock and " << m_bindFailures << " mbind failures";
+            }
+            os << std::endl;
+        }
+
+    private:
+        static const size_t c_hugePageSize = 2 << 20;
+        static const size_t c_bufferAlignment = 4096;
+
+        struct SArena
+        {
+            void* pBase;
+            size_t size;
+        };
+
+        struct SBuffer
+        {
+            uint8_t* pData;
+            size_t capacity;
+        };
+
+        static size_t RoundUp( size_t value, size_t alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        // Maps, binds, locks and faults in a new arena. Called with m_mutex held.
+        void MapArena( size_t minimumSize)
+        {
+            const size_t size = std::max( m_minArenaSize, RoundUp( minimumSize, c_hugePageSize));
+            bool hugeTlb = true;
+            void* pBase = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+            if ( pBase == MAP_FAILED )
+            {
+                // No explicit huge pages reserved. Map a 2 MB aligned region and ask for
+                // transparent huge pages.
+                hugeTlb = false;
+                uint8_t* pRegion = (uint8_t*) mmap( NULL, size + c_hugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if ( pRegion == MAP_FAILED )
+                {
+                    throw RUNTIME_EXCEPTION( "Could not map %lu bytes for grab buffers: %s", (unsigned long) size, strerror( errno));
+                }
+                uint8_t* pAligned = (uint8_t*) RoundUp( (size_t) pRegion, c_hugePageSize);
+                if ( pAligned > pRegion )
+                {
+                    munmap( pRegion, pAligned - pRegion);
+                }
+                munmap( pAligned + size, pRegion + size + c_hugePageSize - pAligned - size);
+                pBase = pAligned;
+#ifdef MADV_HUGEPAGE
+                madvise( pBase, size, MADV_HUGEPAGE);
+#endif
+            }
+
+            // The policy must be set before the pages are faulted in.
+            if ( m_numaNode != c_numaNodeAny && !BindToNode( pBase, size) )
+            {
+                ++m_bindFailures;
+            }
+            if ( m_lockMemory && mlock( pBase, size) == 0 )
+            {
+                // mlock has faulted in all pages.
+                m_lockedBytes += size;
+            }
+            else
+            {
+                if ( m_lockMemory )
+                {
+                    ++m_lockFailures;
+                }
+                for ( size_t offset = 0; offset < size; offset += 4096 )
+                {
+                    ((volatile uint8_t*) pBase)[ offset ] = 0;
+                }
+            }
+
+            SArena arena = { pBase, size };
+            m_arenas.push_back( arena);
+            m_mappedBytes += size;
+            if ( hugeTlb )
+            {
+                m_hugeTlbBytes += size;
+            }
+            m_pArenaFree = (uint8_t*) pBase;
+            m_arenaRemaining = size;
+        }
+
+        // Binds the memory to m_numaNode with mbind, without needing libnuma.
+        bool BindToNode( void* pAddress, size_t size) const
+        {
+#ifdef SYS_mbind
+            const int c_mpolBind = 2;
+            const unsigned int c_mpolMfMove = 1 << 1;
+            const size_t bitsPerWord = 8 * sizeof( unsigned long);
+            std::vector<unsigned long> nodeMask( m_numaNode / bitsPerWord + 1, 0);
+            nodeMask[ m_numaNode / bitsPerWord ] = 1UL << (m_numaNode % bitsPerWord);
+            return syscall( SYS_mbind, pAddress, size, c_mpolBind, &nodeMask[0], nodeMask.size() * bitsPerWord + 1, c_mpolMfMove) == 0;
+#else
+            (void) pAddress;
+            (void) size;
+            return false;
+#endif
+        }
+
+        const int m_numaNode;
+        const bool m_lockMemory;
+        const size_t m_minArenaSize;
+
+        mutable std::mutex m_mutex;
+        std::vector<SArena> m_arenas;
+        uint8_t* m_pArenaFree;
+        size_t m_arenaRemaining;
+        std::vector<SBuffer> m_buffers;                 // Indexed by the buffer context.
+        std::multimap<size_t, intptr_t> m_freeBuffers;  // Capacity -> buffer context.
+        size_t m_mappedBytes;
+        size_t m_hugeTlbBytes;
+        size_t m_lockedBytes;
+        uint64_t m_lockFailures;
+        uint64_t m_bindFailures;
+        uint64_t m_newBuffers;
+        uint64_t m_reusedBuffers;
+    };
+}
+
+#endif /* INCLUDED_HUGEPAGEBUFFERFACTORY_H_7093156 */
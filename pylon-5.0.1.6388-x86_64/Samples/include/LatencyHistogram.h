@@ -0,0 +1,212 @@
+// Contains a fixed-size log-linear histogram for recording latencies in nanoseconds
+// and a helper for reading the host monotonic clock.
+
+#ifndef INCLUDED_LATENCYHISTOGRAM_H_5310482
+#define INCLUDED_LATENCYHISTOGRAM_H_5310482
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <ostream>
+#include <iomanip>
+
+namespace Pylon
+{
+    // Returns the host monotonic clock in nanoseconds.
+    inline uint64_t GetMonotonicTimeNs()
+    {
+        struct timespec ts;
+        clock_gettime( CLOCK_MONOTONIC, &ts);
+        return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+    }
+
+
+    // Returns the host wall-clock time (CLOCK_REALTIME) in nanoseconds.
+    inline uint64_t GetRealtimeNs()
+    {
+        struct timespec ts;
+        clock_gettime( CLOCK_REALTIME, &ts);
+        return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+    }
+
+
+    // Records values (usually latencies in ns) into buckets whose width grows with the value.
+    // Every power of two is split into 16 linear sub-buckets, so any reported percentile is
+    // within about 6% of the true value. Recording is a few instructions and never allocates.
+    // The class is not thread-safe; use one instance per thread or protect it externally.
+    class CLatencyHistogram
+    {
+    public:
+        enum
+        {
+            c_subBucketBits = 4,
+            c_subBucketCount = 1 << c_subBucketBits,
+            c_bucketCount = (64 - c_subBucketBits + 1) * c_subBucketCount
+        };
+
+        CLatencyHistogram()
+        {
+            Reset();
+        }
+
+        void Reset()
+        {
+            memset( m_counts, 0, sizeof( m_counts));
+            m_count = 0;
+            m_sum = 0;
+            m_sumSquares = 0.0;
+            m_min = ~0ULL;
+            m_max = 0;
+        }
+
+        void Record( uint64_t value)
+        {
+            ++m_counts[ BucketIndex( value) ];
+            ++m_count;
+            m_sum += value;
+            m_sumSquares += (double) value * (double) value;
+            if ( value < m_min )
+            {
+                m_min = value;
+            }
+            if ( value > m_max )
+            {
+                m_max = value;
+            }
+        }
+
+        void Merge( const CLatencyHistogram& other)
+        {
+            for ( int i = 0; i < c_bucketCount; ++i )
+            {
+                m_counts[i] += other.m_counts[i];
+            }
+            m_count += other.m_count;
+            m_sum += other.m_sum;
+            m_sumSquares += other.m_sumSquares;
+            if ( other.m_min < m_min )
+            {
+                m_min = other.m_min;
+            }
+            if ( other.m_max > m_max )
+            {
+                m_max = other.m_max;
+            }
+        }
+
+        uint64_t GetCount() const { return m_count; }
+        uint64_t GetMin() const { return m_count ? m_min : 0; }
+        uint64_t GetMax() const { return m_max; }
+        double GetMean() const { return m_count ? (double) m_sum / (double) m_count : 0.0; }
+
+        // The standard deviation, i.e. the jitter of a latency.
+        double GetStandardDeviation() const
+        {
+            if ( m_count == 0 )
+            {
+                return 0.0;
+            }
+            const double mean = GetMean();
+            const double variance = m_sumSquares / (double) m_count - mean * mean;
+            return variance > 0.0 ? sqrt( variance) : 0.0;
+        }
+
+        // Returns the upper bound of the bucket holding the given percentile (0..100).
+        uint64_t GetPercentile( double percentile) const
+        {
+            if ( m_count == 0 )
+            {
+                return 0;
+            }
+            uint64_t rank = (uint64_t) (percentile / 100.0 * (double) m_count + 0.5);
+            if ( rank < 1 )
+            {
+                rank = 1;
+            }
+            uint64_t seen = 0;
+            for ( int i = 0; i < c_bucketCount; ++i )
+            {
+                seen += m_counts[i];
+                if ( seen >= rank )
+                {
+                    uint64_t upper = BucketUpperBound( i);
+                    return upper < m_max ? upper : m_max;
+                }
+            }
+            return m_max;
+        }
+
+        // Prints count, mean and the usual percentiles, scaling ns values to the given unit.
+        void Print( std::ostream& os, const char* name, double divisor = 1000.0, const char* unit = "us") const
+        {
+            std::ios::fmtflags flags = os.flags();
+            std::streamsize precision = os.precision();
+            os << std::fixed << std::setprecision( 1)
+               << name << ": n=" << m_count
+               << " min=" << GetMin() / divisor
+               << " mean=" << GetMean() / divisor
+               << " p50=" << GetPercentile( 50.0) / divisor
+               << " p90=" << GetPercentile( 90.0) / divisor
+               << " p99=" << GetPercentile( 99.0) / divisor
+               << " p99.9=" << GetPercentile( 99.9) / divisor
+               << " max=" << GetMax() / divisor
+               << " " << unit << std::endl;
+            os.flags( flags);
+            os.precision( precision);
+        }
+
+        // Prints the same values as Print() and the standard deviation as JSON object.
+        void PrintJson( std::ostream& os, double divisor = 1000.0) const
+        {
+            std::ios::fmtflags flags = os.flags();
+            std::streamsize precision = os.precision();
+            os << std::fixed << std::setprecision( 3)
+               << "{ \"count\": " << m_count
+               << ", \"min\": " << GetMin() / divisor
+               << ", \"mean\": " << GetMean() / divisor
+               << ", \"stddev\": " << GetStandardDeviation() / divisor
+               << ", \"p50\": " << GetPercentile( 50.0) / divisor
+               << ", \"p90\": " << GetPercentile( 90.0) / divisor
+               << ", \"p99\": " << GetPercentile( 99.0) / divisor
+               << ", \"p99.9\": " << GetPercentile( 99.9) / divisor
+               << ", \"max\": " << GetMax() / divisor
+               << " }";
+            os.flags( flags);
+            os.precision( precision);
+        }
+
+    private:
+        static int BucketIndex( uint64_t value)
+        {
+            if ( value < (uint64_t) c_subBucketCount )
+            {
+                return (int) value;
+            }
+            int exponent = 63 - __builtin_clzll( value);
+            int subBucket = (int) (value >> (exponent - c_subBucketBits)) & (c_subBucketCount - 1);
+            return (exponent - c_subBucketBits + 1) * c_subBucketCount + subBucket;
+        }
+
+        static uint64_t BucketUpperBound( int index)
+        {
+            if ( index < c_subBucketCount )
+            {
+                return (uint64_t) index;
+            }
+            int exponent = index / c_subBucketCount + c_subBucketBits - 1;
+            uint64_t subBucket = (uint64_t) (index % c_subBucketCount);
+            uint64_t lower = (c_subBucketCount + subBucket) << (exponent - c_subBucketBits);
+            return lower + (1ULL << (exponent - c_subBucketBits)) - 1;
+        }
+
+        uint64_t m_counts[ c_bucketCount ];
+        uint64_t m_count;
+        uint64_t m_sum;
+        double m_sumSquares;
+        uint64_t m_min;
+        uint64_t m_max;
+    };
+}
+
+#endif /* INCLUDED_LATENCYHISTOGRAM_H_5310482 */
@@ -0,0 +1,305 @@
+// Contains kernels for converting between Mono12 (12 bit in 16 bit containers) and Mono12p.
+//
+// Mono12p is the GenICam PFNC packed layout: two pixels occupy three bytes, packed LSB first.
+//   byte 0 = p0 bits 0..7
+//   byte 1 = p0 bits 8..11 | p1 bits 0..3 << 4
+//   byte 2 = p1 bits 4..11
+// An odd last pixel occupies two bytes. This is not the same as Basler's Mono12packed layout.
+//
+// Unpacking can shift the pixels left, e.g. by 4 for MSB aligned Mono16 like the output of
+// CImageFormatConverter, or keep the 8 most significant bits for Mono8.
+//
+// The kernels use AVX2 or SSSE3 when the CPU supports them and fall back to a scalar loop
+// otherwise. They never read or write outside the given pixel ranges.
+
+#ifndef INCLUDED_MONO12PACKING_H_1784205
+#define INCLUDED_MONO12PACKING_H_1784205
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <immintrin.h>
+
+namespace Mono12Packing
+{
+    enum EKernel
+    {
+        Kernel_Auto,
+        Kernel_Scalar,
+        Kernel_Ssse3,
+        Kernel_Avx2
+    };
+
+    // Returns the number of bytes needed for pixelCount Mono12p pixels.
+    inline size_t GetPackedSize( size_t pixelCount)
+    {
+        return (pixelCount * 12 + 7) / 8;
+    }
+
+
+    inline void PackScalar( const uint16_t* pSource, uint8_t* pDestination, size_t pixelCount)
+    {
+        size_t i = 0;
+        for ( ; i + 1 < pixelCount; i += 2, pDestination += 3 )
+        {
+            uint32_t p0 = pSource[i] & 0xFFF;
+            uint32_t p1 = pSource[i + 1] & 0xFFF;
+            pDestination[0] = (uint8_t) p0;
+            pDestination[1] = (uint8_t) ((p0 >> 8) | (p1 << 4));
+            pDestination[2] = (uint8_t) (p1 >> 4);
+        }
+        if ( i < pixelCount )
+        {
+            uint32_t p0 = pSource[i] & 0xFFF;
+            pDestination[0] = (uint8_t) p0;
+            pDestination[1] = (uint8_t) (p0 >> 8);
+        }
+    }
+
+
+    inline void UnpackScalar( const uint8_t* pSource, uint16_t* pDestination, size_t pixelCount, int leftShift = 0)
+    {
+        size_t i = 0;
+        for ( ; i + 1 < pixelCount; i += 2, pSource += 3 )
+        {
+            pDestination[i] = (uint16_t) ((pSource[0] | ((pSource[1] & 0x0F) << 8)) << leftShift);
+            pDestination[i + 1] = (uint16_t) (((pSource[1] >> 4) | (pSource[2] << 4)) << leftShift);
+        }
+        if ( i < pixelCount )
+        {
+            pDestination[i] = (uint16_t) ((pSource[0] | ((pSource[1] & 0x0F) << 8)) << leftShift);
+        }
+    }
+
+
+    // Keeps the 8 most significant bits of every pixel.
+    inline void UnpackToMono8Scalar( const uint8_t* pSource, uint8_t* pDestination, size_t pixelCount)
+    {
+        size_t i = 0;
+        for ( ; i + 1 < pixelCount; i += 2, pSource += 3 )
+        {
+            pDestination[i] = (uint8_t) ((pSource[0] >> 4) | (pSource[1] << 4));
+            pDestination[i + 1] = pSource[2];
+        }
+        if ( i < pixelCount )
+        {
+            pDestination[i] = (uint8_t) ((pSource[0] >> 4) | (pSource[1] << 4));
+        }
+    }
+
+
+    // Packs 8 pixels per iteration: each 32-bit lane holding two pixels becomes 24 bits,
+    // then the three low bytes of each lane are gathered with a byte shuffle.
+    __attribute__(( target( "ssse3")))
+    inline void PackSsse3( const uint16_t* pSource, uint8_t* pDestination, size_t pixelCount)
+    {
+        const __m128i lowMask = _mm_set1_epi32( 0x00000FFF);
+        const __m128i highMask = _mm_set1_epi32( 0x00FFF000);
+        const __m128i gather = _mm_setr_epi8( 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        size_t i = 0;
+        for ( ; i + 8 <= pixelCount; i += 8, pDestination += 12 )
+        {
+            __m128i pixels = _mm_loadu_si128( (const __m128i*) (pSource + i));
+            __m128i packed = _mm_or_si128( _mm_and_si128( pixels, lowMask), _mm_and_si128( _mm_srli_epi32( pixels, 4), highMask));
+            packed = _mm_shuffle_epi8( packed, gather);
+            _mm_storel_epi64( (__m128i*) pDestination, packed);
+            uint32_t last = (uint32_t) _mm_cvtsi128_si32( _mm_srli_si128( packed, 8));
+            memcpy( pDestination + 8, &last, 4);
+        }
+        PackScalar( pSource + i, pDestination, pixelCount - i);
+    }
+
+
+    // Unpacks the 8 pixels of 12 bytes.
+    __attribute__(( target( "ssse3")))
+    inline __m128i UnpackSsse3Step( const uint8_t* pSource)
+    {
+        const __m128i spread = _mm_setr_epi8( 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i lowMask = _mm_set1_epi32( 0x00000FFF);
+        const __m128i highMask = _mm_set1_epi32( 0x0FFF0000);
+        uint32_t last;
+        memcpy( &last, pSource + 8, 4);
+        __m128i packed = _mm_unpacklo_epi64( _mm_loadl_epi64( (const __m128i*) pSource), _mm_cvtsi32_si128( (int) last));
+        packed = _mm_shuffle_epi8( packed, spread);
+        return _mm_or_si128( _mm_and_si128( packed, lowMask), _mm_and_si128( _mm_slli_epi32( packed, 4), highMask));
+    }
+
+
+    __attribute__(( target( "ssse3")))
+    inline void UnpackSsse3( const uint8_t* pSource, uint16_t* pDestination, size_t pixelCount, int leftShift = 0)
+    {
+        const __m128i shift = _mm_cvtsi32_si128( leftShift);
+        size_t i = 0;
+        for ( ; i + 8 <= pixelCount; i += 8, pSource += 12 )
+        {
+            _mm_storeu_si128( (__m128i*) (pDestination + i), _mm_sll_epi16( UnpackSsse3Step( pSource), shift));
+        }
+        UnpackScalar( pSource, pDestination + i, pixelCount - i, leftShift);
+    }
+
+
+    __attribute__(( target( "ssse3")))
+    inline void UnpackToMono8Ssse3( const uint8_t* pSource, uint8_t* pDestination, size_t pixelCount)
+    {
+        size_t i = 0;
+        for ( ; i + 16 <= pixelCount; i += 16, pSource += 24 )
+        {
+            const __m128i low = _mm_srli_epi16( UnpackSsse3Step( pSource), 4);
+            const __m128i high = _mm_srli_epi16( UnpackSsse3Step( pSource + 12), 4);
+            _mm_storeu_si128( (__m128i*) (pDestination + i), _mm_packus_epi16( low, high));
+        }
+        UnpackToMono8Scalar( pSource, pDestination + i, pixelCount - i);
+    }
+
+
+    // Packs 16 pixels per iteration. After the in-lane shuffle, a cross-lane permutation moves
+    // the 24 output bytes together so they can be stored without writing past the end.
+    __attribute__(( target( "avx2")))
+    inline void PackAvx2( const uint16_t* pSource, uint8_t* pDestination, size_t pixelCount)
+    {
+        const __m256i lowMask = _mm256_set1_epi32( 0x00000FFF);
+        const __m256i highMask = _mm256_set1_epi32( 0x00FFF000);
+        const __m256i gather = _mm256_setr_epi8(
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        const __m256i compact = _mm256_setr_epi32( 0, 1, 2, 4, 5, 6, 3, 7);
+        size_t i = 0;
+        for ( ; i + 16 <= pixelCount; i += 16, pDestination += 24 )
+        {
+            __m256i pixels = _mm256_loadu_si256( (const __m256i*) (pSource + i));
+            __m256i packed = _mm256_or_si256( _mm256_and_si256( pixels, lowMask), _mm256_and_si256( _mm256_srli_epi32( pixels, 4), highMask));
+            packed = _mm256_permutevar8x32_epi32( _mm256_shuffle_epi8( packed, gather), compact);
+            _mm_storeu_si128( (__m128i*) pDestination, _mm256_castsi256_si128( packed));
+            _mm_storel_epi64( (__m128i*) (pDestination + 16), _mm256_extracti128_si256( packed, 1));
+        }
+        PackSsse3( pSource + i, pDestination, pixelCount - i);
+    }
+
+
+    // Unpacks the 16 pixels of 24 bytes. The input bytes are split into two lanes of 12 bytes each.
+    __attribute__(( target( "avx2")))
+    inline __m256i UnpackAvx2Step( const uint8_t* pSource)
+    {
+        const __m256i spread = _mm256_setr_epi8(
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m256i lowMask = _mm256_set1_epi32( 0x00000FFF);
+        const __m256i highMask = _mm256_set1_epi32( 0x0FFF0000);
+        __m128i low = _mm_loadu_si128( (const __m128i*) pSource);
+        __m128i high = _mm_loadl_epi64( (const __m128i*) (pSource + 16));
+        __m256i packed = _mm256_inserti128_si256( _mm256_castsi128_si256( low), _mm_alignr_epi8( high, low, 12), 1);
+        packed = _mm256_shuffle_epi8( packed, spread);
+        return _mm256_or_si256( _mm256_and_si256( packed, lowMask), _mm256_and_si256( _mm256_slli_epi32( packed, 4), highMask));
+    }
+
+
+    // Unpacks 16 pixels per iteration.
+    __attribute__(( target( "avx2")))
+    inline void UnpackAvx2( const uint8_t* pSource, uint16_t* pDestination, size_t pixelCount, int leftShift = 0)
+    {
+        const __m128i shift = _mm_cvtsi32_si128( leftShift);
+        size_t i = 0;
+        for ( ; i + 16 <= pixelCount; i += 16, pSource += 24 )
+        {
+            _mm256_storeu_si256( (__m256i*) (pDestination + i), _mm256_sll_epi16( UnpackAvx2Step( pSource), shift));
+        }
+        UnpackSsse3( pSource, pDestination + i, pixelCount - i, leftShift);
+    }
+
+
+    // Unpacks 32 pixels per iteration. The byte pack works per lane, the permutation puts the
+    // pixels back in order.
+    __attribute__(( target( "avx2")))
+    inline void UnpackToMono8Avx2( const uint8_t* pSource, uint8_t* pDestination, size_t pixelCount)
+    {
+        size_t i = 0;
+        for ( ; i + 32 <= pixelCount; i += 32, pSource += 48 )
+        {
+            const __m256i low = _mm256_srli_epi16( UnpackAvx2Step( pSource), 4);
+            const __m256i high = _mm256_srli_epi16( UnpackAvx2Step( pSource + 24), 4);
+            _mm256_storeu_si256( (__m256i*) (pDestination + i), _mm256_permute4x64_epi64( _mm256_packus_epi16( low, high), 0xD8));
+        }
+        UnpackToMono8Ssse3( pSource, pDestination + i, pixelCount - i);
+    }
+
+
+    // Returns the best kernel supported by the CPU.
+    inline EKernel GetBestKernel()
+    {
+        static const EKernel best = __builtin_cpu_supports( "avx2") ? Kernel_Avx2
+            : (__builtin_cpu_supports( "ssse3") ? Kernel_Ssse3 : Kernel_Scalar);
+        return best;
+    }
+
+
+    inline const char* GetKernelName( EKernel kernel)
+    {
+        switch ( kernel == Kernel_Auto ? GetBestKernel() : kernel )
+        {
+        case Kernel_Avx2:
+            return "AVX2";
+        case Kernel_Ssse3:
+            return "SSSE3";
+        default:
+            return "scalar";
+        }
+    }
+
+
+    // Packs Mono12 pixels into Mono12p. pDestination must hold GetPackedSize( pixelCount) bytes.
+    inline void Pack( const uint16_t* pSource, uint8_t* pDestination, size_t pixelCount, EKernel kernel = Kernel_Auto)
+    {
+        switch ( kernel == Kernel_Auto ? GetBestKernel() : kernel )
+        {
+        case Kernel_Avx2:
+            PackAvx2( pSource, pDestination, pixelCount);
+            break;
+        case Kernel_Ssse3:
+            PackSsse3( pSource, pDestination, pixelCount);
+            break;
+        default:
+            PackScalar( pSource, pDestination, pixelCount);
+            break;
+        }
+    }
+
+
+    // Unpacks Mono12p pixels into Mono12, shifted left by leftShift (0 to 4) bits. pSource must
+    // hold GetPackedSize( pixelCount) bytes.
+    inline void Unpack( const uint8_t* pSource, uint16_t* pDestination, size_t pixelCount, EKernel kernel = Kernel_Auto, int leftShift = 0)
+    {
+        switch ( kernel == Kernel_Auto ? GetBestKernel() : kernel )
+        {
+        case Kernel_Avx2:
+            UnpackAvx2( pSource, pDestination, pixelCount, leftShift);
+            break;
+        case Kernel_Ssse3:
+            UnpackSsse3( pSource, pDestination, pixelCount, leftShift);
+            break;
+        default:
+            UnpackScalar( pSource, pDestination, pixelCount, leftShift);
+            break;
+        }
+    }
+
+
+    // Unpacks Mono12p pixels into Mono8, keeping the 8 most significant bits. pSource must hold
+    // GetPackedSize( pixelCount) bytes.
+    inline void UnpackToMono8( const uint8_t* pSource, uint8_t* pDestination, size_t pixelCount, EKernel kernel = Kernel_Auto)
+    {
+        switch ( kernel == Kernel_Auto ? GetBestKernel() : kernel )
+        {
+        case Kernel_Avx2:
+            UnpackToMono8Avx2( pSource, pDestination, pixelCount);
+            break;
+        case Kernel_Ssse3:
+            UnpackToMono8Ssse3( pSource, pDestination, pixelCount);
+            break;
+        default:
+            UnpackToMono8Scalar( pSource, pDestination, pixelCount);
+            break;
+        }
+    }
+}
+
+#endif /* INCLUDED_MONO12PACKING_H_1784205 */
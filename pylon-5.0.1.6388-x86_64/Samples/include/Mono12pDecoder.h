@@ -0,0 +1,124 @@
+// Contains a decoder from Mono12p frames to the 16 bit or 8 bit frames the processing expects.
+//
+// With PixelFormat_Mono12p the camera transfers 25% less data than with Mono12, which raises the
+// frame rate USB can carry. CMono12pDecoder unpacks such a frame with the kernels of
+// Mono12Packing.h into
+// * PixelType_Mono12: 12 bit values in 16 bit containers, as grabbed with PixelFormat_Mono12,
+// * PixelType_Mono16: MSB aligned, as CImageFormatConverter outputs Mono16 by default,
+// * PixelType_Mono8: the 8 most significant bits, as CImageFormatConverter outputs Mono8.
+// It can run inline in the image event handler or on a worker thread; use one decoder per thread.
+//
+// Frames without padding are one continuous bit stream and are unpacked in one piece. With
+// padding, every line starts on a byte boundary and is unpacked on its own.
+
+#ifndef INCLUDED_MONO12PDECODER_H_4420713
+#define INCLUDED_MONO12PDECODER_H_4420713
+
+#include <pylon/PylonIncludes.h>
+#include <ostream>
+#include "Mono12Packing.h"
+#include "LatencyHistogram.h"
+
+namespace Pylon
+{
+    class CMono12pDecoder
+    {
+    public:
+        explicit CMono12pDecoder( EPixelType outputPixelType = PixelType_Mono12, Mono12Packing::EKernel kernel = Mono12Packing::Kernel_Auto)
+            : m_outputPixelType( outputPixelType)
+            , m_kernel( kernel)
+            , m_frames( 0)
+        {
+            if ( outputPixelType != PixelType_Mono12 && outputPixelType != PixelType_Mono16 && outputPixelType != PixelType_Mono8 )
+            {
+                throw RUNTIME_EXCEPTION( "CMono12pDecoder: the output pixel type must be Mono12, Mono16 or Mono8.");
+            }
+        }
+
+        EPixelType GetOutputPixelType() const
+        {
+            return m_outputPixelType;
+        }
+
+        // Decodes a Mono12p image or grab result. The destination image is only reset when its
+        // format or size changes.
+        void Decode( CPylonImage& destination, const IImage& source)
+        {
+            if ( source.GetPixelType() != PixelType_Mono12p )
+            {
+                throw RUNTIME_EXCEPTION( "CMono12pDecoder: the source image is not Mono12p.");
+            }
+            if ( destination.GetPixelType() != m_outputPixelType || destination.GetWidth() != source.GetWidth()
+                || destination.GetHeight() != source.GetHeight() || destination.GetPaddingX() != 0 || !destination.IsUnique() )
+            {
+                destination.Reset( m_outputPixelType, source.GetWidth(), source.GetHeight());
+            }
+            Decode( destination.GetBuffer(), destination.GetAllocatedBufferSize(), source.GetBuffer(), source.GetImageSize(),
+                source.GetWidth(), source.GetHeight(), source.GetPaddingX());
+        }
+
+        // Decodes a Mono12p buffer into an unpadded destination buffer.
+        void Decode( void* pDestination, size_t destinationSize, const void* pSource, size_t sourceSize, uint32_t width, uint32_t height,
+            size_t paddingX)
+        {
+            const uint64_t startNs = GetMonotonicTimeNs();
+            const size_t bytesPerPixel = m_outputPixelType == PixelType_Mono8 ? 1 : 2;
+            const size_t sourceStride = Mono12Packing::GetPackedSize( width) + paddingX;
+            const size_t requiredSourceSize = paddingX == 0 ? Mono12Packing::GetPackedSize( (size_t) width * height) : sourceStride * height;
+            if ( destinationSize < (size_t) width * height * bytesPerPixel || sourceSize < requiredSourceSize )
+            {
+                throw RUNTIME_EXCEPTION( "CMono12pDecoder: the source or destination buffer is too small.");
+            }
+
+            const uint8_t* pPacked = static_cast<const uint8_t*>( pSource);
+            uint8_t* pPixels = static_cast<uint8_t*>( pDestination);
+            if ( paddingX == 0 )
+            {
+                DecodeRun( pPacked, pPixels, (size_t) width * height);
+            }
+            else
+            {
+                for ( uint32_t y = 0; y < height; ++y )
+                {
+                    DecodeRun( pPacked + y * sourceStride, pPixels + (size_t) y * width * bytesPerPixel, width);
+                }
+            }
+            ++m_frames;
+            m_decodeTime.Record( GetMonotonicTimeNs() - startNs);
+        }
+
+        uint64_t GetFrameCount() const
+        {
+            return m_frames;
+        }
+
+        void PrintStatistics( std::ostream& os) const
+        {
+            os << "Mono12p decoder (" << Mono12Packing::GetKernelName( m_kernel) << ", to "
+               << (m_outputPixelType == PixelType_Mono8 ? "Mono8" : (m_outputPixelType == PixelType_Mono16 ? "Mono16" : "Mono12")) << "): "
+               << m_frames << " frames" << std::endl;
+            m_decodeTime.Print( os, "Decode time per frame");
+        }
+
+    private:
+        void DecodeRun( const uint8_t* pPacked, uint8_t* pPixels, size_t pixelCount) const
+        {
+            if ( m_outputPixelType == PixelType_Mono8 )
+            {
+                Mono12Packing::UnpackToMono8( pPacked, pPixels, pixelCount, m_kernel);
+            }
+            else
+            {
+                Mono12Packing::Unpack( pPacked, reinterpret_cast<uint16_t*>( pPixels), pixelCount, m_kernel,
+                    m_outputPixelType == PixelType_Mono16 ? 4 : 0);
+            }
+        }
+
+        const EPixelType m_outputPixelType;
+        const Mono12Packing::EKernel m_kernel;
+        uint64_t m_frames;
+        CLatencyHistogram m_decodeTime;
+    };
+}
+
+#endif /* INCLUDED_MONO12PDECODER_H_4420713 */
@@ -0,0 +1,462 @@
+// Contains a grabber that runs a dedicated grab thread and a processing worker per camera.
+//
+// CInstantCameraArray::RetrieveResult() serves all cameras from one thread, so slow processing
+// of one camera's images holds up all other cameras. CMultiCameraGrabber instead starts two
+// threads per camera of the array:
+// * a grab thread that calls RetrieveResult() of its camera only and pushes the grab results
+//   into a lock-free single-producer single-consumer queue (CSpscQueue),
+// * a worker thread that takes the results off that queue and passes them to
+//   ICameraFrameProcessor::ProcessFrame().
+// The grab threads can be pinned to a set of cores, and so can the workers. If a worker falls
+// behind and its queue is full, the grab thread releases the new result at once and counts it
+// as dropped, so the buffer goes back to the camera and the other cameras are not affected.
+// Keep the queue capacity below MaxNumBuffer of the cameras. Frames lost before they reached
+// the grab thread (e.g. no free buffer) are counted from gaps in the block IDs.
+
+#ifndef INCLUDED_MULTICAMERAGRABBER_H_5526041
+#define INCLUDED_MULTICAMERAGRABBER_H_5526041
+
+#include <pylon/PylonIncludes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <ostream>
+#include <iomanip>
+#include "SpscQueue.h"
+#include "LatencyHistogram.h"
+
+namespace Pylon
+{
+    // Processes the frames of a CMultiCameraGrabber. ProcessFrame is called by the worker thread
+    // of the camera that grabbed the frame, so it is called concurrently for different cameras
+    // but never concurrently for the same camera.
+    class ICameraFrameProcessor
+    {
+    public:
+        virtual ~ICameraFrameProcessor() {}
+        virtual void ProcessFrame( size_t cameraIndex, const CGrabResultPtr& ptrGrabResult) = 0;
+    };
+
+
+    class CMultiCameraGrabber
+    {
+    public:
+        // Camera i gets its grab thread pinned to grabCores[i % grabCores.size()] and its worker
+        // pinned to workerCores[i % workerCores.size()]. Empty core lists leave the threads
+        // unpinned. The cameras must be open; the grabber must not outlive them.
+        CMultiCameraGrabber( CInstantCameraArray& cameras, ICameraFrameProcessor& processor, size_t queueCapacity,
+            const std::vector<int>& grabCores = std::vector<int>(), const std::vector<int>& workerCores = std::vector<int>())
+            : m_cameras( cameras)
+            , m_processor( processor)
+            , m_grabCores( grabCores)
+            , m_workerCores( workerCores)
+            , m_running( false)
+            , m_startNs( 0)
+            , m_stopNs( 0)
+        {
+            for ( size_t i = 0; i < cameras.GetSize(); ++i )
+            {
+                m_channels.push_back( std::unique_ptr<SChannel>( new SChannel( queueCapacity)));
+            }
+        }
+
+        ~CMultiCameraGrabber()
+        {
+            Stop();
+        }
+
+        // Starts grabbing on all cameras and starts the threads. If that fails for one camera,
+        // the cameras and threads already started are stopped before the exception is passed on.
+        void Start( EGrabStrategy strategy = GrabStrategy_OneByOne)
+        {
+            if ( m_running )
+            {
+                return;
+            }
+            for ( size_t i = 0; i < m_channels.size(); ++i )
+            {
+                m_channels[i]->Reset();
+            }
+            m_stopping.store( false);
+            m_workersStopping.store( false);
+            m_startNs = GetMonotonicTimeNs();
+            try
+            {
+                for ( size_t i = 0; i < m_channels.size(); ++i )
+                {
+                    m_cameras[ i ].StartGrabbing( strategy);
+                    m_channels[i]->grabThread = std::thread( &CMultiCameraGrabber::GrabLoop, this, i);
+                    m_channels[i]->workerThread = std::thread( &CMultiCameraGrabber::WorkerLoop, this, i);
+                }
+            }
+            catch (...)
+            {
+                m_stopping.store( true);
+                for ( size_t i = 0; i < m_channels.size(); ++i )
+                {
+                    if ( m_channels[i]->grabThread.joinable() )
+                    {
+                        m_channels[i]->grabThread.join();
+                    }
+                    m_cameras[ i ].StopGrabbing();
+                }
+                m_workersStopping.store( true);
+                for ( size_t i = 0; i < m_channels.size(); ++i )
+                {
+                    if ( m_channels[i]->workerThread.joinable() )
+                    {
+                        m_channels[i]->workerThread.join();
+                    }
+                }
+                throw;
+            }
+            m_running = true;
+        }
+
+        // Stops grabbing, processes the frames still queued and joins the threads.
+        void Stop()
+        {
+            if ( !m_running )
+            {
+                return;
+            }
+            m_stopping.store( true);
+            for ( size_t i = 0; i < m_channels.size(); ++i )
+            {
+                m_channels[i]->grabThread.join();
+            }
+            m_stopNs = GetMonotonicTimeNs();
+            m_workersStopping.store( true);
+            for ( size_t i = 0; i < m_channels.size(); ++i )
+            {
+                m_channels[i]->workerThread.join();
+            }
+            m_running = false;
+        }
+
+        // The frames processed by the workers of all cameras so far.
+        uint64_t GetProcessedCount() const
+        {
+            uint64_t processed = 0;
+            for ( size_t i = 0; i < m_channels.size(); ++i )
+            {
+                processed += m_channels[i]->processed.load( std::memory_order_relaxed);
+            }
+            return processed;
+        }
+
+        // Returns true if a grab thread has stopped or ProcessFrame has failed because of an exception.
+        bool HasErrors() const
+        {
+            for ( size_t i = 0; i < m_channels.size(); ++i )
+            {
+                std::lock_guard<std::mutex> lock( m_channels[i]->errorMutex);
+                if ( !m_channels[i]->error.empty() )
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Prints one row per camera and the total: the grab results retrieved, the frame rate
+        // processed by the worker, failed grabs, frames lost before retrieval, frames dropped
+        // because the queue was full, the queue depth seen by new frames and the p99 time frames
+        // waited in the queue. Call after Stop().
+        void PrintStatistics( std::ostream& os) const
+        {
+            const uint64_t endNs = m_running ? GetMonotonicTimeNs() : m_stopNs;
+            const double seconds = endNs > m_startNs ? (endNs - m_startNs) * 1e-9 : 0.0;
+            const std::ios_base::fmtflags flags = os.flags();
+            const std::streamsize precision = os.precision();
+            os << std::fixed << std::setprecision( 1);
+            os << std::setw( 7) << "Camera" << std::setw( 10) << "Grabbed" << std::setw( 10) << "Frames/s"
+               << std::setw( 8) << "Failed" << std::setw( 8) << "Lost" << std::setw( 9) << "Dropped"
+               << std::setw( 10) << "Queue avg" << std::setw( 10) << "Queue max" << std::setw( 12) << "Wait p99 us" << std::endl;
+
+            SChannelTotals total;
+            for ( size_t i = 0; i < m_channels.size(); ++i )
+            {
+                const SChannel& channel = *m_channels[i];
+                SChannelTotals row;
+                row.Add( channel);
+                PrintRow( os, std::to_string( (unsigned long long) i), row, seconds, channel.queueWait.GetPercentile( 99.0) / 1000.0);
+                total.Add( channel);
+            }
+            PrintRow( os, "total", total, seconds, -1.0);
+
+            for ( size_t i = 0; i < m_channels.size(); ++i )
+            {
+                std::lock_guard<std::mutex> lock( m_channels[i]->errorMutex);
+                if ( !m_channels[i]->error.empty() )
+                {
+                    os << "Camera " << i << " error: " << m_channels[i]->error << std::endl;
+                }
+                if ( m_channels[i]->pinFailures != 0 )
+                {
+                    os << "Camera " << i << ": " << m_channels[i]->pinFailures << " threads could not be pinned." << std::endl;
+                }
+            }
+            os.flags( flags);
+            os.precision( precision);
+        }
+
+    private:
+        // A grab result in the queue of a camera, with the time it was pushed.
+        struct SQueuedFrame
+        {
+            SQueuedFrame()
+                : pushTimeNs( 0)
+            {
+            }
+
+            CGrabResultPtr ptrGrabResult;
+            uint64_t pushTimeNs;
+        };
+
+        static SQueuedFrame MakeQueuedFrame( const CGrabResultPtr& ptrGrabResult)
+        {
+            SQueuedFrame frame;
+            frame.ptrGrabResult = ptrGrabResult;
+            frame.pushTimeNs = GetMonotonicTimeNs();
+            return frame;
+        }
+
+        // The state of one camera, shared by its grab thread and its worker.
+        struct SChannel
+        {
+            explicit SChannel( size_t queueCapacity)
+                : queue( queueCapacity)
+            {
+                Reset();
+            }
+
+            void Reset()
+            {
+                grabbed = 0;
+                failed = 0;
+                lost = 0;
+                dropped = 0;
+                depthSum = 0;
+                maxDepth = 0;
+                lastBlockId = 0;
+                hasBlockId = false;
+                pinFailures = 0;
+                processed.store( 0);
+                queueWait.Reset();
+                error.clear();
+            }
+
+            CSpscQueue<SQueuedFrame> queue;
+            std::thread grabThread;
+            std::thread workerThread;
+
+            // Written by the grab thread, read after it has been joined.
+            uint64_t grabbed;
+            uint64_t failed;
+            uint64_t lost;
+            uint64_t dropped;
+            uint64_t depthSum;      // Over the grab results that succeeded.
+            size_t maxDepth;
+            uint64_t lastBlockId;
+            bool hasBlockId;
+            std::atomic<unsigned int> pinFailures;
+
+            // Written by the worker.
+            std::atomic<uint64_t> processed;
+            CLatencyHistogram queueWait;
+
+            mutable std::mutex errorMutex;
+            std::string error;
+        };
+
+        struct SChannelTotals
+        {
+            SChannelTotals()
+                : grabbed( 0), failed( 0), lost( 0), dropped( 0), processed( 0), depthSum( 0), maxDepth( 0)
+            {
+            }
+
+            void Add( const SChannel& channel)
+            {
+                grabbed += channel.grabbed;
+                failed += channel.failed;
+                lost += channel.lost;
+                dropped += channel.dropped;
+                processed += channel.processed.load();
+                depthSum += channel.depthSum;
+                maxDepth = std::max( maxDepth, channel.maxDepth);
+            }
+
+            uint64_t grabbed;
+            uint64_t failed;
+            uint64_t lost;
+            uint64_t dropped;
+            uint64_t processed;
+            uint64_t depthSum;
+            size_t maxDepth;
+        };
+
+        static void PrintRow( std::ostream& os, const std::string& name, const SChannelTotals& row, double seconds, double waitP99Us)
+        {
+            os << std::setw( 7) << name << std::setw( 10) << row.grabbed
+               << std::setw( 10) << (seconds > 0.0 ? row.processed / seconds : 0.0)
+               << std::setw( 8) << row.failed << std::setw( 8) << row.lost << std::setw( 9) << row.dropped
+               << std::setw( 10) << (row.grabbed > row.failed ? (double) row.depthSum / (row.grabbed - row.failed) : 0.0)
+               << std::setw( 10) << row.maxDepth;
+            if ( waitP99Us >= 0.0 )
+            {
+                os << std::setw( 12) << waitP99Us;
+            }
+            os << std::endl;
+        }
+
+        static bool PinCurrentThread( const std::vector<int>& cores, size_t index)
+        {
+            if ( cores.empty() )
+            {
+                return true;
+            }
+            cpu_set_t cpuSet;
+            CPU_ZERO( &cpuSet);
+            CPU_SET( cores[ index % cores.size() ], &cpuSet);
+            return pthread_setaffinity_np( pthread_self(), sizeof( cpuSet), &cpuSet) == 0;
+        }
+
+        void GrabLoop( size_t index)
+        {
+            SChannel& channel = *m_channels[ index ];
+            if ( !PinCurrentThread( m_grabCores, index) )
+            {
+                ++channel.pinFailures;
+            }
+
+            CInstantCamera& camera = m_cameras[ index ];
+            CGrabResultPtr ptrGrabResult;
+            try
+            {
+                while ( !m_stopping.load( std::memory_order_relaxed) && camera.IsGrabbing() )
+                {
+                    // The timeout bounds the time Stop() waits for this thread.
+                    if ( !camera.RetrieveResult( 100, ptrGrabResult, TimeoutHandling_Return) )
+                    {
+                        continue;
+                    }
+                    ++channel.grabbed;
+                    if ( !ptrGrabResult->GrabSucceeded() )
+                    {
+                        ++channel.failed;
+                        continue;
+                    }
+
+                    // Block IDs count up by one per frame; GigE skips 0 when it wraps.
+                    const uint64_t blockId = ptrGrabResult->GetBlockID();
+                    if ( channel.hasBlockId && blockId > channel.lastBlockId + 1 )
+                    {
+                        channel.lost += blockId - channel.lastBlockId - 1;
+                    }
+                    channel.lastBlockId = blockId;
+                    channel.hasBlockId = true;
+
+                    const size_t depth = channel.queue.GetSize();
+                    channel.depthSum += depth;
+                    if ( channel.queue.TryPush( MakeQueuedFrame( ptrGrabResult)) )
+                    {
+                        channel.maxDepth = std::max( channel.maxDepth, depth + 1);
+                    }
+                    else
+                    {
+                        ++channel.dropped;
+                    }
+                    ptrGrabResult.Release();
+                }
+            }
+            catch (const GenericException& e)
+            {
+                std::lock_guard<std::mutex> lock( channel.errorMutex);
+                channel.error = e.GetDescription();
+            }
+            ptrGrabResult.Release();
+            camera.StopGrabbing();
+        }
+
+        void WorkerLoop( size_t index)
+        {
+            SChannel& channel = *m_channels[ index ];
+            if ( !PinCurrentThread( m_workerCores, index) )
+            {
+                ++channel.pinFailures;
+            }
+
+            SQueuedFrame frame;
+            unsigned int idlePolls = 0;
+            for (;;)
+            {
+                if ( !channel.queue.TryPop( frame) )
+                {
+                    // The queue is only final once the grab thread has been joined. A frame pushed
+                    // before that may have arrived after the failed pop, so look once more.
+                    if ( m_workersStopping.load( std::memory_order_acquire) )
+                    {
+                        if ( !channel.queue.TryPop( frame) )
+                        {
+                            break;
+                        }
+                    }
+                    else
+                    {
+                        // Spin briefly for low latency, then sleep to leave the core to others.
+                        if ( ++idlePolls < 64 )
+                        {
+                            std::this_thread::yield();
+                        }
+                        else
+                        {
+                            usleep( 100);
+                        }
+                        continue;
+                    }
+                }
+                idlePolls = 0;
+                channel.queueWait.Record( GetMonotonicTimeNs() - frame.pushTimeNs);
+                try
+                {
+                    m_processor.ProcessFrame( index, frame.ptrGrabResult);
+                }
+                catch (const GenericException& e)
+                {
+                    std::lock_guard<std::mutex> lock( channel.errorMutex);
+                    channel.error = e.GetDescription();
+                }
+                catch (const std::exception& e)
+                {
+                    std::lock_guard<std::mutex> lock( channel.errorMutex);
+                    channel.error = e.what();
+                }
+                frame.ptrGrabResult.Release();
+                channel.processed.fetch_add( 1, std::memory_order_relaxed);
+            }
+        }
+
+        CInstantCameraArray& m_cameras;
+        ICameraFrameProcessor& m_processor;
+        const std::vector<int> m_grabCores;
+        const std::vector<int> m_workerCores;
+        std::vector< std::unique_ptr<SChannel> > m_channels;
+        std::atomic<bool> m_stopping;
+        std::atomic<bool> m_workersStopping;
+        bool m_running;
+        uint64_t m_startNs;
+        uint64_t m_stopNs;
+    };
+}
+
+#endif /* INCLUDED_MULTICAMERAGRABBER_H_5526041 */
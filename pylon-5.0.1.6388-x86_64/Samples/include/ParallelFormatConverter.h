@@ -0,0 +1,338 @@
+// Contains an image format converter that converts the row bands of a frame in parallel.
+//
+// CParallelFormatConverter splits the source frame into bands of rows and converts them with
+// one CImageFormatConverter per thread, on threads that are started once and wait for the next
+// frame in between. Every band is written directly into the destination image, which is only
+// reallocated when its format or size changes. The calling thread converts the first band.
+//
+// The converter is parameterized through GetConverter() like a CImageFormatConverter; the
+// settings are copied to the band converters before each conversion, and the output is the
+// same as that of one CImageFormatConverter on the whole frame:
+// * Bayer formats are demosaiced with neighboring rows. Their bands start on even rows, so the
+//   color pattern stays the same, and are converted with c_bayerOverlapRows extra rows above
+//   and below into a buffer of the thread; only the inner rows are copied to the destination.
+// * Bottom-up images, planar output formats and packed lines that do not end on a byte
+//   boundary are converted in one piece by the first band converter.
+
+#ifndef INCLUDED_PARALLELFORMATCONVERTER_H_8813462
+#define INCLUDED_PARALLELFORMATCONVERTER_H_8813462
+
+#include <pylon/PylonIncludes.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <ostream>
+#include "LatencyHistogram.h"
+
+namespace Pylon
+{
+    class CParallelFormatConverter
+    {
+    public:
+        // Bands have at least this number of rows, so small frames are not split needlessly.
+        static const uint32_t c_minBandRows = 32;
+        static const uint32_t c_bayerOverlapRows = 2;
+
+        // threadCount 0 uses one thread per core.
+        explicit CParallelFormatConverter( unsigned int threadCount = 0)
+            : m_threadCount( threadCount != 0 ? threadCount : std::max( 1u, std::thread::hardware_concurrency()))
+            , m_bands( m_threadCount)
+            , m_generation( 0)
+            , m_bandCount( 0)
+            , m_pending( 0)
+            , m_stopping( false)
+            , m_conversions( 0)
+            , m_bandedConversions( 0)
+        {
+            for ( size_t i = 0; i < m_bands.size(); ++i )
+            {
+                m_bands[i].pConverter.reset( new CImageFormatConverter);
+            }
+            try
+            {
+                for ( size_t i = 1; i < m_bands.size(); ++i )
+                {
+                    m_workers.push_back( std::thread( &CParallelFormatConverter::WorkerLoop, this, i));
+                }
+            }
+            catch (...)
+            {
+                // The destructor is not called, so the threads already started must be joined here.
+                StopWorkers();
+                throw;
+            }
+        }
+
+        ~CParallelFormatConverter()
+        {
+            StopWorkers();
+        }
+
+        // The settings of all conversions, e.g. OutputPixelFormat or MonoConversionMethod.
+        CImageFormatConverter& GetConverter()
+        {
+            return m_settings;
+        }
+
+        unsigned int GetThreadCount() const
+        {
+            return m_threadCount;
+        }
+
+        void Convert( CPylonImage& destination, const IImage& source)
+        {
+            Convert( destination, source.GetBuffer(), source.GetImageSize(), source.GetPixelType(), source.GetWidth(), source.GetHeight(),
+                source.GetPaddingX(), source.GetOrientation());
+        }
+
+        // Resets the destination image to the output format; its buffer is reused if it is large enough.
+        void Convert( CPylonImage& destination, const void* pSource, size_t sourceSize, EPixelType sourcePixelType,
+            uint32_t width, uint32_t height, size_t sourcePaddingX, EImageOrientation sourceOrientation)
+        {
+            const EImageOrientation orientation = m_settings.OutputOrientation.GetValue() == OutputOrientation_Unchanged ? sourceOrientation
+                : (m_settings.OutputOrientation.GetValue() == OutputOrientation_BottomUp ? ImageOrientation_BottomUp : ImageOrientation_TopDown);
+            const EPixelType outputPixelType = m_settings.OutputPixelFormat.GetValue();
+            const size_t outputPaddingX = (size_t) m_settings.OutputPaddingX.GetValue();
+            if ( destination.GetPixelType() != outputPixelType || destination.GetWidth() != width || destination.GetHeight() != height
+                || destination.GetPaddingX() != outputPaddingX || destination.GetOrientation() != orientation || !destination.IsUnique() )
+            {
+                destination.Reset( outputPixelType, width, height, outputPaddingX, orientation);
+            }
+            Convert( destination.GetBuffer(), destination.GetAllocatedBufferSize(), pSource, sourceSize, sourcePixelType, width, height,
+                sourcePaddingX, sourceOrientation);
+        }
+
+        void Convert( void* pDestination, size_t destinationSize, const void* pSource, size_t sourceSize, EPixelType sourcePixelType,
+            uint32_t width, uint32_t height, size_t sourcePaddingX, EImageOrientation sourceOrientation)
+        {
+            const uint64_t startNs = GetMonotonicTimeNs();
+            for ( size_t i = 0; i < m_bands.size(); ++i )
+            {
+                CopySettings( *m_bands[i].pConverter);
+            }
+
+            // Bands of whole rows need byte aligned lines and a top-down layout on both sides.
+            const EPixelType outputPixelType = m_settings.OutputPixelFormat.GetValue();
+            size_t sourceStride = 0;
+            size_t destinationStride = 0;
+            const bool bayer = IsBayer( sourcePixelType);
+            const uint32_t rowAlignment = bayer ? 2 : 1;
+            size_t bandCount = std::max( (size_t) 1, std::min( (size_t) m_threadCount, (size_t) height / c_minBandRows));
+            if ( sourceOrientation != ImageOrientation_TopDown || m_settings.OutputOrientation.GetValue() == OutputOrientation_BottomUp
+                || PlaneCount( outputPixelType) != 1
+                || !ComputeStride( sourceStride, sourcePixelType, width, sourcePaddingX)
+                || !ComputeStride( destinationStride, outputPixelType, width, (size_t) m_settings.OutputPaddingX.GetValue())
+                || m_bands[0].pConverter->GetBufferSizeForConversion( sourcePixelType, width, height) != destinationStride * height )
+            {
+                bandCount = 1;
+            }
+            if ( bandCount == 1 )
+            {
+                m_bands[0].pConverter->Convert( pDestination, destinationSize, pSource, sourceSize, sourcePixelType, width, height,
+                    sourcePaddingX, sourceOrientation);
+                Record( startNs, false);
+                return;
+            }
+            if ( destinationSize < destinationStride * height || sourceSize < sourceStride * height )
+            {
+                throw RUNTIME_EXCEPTION( "CParallelFormatConverter: the source or destination buffer is too small.");
+            }
+
+            // Split into bands, the Bayer bands on even rows.
+            uint32_t rowsPerBand = (uint32_t) ((height + bandCount - 1) / bandCount);
+            rowsPerBand = (rowsPerBand + rowAlignment - 1) / rowAlignment * rowAlignment;
+            bandCount = (height + rowsPerBand - 1) / rowsPerBand;
+            for ( size_t i = 0; i < bandCount; ++i )
+            {
+                SBand& band = m_bands[i];
+                band.firstRow = (uint32_t) i * rowsPerBand;
+                band.rowCount = std::min( rowsPerBand, height - band.firstRow);
+                band.overlapAbove = bayer ? std::min( c_bayerOverlapRows, band.firstRow) : 0;
+                band.overlapBelow = bayer ? std::min( c_bayerOverlapRows, height - band.firstRow - band.rowCount) : 0;
+                band.pSource = static_cast<const uint8_t*>( pSource);
+                band.sourceStride = sourceStride;
+                band.sourcePixelType = sourcePixelType;
+                band.width = width;
+                band.sourcePaddingX = sourcePaddingX;
+                band.pDestination = static_cast<uint8_t*>( pDestination);
+                band.destinationStride = destinationStride;
+                band.error.clear();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock( m_mutex);
+                m_bandCount = bandCount;
+                m_pending = bandCount - 1;
+                ++m_generation;
+            }
+            m_start.notify_all();
+            ConvertBand( m_bands[0]);
+            {
+                std::unique_lock<std::mutex> lock( m_mutex);
+                m_done.wait( lock, [this] { return m_pending == 0; });
+            }
+
+            for ( size_t i = 0; i < bandCount; ++i )
+            {
+                if ( !m_bands[i].error.empty() )
+                {
+                    throw RUNTIME_EXCEPTION( "CParallelFormatConverter: %s", m_bands[i].error.c_str());
+                }
+            }
+            Record( startNs, true);
+        }
+
+        void PrintStatistics( std::ostream& os) const
+        {
+            os << "Parallel format converter: " << m_threadCount << " threads, " << m_conversions << " conversions, "
+               << m_bandedConversions << " in bands" << std::endl;
+            m_conversionTime.Print( os, "Conversion time");
+        }
+
+    private:
+        struct SBand
+        {
+            std::unique_ptr<CImageFormatConverter> pConverter;
+            std::vector<uint8_t> overlapBuffer;     // Bayer bands with their extra rows.
+            uint32_t firstRow;
+            uint32_t rowCount;
+            uint32_t overlapAbove;
+            uint32_t overlapBelow;
+            const uint8_t* pSource;
+            size_t sourceStride;
+            EPixelType sourcePixelType;
+            uint32_t width;
+            size_t sourcePaddingX;
+            uint8_t* pDestination;
+            size_t destinationStride;
+            std::string error;
+        };
+
+        template <typename TParameter>
+        static void CopyValue( TParameter& to, TParameter& from)
+        {
+            // Writing a parameter may rebuild the lookup tables of the converter.
+            if ( to.GetValue() != from.GetValue() )
+            {
+                to.SetValue( from.GetValue());
+            }
+        }
+
+        void CopySettings( CImageFormatConverter& to)
+        {
+            CopyValue( to.OutputPixelFormat, m_settings.OutputPixelFormat);
+            CopyValue( to.OutputBitAlignment, m_settings.OutputBitAlignment);
+            CopyValue( to.OutputPaddingX, m_settings.OutputPaddingX);
+            CopyValue( to.OutputOrientation, m_settings.OutputOrientation);
+            CopyValue( to.InconvertibleEdgeHandling, m_settings.InconvertibleEdgeHandling);
+            CopyValue( to.MonoConversionMethod, m_settings.MonoConversionMethod);
+            CopyValue( to.Gamma, m_settings.Gamma);
+            CopyValue( to.AdditionalLeftShift, m_settings.AdditionalLeftShift);
+        }
+
+        static void ConvertBand( SBand& band)
+        {
+            try
+            {
+                const uint32_t firstRow = band.firstRow - band.overlapAbove;
+                const uint32_t rowCount = band.overlapAbove + band.rowCount + band.overlapBelow;
+                const uint8_t* pSource = band.pSource + firstRow * band.sourceStride;
+                uint8_t* pDestination = band.pDestination + (size_t) band.firstRow * band.destinationStride;
+                if ( rowCount == band.rowCount )
+                {
+                    band.pConverter->Convert( pDestination, band.rowCount * band.destinationStride, pSource, rowCount * band.sourceStride,
+                        band.sourcePixelType, band.width, rowCount, band.sourcePaddingX, ImageOrientation_TopDown);
+                    return;
+                }
+                band.overlapBuffer.resize( rowCount * band.destinationStride);
+                band.pConverter->Convert( &band.overlapBuffer[0], band.overlapBuffer.size(), pSource, rowCount * band.sourceStride,
+                    band.sourcePixelType, band.width, rowCount, band.sourcePaddingX, ImageOrientation_TopDown);
+                memcpy( pDestination, &band.overlapBuffer[ band.overlapAbove * band.destinationStride ], band.rowCount * band.destinationStride);
+            }
+            catch (const GenericException &e)
+            {
+                band.error = e.GetDescription();
+            }
+        }
+
+        void WorkerLoop( size_t index)
+        {
+            uint64_t generation = 0;
+            for (;;)
+            {
+                size_t bandCount = 0;
+                {
+                    std::unique_lock<std::mutex> lock( m_mutex);
+                    m_start.wait( lock, [this, generation] { return m_generation != generation || m_stopping; });
+                    if ( m_stopping )
+                    {
+                        return;
+                    }
+                    generation = m_generation;
+                    bandCount = m_bandCount;
+                }
+                if ( index >= bandCount )
+                {
+                    continue;
+                }
+
+                ConvertBand( m_bands[ index ]);
+                bool last = false;
+                {
+                    std::lock_guard<std::mutex> lock( m_mutex);
+                    last = --m_pending == 0;
+                }
+                if ( last )
+                {
+                    m_done.notify_one();
+                }
+            }
+        }
+
+        void StopWorkers()
+        {
+            {
+                std::lock_guard<std::mutex> lock( m_mutex);
+                m_stopping = true;
+            }
+            m_start.notify_all();
+            for ( size_t i = 0; i < m_workers.size(); ++i )
+            {
+                m_workers[i].join();
+            }
+        }
+
+        void Record( uint64_t startNs, bool banded)
+        {
+            m_conversionTime.Record( GetMonotonicTimeNs() - startNs);
+            ++m_conversions;
+            if ( banded )
+            {
+                ++m_bandedConversions;
+            }
+        }
+
+        const unsigned int m_threadCount;
+        CImageFormatConverter m_settings;
+        std::vector<SBand> m_bands;             // One per thread, the first one for the calling thread.
+        std::vector<std::thread> m_workers;
+        std::mutex m_mutex;
+        std::condition_variable m_start;
+        std::condition_variable m_done;
+        uint64_t m_generation;
+        size_t m_bandCount;
+        size_t m_pending;
+        bool m_stopping;
+
+        uint64_t m_conversions;
+        uint64_t m_bandedConversions;
+        CLatencyHistogram m_conversionTime;
+    };
+}
+
+#endif /* INCLUDED_PARALLELFORMATCONVERTER_H_8813462 */
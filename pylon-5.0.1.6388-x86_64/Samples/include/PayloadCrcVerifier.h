@@ -0,0 +1,157 @@
+// Contains a stage that verifies the PayloadCRC16 chunk of every grab result.
+//
+// The CRC covers the image data and all chunks before the CRC chunk, which is always the last
+// one. The stage reads the chunks with a CChunkDecoder, computes the CRC of the covered bytes
+// with the kernels of Crc16.h and compares it with the chunk value. A frame whose CRC does not
+// match is flagged or dropped, depending on the policy; if the grab result also has a CRC
+// checker (HasCRC()), CheckCRC() confirms the mismatch first, so a layout the stage does not
+// understand cannot drop good frames. Frames without CRC chunk are passed on and counted.
+//
+// The statistics give the CRC throughput next to the data rate of the stream, which the
+// verification has to keep up with. Use one verifier per camera, from one thread.
+
+#ifndef INCLUDED_PAYLOADCRCVERIFIER_H_3391846
+#define INCLUDED_PAYLOADCRCVERIFIER_H_3391846
+
+#include <pylon/PylonIncludes.h>
+#include <stdint.h>
+#include <ostream>
+#include "ChunkDecoder.h"
+#include "Crc16.h"
+#include "LatencyHistogram.h"
+
+namespace Pylon
+{
+    // What happens to a frame whose CRC does not match.
+    enum ECrcFailurePolicy
+    {
+        CrcFailure_Flag,    // Pass it on as CrcVerdict_Flagged.
+        CrcFailure_Drop     // Return CrcVerdict_Dropped; the frame must not be processed.
+    };
+
+    enum ECrcVerdict
+    {
+        CrcVerdict_Passed,      // The CRC matches.
+        CrcVerdict_Flagged,     // The CRC does not match, the frame is passed on.
+        CrcVerdict_Dropped,     // The CRC does not match, the frame is dropped.
+        CrcVerdict_NoCrc        // The grab failed or has no CRC chunk.
+    };
+
+
+    class CPayloadCrcVerifier
+    {
+    public:
+        explicit CPayloadCrcVerifier( ECrcFailurePolicy policy = CrcFailure_Drop, Crc16::EKernel kernel = Crc16::Kernel_Auto)
+            : m_policy( policy)
+            , m_kernel( kernel)
+            , m_frames( 0)
+            , m_passed( 0)
+            , m_failed( 0)
+            , m_noCrc( 0)
+            , m_overruled( 0)
+            , m_verifiedBytes( 0)
+            , m_crcNs( 0)
+            , m_streamBytes( 0)
+            , m_firstFrameNs( 0)
+            , m_lastFrameNs( 0)
+        {
+        }
+
+        // Verifies a grab result. The chunk values are returned in data, also for frames that are
+        // dropped.
+        ECrcVerdict Verify( const CGrabResultPtr& ptrGrabResult, SChunkData& data)
+        {
+            const uint64_t nowNs = GetMonotonicTimeNs();
+            m_firstFrameNs = m_frames == 0 ? nowNs : m_firstFrameNs;
+            m_lastFrameNs = nowNs;
+            ++m_frames;
+            if ( !m_decoder.Decode( ptrGrabResult, data) || !data.IsValid( ChunkField_PayloadCRC16) )
+            {
+                ++m_noCrc;
+                return CrcVerdict_NoCrc;
+            }
+            m_streamBytes += ptrGrabResult->GetPayloadSize();
+
+            bool passed;
+            const size_t coverage = m_decoder.GetPayloadCrcCoverage();
+            if ( coverage != 0 )
+            {
+                const uint64_t startNs = GetMonotonicTimeNs();
+                passed = Crc16::Compute( ptrGrabResult->GetBuffer(), coverage, 0, m_kernel) == (uint16_t) data.payloadCRC16;
+                const uint64_t crcNs = GetMonotonicTimeNs() - startNs;
+                m_crcNs += crcNs;
+                m_crcTime.Record( crcNs);
+                m_verifiedBytes += coverage;
+                if ( !passed && ptrGrabResult->HasCRC() && ptrGrabResult->CheckCRC() )
+                {
+                    // The chunk parser of pylon accepts the frame.
+                    ++m_overruled;
+                    passed = true;
+                }
+            }
+            else
+            {
+                // The CRC chunk is not read from the payload; only pylon can check it.
+                passed = !ptrGrabResult->HasCRC() || ptrGrabResult->CheckCRC();
+            }
+
+            if ( passed )
+            {
+                ++m_passed;
+                return CrcVerdict_Passed;
+            }
+            ++m_failed;
+            return m_policy == CrcFailure_Drop ? CrcVerdict_Dropped : CrcVerdict_Flagged;
+        }
+
+        uint64_t GetFailedCount() const
+        {
+            return m_failed;
+        }
+
+        const CChunkDecoder& GetChunkDecoder() const
+        {
+            return m_decoder;
+        }
+
+        void PrintStatistics( std::ostream& os) const
+        {
+            os << "Payload CRC (" << Crc16::GetKernelName( m_kernel) << "): " << m_frames << " frames, " << m_passed << " passed, " << m_failed
+               << (m_policy == CrcFailure_Drop ? " dropped, " : " flagged, ") << m_noCrc << " without CRC";
+            if ( m_overruled != 0 )
+            {
+                os << ", " << m_overruled << " mismatches accepted by CheckCRC()";
+            }
+            os << std::endl;
+            if ( m_crcNs != 0 )
+            {
+                const double streamSeconds = (m_lastFrameNs - m_firstFrameNs) / 1e9;
+                os << "CRC throughput " << m_verifiedBytes / (m_crcNs / 1e9) / 1e6 << " MB/s";
+                if ( streamSeconds > 0.0 )
+                {
+                    os << ", stream data rate " << m_streamBytes / streamSeconds / 1e6 << " MB/s";
+                }
+                os << std::endl;
+                m_crcTime.Print( os, "CRC time per frame");
+            }
+        }
+
+    private:
+        const ECrcFailurePolicy m_policy;
+        const Crc16::EKernel m_kernel;
+        CChunkDecoder m_decoder;
+        uint64_t m_frames;
+        uint64_t m_passed;
+        uint64_t m_failed;
+        uint64_t m_noCrc;
+        uint64_t m_overruled;
+        uint64_t m_verifiedBytes;
+        uint64_t m_crcNs;
+        uint64_t m_streamBytes;
+        uint64_t m_firstFrameNs;
+        uint64_t m_lastFrameNs;
+        CLatencyHistogram m_crcTime;
+    };
+}
+
+#endif /* INCLUDED_PAYLOADCRCVERIFIER_H_3391846 */
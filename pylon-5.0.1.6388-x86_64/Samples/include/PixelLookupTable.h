@@ -0,0 +1,267 @@
+// Contains a host lookup table stage that maps Mono12 pixels (12 bit in 16 bit containers) to
+// 8 or 16 bit output through a 4096-entry table.
+//
+// Unlike the camera's luminance LUT (see ParametrizeCamera_LookupTable), the table can be
+// replaced between any two frames: SetTable() may be called from any thread while another
+// thread is in Apply(). Apply() picks up the latest table at the start of each frame with two
+// atomic operations and never waits; a frame is always mapped with one table only.
+//
+// The AVX2 kernel maps 16 pixels per iteration with two 8-lane gathers from the table, which
+// stays in the L1 cache; the scalar kernel is used on other CPUs. Bits above the 12th of an
+// input pixel are ignored. Table values must not exceed 65535; for 8 bit output, values above
+// 255 are saturated.
+
+#ifndef INCLUDED_PIXELLOOKUPTABLE_H_3301857
+#define INCLUDED_PIXELLOOKUPTABLE_H_3301857
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <immintrin.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+
+namespace Pylon
+{
+    // A table for 12 bit input. The values are 32 bit wide so that they can be gathered directly,
+    // but must not exceed 65535.
+    struct SPixelLookupTable
+    {
+        static const uint32_t c_size = 4096;
+        uint32_t values[ c_size ];
+    };
+
+
+    // Presets. outputMax is 255 for 8 bit output and 65535 for 16 bit output.
+    namespace PixelLookupTables
+    {
+        // Maps the input linearly to the output range.
+        inline void CreateLinear( SPixelLookupTable& table, uint32_t outputMax)
+        {
+            for ( uint32_t i = 0; i < SPixelLookupTable::c_size; ++i )
+            {
+                table.values[i] = (uint32_t) floor( (double) i * outputMax / (SPixelLookupTable::c_size - 1) + 0.5);
+            }
+        }
+
+        // Uses the formula of the gamma conversion of CImageFormatConverter,
+        // out = in ^ gamma / 4095 ^ gamma * outputMax, rounded; a gamma below 1 brightens.
+        inline void CreateGamma( SPixelLookupTable& table, double gamma, uint32_t outputMax)
+        {
+            for ( uint32_t i = 0; i < SPixelLookupTable::c_size; ++i )
+            {
+                const double value = pow( i / (double) (SPixelLookupTable::c_size - 1), gamma) * outputMax;
+                table.values[i] = std::min( (uint32_t) floor( value + 0.5), outputMax);
+            }
+        }
+
+        // Compresses the range logarithmically, out = log( 1 + in) / log( 4096) * outputMax.
+        inline void CreateLog( SPixelLookupTable& table, uint32_t outputMax)
+        {
+            for ( uint32_t i = 0; i < SPixelLookupTable::c_size; ++i )
+            {
+                const double value = log( 1.0 + i) / log( (double) SPixelLookupTable::c_size) * outputMax;
+                table.values[i] = std::min( (uint32_t) floor( value + 0.5), outputMax);
+            }
+        }
+
+        // Stretches the inputs from low to high to the output range. Inputs up to low become 0,
+        // inputs from high become outputMax.
+        inline void CreateWindow( SPixelLookupTable& table, uint32_t low, uint32_t high, uint32_t outputMax)
+        {
+            high = std::max( high, low + 1);
+            for ( uint32_t i = 0; i < SPixelLookupTable::c_size; ++i )
+            {
+                const uint32_t clamped = std::min( std::max( i, low), high);
+                table.values[i] = (uint32_t) (((uint64_t) (clamped - low) * outputMax + (high - low) / 2) / (high - low));
+            }
+        }
+    }
+
+
+    namespace PixelLookupKernels
+    {
+        enum EKernel
+        {
+            Kernel_Auto,
+            Kernel_Scalar,
+            Kernel_Avx2
+        };
+
+        template <typename TOut>
+        inline void MapScalar( const uint32_t* pTable, const uint16_t* pSource, TOut* pDestination, size_t count)
+        {
+            const uint32_t outputMax = (TOut) ~0;
+            for ( size_t i = 0; i < count; ++i )
+            {
+                pDestination[i] = (TOut) std::min( pTable[ pSource[i] & 0xFFF ], outputMax);
+            }
+        }
+
+        // Maps 16 pixels to 16 saturated 16 bit values in order.
+        __attribute__(( target( "avx2")))
+        inline __m256i Map16Avx2( const uint32_t* pTable, const uint16_t* pSource)
+        {
+            const __m256i pixels = _mm256_and_si256( _mm256_loadu_si256( (const __m256i*) pSource), _mm256_set1_epi16( 0xFFF));
+            const __m256i low = _mm256_i32gather_epi32( (const int*) pTable, _mm256_cvtepu16_epi32( _mm256_castsi256_si128( pixels)), 4);
+            const __m256i high = _mm256_i32gather_epi32( (const int*) pTable, _mm256_cvtepu16_epi32( _mm256_extracti128_si256( pixels, 1)), 4);
+            // The pack interleaves the 128 bit lanes; the permutation restores the pixel order.
+            return _mm256_permute4x64_epi64( _mm256_packus_epi32( low, high), 0xD8);
+        }
+
+        __attribute__(( target( "avx2")))
+        inline void MapAvx2( const uint32_t* pTable, const uint16_t* pSource, uint8_t* pDestination, size_t count)
+        {
+            // The byte pack saturates signed 16 bit values, so values from 32768 must be clamped first.
+            const __m256i outputMax = _mm256_set1_epi16( 255);
+            size_t i = 0;
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                const __m256i values = _mm256_min_epu16( Map16Avx2( pTable, pSource + i), outputMax);
+                _mm_storeu_si128( (__m128i*) (pDestination + i),
+                    _mm_packus_epi16( _mm256_castsi256_si128( values), _mm256_extracti128_si256( values, 1)));
+            }
+            MapScalar( pTable, pSource + i, pDestination + i, count - i);
+        }
+
+        __attribute__(( target( "avx2")))
+        inline void MapAvx2( const uint32_t* pTable, const uint16_t* pSource, uint16_t* pDestination, size_t count)
+        {
+            size_t i = 0;
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                _mm256_storeu_si256( (__m256i*) (pDestination + i), Map16Avx2( pTable, pSource + i));
+            }
+            MapScalar( pTable, pSource + i, pDestination + i, count - i);
+        }
+
+        inline EKernel GetBestKernel()
+        {
+            static const EKernel best = __builtin_cpu_supports( "avx2") ? Kernel_Avx2 : Kernel_Scalar;
+            return best;
+        }
+
+        inline const char* GetKernelName( EKernel kernel)
+        {
+            return (kernel == Kernel_Auto ? GetBestKernel() : kernel) == Kernel_Avx2 ? "AVX2 gather" : "scalar";
+        }
+
+        template <typename TOut>
+        inline void Map( const uint32_t* pTable, const uint16_t* pSource, TOut* pDestination, size_t count, EKernel kernel = Kernel_Auto)
+        {
+            if ( (kernel == Kernel_Auto ? GetBestKernel() : kernel) == Kernel_Avx2 )
+            {
+                MapAvx2( pTable, pSource, pDestination, count);
+            }
+            else
+            {
+                MapScalar( pTable, pSource, pDestination, count);
+            }
+        }
+    }
+
+
+    // Maps Mono12 frames to Mono8 or Mono16 with a replaceable table.
+    class CPixelLookupStage
+    {
+    public:
+        explicit CPixelLookupStage( const SPixelLookupTable& table, PixelLookupKernels::EKernel kernel = PixelLookupKernels::Kernel_Auto)
+            : m_kernel( kernel)
+            , m_published( 0)
+            , m_swaps( 0)
+        {
+            for ( size_t i = 0; i < c_slotCount; ++i )
+            {
+                m_slots[i].readers = 0;
+            }
+            m_slots[0].table = table;
+        }
+
+        // Makes the table used for all frames whose Apply() starts afterwards. Frames already
+        // being mapped keep their table. Waits only if all spare slots are held by readers.
+        void SetTable( const SPixelLookupTable& table)
+        {
+            std::lock_guard<std::mutex> lock( m_writerMutex);
+            const size_t published = m_published.load();
+            for ( ;; )
+            {
+                for ( size_t i = 0; i < c_slotCount; ++i )
+                {
+                    // A reader that increments the count after this check sees the slot
+                    // unpublished and retries, so the slot can be written.
+                    if ( i != published && m_slots[i].readers.load() == 0 )
+                    {
+                        m_slots[i].table = table;
+                        m_published.store( i);
+                        ++m_swaps;
+                        return;
+                    }
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        // Maps a Mono12 frame to Mono8 or Mono16. The strides are the distances between the
+        // starts of two lines in bytes; 0 means the lines are not padded.
+        template <typename TOut>
+        void Apply( const uint16_t* pSource, size_t sourceStride, TOut* pDestination, size_t destinationStride, uint32_t width, uint32_t height) const
+        {
+            sourceStride = sourceStride != 0 ? sourceStride : width * sizeof( uint16_t);
+            destinationStride = destinationStride != 0 ? destinationStride : width * sizeof( TOut);
+            SSlot& slot = AcquireSlot();
+            const uint8_t* pSourceLine = reinterpret_cast<const uint8_t*>( pSource);
+            uint8_t* pDestinationLine = reinterpret_cast<uint8_t*>( pDestination);
+            for ( uint32_t y = 0; y < height; ++y, pSourceLine += sourceStride, pDestinationLine += destinationStride )
+            {
+                PixelLookupKernels::Map( slot.table.values, reinterpret_cast<const uint16_t*>( pSourceLine),
+                    reinterpret_cast<TOut*>( pDestinationLine), width, m_kernel);
+            }
+            slot.readers.fetch_sub( 1);
+        }
+
+        // The number of SetTable() calls.
+        uint64_t GetSwapCount() const
+        {
+            std::lock_guard<std::mutex> lock( m_writerMutex);
+            return m_swaps;
+        }
+
+    private:
+        // The published table, one still used by frames started before the last swap, and
+        // one to fill.
+        static const size_t c_slotCount = 3;
+
+        struct SSlot
+        {
+            SPixelLookupTable table;
+            std::atomic<uint32_t> readers;
+        };
+
+        // Registers as a reader of the published slot. If the slot was replaced before the
+        // registration became visible, the writer may be filling it, so try again.
+        SSlot& AcquireSlot() const
+        {
+            for ( ;; )
+            {
+                const size_t published = m_published.load();
+                SSlot& slot = m_slots[ published ];
+                slot.readers.fetch_add( 1);
+                if ( m_published.load() == published )
+                {
+                    return slot;
+                }
+                slot.readers.fetch_sub( 1);
+            }
+        }
+
+        const PixelLookupKernels::EKernel m_kernel;
+        mutable SSlot m_slots[ c_slotCount ];
+        std::atomic<size_t> m_published;
+        mutable std::mutex m_writerMutex;
+        uint64_t m_swaps;
+    };
+}
+
+#endif /* INCLUDED_PIXELLOOKUPTABLE_H_3301857 */
@@ -0,0 +1,458 @@
+// Contains a virtual camera that replays recorded frames through an image event handler.
+//
+// The replay camera reads a directory of image files written by the burst recorder
+// (GrabbedImage_HH_MM_SS_NN.tiff/.png) or a capture container written by CCaptureContainerWriter.
+// The frames are delivered on a replay thread, either at the cadence they were recorded with or
+// as fast as the handler accepts them. This allows benchmarking processing code without a camera.
+//
+// The frames are ordered and paced by the grab time and block ID stored in a capture container or
+// in the ImageDescription of TIFF files written by TiffFileSink.h. Other image files (e.g. written
+// by CImagePersistence) only have the grab time in their name, GrabbedImage_HH_MM_SS_NN, so the
+// frames of one second are delivered back to back. Decoding is timed separately. With
+// ReplayLoading_Preload, the achieved frame rate reflects the handler only; with
+// ReplayLoading_OnDemand, each frame is decoded on the replay thread, so the decode time is part of
+// the replay time and frames are late if decoding takes longer than the recorded frame interval.
+
+#ifndef INCLUDED_REPLAYCAMERA_H_3920571
+#define INCLUDED_REPLAYCAMERA_H_3920571
+
+#include <pylon/PylonIncludes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include "LatencyHistogram.h"
+#include "CaptureContainer.h"
+#include "TiffFileSink.h"
+
+namespace Pylon
+{
+    class CReplayCamera;
+
+    struct SReplayFrameInfo
+    {
+        size_t frameIndex;          // Index within the recording.
+        uint64_t blockId;           // Block ID parsed from the file name or stored in the container.
+        uint64_t recordedTimeNs;    // Host wall-clock time the frame was grabbed (seconds of the day for file names).
+        uint32_t loop;              // Replay loop, starting at 0.
+    };
+
+
+    // Receives the replayed frames. The image is only valid during the call; copy it if it is needed later.
+    class CReplayImageEventHandler
+    {
+    public:
+        virtual ~CReplayImageEventHandler() {}
+        virtual void OnImageGrabbed( CReplayCamera& camera, const CPylonImage& image, const SReplayFrameInfo& info) = 0;
+        virtual void OnGrabStopped( CReplayCamera& /* camera */) {}
+    };
+
+
+    enum EReplayPacing
+    {
+        ReplayPacing_Recorded,          // Deliver the frames at the recorded cadence.
+        ReplayPacing_AsFastAsPossible   // Deliver the next frame as soon as the handler returns.
+    };
+
+    enum EReplayLoading
+    {
+        ReplayLoading_Preload,          // Decode all image files when the recording is opened.
+        ReplayLoading_OnDemand          // Decode each image file on the replay thread before it is due.
+    };
+
+
+    class CReplayCamera
+    {
+    public:
+        CReplayCamera()
+            : m_pHandler( NULL)
+            , m_loading( ReplayLoading_Preload)
+            , m_grabbing( false)
+            , m_stopRequested( false)
+            , m_deliveredCount( 0)
+            , m_elapsedNs( 0)
+            , m_lateCount( 0)
+        {
+        }
+
+        ~CReplayCamera()
+        {
+            StopGrabbing();
+        }
+
+        // Opens a directory of .tiff/.png files or a capture container file.
+        void Open( const std::string& source, EReplayLoading loading = ReplayLoading_Preload)
+        {
+            StopGrabbing();
+            Close();
+            m_loading = loading;
+
+            struct stat sourceStat;
+            if ( stat( source.c_str(), &sourceStat) != 0 )
+            {
+                throw RUNTIME_EXCEPTION( "Could not open %s: %s", source.c_str(), strerror( errno));
+            }
+            if ( S_ISDIR( sourceStat.st_mode) )
+            {
+                OpenDirectory( source);
+            }
+            else
+            {
+                OpenContainer( source);
+            }
+            if ( m_frames.empty() )
+            {
+                throw RUNTIME_EXCEPTION( "%s does not contain any frames.", source.c_str());
+            }
+        }
+
+        void Close()
+        {
+            m_frames.clear();
+            m_container.Close();
+            m_decodeTime.Reset();
+        }
+
+        size_t GetFrameCount() const
+        {
+            return m_frames.size();
+        }
+
+        void RegisterImageEventHandler( CReplayImageEventHandler* pHandler)
+        {
+            m_pHandler = pHandler;
+        }
+
+        // Starts the replay thread. Frames are delivered loopCount times; speedFactor scales the recorded cadence.
+        void StartGrabbing( EReplayPacing pacing = ReplayPacing_Recorded, uint32_t loopCount = 1, double speedFactor = 1.0)
+        {
+            if ( m_frames.empty() )
+            {
+                throw RUNTIME_EXCEPTION( "No recording has been opened.");
+            }
+            StopGrabbing();
+            m_handlerTime.Reset();
+            m_lateness.Reset();
+            m_deliveredCount = 0;
+            m_elapsedNs = 0;
+            m_lateCount = 0;
+            m_stopRequested = false;
+            m_grabbing = true;
+            m_replayThread = std::thread( &CReplayCamera::ReplayLoop, this, pacing, loopCount, speedFactor > 0.0 ? speedFactor : 1.0);
+        }
+
+        void StopGrabbing()
+        {
+            m_stopRequested = true;
+            {
+                std::lock_guard<std::mutex> lock( m_mutex);
+                m_stopCondition.notify_all();
+            }
+            if ( m_replayThread.joinable() )
+            {
+                m_replayThread.join();
+            }
+        }
+
+        bool IsGrabbing() const
+        {
+            return m_grabbing;
+        }
+
+        // Blocks until all frames have been replayed or the timeout has expired. Returns false on timeout.
+        bool WaitForGrabStop( unsigned int timeoutMs)
+        {
+            std::unique_lock<std::mutex> lock( m_mutex);
+            return m_stopCondition.wait_for( lock, std::chrono::milliseconds( timeoutMs), [this] { return !m_grabbing; });
+        }
+
+        void PrintStatistics( std::ostream& os) const
+        {
+            double seconds = m_elapsedNs / 1e9;
+            std::ios::fmtflags flags = os.flags();
+            os << std::fixed << std::setprecision( 1)
+               << "Replayed " << m_deliveredCount << " frames in " << seconds << " s: "
+               << (seconds > 0.0 ? m_deliveredCount / seconds : 0.0) << " frames/s" << std::endl;
+            os.flags( flags);
+            m_decodeTime.Print( os, "Decode time per frame");
+            m_handlerTime.Print( os, "Handler time per frame");
+            if ( m_lateCount > 0 )
+            {
+                os << m_lateCount << " frames were delivered late." << std::endl;
+                m_lateness.Print( os, "Lateness");
+            }
+        }
+
+    private:
+        struct SFrame
+        {
+            std::string filename;   // Empty for frames of a capture container.
+            size_t containerIndex;
+            uint64_t blockId;
+            uint64_t recordedTimeNs;
+            CPylonImage image;      // Decoded image for ReplayLoading_Preload.
+
+            bool operator<( const SFrame& other) const
+            {
+                if ( recordedTimeNs != other.recordedTimeNs )
+                {
+                    return recordedTimeNs < other.recordedTimeNs;
+                }
+                return blockId < other.blockId;
+            }
+        };
+
+        static bool HasImageExtension( const std::string& name)
+        {
+            static const char* const extensions[] = { ".tiff", ".tif", ".png" };
+            for ( size_t i = 0; i < sizeof( extensions) / sizeof( extensions[0]); ++i )
+            {
+                size_t length = strlen( extensions[i]);
+                if ( name.size() > length && strcasecmp( name.c_str() + name.size() - length, extensions[i]) == 0 )
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Parses GrabbedImage_HH_MM_SS_NN.ext into the time of the day and the block ID NN.
+        // Returns false for other names.
+        static bool ParseFileName( const std::string& name, uint64_t& timeOfDayNs, uint64_t& blockId)
+        {
+            // The fourth underscore before the extension starts _HH_MM_SS_NN.
+            size_t position = name.rfind( '.');
+            for ( int i = 0; i < 4 && position != std::string::npos && position > 0; ++i )
+            {
+                position = name.rfind( '_', position - 1);
+            }
+            int hour = 0;
+            int minute = 0;
+            int second = 0;
+            unsigned long long id = 0;
+            if ( position == std::string::npos || sscanf( name.c_str() + position, "_%d_%d_%d_%llu", &hour, &minute, &second, &id) != 4 )
+            {
+                return false;
+            }
+            timeOfDayNs = ((uint64_t) hour * 3600 + (uint64_t) minute * 60 + (uint64_t) second) * 1000000000ULL;
+            blockId = id;
+            return true;
+        }
+
+        void OpenDirectory( const std::string& directory)
+        {
+            DIR* pDirectory = opendir( directory.c_str());
+            if ( pDirectory == NULL )
+            {
+                throw RUNTIME_EXCEPTION( "Could not open directory %s: %s", directory.c_str(), strerror( errno));
+            }
+            size_t describedFiles = 0;
+            struct dirent* pEntry;
+            while ( (pEntry = readdir( pDirectory)) != NULL )
+            {
+                std::string name = pEntry->d_name;
+                if ( !HasImageExtension( name) )
+                {
+                    continue;
+                }
+                SFrame frame;
+                frame.filename = directory + "/" + name;
+                frame.containerIndex = 0;
+                frame.blockId = 0;
+                frame.recordedTimeNs = 0;
+                if ( ReadTiffFrameDescription( frame.filename, frame.blockId, frame.recordedTimeNs) )
+                {
+                    ++describedFiles;
+                }
+                else if ( !ParseFileName( name, frame.recordedTimeNs, frame.blockId) )
+                {
+                    std::cerr << "Skipping " << name << ": neither a frame description nor a GrabbedImage_HH_MM_SS_NN name." << std::endl;
+                    continue;
+                }
+                m_frames.push_back( frame);
+            }
+            closedir( pDirectory);
+            if ( describedFiles != 0 && describedFiles != m_frames.size() )
+            {
+                // The two time bases cannot be mixed.
+                throw RUNTIME_EXCEPTION( "%s mixes files with and without frame description.", directory.c_str());
+            }
+            std::sort( m_frames.begin(), m_frames.end());
+
+            if ( m_loading == ReplayLoading_Preload )
+            {
+                for ( size_t i = 0; i < m_frames.size(); ++i )
+                {
+                    Decode( m_frames[i], m_frames[i].image);
+                }
+            }
+        }
+
+        void OpenContainer( const std::string& filename)
+        {
+            // Container frames are mapped into memory and attached without decoding.
+            // Packed frames have to be unpacked, which is treated like decoding an image file.
+            m_container.Open( filename);
+            m_frames.resize( m_container.GetFrameCount());
+            for ( size_t i = 0; i < m_frames.size(); ++i )
+            {
+                m_frames[i].containerIndex = i;
+                m_frames[i].blockId = m_container.GetRecord( i).blockId;
+                m_frames[i].recordedTimeNs = m_container.GetRecord( i).hostTimeNs;
+            }
+            std::stable_sort( m_frames.begin(), m_frames.end());
+            for ( size_t i = 0; i < m_frames.size(); ++i )
+            {
+                if ( !m_container.IsPacked() )
+                {
+                    m_container.GetImage( m_frames[i].containerIndex, m_frames[i].image);
+                }
+                else if ( m_loading == ReplayLoading_Preload )
+                {
+                    Decode( m_frames[i], m_frames[i].image);
+                }
+            }
+        }
+
+        void Decode( const SFrame& frame, CPylonImage& image)
+        {
+            uint64_t startNs = GetMonotonicTimeNs();
+            if ( frame.filename.empty() )
+            {
+                m_container.GetImage( frame.containerIndex, image);
+            }
+            else
+            {
+                CImagePersistence::Load( frame.filename.c_str(), image);
+            }
+            m_decodeTime.Record( GetMonotonicTimeNs() - startNs);
+        }
+
+        bool SleepUntil( uint64_t deadlineNs)
+        {
+            std::unique_lock<std::mutex> lock( m_mutex);
+            for (;;)
+            {
+                if ( m_stopRequested )
+                {
+                    return false;
+                }
+                uint64_t nowNs = GetMonotonicTimeNs();
+                if ( nowNs >= deadlineNs )
+                {
+                    return true;
+                }
+                m_stopCondition.wait_for( lock, std::chrono::nanoseconds( deadlineNs - nowNs));
+            }
+        }
+
+        void ReplayLoop( EReplayPacing pacing, uint32_t loopCount, double speedFactor)
+        {
+            const bool onDemand = m_loading == ReplayLoading_OnDemand && (m_container.GetFrameCount() == 0 || m_container.IsPacked());
+            const uint64_t firstRecordedNs = m_frames.front().recordedTimeNs;
+            // A loop lasts the recording plus one average frame interval.
+            uint64_t loopDurationNs = m_frames.back().recordedTimeNs - firstRecordedNs;
+            if ( m_frames.size() > 1 )
+            {
+                loopDurationNs += loopDurationNs / (m_frames.size() - 1);
+            }
+
+            CPylonImage decodedImage;
+            const uint64_t startNs = GetMonotonicTimeNs();
+            for ( uint32_t loop = 0; loop < loopCount && !m_stopRequested; ++loop )
+            {
+                for ( size_t i = 0; i < m_frames.size() && !m_stopRequested; ++i )
+                {
+                    const SFrame& frame = m_frames[i];
+                    const CPylonImage* pImage = &frame.image;
+                    if ( onDemand )
+                    {
+                        try
+                        {
+                            Decode( frame, decodedImage);
+                        }
+                        catch (GenICam::GenericException &e)
+                        {
+                            std::cerr << "Could not load frame " << i << ": " << e.GetDescription() << std::endl;
+                            continue;
+                        }
+                        pImage = &decodedImage;
+                    }
+
+                    if ( pacing == ReplayPacing_Recorded )
+                    {
+                        uint64_t offsetNs = loop * loopDurationNs + (frame.recordedTimeNs - firstRecordedNs);
+                        uint64_t dueNs = startNs + (uint64_t) (offsetNs / speedFactor);
+                        uint64_t nowNs = GetMonotonicTimeNs();
+                        if ( nowNs > dueNs )
+                        {
+                            ++m_lateCount;
+                            m_lateness.Record( nowNs - dueNs);
+                        }
+                        else if ( !SleepUntil( dueNs) )
+                        {
+                            break;
+                        }
+                    }
+
+                    SReplayFrameInfo info;
+                    info.frameIndex = i;
+                    info.blockId = frame.blockId;
+                    info.recordedTimeNs = frame.recordedTimeNs;
+                    info.loop = loop;
+
+                    uint64_t handlerStartNs = GetMonotonicTimeNs();
+                    if ( m_pHandler != NULL )
+                    {
+                        m_pHandler->OnImageGrabbed( *this, *pImage, info);
+                    }
+                    m_handlerTime.Record( GetMonotonicTimeNs() - handlerStartNs);
+                    ++m_deliveredCount;
+                }
+            }
+            m_elapsedNs = GetMonotonicTimeNs() - startNs;
+
+            if ( m_pHandler != NULL )
+            {
+                m_pHandler->OnGrabStopped( *this);
+            }
+            std::lock_guard<std::mutex> lock( m_mutex);
+            m_grabbing = false;
+            m_stopCondition.notify_all();
+        }
+
+        CReplayImageEventHandler* m_pHandler;
+        EReplayLoading m_loading;
+        std::vector<SFrame> m_frames;
+        CCaptureContainerReader m_container;
+        std::thread m_replayThread;
+        std::mutex m_mutex;
+        std::condition_variable m_stopCondition;
+        std::atomic<bool> m_grabbing;
+        std::atomic<bool> m_stopRequested;
+
+        // Statistics, written by the replay thread.
+        uint64_t m_deliveredCount;
+        uint64_t m_elapsedNs;
+        uint64_t m_lateCount;
+        CLatencyHistogram m_decodeTime;
+        CLatencyHistogram m_handlerTime;
+        CLatencyHistogram m_lateness;
+    };
+}
+
+#endif /* INCLUDED_REPLAYCAMERA_H_3920571 */
@@ -0,0 +1,487 @@
+// Contains an engine that averages the columns of many frames for shading calibration.
+//
+// Shading calibration needs the mean intensity of every column (and color channel) over all
+// lines of many frames of a uniformly lit scene. CShadingAccumulator reads the frames row by
+// row, as they are laid out in memory, and adds each row into per-column integer sums:
+// * the row is added into 16 bit staging sums with SIMD adds (SSE2 or AVX2, chosen at run time)
+//   for as many rows as cannot overflow them (257 rows of Mono8/RGB8, 16 rows of Mono12),
+// * the staging sums are then widened into 32 bit sums, which are added into 64 bit totals
+//   per frame.
+// The rows of a frame are split into bands that are added in parallel by the calling thread and
+// worker threads, which are started once in the constructor and wait for the next frame.
+// GetAverages() returns the averages in the layout CalculateCoeffs of ParametrizeCamera_Shading
+// expects: one value per column for mono, all red, then all green, then all blue columns for RGB.
+//
+// The engine only uses the C++ standard library. Mono12 is 12 bit data in 16 bit containers
+// (PixelType_Mono12), the values must not exceed 4095.
+
+#ifndef INCLUDED_SHADINGCALIBRATION_H_2605814
+#define INCLUDED_SHADINGCALIBRATION_H_2605814
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <immintrin.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <stdexcept>
+
+namespace Pylon
+{
+    enum EShadingFormat
+    {
+        ShadingFormat_Mono8,
+        ShadingFormat_Mono12,
+        ShadingFormat_RGB8
+    };
+
+    namespace ShadingKernels
+    {
+        enum EKernel
+        {
+            Kernel_Auto,
+            Kernel_Scalar,
+            Kernel_Sse2,
+            Kernel_Avx2
+        };
+
+        // Each kernel adds rowCount rows of valueCount values into the 16 bit staging sums
+        // pStage, which the caller must have zeroed and which must not overflow, and then adds
+        // the staging sums into the 32 bit sums pSums.
+
+        template <typename T>
+        inline void AccumulateScalar( const uint8_t* pRows, size_t stride, size_t rowCount, size_t valueCount, uint16_t* pStage, uint32_t* pSums)
+        {
+            for ( size_t y = 0; y < rowCount; ++y )
+            {
+                const T* pRow = reinterpret_cast<const T*>( pRows + y * stride);
+                for ( size_t i = 0; i < valueCount; ++i )
+                {
+                    pStage[i] = (uint16_t) (pStage[i] + pRow[i]);
+                }
+            }
+            for ( size_t i = 0; i < valueCount; ++i )
+            {
+                pSums[i] += pStage[i];
+            }
+        }
+
+        inline void AccumulateSse2( const uint8_t* pRows, size_t stride, size_t rowCount, size_t valueCount, size_t bytesPerValue,
+            uint16_t* pStage, uint32_t* pSums)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            size_t vectorCount = valueCount & ~(size_t) 15;
+            for ( size_t y = 0; y < rowCount; ++y )
+            {
+                const uint8_t* pRow = pRows + y * stride;
+                if ( bytesPerValue == 1 )
+                {
+                    for ( size_t i = 0; i < vectorCount; i += 16 )
+                    {
+                        const __m128i pixels = _mm_loadu_si128( (const __m128i*) (pRow + i));
+                        __m128i* pLow = (__m128i*) (pStage + i);
+                        __m128i* pHigh = (__m128i*) (pStage + i + 8);
+                        _mm_storeu_si128( pLow, _mm_add_epi16( _mm_loadu_si128( pLow), _mm_unpacklo_epi8( pixels, zero)));
+                        _mm_storeu_si128( pHigh, _mm_add_epi16( _mm_loadu_si128( pHigh), _mm_unpackhi_epi8( pixels, zero)));
+                    }
+                    for ( size_t i = vectorCount; i < valueCount; ++i )
+                    {
+                        pStage[i] = (uint16_t) (pStage[i] + pRow[i]);
+                    }
+                }
+                else
+                {
+                    const uint16_t* pRow16 = reinterpret_cast<const uint16_t*>( pRow);
+                    for ( size_t i = 0; i < vectorCount; i += 8 )
+                    {
+                        __m128i* pStageVector = (__m128i*) (pStage + i);
+                        _mm_storeu_si128( pStageVector, _mm_add_epi16( _mm_loadu_si128( pStageVector), _mm_loadu_si128( (const __m128i*) (pRow16 + i))));
+                    }
+                    for ( size_t i = vectorCount; i < valueCount; ++i )
+                    {
+                        pStage[i] = (uint16_t) (pStage[i] + pRow16[i]);
+                    }
+                }
+            }
+            for ( size_t i = 0; i < vectorCount; i += 8 )
+            {
+                const __m128i stage = _mm_loadu_si128( (const __m128i*) (pStage + i));
+                __m128i* pLow = (__m128i*) (pSums + i);
+                __m128i* pHigh = (__m128i*) (pSums + i + 4);
+                _mm_storeu_si128( pLow, _mm_add_epi32( _mm_loadu_si128( pLow), _mm_unpacklo_epi16( stage, zero)));
+                _mm_storeu_si128( pHigh, _mm_add_epi32( _mm_loadu_si128( pHigh), _mm_unpackhi_epi16( stage, zero)));
+            }
+            for ( size_t i = vectorCount; i < valueCount; ++i )
+            {
+                pSums[i] += pStage[i];
+            }
+        }
+
+        __attribute__(( target( "avx2")))
+        inline void AccumulateAvx2( const uint8_t* pRows, size_t stride, size_t rowCount, size_t valueCount, size_t bytesPerValue,
+            uint16_t* pStage, uint32_t* pSums)
+        {
+            size_t vectorCount = valueCount & ~(size_t) 15;
+            for ( size_t y = 0; y < rowCount; ++y )
+            {
+                const uint8_t* pRow = pRows + y * stride;
+                if ( bytesPerValue == 1 )
+                {
+                    for ( size_t i = 0; i < vectorCount; i += 16 )
+                    {
+                        const __m256i pixels = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*) (pRow + i)));
+                        __m256i* pStageVector = (__m256i*) (pStage + i);
+                        _mm256_storeu_si256( pStageVector, _mm256_add_epi16( _mm256_loadu_si256( pStageVector), pixels));
+                    }
+                    for ( size_t i = vectorCount; i < valueCount; ++i )
+                    {
+                        pStage[i] = (uint16_t) (pStage[i] + pRow[i]);
+                    }
+                }
+                else
+                {
+                    const uint16_t* pRow16 = reinterpret_cast<const uint16_t*>( pRow);
+                    for ( size_t i = 0; i < vectorCount; i += 16 )
+                    {
+                        __m256i* pStageVector = (__m256i*) (pStage + i);
+                        _mm256_storeu_si256( pStageVector, _mm256_add_epi16( _mm256_loadu_si256( pStageVector), _mm256_loadu_si256( (const __m256i*) (pRow16 + i))));
+                    }
+                    for ( size_t i = vectorCount; i < valueCount; ++i )
+                    {
+                        pStage[i] = (uint16_t) (pStage[i] + pRow16[i]);
+                    }
+                }
+            }
+            for ( size_t i = 0; i < vectorCount; i += 8 )
+            {
+                __m256i* pSumVector = (__m256i*) (pSums + i);
+                const __m256i stage = _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*) (pStage + i)));
+                _mm256_storeu_si256( pSumVector, _mm256_add_epi32( _mm256_loadu_si256( pSumVector), stage));
+            }
+            for ( size_t i = vectorCount; i < valueCount; ++i )
+            {
+                pSums[i] += pStage[i];
+            }
+        }
+
+        inline EKernel GetBestKernel()
+        {
+            static const EKernel best = __builtin_cpu_supports( "avx2") ? Kernel_Avx2
+                : (__builtin_cpu_supports( "sse2") ? Kernel_Sse2 : Kernel_Scalar);
+            return best;
+        }
+
+        inline const char* GetKernelName( EKernel kernel)
+        {
+            switch ( kernel == Kernel_Auto ? GetBestKernel() : kernel )
+            {
+            case Kernel_Avx2:
+                return "AVX2";
+            case Kernel_Sse2:
+                return "SSE2";
+            default:
+                return "scalar";
+            }
+        }
+
+        inline void Accumulate( EKernel kernel, const uint8_t* pRows, size_t stride, size_t rowCount, size_t valueCount, size_t bytesPerValue,
+            uint16_t* pStage, uint32_t* pSums)
+        {
+            switch ( kernel == Kernel_Auto ? GetBestKernel() : kernel )
+            {
+            case Kernel_Avx2:
+                AccumulateAvx2( pRows, stride, rowCount, valueCount, bytesPerValue, pStage, pSums);
+                break;
+            case Kernel_Sse2:
+                AccumulateSse2( pRows, stride, rowCount, valueCount, bytesPerValue, pStage, pSums);
+                break;
+            default:
+                if ( bytesPerValue == 1 )
+                {
+                    AccumulateScalar<uint8_t>( pRows, stride, rowCount, valueCount, pStage, pSums);
+                }
+                else
+                {
+                    AccumulateScalar<uint16_t>( pRows, stride, rowCount, valueCount, pStage, pSums);
+                }
+                break;
+            }
+        }
+    }
+
+
+    class CShadingAccumulator
+    {
+    public:
+        // threadCount 0 uses one thread per core.
+        CShadingAccumulator( uint32_t width, EShadingFormat format, unsigned int threadCount = 0,
+            ShadingKernels::EKernel kernel = ShadingKernels::Kernel_Auto)
+            : m_width( width)
+            , m_channels( format == ShadingFormat_RGB8 ? 3 : 1)
+            , m_bytesPerValue( format == ShadingFormat_Mono12 ? 2 : 1)
+            , m_maxValue( format == ShadingFormat_Mono12 ? 4095 : 255)
+            , m_threadCount( threadCount != 0 ? threadCount : std::max( 1u, std::thread::hardware_concurrency()))
+            , m_kernel( kernel)
+            , m_sums( (size_t) width * m_channels, 0)
+            , m_lineCount( 0)
+            , m_frameCount( 0)
+            , m_bands( m_threadCount)
+            , m_generation( 0)
+            , m_bandCount( 0)
+            , m_pending( 0)
+            , m_stopping( false)
+        {
+            if ( width == 0 )
+            {
+                throw std::invalid_argument( "CShadingAccumulator needs a width of at least one pixel.");
+            }
+            for ( size_t i = 0; i < m_bands.size(); ++i )
+            {
+                m_bands[i].sums.resize( m_sums.size());
+                m_bands[i].stage.resize( m_sums.size());
+                m_bands[i].sums32.resize( m_sums.size());
+            }
+            try
+            {
+                for ( size_t i = 1; i < m_bands.size(); ++i )
+                {
+                    m_workers.push_back( std::thread( &CShadingAccumulator::WorkerLoop, this, i));
+                }
+            }
+            catch (...)
+            {
+                // The destructor is not called, so the threads already started must be joined here.
+                StopWorkers();
+                throw;
+            }
+        }
+
+        ~CShadingAccumulator()
+        {
+            StopWorkers();
+        }
+
+        void Reset()
+        {
+            std::fill( m_sums.begin(), m_sums.end(), 0);
+            m_lineCount = 0;
+            m_frameCount = 0;
+        }
+
+        // Adds all lines of a frame. stride is the distance between the starts of two lines in
+        // bytes; 0 means the lines are not padded.
+        void AddFrame( const void* pBuffer, uint32_t height, size_t stride = 0)
+        {
+            const size_t valueCount = m_sums.size();
+            if ( stride == 0 )
+            {
+                stride = valueCount * m_bytesPerValue;
+            }
+            if ( stride < valueCount * m_bytesPerValue )
+            {
+                throw std::invalid_argument( "CShadingAccumulator::AddFrame: the stride is smaller than a line.");
+            }
+
+            // Bands of at least c_minBandRows rows, so small frames are not split needlessly.
+            const size_t bandCount = std::max( (size_t) 1, std::min( (size_t) m_threadCount, (size_t) height / c_minBandRows));
+            const uint8_t* pRows = static_cast<const uint8_t*>( pBuffer);
+            const size_t rowsPerBand = (height + bandCount - 1) / bandCount;
+            for ( size_t i = 0; i < bandCount; ++i )
+            {
+                SBand& band = m_bands[i];
+                const size_t firstRow = i * rowsPerBand;
+                band.pRows = pRows + firstRow * stride;
+                band.stride = stride;
+                band.rowCount = std::min( rowsPerBand, (size_t) height - std::min( firstRow, (size_t) height));
+            }
+
+            if ( bandCount == 1 )
+            {
+                AccumulateBand( m_bands[0]);
+            }
+            else
+            {
+                {
+                    std::lock_guard<std::mutex> lock( m_mutex);
+                    m_bandCount = bandCount;
+                    m_pending = bandCount - 1;
+                    ++m_generation;
+                }
+                m_start.notify_all();
+                AccumulateBand( m_bands[0]);
+                {
+                    std::unique_lock<std::mutex> lock( m_mutex);
+                    m_done.wait( lock, [this] { return m_pending == 0; });
+                }
+            }
+
+            for ( size_t band = 0; band < bandCount; ++band )
+            {
+                const std::vector<uint64_t>& sums = m_bands[band].sums;
+                for ( size_t i = 0; i < valueCount; ++i )
+                {
+                    m_sums[i] += sums[i];
+                }
+            }
+            m_lineCount += height;
+            ++m_frameCount;
+        }
+
+        uint64_t GetFrameCount() const
+        {
+            return m_frameCount;
+        }
+
+        uint64_t GetLineCount() const
+        {
+            return m_lineCount;
+        }
+
+        // The number of averages GetAverages() returns, NumCoeffs in ParametrizeCamera_Shading.
+        uint32_t GetNumCoeffs() const
+        {
+            return (uint32_t) m_sums.size();
+        }
+
+        // Writes GetNumCoeffs() column averages, for RGB ordered by channel, then by column.
+        void GetAverages( double* pIntensities) const
+        {
+            const double scale = m_lineCount != 0 ? 1.0 / (double) m_lineCount : 0.0;
+            for ( uint32_t x = 0; x < m_width; ++x )
+            {
+                for ( uint32_t channel = 0; channel < m_channels; ++channel )
+                {
+                    pIntensities[ channel * m_width + x ] = (double) m_sums[ (size_t) x * m_channels + channel ] * scale;
+                }
+            }
+        }
+
+    private:
+        static const size_t c_minBandRows = 64;
+
+        // The rows of a frame added by one thread, and its sums, allocated once for a row.
+        struct SBand
+        {
+            SBand()
+                : pRows( NULL)
+                , stride( 0)
+                , rowCount( 0)
+            {
+            }
+
+            const uint8_t* pRows;
+            size_t stride;
+            size_t rowCount;
+            std::vector<uint64_t> sums;
+            std::vector<uint16_t> stage;
+            std::vector<uint32_t> sums32;
+        };
+
+        // Adds the rows of the band into its sums, which are zeroed first.
+        void AccumulateBand( SBand& band) const
+        {
+            const size_t valueCount = m_sums.size();
+            const uint8_t* pRows = band.pRows;
+            const size_t stride = band.stride;
+            const size_t rowCount = band.rowCount;
+            std::vector<uint64_t>& sums = band.sums;
+            std::vector<uint16_t>& stage = band.stage;
+            std::vector<uint32_t>& sums32 = band.sums32;
+            std::fill( sums.begin(), sums.end(), 0);
+            std::fill( sums32.begin(), sums32.end(), 0);
+
+            // Rows that fit into the 16 bit staging sums, and into the 32 bit sums.
+            const size_t stageRows = 65535 / m_maxValue;
+            const size_t flushRows = (0xFFFFFFFFULL / m_maxValue) / stageRows * stageRows;
+            size_t rowsInSums32 = 0;
+            for ( size_t row = 0; row < rowCount; row += stageRows )
+            {
+                const size_t rows = std::min( stageRows, rowCount - row);
+                std::fill( stage.begin(), stage.end(), 0);
+                ShadingKernels::Accumulate( m_kernel, pRows + row * stride, stride, rows, valueCount, m_bytesPerValue, &stage[0], &sums32[0]);
+                rowsInSums32 += rows;
+                if ( rowsInSums32 >= flushRows || row + rows == rowCount )
+                {
+                    for ( size_t i = 0; i < valueCount; ++i )
+                    {
+                        sums[i] += sums32[i];
+                    }
+                    std::fill( sums32.begin(), sums32.end(), 0);
+                    rowsInSums32 = 0;
+                }
+            }
+        }
+
+        void WorkerLoop( size_t index)
+        {
+            uint64_t generation = 0;
+            for (;;)
+            {
+                size_t bandCount = 0;
+                {
+                    std::unique_lock<std::mutex> lock( m_mutex);
+                    m_start.wait( lock, [this, generation] { return m_generation != generation || m_stopping; });
+                    if ( m_stopping )
+                    {
+                        return;
+                    }
+                    generation = m_generation;
+                    bandCount = m_bandCount;
+                }
+                if ( index >= bandCount )
+                {
+                    continue;
+                }
+
+                AccumulateBand( m_bands[ index ]);
+                bool last = false;
+                {
+                    std::lock_guard<std::mutex> lock( m_mutex);
+                    last = --m_pending == 0;
+                }
+                if ( last )
+                {
+                    m_done.notify_one();
+                }
+            }
+        }
+
+        void StopWorkers()
+        {
+            {
+                std::lock_guard<std::mutex> lock( m_mutex);
+                m_stopping = true;
+            }
+            m_start.notify_all();
+            for ( size_t i = 0; i < m_workers.size(); ++i )
+            {
+                m_workers[i].join();
+            }
+        }
+
+        const uint32_t m_width;
+        const uint32_t m_channels;
+        const size_t m_bytesPerValue;
+        const uint32_t m_maxValue;
+        const unsigned int m_threadCount;
+        const ShadingKernels::EKernel m_kernel;
+        std::vector<uint64_t> m_sums;   // Per value of a row, i.e. interleaved for RGB.
+        uint64_t m_lineCount;
+        uint64_t m_frameCount;
+
+        std::vector<SBand> m_bands;             // One per thread, the first one for the calling thread.
+        std::vector<std::thread> m_workers;
+        std::mutex m_mutex;
+        std::condition_variable m_start;
+        std::condition_variable m_done;
+        uint64_t m_generation;
+        size_t m_bandCount;
+        size_t m_pending;
+        bool m_stopping;
+    };
+}
+
+#endif /* INCLUDED_SHADINGCALIBRATION_H_2605814 */
@@ -0,0 +1,118 @@
+// Contains a bounded lock-free queue for exactly one producer thread and one consumer thread.
+//
+// TryPush() and TryPop() never block, lock or allocate; each costs a few atomic loads and
+// stores. The producer and the consumer indices live on separate cache lines, and each side
+// keeps a cached copy of the other side's index, so the cache line of the other thread is only
+// read when the queue looks full or empty. The capacity is rounded up to a power of two.
+
+#ifndef INCLUDED_SPSCQUEUE_H_3318420
+#define INCLUDED_SPSCQUEUE_H_3318420
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+#include <stdexcept>
+
+namespace Pylon
+{
+    template <typename T>
+    class CSpscQueue
+    {
+    public:
+        explicit CSpscQueue( size_t capacity)
+            : m_items( RoundUpToPowerOfTwo( capacity))
+            , m_mask( m_items.size() - 1)
+            , m_head( 0)
+            , m_cachedTail( 0)
+            , m_tail( 0)
+            , m_cachedHead( 0)
+        {
+            if ( capacity == 0 )
+            {
+                throw std::invalid_argument( "CSpscQueue needs a capacity of at least one.");
+            }
+        }
+
+        // Producer thread only. Returns false if the queue is full.
+        bool TryPush( const T& item)
+        {
+            const size_t tail = m_tail.load( std::memory_order_relaxed);
+            if ( tail - m_cachedHead == m_items.size() )
+            {
+                m_cachedHead = m_head.load( std::memory_order_acquire);
+                if ( tail - m_cachedHead == m_items.size() )
+                {
+                    return false;
+                }
+            }
+            m_items[ tail & m_mask ] = item;
+            m_tail.store( tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer thread only. Returns false if the queue is empty. The slot is reset to T(),
+        // so e.g. a CGrabResultPtr does not keep its buffer after it has been taken.
+        bool TryPop( T& item)
+        {
+            const size_t head = m_head.load( std::memory_order_relaxed);
+            if ( head == m_cachedTail )
+            {
+                m_cachedTail = m_tail.load( std::memory_order_acquire);
+                if ( head == m_cachedTail )
+                {
+                    return false;
+                }
+            }
+            item = m_items[ head & m_mask ];
+            m_items[ head & m_mask ] = T();
+            m_head.store( head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // The number of queued items. Exact when called from the producer or the consumer
+        // thread while the other side is idle, otherwise a snapshot.
+        size_t GetSize() const
+        {
+            const size_t head = m_head.load( std::memory_order_acquire);
+            const size_t tail = m_tail.load( std::memory_order_acquire);
+            return tail - head;
+        }
+
+        size_t GetCapacity() const
+        {
+            return m_items.size();
+        }
+
+    private:
+        CSpscQueue( const CSpscQueue&);
+        CSpscQueue& operator=( const CSpscQueue&);
+
+        static size_t RoundUpToPowerOfTwo( size_t value)
+        {
+            size_t result = 1;
+            while ( result < value )
+            {
+                result <<= 1;
+            }
+            return result;
+        }
+
+        // The padding keeps the indices of the two threads on different cache lines, also when
+        // the queue is allocated with new, which does not honor alignas before C++17.
+        std::vector<T> m_items;
+        const size_t m_mask;
+        char m_padding0[64];
+
+        // Written by the consumer.
+        std::atomic<size_t> m_head;
+        size_t m_cachedTail;
+        char m_padding1[64];
+
+        // Written by the producer.
+        std::atomic<size_t> m_tail;
+        size_t m_cachedHead;
+        char m_padding2[64];
+    };
+}
+
+#endif /* INCLUDED_SPSCQUEUE_H_3318420 */
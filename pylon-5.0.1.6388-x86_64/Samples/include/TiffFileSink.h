@@ -0,0 +1,1027 @@
+// Contains frame sinks that write one uncompressed TIFF file per frame without CImagePersistence.
+//
+// The TIFF header is built in a small buffer and the image data is written straight from the
+// grab result, so no pixel data is copied. 12-bit formats are stored LSB aligned in 16-bit samples
+// (CImagePersistence stores them MSB aligned); the MaxSampleValue tag is set to 4095. The
+// ImageDescription tag holds the block ID and the grab time of the frame, which
+// ReadTiffFrameDescription() reads back, e.g. for replaying the files at the recorded cadence.
+//
+// Two backends are provided:
+// * CPosixTiffSink opens, writes, optionally fsyncs and closes every file with blocking calls.
+// * CUringTiffSink queues the open, write, fsync and close operations of a whole batch of frames
+//   as linked io_uring requests and submits them with a single system call. Completions are
+//   handled on a separate thread, which releases the grab results. It needs Linux 5.19 or newer.
+// CreateTiffFileSink() selects a backend and falls back to POSIX I/O if io_uring is not usable.
+// Use a CFrameWriterPool with maxBatch > 1 to let the io_uring sink batch submissions.
+
+#ifndef INCLUDED_TIFFFILESINK_H_2468013
+#define INCLUDED_TIFFFILESINK_H_2468013
+
+#include <pylon/PylonIncludes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
+#include "FrameWriterPool.h"
+#include "LatencyHistogram.h"
+
+#if defined( __linux__ ) && defined( __has_include )
+#  if __has_include( <linux/io_uring.h> )
+#    include <linux/io_uring.h>
+#    if defined( IORING_RSRC_REGISTER_SPARSE ) && defined( __NR_io_uring_setup )
+#      define PYLON_SAMPLES_HAVE_IO_URING 1
+#    endif
+#  endif
+#endif
+
+namespace Pylon
+{
+    // Enough room for the TIFF header of any supported format including the frame description.
+    static const size_t c_tiffHeaderCapacity = 256;
+
+    // The ImageDescription of the files, "BlockID=<block ID> GrabTimeNs=<CLOCK_REALTIME ns>".
+    static const size_t c_tiffDescriptionCapacity = 64;
+
+    inline void FormatTiffFrameDescription( char* pDescription, uint64_t blockId, uint64_t grabTimeNs)
+    {
+        snprintf( pDescription, c_tiffDescriptionCapacity, "BlockID=%llu GrabTimeNs=%llu", (unsigned long long) blockId, (unsigned long long) grabTimeNs);
+    }
+
+    // Reads the block ID and the grab time from the ImageDescription of a little-endian TIFF file.
+    // Returns false if the file has no such description.
+    inline bool ReadTiffFrameDescription( const std::string& filename, uint64_t& blockId, uint64_t& grabTimeNs)
+    {
+        uint8_t header[ 1024 ];
+        int fd = open( filename.c_str(), O_RDONLY);
+        if ( fd < 0 )
+        {
+            return false;
+        }
+        const ssize_t size = read( fd, header, sizeof( header));
+        close( fd);
+        struct SReader
+        {
+            static uint32_t U16( const uint8_t* p) { return p[0] | (uint32_t) p[1] << 8; }
+            static uint32_t U32( const uint8_t* p) { return U16( p) | U16( p + 2) << 16; }
+        };
+        if ( size < 8 || header[0] != 'I' || header[1] != 'I' || SReader::U16( header + 2) != 42 )
+        {
+            return false;
+        }
+        const uint32_t ifdOffset = SReader::U32( header + 4);
+        if ( ifdOffset + 2 > (size_t) size )
+        {
+            return false;
+        }
+        const uint32_t entryCount = SReader::U16( header + ifdOffset);
+        for ( uint32_t i = 0; i < entryCount && ifdOffset + 2 + (i + 1) * 12 <= (size_t) size; ++i )
+        {
+            const uint8_t* pEntry = header + ifdOffset + 2 + i * 12;
+            const uint32_t count = SReader::U32( pEntry + 4);
+            const uint32_t offset = SReader::U32( pEntry + 8);
+            if ( SReader::U16( pEntry) != 270 || SReader::U16( pEntry + 2) != 2 || count <= 4 || count > c_tiffDescriptionCapacity
+                || offset + count > (size_t) size )
+            {
+                continue;
+            }
+            char description[ c_tiffDescriptionCapacity + 1 ];
+            memcpy( description, header + offset, count);
+            description[ count ] = 0;
+            unsigned long long id = 0;
+            unsigned long long timeNs = 0;
+            if ( sscanf( description, "BlockID=%llu GrabTimeNs=%llu", &id, &timeNs) == 2 )
+            {
+                blockId = id;
+                grabTimeNs = timeNs;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Builds the header of a single-strip, uncompressed TIFF file whose image data directly
+    // follows the header. pDescription (at most c_tiffDescriptionCapacity bytes) is stored as
+    // ImageDescription if given. Returns the header size or 0 if the frame cannot be stored this way.
+    inline size_t BuildTiffHeader( uint8_t* pHeader, EPixelType pixelType, uint32_t width, uint32_t height, size_t paddingX, size_t imageSize,
+        const char* pDescription = NULL)
+    {
+        uint16_t samplesPerPixel = 1;
+        uint16_t bitsPerSample = 8;
+        uint16_t photometric = 1;  // BlackIsZero
+        uint16_t maxSampleValue = 0;
+        switch ( pixelType )
+        {
+        case PixelType_Mono8:
+            break;
+        case PixelType_Mono10:
+            bitsPerSample = 16;
+            maxSampleValue = 1023;
+            break;
+        case PixelType_Mono12:
+            bitsPerSample = 16;
+            maxSampleValue = 4095;
+            break;
+        case PixelType_Mono16:
+            bitsPerSample = 16;
+            break;
+        case PixelType_RGB8packed:
+            samplesPerPixel = 3;
+            photometric = 2;  // RGB
+            break;
+        default:
+            return 0;
+        }
+        if ( paddingX != 0 || (uint64_t) width * height * samplesPerPixel * (bitsPerSample / 8) != imageSize )
+        {
+            return 0;
+        }
+
+        // Values of more than 4 bytes follow the directory: the bits per sample of RGB and the description.
+        const uint32_t descriptionCount = pDescription != NULL ? (uint32_t) strnlen( pDescription, c_tiffDescriptionCapacity - 1) + 1 : 0;
+        const bool hasDescription = descriptionCount > 4;
+        const uint16_t entryCount = 10 + (maxSampleValue ? 1 : 0) + (hasDescription ? 1 : 0);
+        const uint32_t ifdOffset = 8;
+        const uint32_t extraOffset = ifdOffset + 2 + entryCount * 12 + 4;
+        const uint32_t descriptionOffset = extraOffset + 8;
+        const uint32_t dataOffset = descriptionOffset + (hasDescription ? (descriptionCount + 1) / 2 * 2 : 0);
+        memset( pHeader, 0, dataOffset);
+
+        uint8_t* p = pHeader;
+        struct SWriter
+        {
+            static void U16( uint8_t*& p, uint16_t value) { p[0] = (uint8_t) value; p[1] = (uint8_t) (value >> 8); p += 2; }
+            static void U32( uint8_t*& p, uint32_t value) { U16( p, (uint16_t) value); U16( p, (uint16_t) (value >> 16)); }
+            static void Entry( uint8_t*& p, uint16_t tag, uint16_t type, uint32_t count, uint32_t value)
+            {
+                U16( p, tag);
+                U16( p, type);
+                U32( p, count);
+                if ( type == 3 && count == 1 )
+                {
+                    U16( p, (uint16_t) value);
+                    U16( p, 0);
+                }
+                else
+                {
+                    U32( p, value);
+                }
+            }
+        };
+        const uint16_t c_ascii = 2;
+        const uint16_t c_short = 3;
+        const uint16_t c_long = 4;
+
+        *p++ = 'I';
+        *p++ = 'I';
+        SWriter::U16( p, 42);
+        SWriter::U32( p, ifdOffset);
+        SWriter::U16( p, entryCount);
+        SWriter::Entry( p, 256, c_long, 1, width);                                  // ImageWidth
+        SWriter::Entry( p, 257, c_long, 1, height);                                 // ImageLength
+        SWriter::Entry( p, 258, c_short, samplesPerPixel,                           // BitsPerSample
+            samplesPerPixel == 1 ? bitsPerSample : extraOffset);
+        SWriter::Entry( p, 259, c_short, 1, 1);                                     // Compression: none
+        SWriter::Entry( p, 262, c_short, 1, photometric);                           // PhotometricInterpretation
+        if ( hasDescription )
+        {
+            SWriter::Entry( p, 270, c_ascii, descriptionCount, descriptionOffset);  // ImageDescription
+        }
+        SWriter::Entry( p, 273, c_long, 1, dataOffset);                             // StripOffsets
+        SWriter::Entry( p, 277, c_short, 1, samplesPerPixel);                       // SamplesPerPixel
+        SWriter::Entry( p, 278, c_long, 1, height);                                 // RowsPerStrip
+        SWriter::Entry( p, 279, c_long, 1, (uint32_t) imageSize);                   // StripByteCounts
+        if ( maxSampleValue )
+        {
+            SWriter::Entry( p, 281, c_short, 1, maxSampleValue);                    // MaxSampleValue
+        }
+        SWriter::Entry( p, 284, c_short, 1, 1);                                     // PlanarConfiguration: chunky
+        SWriter::U32( p, 0);                                                        // No next IFD.
+        for ( uint16_t i = 0; i < samplesPerPixel && samplesPerPixel > 1; ++i )
+        {
+            SWriter::U16( p, bitsPerSample);
+        }
+        if ( hasDescription )
+        {
+            memcpy( pHeader + descriptionOffset, pDescription, descriptionCount - 1);
+        }
+        return dataOffset;
+    }
+
+
+    // Writes each frame with open/writev/fsync/close on the calling writer thread.
+    class CPosixTiffSink : public IFrameSink
+    {
+    public:
+        explicit CPosixTiffSink( bool useFsync = false)
+            : m_useFsync( useFsync)
+        {
+        }
+
+        virtual void WriteFrame( const CGrabResultPtr& ptrGrabResult, const std::string& name)
+        {
+            WriteTiff( ptrGrabResult, name, GetRealtimeNs());
+        }
+
+    protected:
+        virtual void WriteJob( const SFrameWriteJob& job)
+        {
+            WriteTiff( job.ptrGrabResult, job.name, job.grabTimeNs);
+        }
+
+    private:
+        void WriteTiff( const CGrabResultPtr& ptrGrabResult, const std::string& name, uint64_t grabTimeNs)
+        {
+            char description[ c_tiffDescriptionCapacity ];
+            FormatTiffFrameDescription( description, ptrGrabResult->GetBlockID(), grabTimeNs);
+            uint8_t header[ c_tiffHeaderCapacity ];
+            size_t headerSize = BuildTiffHeader( header, ptrGrabResult->GetPixelType(), ptrGrabResult->GetWidth(), ptrGrabResult->GetHeight(),
+                ptrGrabResult->GetPaddingX(), ptrGrabResult->GetImageSize(), description);
+            if ( headerSize == 0 )
+            {
+                // Formats that cannot be written directly are converted by pylon.
+                CImagePersistence::Save( ImageFileFormat_Tiff, name.c_str(), ptrGrabResult);
+                return;
+            }
+
+            int fd = open( name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if ( fd < 0 )
+            {
+                throw RUNTIME_EXCEPTION( "Could not create %s: %s", name.c_str(), strerror( errno));
+            }
+            struct iovec parts[2];
+            parts[0].iov_base = header;
+            parts[0].iov_len = headerSize;
+            parts[1].iov_base = ptrGrabResult->GetBuffer();
+            parts[1].iov_len = ptrGrabResult->GetImageSize();
+            size_t total = parts[0].iov_len + parts[1].iov_len;
+            ssize_t written = writev( fd, parts, 2);
+            int error = 0;
+            if ( written != (ssize_t) total )
+            {
+                error = written < 0 ? errno : EIO;
+            }
+            else if ( m_useFsync && fsync( fd) != 0 )
+            {
+                error = errno;
+            }
+            if ( close( fd) != 0 && error == 0 )
+            {
+                error = errno;
+            }
+            if ( error != 0 )
+            {
+                throw RUNTIME_EXCEPTION( "Writing %s failed: %s", name.c_str(), strerror( error));
+            }
+        }
+
+        const bool m_useFsync;
+    };
+
+
+#if defined( PYLON_SAMPLES_HAVE_IO_URING )
+
+    // Queues every frame as the linked requests openat -> write header -> write image [-> fsync] -> close.
+    // Files are opened into fixed file slots, so the whole chain can be submitted before the
+    // file descriptor is known. WriteFrames() returns as soon as the batch has been submitted;
+    // it blocks only while all slots are in flight.
+    //
+    // With registerGrabBuffers, each grab buffer is registered with the ring the first time it is
+    // seen, and the image data is written with fixed-buffer requests. A registration pins the memory
+    // it was made for. If the camera frees its buffers and allocates new ones at the same address,
+    // the registration would point to the old memory, so only enable this when the grab buffers stay
+    // allocated (e.g. grabbing is not restarted, or a CHugePageBufferFactory provides them), or call
+    // ResetBufferRegistrations() after each StopGrabbing() once all frames have been written.
+    class CUringTiffSink : public IFrameSink
+    {
+    public:
+        // maxInFlight is the number of frames that can be queued in the kernel at a time.
+        explicit CUringTiffSink( bool useFsync = false, bool registerGrabBuffers = false, unsigned int maxInFlight = 32, unsigned int maxRegisteredBuffers = 256)
+            : m_useFsync( useFsync)
+            , m_registerGrabBuffers( registerGrabBuffers)
+            , m_ringFd( -1)
+            , m_pSqRing( NULL)
+            , m_pCqRing( NULL)
+            , m_pSqes( NULL)
+            , m_sqRingSize( 0)
+            , m_cqRingSize( 0)
+            , m_sqesSize( 0)
+            , m_unsubmitted( 0)
+            , m_slots( maxInFlight)
+            , m_headerArena( maxInFlight * c_tiffHeaderCapacity)
+            , m_bufferRegistrations( maxRegisteredBuffers)
+            , m_registeredBufferCount( 1)
+            , m_useFixedBuffers( false)
+            , m_grabBuffersRegistered( 0)
+            , m_stopping( false)
+            , m_ringError( 0)
+            , m_inFlight( 0)
+            , m_submitted( 0)
+            , m_completed( 0)
+            , m_failed( 0)
+            , m_submitCalls( 0)
+        {
+            SetupRing( maxInFlight * 8);
+            for ( size_t i = 0; i < m_slots.size(); ++i )
+            {
+                m_freeSlots.push_back( (unsigned int) i);
+            }
+            m_completionThread = std::thread( &CUringTiffSink::CompletionLoop, this);
+        }
+
+        ~CUringTiffSink()
+        {
+            Flush();
+            {
+                std::lock_guard<std::mutex> lock( m_mutex);
+                m_stopping = true;
+            }
+            // Wake up the completion thread with a no-op request, unless it has already given up.
+            {
+                std::lock_guard<std::mutex> lock( m_mutex);
+                if ( m_ringError == 0 )
+                {
+                    try
+                    {
+                        struct io_uring_sqe* pSqe = GetSqe();
+                        pSqe->opcode = IORING_OP_NOP;
+                        pSqe->user_data = c_wakeUpUserData;
+                        SubmitLocked( 1);
+                    }
+                    catch (GenICam::GenericException &e)
+                    {
+                        std::cerr << e.GetDescription() << std::endl;
+                        FailRingLocked( EIO);
+                    }
+                }
+            }
+            m_completionThread.join();
+            TeardownRing();
+        }
+
+        // Returns true if the running kernel supports everything the sink needs.
+        static bool IsSupported()
+        {
+            try
+            {
+                CUringTiffSink probe( false, false, 1, 2);
+                return true;
+            }
+            catch (GenICam::GenericException &)
+            {
+                return false;
+            }
+        }
+
+        virtual void WriteFrame( const CGrabResultPtr& ptrGrabResult, const std::string& name)
+        {
+            SFrameWriteJob job;
+            job.ptrGrabResult = ptrGrabResult;
+            job.name = name;
+            job.enqueueTimeNs = GetMonotonicTimeNs();
+            job.grabTimeNs = GetRealtimeNs();
+            WriteFrames( &job, 1);
+        }
+
+        // Frames are reported to the write handler when their close request has completed.
+        virtual void WriteFrames( const SFrameWriteJob* pJobs, size_t count)
+        {
+            std::unique_lock<std::mutex> lock( m_mutex);
+            unsigned int queuedRequests = 0;
+            size_t i = 0;
+            try
+            {
+                for ( ; i < count; ++i )
+                {
+                    QueueJobLocked( lock, pJobs[i], queuedRequests);
+                }
+                SubmitLocked( queuedRequests);
+            }
+            catch (GenICam::GenericException &e)
+            {
+                // The ring cannot be used any more; fail the frames in flight and the rest of the batch.
+                std::cerr << e.GetDescription() << std::endl;
+                FailRingLocked( EIO);
+                for ( ++i; i < count; ++i )
+                {
+                    ReportFrameWritten( pJobs[i], false);
+                }
+            }
+        }
+
+        // Waits until all submitted frames have completed.
+        virtual void Flush()
+        {
+            std::unique_lock<std::mutex> lock( m_mutex);
+            m_slotFreed.wait( lock, [this] { return m_inFlight == 0; });
+        }
+
+        // Waits for all frames in flight and drops the grab buffer registrations.
+        void ResetBufferRegistrations()
+        {
+            std::unique_lock<std::mutex> lock( m_mutex);
+            m_slotFreed.wait( lock, [this] { return m_inFlight == 0; });
+            for ( unsigned int i = 1; i < m_registeredBufferCount; ++i )
+            {
+                RegisterBuffer( i, NULL, 0);
+            }
+            m_registeredBufferCount = 1;
+        }
+
+        void PrintStatistics( std::ostream& os) const
+        {
+            std::lock_guard<std::mutex> lock( m_mutex);
+            os << "io_uring sink: " << m_submitted << " frames submitted in " << m_submitCalls << " submissions, "
+               << m_completed << " completed, " << m_failed << " failed, "
+               << m_grabBuffersRegistered << " written from registered grab buffers" << std::endl;
+            m_completionLatency.Print( os, "Submit to completion");
+        }
+
+    private:
+        static const uint64_t c_wakeUpUserData = ~0ULL;
+
+        // Puts a frame into a free slot and queues its requests. Throws only if submitting fails
+        // after the frame has got its slot, so FailRingLocked() reports it.
+        void QueueJobLocked( std::unique_lock<std::mutex>& lock, const SFrameWriteJob& job, unsigned int& queuedRequests)
+        {
+            const CGrabResultPtr& ptrGrabResult = job.ptrGrabResult;
+            if ( m_ringError == 0 && m_freeSlots.empty() )
+            {
+                // Submit what has been queued so far, then wait for a slot.
+                try
+                {
+                    SubmitLocked( queuedRequests);
+                }
+                catch (GenICam::GenericException &e)
+                {
+                    std::cerr << e.GetDescription() << std::endl;
+                    FailRingLocked( EIO);
+                }
+                queuedRequests = 0;
+                m_slotFreed.wait( lock, [this] { return !m_freeSlots.empty() || m_ringError != 0; });
+            }
+            if ( m_ringError != 0 )
+            {
+                std::cerr << "Writing " << job.name << " failed: " << strerror( m_ringError) << std::endl;
+                ++m_failed;
+                ReportFrameWritten( job, false);
+                return;
+            }
+            unsigned int slotIndex = m_freeSlots.back();
+            SSlot& slot = m_slots[ slotIndex ];
+            uint8_t* pHeader = &m_headerArena[ slotIndex * c_tiffHeaderCapacity ];
+            char description[ c_tiffDescriptionCapacity ];
+            FormatTiffFrameDescription( description, ptrGrabResult->GetBlockID(), job.grabTimeNs);
+            size_t headerSize = BuildTiffHeader( pHeader, ptrGrabResult->GetPixelType(), ptrGrabResult->GetWidth(), ptrGrabResult->GetHeight(),
+                ptrGrabResult->GetPaddingX(), ptrGrabResult->GetImageSize(), description);
+            if ( headerSize == 0 )
+            {
+                // Formats that cannot be written directly are converted by pylon, synchronously.
+                lock.unlock();
+                bool succeeded = false;
+                try
+                {
+                    CImagePersistence::Save( ImageFileFormat_Tiff, job.name.c_str(), ptrGrabResult);
+                    succeeded = true;
+                }
+                catch (GenICam::GenericException &e)
+                {
+                    std::cerr << "Writing " << job.name << " failed: " << e.GetDescription() << std::endl;
+                }
+                lock.lock();
+                ReportFrameWritten( job, succeeded);
+                return;
+            }
+            m_freeSlots.pop_back();
+            slot.job = job;
+            slot.submitTimeNs = GetMonotonicTimeNs();
+            slot.result = 0;
+            slot.closeRetried = false;
+            slot.pendingRequests = 0;
+            ++m_inFlight;
+            ++m_submitted;
+            queuedRequests += QueueFrame( slotIndex, pHeader, headerSize);
+        }
+
+        // Called when io_uring_enter fails: the requests in flight will never complete, so their
+        // frames are reported as failed and everybody waiting for a slot or Flush() is woken up.
+        // The kernel may still access the grab buffers of requests it has already consumed; with a
+        // broken ring there is no way to find out.
+        void FailRingLocked( int error)
+        {
+            if ( m_ringError == 0 )
+            {
+                m_ringError = error;
+            }
+            for ( size_t i = 0; i < m_slots.size(); ++i )
+            {
+                SSlot& slot = m_slots[i];
+                if ( slot.pendingRequests == 0 )
+                {
+                    continue;
+                }
+                slot.pendingRequests = 0;
+                CompleteSlotLocked( (unsigned int) i, error);
+            }
+            m_unsubmitted = 0;
+            m_slotFreed.notify_all();
+        }
+
+        // Reports a frame whose requests have all completed and frees its slot.
+        void CompleteSlotLocked( unsigned int slotIndex, int error)
+        {
+            SSlot& slot = m_slots[ slotIndex ];
+            if ( error != 0 )
+            {
+                std::cerr << "Writing " << slot.job.name << " failed: " << strerror( error) << std::endl;
+                ++m_failed;
+            }
+            else
+            {
+                ++m_completed;
+            }
+            m_completionLatency.Record( GetMonotonicTimeNs() - slot.submitTimeNs);
+            ReportFrameWritten( slot.job, error == 0);
+            slot.job.ptrGrabResult.Release();
+            m_freeSlots.push_back( slotIndex);
+            --m_inFlight;
+            m_slotFreed.notify_all();
+        }
+
+        enum ERequest
+        {
+            Request_Open,
+            Request_WriteHeader,
+            Request_WriteImage,
+            Request_Fsync,
+            Request_Close
+        };
+
+        struct SSlot
+        {
+            SFrameWriteJob job;
+            uint64_t submitTimeNs;
+            int result;             // First error of the chain, 0 on success.
+            bool closeRetried;
+            unsigned int pendingRequests;
+        };
+
+        struct SBufferRegistration
+        {
+            const uint8_t* pBuffer;
+            size_t size;
+        };
+
+        static int SysSetup( unsigned int entries, struct io_uring_params* pParams)
+        {
+            return (int) syscall( __NR_io_uring_setup, entries, pParams);
+        }
+
+        static int SysEnter( int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags)
+        {
+            return (int) syscall( __NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+        }
+
+        // Waits for at least one completion or until the timeout has expired (errno ETIME).
+        static int SysWaitForCompletion( int fd, uint64_t timeoutNs)
+        {
+            struct __kernel_timespec timeout;
+            timeout.tv_sec = (int64_t) (timeoutNs / 1000000000ULL);
+            timeout.tv_nsec = (long long) (timeoutNs % 1000000000ULL);
+            struct io_uring_getevents_arg arg;
+            memset( &arg, 0, sizeof( arg));
+            arg.ts = (uint64_t) (uintptr_t) &timeout;
+            return (int) syscall( __NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof( arg));
+        }
+
+        static int SysRegister( int fd, unsigned int opcode, const void* pArg, unsigned int count)
+        {
+            return (int) syscall( __NR_io_uring_register, fd, opcode, pArg, count);
+        }
+
+        void SetupRing( unsigned int entries)
+        {
+            struct io_uring_params params;
+            memset( &params, 0, sizeof( params));
+            m_ringFd = SysSetup( entries, &params);
+            if ( m_ringFd < 0 )
+            {
+                throw RUNTIME_EXCEPTION( "io_uring_setup failed: %s", strerror( errno));
+            }
+
+            m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned int);
+            m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe);
+            if ( params.features & IORING_FEAT_SINGLE_MMAP )
+            {
+                m_sqRingSize = m_cqRingSize = (m_sqRingSize > m_cqRingSize ? m_sqRingSize : m_cqRingSize);
+            }
+            m_pSqRing = (uint8_t*) mmap( NULL, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+            if ( m_pSqRing == MAP_FAILED )
+            {
+                m_pSqRing = NULL;
+                TeardownRing();
+                throw RUNTIME_EXCEPTION( "Mapping the io_uring submission ring failed: %s", strerror( errno));
+            }
+            if ( params.features & IORING_FEAT_SINGLE_MMAP )
+            {
+                m_pCqRing = m_pSqRing;
+            }
+            else
+            {
+                m_pCqRing = (uint8_t*) mmap( NULL, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+                if ( m_pCqRing == MAP_FAILED )
+                {
+                    m_pCqRing = NULL;
+                    TeardownRing();
+                    throw RUNTIME_EXCEPTION( "Mapping the io_uring completion ring failed: %s", strerror( errno));
+                }
+            }
+            m_sqesSize = params.sq_entries * sizeof( struct io_uring_sqe);
+            m_pSqes = (struct io_uring_sqe*) mmap( NULL, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+            if ( m_pSqes == MAP_FAILED )
+            {
+                m_pSqes = NULL;
+                TeardownRing();
+                throw RUNTIME_EXCEPTION( "Mapping the io_uring submission entries failed: %s", strerror( errno));
+            }
+
+            m_pSqHead = (unsigned int*) (m_pSqRing + params.sq_off.head);
+            m_pSqTail = (unsigned int*) (m_pSqRing + params.sq_off.tail);
+            m_sqMask = *(unsigned int*) (m_pSqRing + params.sq_off.ring_mask);
+            m_sqEntries = params.sq_entries;
+            m_pSqArray = (unsigned int*) (m_pSqRing + params.sq_off.array);
+            m_pCqHead = (unsigned int*) (m_pCqRing + params.cq_off.head);
+            m_pCqTail = (unsigned int*) (m_pCqRing + params.cq_off.tail);
+            m_cqMask = *(unsigned int*) (m_pCqRing + params.cq_off.ring_mask);
+            m_pCqes = (struct io_uring_cqe*) (m_pCqRing + params.cq_off.cqes);
+
+            // The kernel must support all request types used.
+            static const uint8_t requiredOps[] = { IORING_OP_OPENAT, IORING_OP_WRITE, IORING_OP_WRITE_FIXED, IORING_OP_FSYNC, IORING_OP_CLOSE };
+            std::vector<uint8_t> probeMemory( sizeof( struct io_uring_probe) + 256 * sizeof( struct io_uring_probe_op));
+            struct io_uring_probe* pProbe = (struct io_uring_probe*) &probeMemory[0];
+            if ( SysRegister( m_ringFd, IORING_REGISTER_PROBE, pProbe, 256) < 0 )
+            {
+                TeardownRing();
+                throw RUNTIME_EXCEPTION( "io_uring probing failed: %s", strerror( errno));
+            }
+            for ( size_t i = 0; i < sizeof( requiredOps); ++i )
+            {
+                if ( requiredOps[i] > pProbe->last_op || !(pProbe->ops[ requiredOps[i] ].flags & IO_URING_OP_SUPPORTED) )
+                {
+                    TeardownRing();
+                    throw RUNTIME_EXCEPTION( "The kernel does not support io_uring request type %d.", (int) requiredOps[i]);
+                }
+            }
+
+            // One fixed file slot per frame in flight.
+            struct io_uring_rsrc_register files;
+            memset( &files, 0, sizeof( files));
+            files.nr = (uint32_t) m_slots.size();
+            files.flags = IORING_RSRC_REGISTER_SPARSE;
+            if ( SysRegister( m_ringFd, IORING_REGISTER_FILES2, &files, sizeof( files)) < 0 )
+            {
+                TeardownRing();
+                throw RUNTIME_EXCEPTION( "Registering io_uring file slots failed: %s", strerror( errno));
+            }
+
+            // Buffer 0 holds the TIFF headers, the other buffers are registered on first use.
+            // Without registered buffers (e.g. memory lock limit), plain writes are used.
+            struct io_uring_rsrc_register buffers;
+            memset( &buffers, 0, sizeof( buffers));
+            buffers.nr = (uint32_t) m_bufferRegistrations.size();
+            buffers.flags = IORING_RSRC_REGISTER_SPARSE;
+            if ( SysRegister( m_ringFd, IORING_REGISTER_BUFFERS2, &buffers, sizeof( buffers)) == 0 )
+            {
+                m_useFixedBuffers = RegisterBuffer( 0, &m_headerArena[0], m_headerArena.size());
+            }
+        }
+
+        void TeardownRing()
+        {
+            if ( m_pSqes != NULL )
+            {
+                munmap( m_pSqes, m_sqesSize);
+            }
+            if ( m_pCqRing != NULL && m_pCqRing != m_pSqRing )
+            {
+                munmap( m_pCqRing, m_cqRingSize);
+            }
+            if ( m_pSqRing != NULL )
+            {
+                munmap( m_pSqRing, m_sqRingSize);
+            }
+            if ( m_ringFd >= 0 )
+            {
+                close( m_ringFd);
+            }
+            m_pSqes = NULL;
+            m_pCqRing = NULL;
+            m_pSqRing = NULL;
+            m_ringFd = -1;
+        }
+
+        bool RegisterBuffer( unsigned int index, const uint8_t* pBuffer, size_t size)
+        {
+            struct iovec buffer;
+            buffer.iov_base = (void*) pBuffer;
+            buffer.iov_len = size;
+            struct io_uring_rsrc_update2 update;
+            memset( &update, 0, sizeof( update));
+            update.offset = index;
+            update.data = (uint64_t) (uintptr_t) &buffer;
+            update.nr = 1;
+            if ( SysRegister( m_ringFd, IORING_REGISTER_BUFFERS_UPDATE, &update, sizeof( update)) < 0 )
+            {
+                return false;
+            }
+            m_bufferRegistrations[ index ].pBuffer = pBuffer;
+            m_bufferRegistrations[ index ].size = size;
+            return true;
+        }
+
+        // Returns the index of the registered buffer containing the range or -1.
+        // Grab buffers are reused by the camera, so only a few registrations are ever needed.
+        int FindOrRegisterBuffer( const uint8_t* pBuffer, size_t size)
+        {
+            for ( unsigned int i = 1; i < m_registeredBufferCount; ++i )
+            {
+                const SBufferRegistration& registration = m_bufferRegistrations[i];
+                if ( pBuffer >= registration.pBuffer && pBuffer + size <= registration.pBuffer + registration.size )
+                {
+                    return (int) i;
+                }
+            }
+            if ( m_registeredBufferCount < m_bufferRegistrations.size() && RegisterBuffer( m_registeredBufferCount, pBuffer, size) )
+            {
+                return (int) m_registeredBufferCount++;
+            }
+            return -1;
+        }
+
+        struct io_uring_sqe* GetSqe()
+        {
+            unsigned int tail = *m_pSqTail;
+            while ( tail - __atomic_load_n( m_pSqHead, __ATOMIC_ACQUIRE) >= m_sqEntries )
+            {
+                // The ring is full of requests the kernel has not consumed yet.
+                SubmitLocked( 0);
+            }
+            unsigned int index = tail & m_sqMask;
+            struct io_uring_sqe* pSqe = &m_pSqes[ index ];
+            memset( pSqe, 0, sizeof( *pSqe));
+            m_pSqArray[ index ] = index;
+            __atomic_store_n( m_pSqTail, tail + 1, __ATOMIC_RELEASE);
+            ++m_unsubmitted;
+            return pSqe;
+        }
+
+        unsigned int QueueFrame( unsigned int slotIndex, const uint8_t* pHeader, size_t headerSize)
+        {
+            SSlot& slot = m_slots[ slotIndex ];
+            const uint8_t* pImage = (const uint8_t*) slot.job.ptrGrabResult->GetBuffer();
+            const size_t imageSize = slot.job.ptrGrabResult->GetImageSize();
+            int imageBuffer = (m_useFixedBuffers && m_registerGrabBuffers) ? FindOrRegisterBuffer( pImage, imageSize) : -1;
+            if ( imageBuffer >= 0 )
+            {
+                ++m_grabBuffersRegistered;
+            }
+            const uint64_t userData = (uint64_t) slotIndex << 8;
+
+            struct io_uring_sqe* pSqe = GetSqe();
+            pSqe->opcode = IORING_OP_OPENAT;
+            pSqe->fd = AT_FDCWD;
+            pSqe->addr = (uint64_t) (uintptr_t) slot.job.name.c_str();
+            pSqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+            pSqe->len = 0644;
+            pSqe->file_index = slotIndex + 1;
+            pSqe->flags = IOSQE_IO_LINK;
+            pSqe->user_data = userData | Request_Open;
+
+            pSqe = GetSqe();
+            pSqe->opcode = m_useFixedBuffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            pSqe->fd = (int) slotIndex;
+            pSqe->addr = (uint64_t) (uintptr_t) pHeader;
+            pSqe->len = (uint32_t) headerSize;
+            pSqe->off = 0;
+            pSqe->buf_index = 0;
+            pSqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+            pSqe->user_data = userData | Request_WriteHeader;
+
+            pSqe = GetSqe();
+            pSqe->opcode = imageBuffer >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            pSqe->fd = (int) slotIndex;
+            pSqe->addr = (uint64_t) (uintptr_t) pImage;
+            pSqe->len = (uint32_t) imageSize;
+            pSqe->off = headerSize;
+            pSqe->buf_index = (uint16_t) (imageBuffer >= 0 ? imageBuffer : 0);
+            pSqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+            pSqe->user_data = userData | Request_WriteImage;
+            unsigned int count = 3;
+
+            if ( m_useFsync )
+            {
+                pSqe = GetSqe();
+                pSqe->opcode = IORING_OP_FSYNC;
+                pSqe->fd = (int) slotIndex;
+                pSqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+                pSqe->user_data = userData | Request_Fsync;
+                ++count;
+            }
+
+            QueueClose( slotIndex);
+            ++count;
+            slot.pendingRequests = count;
+            return count;
+        }
+
+        void QueueClose( unsigned int slotIndex)
+        {
+            struct io_uring_sqe* pSqe = GetSqe();
+            pSqe->opcode = IORING_OP_CLOSE;
+            pSqe->file_index = slotIndex + 1;
+            pSqe->user_data = ((uint64_t) slotIndex << 8) | Request_Close;
+        }
+
+        void SubmitLocked( unsigned int /* requestCount */)
+        {
+            while ( m_unsubmitted > 0 )
+            {
+                int result = SysEnter( m_ringFd, m_unsubmitted, 0, 0);
+                if ( result < 0 )
+                {
+                    if ( errno == EINTR || errno == EAGAIN || errno == EBUSY )
+                    {
+                        continue;
+                    }
+                    throw RUNTIME_EXCEPTION( "io_uring_enter failed: %s", strerror( errno));
+                }
+                m_unsubmitted -= (unsigned int) result;
+                ++m_submitCalls;
+            }
+        }
+
+        void CompletionLoop()
+        {
+            for (;;)
+            {
+                // The timeout lets the thread end even if the wake-up request cannot be submitted.
+                int result = SysWaitForCompletion( m_ringFd, 100000000);
+                if ( result < 0 && errno != EINTR && errno != ETIME )
+                {
+                    const int error = errno;
+                    std::cerr << "io_uring_enter failed: " << strerror( error) << std::endl;
+                    std::lock_guard<std::mutex> lock( m_mutex);
+                    FailRingLocked( error);
+                    return;
+                }
+
+                std::lock_guard<std::mutex> lock( m_mutex);
+                unsigned int head = *m_pCqHead;
+                unsigned int tail = __atomic_load_n( m_pCqTail, __ATOMIC_ACQUIRE);
+                for ( ; head != tail; ++head )
+                {
+                    const struct io_uring_cqe& cqe = m_pCqes[ head & m_cqMask ];
+                    if ( cqe.user_data == c_wakeUpUserData )
+                    {
+                        // Only wakes the thread up to see m_stopping.
+                        continue;
+                    }
+                    HandleCompletion( (unsigned int) (cqe.user_data >> 8), (ERequest) (cqe.user_data & 0xFF), cqe.res);
+                }
+                __atomic_store_n( m_pCqHead, head, __ATOMIC_RELEASE);
+                try
+                {
+                    // Close requests queued again by HandleCompletion().
+                    SubmitLocked( 0);
+                }
+                catch (GenICam::GenericException &e)
+                {
+                    std::cerr << e.GetDescription() << std::endl;
+                    FailRingLocked( EIO);
+                }
+                if ( m_stopping && (m_inFlight == 0 || m_ringError != 0) )
+                {
+                    return;
+                }
+            }
+        }
+
+        void HandleCompletion( unsigned int slotIndex, ERequest request, int result)
+        {
+            SSlot& slot = m_slots[ slotIndex ];
+            if ( slot.pendingRequests == 0 )
+            {
+                // The frame has already been failed by FailRingLocked().
+                return;
+            }
+            if ( result < 0 && result != -ECANCELED && slot.result == 0 )
+            {
+                slot.result = result;
+            }
+            if ( request == Request_WriteImage && result >= 0 && (size_t) result != slot.job.ptrGrabResult->GetImageSize() && slot.result == 0 )
+            {
+                slot.result = -EIO; // Short write.
+            }
+            if ( request == Request_Close && result == -ECANCELED && !slot.closeRetried )
+            {
+                // An earlier request of the chain failed; the file slot still has to be closed.
+                slot.closeRetried = true;
+                QueueClose( slotIndex);
+                ++slot.pendingRequests;
+            }
+            if ( --slot.pendingRequests > 0 )
+            {
+                return;
+            }
+            CompleteSlotLocked( slotIndex, -slot.result);
+        }
+
+        const bool m_useFsync;
+        const bool m_registerGrabBuffers;
+        int m_ringFd;
+        uint8_t* m_pSqRing;
+        uint8_t* m_pCqRing;
+        struct io_uring_sqe* m_pSqes;
+        size_t m_sqRingSize;
+        size_t m_cqRingSize;
+        size_t m_sqesSize;
+        unsigned int* m_pSqHead;
+        unsigned int* m_pSqTail;
+        unsigned int* m_pSqArray;
+        unsigned int m_sqMask;
+        unsigned int m_sqEntries;
+        unsigned int* m_pCqHead;
+        unsigned int* m_pCqTail;
+        unsigned int m_cqMask;
+        struct io_uring_cqe* m_pCqes;
+        unsigned int m_unsubmitted;
+
+        std::vector<SSlot> m_slots;
+        std::vector<unsigned int> m_freeSlots;
+        std::vector<uint8_t> m_headerArena;
+        std::vector<SBufferRegistration> m_bufferRegistrations;
+        unsigned int m_registeredBufferCount;
+        bool m_useFixedBuffers;
+        uint64_t m_grabBuffersRegistered;
+        bool m_stopping;
+        int m_ringError;            // errno of a failed io_uring_enter; no more frames are accepted.
+        std::thread m_completionThread;
+        mutable std::mutex m_mutex;
+        std::condition_variable m_slotFreed;
+
+        // Statistics, protected by m_mutex.
+        size_t m_inFlight;
+        uint64_t m_submitted;
+        uint64_t m_completed;
+        uint64_t m_failed;
+        uint64_t m_submitCalls;
+        CLatencyHistogram m_completionLatency;
+    };
+
+#endif /* PYLON_SAMPLES_HAVE_IO_URING */
+
+
+    enum ETiffSinkBackend
+    {
+        TiffSinkBackend_Posix,
+        TiffSinkBackend_Uring   // Falls back to TiffSinkBackend_Posix if io_uring cannot be used.
+    };
+
+
+    // Creates a TIFF sink for the requested backend. The caller owns the returned sink.
+    // See CUringTiffSink for when registerGrabBuffers is safe to use.
+    inline IFrameSink* CreateTiffFileSink( ETiffSinkBackend backend, bool useFsync = false, bool registerGrabBuffers = false)
+    {
+#if defined( PYLON_SAMPLES_HAVE_IO_URING )
+        if ( backend == TiffSinkBackend_Uring )
+        {
+            try
+            {
+                return new CUringTiffSink( useFsync, registerGrabBuffers);
+            }
+            catch (GenICam::GenericException &e)
+            {
+                std::cerr << "io_uring is not available, using POSIX I/O: " << e.GetDescription() << std::endl;
+            }
+        }
+#else
+        if ( backend == TiffSinkBackend_Uring )
+        {
+            std::cerr << "io_uring support has not been compiled in, using POSIX I/O." << std::endl;
+        }
+#endif
+        return new CPosixTiffSink( useFsync);
+    }
+}
+
+#endif /* INCLUDED_TIFFFILESINK_H_2468013 */